@@ -0,0 +1,144 @@
+#include <area_coalescer.hpp>
+
+#include <algorithm>
+
+namespace LVGLDisplay {
+
+  static uint32_t area_pixels(const lv_area_t& area) { return lv_area_get_width(&area) * lv_area_get_height(&area); }
+
+  static bool area_contains(const lv_area_t& outer, const lv_area_t& inner) {
+    return inner.x1 >= outer.x1 && inner.y1 >= outer.y1 && inner.x2 <= outer.x2 && inner.y2 <= outer.y2;
+  }
+
+  static lv_area_t area_union(const lv_area_t& a, const lv_area_t& b) {
+    return {std::min(a.x1, b.x1), std::min(a.y1, b.y1), std::max(a.x2, b.x2), std::max(a.y2, b.y2)};
+  }
+
+  uint32_t AreaCoalescer::transactions(const lv_area_t& area) const {
+    // LVGL renders areas taller than the draw buffer in stripes, each flushed separately.
+    if(_config.buffer_pixels == 0) {
+      return 1;
+    }
+    const uint32_t rows = std::max<uint32_t>(1, _config.buffer_pixels / lv_area_get_width(&area));
+    return (lv_area_get_height(&area) + rows - 1) / rows;
+  }
+
+  uint64_t AreaCoalescer::cost(const lv_area_t& area) const {
+    return static_cast<uint64_t>(transactions(area)) * _config.transaction_cost + area_pixels(area) * _config.bytes_per_pixel;
+  }
+
+  bool AreaCoalescer::trim(lv_area_t& area, const lv_area_t& other) {
+    // Only an overlap which spans a full edge can be cut away while leaving a single rectangle.
+    if(other.x1 <= area.x1 && other.x2 >= area.x2) {
+      if(other.y1 <= area.y1 && other.y2 >= area.y1 && other.y2 < area.y2) {
+        area.y1 = other.y2 + 1;
+        return true;
+      }
+      if(other.y2 >= area.y2 && other.y1 <= area.y2 && other.y1 > area.y1) {
+        area.y2 = other.y1 - 1;
+        return true;
+      }
+    }
+    if(other.y1 <= area.y1 && other.y2 >= area.y2) {
+      if(other.x1 <= area.x1 && other.x2 >= area.x1 && other.x2 < area.x2) {
+        area.x1 = other.x2 + 1;
+        return true;
+      }
+      if(other.x2 >= area.x2 && other.x1 <= area.x2 && other.x1 > area.x1) {
+        area.x2 = other.x1 - 1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void AreaCoalescer::coalesce(lv_disp_t* disp) {
+    lv_area_t areas[LV_INV_BUF_SIZE];
+    size_t count = 0;
+    for(uint16_t i = 0; i < disp->inv_p; i++) {
+      if(disp->inv_area_joined[i] == 0) {
+        areas[count++] = disp->inv_areas[i];
+      }
+    }
+
+    coalesce(areas, &count);
+
+    for(size_t i = 0; i < count; i++) {
+      disp->inv_areas[i] = areas[i];
+      disp->inv_area_joined[i] = 0;
+    }
+    disp->inv_p = count;
+  }
+
+  void AreaCoalescer::coalesce(lv_area_t* areas, size_t* count) {
+    size_t n = *count;
+    if(n == 0) {
+      return;
+    }
+    _stats.frames++;
+    _stats.areas_in += n;
+    for(size_t i = 0; i < n; i++) {
+      _stats.transactions_before += transactions(areas[i]);
+      _stats.bytes_before += area_pixels(areas[i]) * _config.bytes_per_pixel;
+    }
+
+    if(_config.enabled) {
+      bool changed = true;
+      while(changed) {
+        changed = false;
+
+        // Drop areas covered by another, and trim overlaps which span a full edge.
+        for(size_t i = 0; i < n; i++) {
+          for(size_t j = 0; j < n; j++) {
+            if(i == j) {
+              continue;
+            }
+            if(area_contains(areas[j], areas[i])) {
+              areas[i] = areas[--n];
+              _stats.dropped++;
+              changed = true;
+              i--;
+              break;
+            }
+            if(trim(areas[i], areas[j])) {
+              _stats.trimmed++;
+              changed = true;
+            }
+          }
+        }
+
+        // Merge the pair with the largest saving, if the bounding box is cheaper than flushing both.
+        size_t best_i = 0, best_j = 0;
+        uint64_t best_saving = 0;
+        for(size_t i = 0; i < n; i++) {
+          for(size_t j = i + 1; j < n; j++) {
+            const uint64_t separate = cost(areas[i]) + cost(areas[j]);
+            const uint64_t merged = cost(area_union(areas[i], areas[j]));
+            if(merged < separate && separate - merged > best_saving) {
+              best_saving = separate - merged;
+              best_i = i;
+              best_j = j;
+            }
+          }
+        }
+        if(best_saving) {
+          areas[best_i] = area_union(areas[best_i], areas[best_j]);
+          areas[best_j] = areas[--n];
+          _stats.merged++;
+          changed = true;
+        }
+      }
+
+      // Flush in panel scan order, top to bottom.
+      std::sort(areas, areas + n, [](const lv_area_t& a, const lv_area_t& b) { return a.y1 != b.y1 ? a.y1 < b.y1 : a.x1 < b.x1; });
+    }
+
+    *count = n;
+    _stats.areas_out += n;
+    for(size_t i = 0; i < n; i++) {
+      _stats.transactions_after += transactions(areas[i]);
+      _stats.bytes_after += area_pixels(areas[i]) * _config.bytes_per_pixel;
+    }
+  }
+
+}  // namespace LVGLDisplay
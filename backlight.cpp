@@ -0,0 +1,216 @@
+#include <backlight.hpp>
+#include <math.h>
+
+#if !CONFIG_IDF_TARGET_LINUX
+  #include "driver/ledc.h"
+#endif
+
+namespace LVGLDisplay {
+
+#if !CONFIG_IDF_TARGET_LINUX
+  static constexpr ledc_mode_t BACKLIGHT_MODE = LEDC_LOW_SPEED_MODE;
+#endif
+
+  Backlight::~Backlight() {
+#if !CONFIG_IDF_TARGET_LINUX && !SOC_LEDC_SUPPORT_FADE_STOP
+    if(_deferred) {
+      esp_timer_stop(_deferred);
+      esp_timer_delete(_deferred);
+    }
+#endif
+    if(_mutex) {
+      vSemaphoreDelete(_mutex);
+    }
+  }
+
+  esp_err_t Backlight::start(const Config& config) {
+    if(config.gpio < 0 || config.frequency_hz == 0 || config.resolution_bits == 0 || config.resolution_bits > 14 ||
+       config.gamma <= 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    _config = config;
+
+#if !CONFIG_IDF_TARGET_LINUX
+    ledc_timer_config_t timer_config = {};
+    timer_config.speed_mode = BACKLIGHT_MODE;
+    timer_config.duty_resolution = (ledc_timer_bit_t)config.resolution_bits;
+    timer_config.timer_num = (ledc_timer_t)config.timer;
+    timer_config.freq_hz = config.frequency_hz;
+    timer_config.clk_cfg = LEDC_AUTO_CLK;
+    esp_err_t err = ledc_timer_config(&timer_config);
+    if(err != ESP_OK) {
+      return err;
+    }
+    ledc_channel_config_t channel_config = {};
+    channel_config.gpio_num = config.gpio;
+    channel_config.speed_mode = BACKLIGHT_MODE;
+    channel_config.channel = (ledc_channel_t)config.channel;
+    channel_config.timer_sel = (ledc_timer_t)config.timer;
+    channel_config.duty = 0;
+    channel_config.flags.output_invert = config.invert;
+    err = ledc_channel_config(&channel_config);
+    if(err != ESP_OK) {
+      return err;
+    }
+    // The fade service may already be installed by the application.
+    err = ledc_fade_func_install(0);
+    if(err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+      return err;
+    }
+  #if !SOC_LEDC_SUPPORT_FADE_STOP
+    if(!_deferred) {
+      esp_timer_create_args_t timer_args = {};
+      timer_args.callback = deferred_callback;
+      timer_args.arg = this;
+      timer_args.name = "backlight";
+      err = esp_timer_create(&timer_args, &_deferred);
+      if(err != ESP_OK) {
+        return err;
+      }
+    }
+  #endif
+#endif
+
+    _mutex = xSemaphoreCreateMutex();
+    return _mutex ? ESP_OK : ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t Backlight::set(uint8_t level, uint32_t fade_ms) {
+    if(!_mutex) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _level = level;
+    const esp_err_t err = show(shown(_state), fade_ms);
+    xSemaphoreGive(_mutex);
+    return err;
+  }
+
+  void Backlight::policy(const Policy& policy) {
+    if(!_mutex) {
+      _policy = policy;
+      return;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _policy = policy;
+    // Without a policy nothing would restore the backlight.
+    if(!policy.enabled() && _state != State::ACTIVE) {
+      _state = State::ACTIVE;
+      show(shown(_state), policy.wake_ms);
+    }
+    xSemaphoreGive(_mutex);
+  }
+
+  esp_err_t Backlight::idle(uint32_t inactive_ms) {
+    if(!_mutex) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    State state = State::ACTIVE;
+    if(_policy.off_after_ms && inactive_ms >= _policy.off_after_ms) {
+      state = State::OFF;
+    }
+    else if(_policy.dim_after_ms && inactive_ms >= _policy.dim_after_ms) {
+      state = State::DIMMED;
+    }
+    esp_err_t err = ESP_OK;
+    if(state != _state) {
+      _state = state;
+      err = show(shown(state), state == State::ACTIVE ? _policy.wake_ms : _policy.fade_ms);
+    }
+    xSemaphoreGive(_mutex);
+    return err;
+  }
+
+  uint32_t Backlight::duty(uint8_t level) const {
+    if(!level) {
+      return 0;
+    }
+    const uint32_t duty = lroundf(powf(level / (float)MAX_LEVEL, _config.gamma) * max_duty());
+    // The lowest levels round to nothing, keep them lit.
+    return duty ? duty : 1;
+  }
+
+  uint32_t Backlight::duty() const {
+#if CONFIG_IDF_TARGET_LINUX
+    const uint32_t to = duty(_target);
+    const int64_t now = esp_timer_get_time();
+    if(now >= _fade_end_us) {
+      return to;
+    }
+    return _from_duty + ((int64_t)to - _from_duty) * (now - _fade_start_us) / (_fade_end_us - _fade_start_us);
+#else
+    return _mutex ? ledc_get_duty(BACKLIGHT_MODE, (ledc_channel_t)_config.channel) : 0;
+#endif
+  }
+
+  uint8_t Backlight::shown(State state) const {
+    const uint8_t level = _level;
+    switch(state) {
+      case State::ACTIVE: return level;
+      case State::DIMMED: return level < _policy.dim_level ? level : _policy.dim_level;
+      case State::OFF: return 0;
+    }
+    return level;
+  }
+
+  esp_err_t Backlight::show(uint8_t level, uint32_t fade_ms) {
+    if(level == _target) {
+      return ESP_OK;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    _from_duty = duty();
+#endif
+    _target = level;
+    return fade(fade_ms);
+  }
+
+  esp_err_t Backlight::fade(uint32_t fade_ms) {
+    const int64_t now = esp_timer_get_time();
+#if !CONFIG_IDF_TARGET_LINUX
+    const ledc_channel_t channel = (ledc_channel_t)_config.channel;
+  #if SOC_LEDC_SUPPORT_FADE_STOP
+    if(now < _fade_end_us) {
+      ledc_fade_stop(BACKLIGHT_MODE, channel);
+    }
+  #else
+    // The channel is held until the fade ends, show the target then rather than wait for it here.
+    if(now < _fade_end_us) {
+      _deferred_fade_ms = fade_ms;
+      esp_timer_stop(_deferred);
+      return esp_timer_start_once(_deferred, _fade_end_us - now);
+    }
+  #endif
+    const uint32_t duty = this->duty(_target);
+    esp_err_t err;
+    if(fade_ms) {
+      err = ledc_set_fade_with_time(BACKLIGHT_MODE, channel, duty, fade_ms);
+      if(err == ESP_OK) {
+        err = ledc_fade_start(BACKLIGHT_MODE, channel, LEDC_FADE_NO_WAIT);
+      }
+    }
+    else {
+      err = ledc_set_duty_and_update(BACKLIGHT_MODE, channel, duty, 0);
+    }
+    if(err != ESP_OK) {
+      return err;
+    }
+#endif
+    _fade_start_us = now;
+    _fade_end_us = now + fade_ms * 1000;
+    return ESP_OK;
+  }
+
+#if !CONFIG_IDF_TARGET_LINUX && !SOC_LEDC_SUPPORT_FADE_STOP
+  void Backlight::deferred_callback(void* arg) {
+    Backlight* backlight = (Backlight*)arg;
+    xSemaphoreTake(backlight->_mutex, portMAX_DELAY);
+    backlight->fade(backlight->_deferred_fade_ms);
+    xSemaphoreGive(backlight->_mutex);
+  }
+#endif
+
+}  // namespace LVGLDisplay
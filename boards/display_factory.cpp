@@ -1,17 +1,8 @@
 #include "display_factory.hpp"
 
-#include "t-display-s3.hpp"
-#include "ttgo-tdisplay.hpp"
-
 namespace LVGLDisplay {
-  Display& DisplayFactory::active_display() {
-#ifdef CONFIG_LVGL_DISPLAY_TDISPLAY_S3
-    static TDisplayS3 display;
-#elif CONFIG_LVGL_DISPLAY_TTGO_TDISPLAY
-    static TTGOTDisplay display;
-#else
-  #error No active display defined.
-#endif
+  ActiveDisplay& DisplayFactory::active_display() {
+    static ActiveDisplay display;
     return display;
   }
 };  // namespace LVGLDisplay
\ No newline at end of file
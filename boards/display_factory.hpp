@@ -7,8 +7,31 @@
 
 #include <display.hpp>
 
+#ifdef CONFIG_LVGL_DISPLAY_TDISPLAY_S3
+  #include "t-display-s3.hpp"
+#elif CONFIG_LVGL_DISPLAY_TTGO_TDISPLAY
+  #include "ttgo-tdisplay.hpp"
+#elif CONFIG_LVGL_DISPLAY_VIRTUAL
+  #include "virtual-display.hpp"
+#else
+  #error No active display defined.
+#endif
+
 namespace LVGLDisplay {
 
+#ifdef CONFIG_LVGL_DISPLAY_TDISPLAY_S3
+  using ActiveDisplay = TDisplayS3;
+#elif CONFIG_LVGL_DISPLAY_TTGO_TDISPLAY
+  using ActiveDisplay = TTGOTDisplay;
+#elif CONFIG_LVGL_DISPLAY_VIRTUAL
+  using ActiveDisplay = VirtualDisplay;
+#endif
+
+  /**
+   * @brief The compile time traits of the active display.
+   */
+  using ActiveTraits = ActiveDisplay::traits;
+
   class DisplayFactory {
    public:
     /**
@@ -17,7 +40,7 @@ namespace LVGLDisplay {
      * The display is automatically added to the controller during initialisation.
      * @return A reference to the active display.
      */
-    static Display& active_display();
+    static ActiveDisplay& active_display();
   };
 
 }  // namespace LVGLDisplay
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "driver/gpio.h"
 #include "esp_err.h"
+#include "esp_lcd_panel_commands.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_lcd_panel_vendor.h"
@@ -12,8 +13,7 @@
 
 static const char* TAG = "t-display-s3";
 
-#define LCD_H_RES 320
-#define LCD_V_RES 170
+using Traits = LVGLDisplay::TDisplayS3Traits;
 
 #define LCD_BK_LIGHT_ON_LEVEL  1
 #define LCD_BK_LIGHT_OFF_LEVEL !LCD_BK_LIGHT_ON_LEVEL
@@ -35,46 +35,51 @@ static const char* TAG = "t-display-s3";
 #define PIN_NUM_RST          GPIO_NUM_5
 #define LCD_CMD_BITS         8
 #define LCD_PARAM_BITS       8
-#define LCD_I80_BUS_WIDTH    8
 #define PSRAM_DATA_ALIGNMENT 64
 
-#define LCD_PIXEL_CLOCK_HZ  (CONFIG_LVGL_DISPLAY_PIXEL_CLOCK * 1000 * 1000)
-#define LCD_BUFF_LINE_COUNT CONFIG_LVGL_DISPLAY_DRAW_BUFF_LEN
-#define LCD_TQUEUE_LENGTH   CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH
-
-#ifdef CONFIG_LVGL_DISPLAY_MIRROR_X
-  #define LCD_MIRROR_X true
-#else
-  #define LCD_MIRROR_X false
+// Tearing effect output, for frame pacing
+#if defined(CONFIG_LVGL_DISPLAY_TE_GPIO) && CONFIG_LVGL_DISPLAY_TE_GPIO >= 0
+  #define PIN_NUM_TE CONFIG_LVGL_DISPLAY_TE_GPIO
 #endif
 
-#ifdef CONFIG_LVGL_DISPLAY_MIRROR_Y
-  #define LCD_MIRROR_Y true
-#else
-  #define LCD_MIRROR_Y false
+// CST816 touch controller of the touch variant
+#ifdef CONFIG_LVGL_DISPLAY_TOUCH
+  #define PIN_NUM_TOUCH_INT CONFIG_LVGL_DISPLAY_TOUCH_INT_GPIO
+  #define PIN_NUM_TOUCH_RST CONFIG_LVGL_DISPLAY_TOUCH_RST_GPIO
+  #define PIN_NUM_TOUCH_SDA CONFIG_LVGL_DISPLAY_TOUCH_SDA_GPIO
+  #define PIN_NUM_TOUCH_SCL CONFIG_LVGL_DISPLAY_TOUCH_SCL_GPIO
 #endif
 
 static bool example_notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t* edata, void* user_ctx) {
-  lv_disp_t** disp = (lv_disp_t**)user_ctx;
-  lvgl_port_flush_ready(*disp);
-  return false;
+  LVGLDisplay::Display* display = (LVGLDisplay::Display*)user_ctx;
+  return display->flush_ready();
 }
 
 namespace LVGLDisplay {
 
   TDisplayS3::TDisplayS3() {
     ESP_LOGI(TAG, "Initialize backlight");
-    gpio_config_t bk_gpio_config = {.pin_bit_mask = 1ULL << PIN_NUM_BK_LIGHT,
-                                    .mode = GPIO_MODE_OUTPUT,
-                                    .pull_up_en = GPIO_PULLUP_DISABLE,
-                                    .pull_down_en = GPIO_PULLDOWN_DISABLE,
-                                    .intr_type = GPIO_INTR_DISABLE};
-    _err = gpio_config(&bk_gpio_config);
-    if(_err != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to initialise backlight GPIO.");
-      return;
+    if(Traits::pwm_backlight) {
+      // Starts off, the LEDC drives the pin from here.
+      _err = _backlight.start(backlight_config(PIN_NUM_BK_LIGHT));
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialise backlight PWM.");
+        return;
+      }
+    }
+    else {
+      gpio_config_t bk_gpio_config = {.pin_bit_mask = 1ULL << PIN_NUM_BK_LIGHT,
+                                      .mode = GPIO_MODE_OUTPUT,
+                                      .pull_up_en = GPIO_PULLUP_DISABLE,
+                                      .pull_down_en = GPIO_PULLDOWN_DISABLE,
+                                      .intr_type = GPIO_INTR_DISABLE};
+      _err = gpio_config(&bk_gpio_config);
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialise backlight GPIO.");
+        return;
+      }
+      gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_OFF_LEVEL);
     }
-    gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_OFF_LEVEL);
 
     ESP_LOGI(TAG, "Initialize read strobe");
     gpio_config_t rd_gpio_config = {.pin_bit_mask = 1ULL << PIN_NUM_RD,
@@ -106,8 +111,8 @@ namespace LVGLDisplay {
           PIN_NUM_DATA6,
           PIN_NUM_DATA7,
         },
-      .bus_width = LCD_I80_BUS_WIDTH,
-      .max_transfer_bytes = LCD_H_RES * LCD_BUFF_LINE_COUNT * sizeof(uint16_t),
+      .bus_width = Traits::bus_width,
+      .max_transfer_bytes = LVGLDisplay::TDisplayS3::BUFFER_BYTES,
       .psram_trans_align = PSRAM_DATA_ALIGNMENT,
       .sram_trans_align = 4,
     };
@@ -119,10 +124,10 @@ namespace LVGLDisplay {
 
     esp_lcd_panel_io_i80_config_t io_config = {
       .cs_gpio_num = PIN_NUM_CS,
-      .pclk_hz = LCD_PIXEL_CLOCK_HZ,
-      .trans_queue_depth = LCD_TQUEUE_LENGTH,
+      .pclk_hz = Traits::clock_hz,
+      .trans_queue_depth = Traits::queue_depth,
       .on_color_trans_done = example_notify_lvgl_flush_ready,
-      .user_ctx = &_display,
+      .user_ctx = this,
       .lcd_cmd_bits = LCD_CMD_BITS,
       .lcd_param_bits = LCD_PARAM_BITS,
       .dc_levels =
@@ -136,7 +141,7 @@ namespace LVGLDisplay {
         {
           .cs_active_high = false,
           .reverse_color_bits = false,
-          .swap_color_bytes = !LV_COLOR_16_SWAP,  // Swap can be done in LvGL (default) or DMA
+          .swap_color_bytes = Traits::bus_swap,  // Swap can be done in LvGL, the flush path or DMA (default)
           .pclk_active_neg = false,
           .pclk_idle_low = false,
         },
@@ -163,44 +168,95 @@ namespace LVGLDisplay {
       return;
     }
 
-    esp_lcd_panel_reset(_panel_handle);
-    esp_lcd_panel_init(_panel_handle);
-    esp_lcd_panel_invert_color(_panel_handle, true);
-    esp_lcd_panel_set_gap(_panel_handle, 0, 35);
-    esp_lcd_panel_swap_xy(_panel_handle, true);
-    esp_lcd_panel_mirror(_panel_handle, LCD_MIRROR_X, LCD_MIRROR_Y);
-
-    // user can flush pre-defined pattern to the screen before we turn on the screen or backlight
-    _err = esp_lcd_panel_disp_on_off(_panel_handle, true);
+    // Reset and initialisation delays overlap with LVGL's start when the bring-up is asynchronous.
+    ESP_LOGI(TAG, "Bring up st7789");
+    _err = start_bring_up(bring_up_config());
     if(_err != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to turn display on.");
+      ESP_LOGE(TAG, "Failed to bring up st7789 display.");
       return;
     }
+
+    if(Traits::shadow_tile_rows) {
+      ESP_LOGI(TAG, "Allocate shadow frame in PSRAM");
+      ShadowFrame::Config shadow_config;
+      shadow_config.hres = Traits::hres;
+      shadow_config.vres = Traits::vres;
+      shadow_config.tile_rows = Traits::shadow_tile_rows;
+      shadow_config.alignment = PSRAM_DATA_ALIGNMENT;
+      shadow_config.caps = MALLOC_CAP_SPIRAM;
+      _err = _shadow.allocate(shadow_config);
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate shadow frame.");
+        return;
+      }
+    }
   }
 
   TDisplayS3::~TDisplayS3() {}
 
+  esp_err_t TDisplayS3::init_panel() {
+    esp_lcd_panel_reset(_panel_handle);
+    esp_lcd_panel_init(_panel_handle);
+    esp_lcd_panel_invert_color(_panel_handle, true);
+    esp_lcd_panel_set_gap(_panel_handle, Traits::x_gap, Traits::y_gap);
+    esp_lcd_panel_swap_xy(_panel_handle, Traits::swap_xy);
+    esp_lcd_panel_mirror(_panel_handle, Traits::mirror_x, Traits::mirror_y);
+
+#ifdef PIN_NUM_TE
+    // Pulse TE at the start of each vertical blanking period only.
+    const uint8_t te_mode = 0;
+    esp_err_t err = esp_lcd_panel_io_tx_param(_io_handle, LCD_CMD_TEON, &te_mode, 1);
+    if(err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to enable tearing effect output.");
+      return err;
+    }
+#endif
+    return ESP_OK;
+  }
+
   esp_err_t TDisplayS3::backlight(const bool enable) const {
-    ESP_LOGI(TAG, "LCD backlight %s", enable ? "on" : "off");
+    ESP_LOGD(TAG, "LCD backlight %s", enable ? "on" : "off");
+    if(Traits::pwm_backlight) {
+      // The LEDC drives the pin, so switch it fully on or off through the LEDC, as the controller does.
+      return _backlight.set(enable ? Backlight::MAX_LEVEL : 0, 0);
+    }
     gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_ON_LEVEL && enable);
     return ESP_OK;
   }
 
-  esp_err_t TDisplayS3::error() const { return _err; }
+  esp_err_t TDisplayS3::error() const { return _err != ESP_OK ? _err : bring_up().error(); }
+
+  VsyncSource* TDisplayS3::vsync_source() {
+#ifdef PIN_NUM_TE
+    static GpioVsync te(PIN_NUM_TE);
+    return &te;
+#else
+    return NULL;
+#endif
+  }
+
+  TouchSource* TDisplayS3::touch_source() {
+#ifdef PIN_NUM_TOUCH_INT
+    // The controller reports in the panel's memory orientation, portrait, turned like the panel into LVGL's.
+    Cst816Touch::Config config;
+    config.sda = PIN_NUM_TOUCH_SDA;
+    config.scl = PIN_NUM_TOUCH_SCL;
+    config.interrupt = PIN_NUM_TOUCH_INT;
+    config.reset = PIN_NUM_TOUCH_RST;
+    config.columns = Traits::swap_xy ? Traits::vres : Traits::hres;
+    config.rows = Traits::swap_xy ? Traits::hres : Traits::vres;
+    config.swap_xy = Traits::swap_xy;
+    config.mirror_x = Traits::swap_xy ? Traits::mirror_y : Traits::mirror_x;
+    config.mirror_y = Traits::swap_xy ? Traits::mirror_x : Traits::mirror_y;
+    static Cst816Touch touch(config);
+    return &touch;
+#else
+    return NULL;
+#endif
+  }
 
   TDisplayS3& TDisplayS3::instance() {
     static TDisplayS3 _instance;
     return _instance;
   }
-
-  size_t TDisplayS3::buffer_size() const { return LCD_H_RES * LCD_BUFF_LINE_COUNT; }
-  bool TDisplayS3::double_buffer() const { return true; }
-  size_t TDisplayS3::hres() const { return LCD_H_RES; }
-  size_t TDisplayS3::vres() const { return LCD_V_RES; }
-  bool TDisplayS3::monochrome() const { return false; }
-  bool TDisplayS3::swap_xy() const { return true; }
-  bool TDisplayS3::mirror_x() const { return LCD_MIRROR_X; }
-  bool TDisplayS3::mirror_y() const { return LCD_MIRROR_Y; }
-  bool TDisplayS3::dma() const { return true; }
-  bool TDisplayS3::spi_ram() const { return false; }
 }  // namespace LVGLDisplay
\ No newline at end of file
@@ -1,25 +1,33 @@
 #pragma once
 
-#include <display.hpp>
+#include <board_traits.hpp>
+#include <touch_input.hpp>
 
 namespace LVGLDisplay {
-  class TDisplayS3 : public Display {
+  struct TDisplayS3Traits : BoardTraits {
+    static constexpr size_t hres = 320;
+    static constexpr size_t vres = 170;
+    static constexpr BusModel::Bus bus = BusModel::Bus::I80;
+    static constexpr uint8_t bus_width = 8;
+    static constexpr uint32_t clock_hz = CONFIG_LVGL_DISPLAY_PIXEL_CLOCK * 1000 * 1000;
+    static constexpr bool dma = true;
+    static constexpr bool spi_ram = false;
+    static constexpr int y_gap = 35;
+    static constexpr bool bus_swap = !LV_COLOR_16_SWAP && !software_swap;
+  };
+
+  class TDisplayS3 : public Board<TDisplayS3Traits> {
    public:
     TDisplayS3();
     ~TDisplayS3();
     static TDisplayS3& instance();
-    size_t buffer_size() const override;
-    bool double_buffer() const override;
-    size_t hres() const override;
-    size_t vres() const override;
-    bool monochrome() const override;
-    bool swap_xy() const override;
-    bool mirror_x() const override;
-    bool mirror_y() const override;
-    bool dma() const override;
-    bool spi_ram() const override;
     esp_err_t backlight(const bool enable) const override;
     esp_err_t error() const override;
+    VsyncSource* vsync_source() override;
+    TouchSource* touch_source() override;
+
+   protected:
+    esp_err_t init_panel() override;
 
    private:
     esp_err_t _err;
@@ -1,7 +1,10 @@
 #include "ttgo-tdisplay.hpp"
 
+#include <algorithm>
+
 #include "driver/gpio.h"
 #include "esp_err.h"
+#include "esp_lcd_panel_commands.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_lcd_panel_vendor.h"
@@ -13,8 +16,7 @@
 
 static const char* TAG = "ttgo-tdisplay";
 
-#define LCD_H_RES 240
-#define LCD_V_RES 135
+using Traits = LVGLDisplay::TTGOTDisplayTraits;
 
 #define LCD_BK_LIGHT_ON_LEVEL  1
 #define LCD_BK_LIGHT_OFF_LEVEL !LCD_BK_LIGHT_ON_LEVEL
@@ -26,52 +28,59 @@ static const char* TAG = "ttgo-tdisplay";
 #define PIN_NUM_SCLK        GPIO_NUM_18
 #define PIN_NUM_CS           GPIO_NUM_5
 #define PIN_NUM_DC           GPIO_NUM_16
-#define LCD_SPI_CLOCK_HZ  (CONFIG_LVGL_DISPLAY_SPI_CLOCK * 1000 * 1000)
 
 #define LCD_CMD_BITS         8
 #define LCD_PARAM_BITS       8
 
-#define LCD_BUFF_LINE_COUNT CONFIG_LVGL_DISPLAY_DRAW_BUFF_LEN
-#define LCD_TQUEUE_LENGTH   CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH
-
-#ifdef CONFIG_LVGL_DISPLAY_MIRROR_X
-  #define LCD_MIRROR_X true
+// Data input and largest transaction of the other devices on a shared bus
+#ifdef CONFIG_LVGL_DISPLAY_SPI_SHARED
+  #define PIN_NUM_MISO         CONFIG_LVGL_DISPLAY_SPI_MISO_GPIO
+  #define LCD_SPI_MAX_TRANSFER CONFIG_LVGL_DISPLAY_SPI_MAX_TRANSFER
 #else
-  #define LCD_MIRROR_X false
+  #define PIN_NUM_MISO         -1
+  #define LCD_SPI_MAX_TRANSFER 0
 #endif
 
-#ifdef CONFIG_LVGL_DISPLAY_MIRROR_Y
-  #define LCD_MIRROR_Y true
-#else
-  #define LCD_MIRROR_Y false
+// Tearing effect output, for frame pacing
+#if defined(CONFIG_LVGL_DISPLAY_TE_GPIO) && CONFIG_LVGL_DISPLAY_TE_GPIO >= 0
+  #define PIN_NUM_TE CONFIG_LVGL_DISPLAY_TE_GPIO
 #endif
 
 static bool notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t* edata, void* user_ctx) {
-  lv_disp_t** disp = (lv_disp_t**)user_ctx;
-  lvgl_port_flush_ready(*disp);
-  return false;
+  LVGLDisplay::Display* display = (LVGLDisplay::Display*)user_ctx;
+  return display->flush_ready();
 }
 
 namespace LVGLDisplay {
 
   TTGOTDisplay::TTGOTDisplay() {
     ESP_LOGI(TAG, "Initialize backlight");
-    gpio_config_t bk_gpio_config = {.pin_bit_mask = 1ULL << PIN_NUM_BK_LIGHT,
-                                    .mode = GPIO_MODE_OUTPUT,
-                                    .pull_up_en = GPIO_PULLUP_DISABLE,
-                                    .pull_down_en = GPIO_PULLDOWN_DISABLE,
-                                    .intr_type = GPIO_INTR_DISABLE};
-    _err = gpio_config(&bk_gpio_config);
-    if(_err != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to initialise backlight GPIO.");
-      return;
+    if(Traits::pwm_backlight) {
+      // Starts off, the LEDC drives the pin from here.
+      _err = _backlight.start(backlight_config(PIN_NUM_BK_LIGHT));
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialise backlight PWM.");
+        return;
+      }
+    }
+    else {
+      gpio_config_t bk_gpio_config = {.pin_bit_mask = 1ULL << PIN_NUM_BK_LIGHT,
+                                      .mode = GPIO_MODE_OUTPUT,
+                                      .pull_up_en = GPIO_PULLUP_DISABLE,
+                                      .pull_down_en = GPIO_PULLDOWN_DISABLE,
+                                      .intr_type = GPIO_INTR_DISABLE};
+      _err = gpio_config(&bk_gpio_config);
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialise backlight GPIO.");
+        return;
+      }
+      gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_OFF_LEVEL);
     }
-    gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_OFF_LEVEL);
 
     ESP_LOGI(TAG, "Initialize SPI bus");
     spi_bus_config_t buscfg = {
         .mosi_io_num = PIN_NUM_MOSI,
-        .miso_io_num = -1,
+        .miso_io_num = PIN_NUM_MISO,
         .sclk_io_num = PIN_NUM_SCLK,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
@@ -79,11 +88,20 @@ namespace LVGLDisplay {
         .data5_io_num = -1,
         .data6_io_num = -1,
         .data7_io_num = -1,
-        .max_transfer_sz = LCD_H_RES * LCD_BUFF_LINE_COUNT * sizeof(uint16_t),
+        .max_transfer_sz = std::max<int>(LVGLDisplay::TTGOTDisplay::BUFFER_BYTES, LCD_SPI_MAX_TRANSFER),
         .flags = 0,
         .intr_flags = 0,
     };
-    ESP_ERROR_CHECK(spi_bus_initialize(LCD_SPI_BUS, &buscfg, SPI_DMA_CH_AUTO));
+    _err = spi_bus_initialize(LCD_SPI_BUS, &buscfg, SPI_DMA_CH_AUTO);
+    if(_err == ESP_ERR_INVALID_STATE && Traits::shared_bus) {
+      // Initialised by the application for its own devices, its max_transfer_sz must cover a colour chunk.
+      ESP_LOGI(TAG, "SPI bus already initialised, sharing it");
+      _err = ESP_OK;
+    }
+    if(_err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to initialise SPI bus.");
+      return;
+    }
 
     ESP_LOGI(TAG, "Install panel IO");
 
@@ -91,10 +109,10 @@ namespace LVGLDisplay {
         .cs_gpio_num = PIN_NUM_CS,
         .dc_gpio_num = PIN_NUM_DC,
         .spi_mode = 0,
-        .pclk_hz = LCD_SPI_CLOCK_HZ,
-        .trans_queue_depth = LCD_TQUEUE_LENGTH,
+        .pclk_hz = Traits::clock_hz,
+        .trans_queue_depth = Traits::queue_depth,
         .on_color_trans_done = notify_lvgl_flush_ready,
-        .user_ctx = &_display,
+        .user_ctx = this,
         .lcd_cmd_bits = LCD_CMD_BITS,
         .lcd_param_bits = LCD_PARAM_BITS,
         .flags = {
@@ -106,7 +124,21 @@ namespace LVGLDisplay {
         },
     };
     // Attach the LCD to the SPI bus
-    ESP_ERROR_CHECK(esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)LCD_SPI_BUS, &io_config, &_io_handle));
+    _err = esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)LCD_SPI_BUS, &io_config, &_io_handle);
+    if(_err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to attach the panel to the SPI bus.");
+      return;
+    }
+
+    if(Traits::shared_bus) {
+      // Colour transfers are chunked from the splash on, so other devices can use the bus during the bring-up.
+      ESP_LOGI(TAG, "Share SPI bus");
+      _err = _arbiter.start(arbiter_config(), this);
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start SPI bus arbiter.");
+        return;
+      }
+    }
 
     esp_lcd_panel_dev_config_t panel_config = {
         .reset_gpio_num = -1,
@@ -118,45 +150,65 @@ namespace LVGLDisplay {
         .vendor_config = NULL
     };
     _err = esp_lcd_new_panel_st7789(_io_handle, &panel_config, &_panel_handle);
+    if(_err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to initialise st7889 display driver.");
+      return;
+    }
 
-    esp_lcd_panel_reset(_panel_handle);
-    esp_lcd_panel_init(_panel_handle);
-    esp_lcd_panel_invert_color(_panel_handle, true);
-    esp_lcd_panel_set_gap(_panel_handle, 40, 53);
-    esp_lcd_panel_swap_xy(_panel_handle, true);
-    esp_lcd_panel_mirror(_panel_handle, LCD_MIRROR_X, LCD_MIRROR_Y);
-
-    // user can flush pre-defined pattern to the screen before we turn on the screen or backlight
-    _err = esp_lcd_panel_disp_on_off(_panel_handle, true);
+    // Reset and initialisation delays overlap with LVGL's start when the bring-up is asynchronous.
+    ESP_LOGI(TAG, "Bring up st7789");
+    _err = start_bring_up(bring_up_config());
     if(_err != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to turn display on.");
+      ESP_LOGE(TAG, "Failed to bring up st7789 display.");
       return;
     }
   }
 
   TTGOTDisplay::~TTGOTDisplay() {}
 
+  esp_err_t TTGOTDisplay::init_panel() {
+    esp_lcd_panel_reset(_panel_handle);
+    esp_lcd_panel_init(_panel_handle);
+    esp_lcd_panel_invert_color(_panel_handle, true);
+    esp_lcd_panel_set_gap(_panel_handle, Traits::x_gap, Traits::y_gap);
+    esp_lcd_panel_swap_xy(_panel_handle, Traits::swap_xy);
+    esp_lcd_panel_mirror(_panel_handle, Traits::mirror_x, Traits::mirror_y);
+
+#ifdef PIN_NUM_TE
+    // Pulse TE at the start of each vertical blanking period only.
+    const uint8_t te_mode = 0;
+    esp_err_t err = esp_lcd_panel_io_tx_param(_io_handle, LCD_CMD_TEON, &te_mode, 1);
+    if(err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to enable tearing effect output.");
+      return err;
+    }
+#endif
+    return ESP_OK;
+  }
+
   esp_err_t TTGOTDisplay::backlight(const bool enable) const {
-    ESP_LOGI(TAG, "LCD backlight %s", enable ? "on" : "off");
+    ESP_LOGD(TAG, "LCD backlight %s", enable ? "on" : "off");
+    if(Traits::pwm_backlight) {
+      // The LEDC drives the pin, so switch it fully on or off through the LEDC, as the controller does.
+      return _backlight.set(enable ? Backlight::MAX_LEVEL : 0, 0);
+    }
     gpio_set_level(PIN_NUM_BK_LIGHT, LCD_BK_LIGHT_ON_LEVEL && enable);
     return ESP_OK;
   }
 
-  esp_err_t TTGOTDisplay::error() const { return _err; }
+  esp_err_t TTGOTDisplay::error() const { return _err != ESP_OK ? _err : bring_up().error(); }
+
+  VsyncSource* TTGOTDisplay::vsync_source() {
+#ifdef PIN_NUM_TE
+    static GpioVsync te(PIN_NUM_TE);
+    return &te;
+#else
+    return NULL;
+#endif
+  }
 
   TTGOTDisplay& TTGOTDisplay::instance() {
     static TTGOTDisplay _instance;
     return _instance;
   }
-
-  size_t TTGOTDisplay::buffer_size() const { return LCD_H_RES * LCD_BUFF_LINE_COUNT; }
-  bool TTGOTDisplay::double_buffer() const { return true; }
-  size_t TTGOTDisplay::hres() const { return LCD_H_RES; }
-  size_t TTGOTDisplay::vres() const { return LCD_V_RES; }
-  bool TTGOTDisplay::monochrome() const { return false; }
-  bool TTGOTDisplay::swap_xy() const { return true; }
-  bool TTGOTDisplay::mirror_x() const { return LCD_MIRROR_X; }
-  bool TTGOTDisplay::mirror_y() const { return LCD_MIRROR_Y; }
-  bool TTGOTDisplay::dma() const { return true; }
-  bool TTGOTDisplay::spi_ram() const { return false; }
 }  // namespace LVGLDisplay
\ No newline at end of file
@@ -1,25 +1,32 @@
 #pragma once
 
-#include <display.hpp>
+#include <board_traits.hpp>
 
 namespace LVGLDisplay {
-  class TTGOTDisplay : public Display {
+  struct TTGOTDisplayTraits : BoardTraits {
+    static constexpr size_t hres = 240;
+    static constexpr size_t vres = 135;
+    static constexpr BusModel::Bus bus = BusModel::Bus::SPI;
+    static constexpr uint8_t bus_width = 1;
+    static constexpr uint32_t clock_hz = CONFIG_LVGL_DISPLAY_SPI_CLOCK * 1000 * 1000;
+    static constexpr bool dma = true;
+    static constexpr bool spi_ram = false;
+    static constexpr size_t scan_offset = 40;
+    static constexpr int x_gap = 40;
+    static constexpr int y_gap = 53;
+  };
+
+  class TTGOTDisplay : public Board<TTGOTDisplayTraits> {
    public:
     TTGOTDisplay();
     ~TTGOTDisplay();
     static TTGOTDisplay& instance();
-    size_t buffer_size() const override;
-    bool double_buffer() const override;
-    size_t hres() const override;
-    size_t vres() const override;
-    bool monochrome() const override;
-    bool swap_xy() const override;
-    bool mirror_x() const override;
-    bool mirror_y() const override;
-    bool dma() const override;
-    bool spi_ram() const override;
     esp_err_t backlight(const bool enable) const override;
     esp_err_t error() const override;
+    VsyncSource* vsync_source() override;
+
+   protected:
+    esp_err_t init_panel() override;
 
    private:
     esp_err_t _err;
@@ -0,0 +1,119 @@
+#include "virtual-display.hpp"
+
+#include "esp_err.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_log.h"
+#include "esp_lvgl_port.h"
+#include "lvgl.h"
+
+static const char* TAG = "virtual-display";
+
+using Traits = LVGLDisplay::VirtualDisplayTraits;
+
+#define LCD_CMD_BITS   8
+#define LCD_PARAM_BITS 8
+
+#define LCD_LOG_DEPTH CONFIG_LVGL_DISPLAY_VIRTUAL_LOG_DEPTH
+
+static bool notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t* edata, void* user_ctx) {
+  LVGLDisplay::Display* display = (LVGLDisplay::Display*)user_ctx;
+  return display->flush_ready();
+}
+
+namespace LVGLDisplay {
+
+  VirtualDisplay::VirtualDisplay() {
+    if(Traits::pwm_backlight) {
+      // There is no GPIO, the fades are simulated in time.
+      ESP_LOGI(TAG, "Initialize simulated backlight");
+      _err = _backlight.start(backlight_config(0));
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialise simulated backlight.");
+        return;
+      }
+    }
+
+    ESP_LOGI(TAG, "Install simulated st7789 panel");
+    SimulatedPanel::Config panel_config;
+    panel_config.hres = Traits::hres;
+    panel_config.vres = Traits::vres;
+    panel_config.swap_xy = Traits::swap_xy;
+    panel_config.mirror_x = Traits::mirror_x;
+    panel_config.mirror_y = Traits::mirror_y;
+    panel_config.columns = Traits::panel_columns;
+    panel_config.rows = Traits::panel_lines;
+    panel_config.bus = bus_config();
+    panel_config.bus.cmd_bits = LCD_CMD_BITS;
+    panel_config.bus.param_bits = LCD_PARAM_BITS;
+    panel_config.log_depth = LCD_LOG_DEPTH;
+    panel_config.on_color_trans_done = notify_lvgl_flush_ready;
+    panel_config.user_ctx = this;
+
+    _err = _panel.create(panel_config, &_io_handle, &_panel_handle);
+    if(_err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to create simulated panel.");
+      return;
+    }
+
+    if(Traits::shared_bus) {
+      // Other devices are modelled with SimulatedPanel::device_transaction().
+      ESP_LOGI(TAG, "Share simulated SPI bus");
+      _err = _arbiter.start(arbiter_config(), this);
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start bus arbiter.");
+        return;
+      }
+    }
+
+    _err = start_bring_up(bring_up_config());
+    if(_err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to bring up simulated panel.");
+      return;
+    }
+
+    if(Traits::shadow_tile_rows) {
+      ESP_LOGI(TAG, "Allocate shadow frame");
+      ShadowFrame::Config shadow_config;
+      shadow_config.hres = Traits::hres;
+      shadow_config.vres = Traits::vres;
+      shadow_config.tile_rows = Traits::shadow_tile_rows;
+      shadow_config.alignment = 4;
+      shadow_config.caps = MALLOC_CAP_DEFAULT;
+      _err = _shadow.allocate(shadow_config);
+      if(_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate shadow frame.");
+        return;
+      }
+    }
+  }
+
+  VirtualDisplay::~VirtualDisplay() {}
+
+  esp_err_t VirtualDisplay::init_panel() {
+    esp_lcd_panel_reset(_panel_handle);
+    esp_lcd_panel_init(_panel_handle);
+    esp_lcd_panel_invert_color(_panel_handle, true);
+    esp_lcd_panel_swap_xy(_panel_handle, Traits::swap_xy);
+    esp_lcd_panel_mirror(_panel_handle, Traits::mirror_x, Traits::mirror_y);
+    return ESP_OK;
+  }
+
+  esp_err_t VirtualDisplay::backlight(const bool enable) const {
+    ESP_LOGD(TAG, "LCD backlight %s", enable ? "on" : "off");
+    return ESP_OK;
+  }
+
+  esp_err_t VirtualDisplay::error() const { return _err != ESP_OK ? _err : bring_up().error(); }
+
+  int64_t VirtualDisplay::time_us() const { return _panel.now_ns() / 1000; }
+
+  VsyncSource* VirtualDisplay::vsync_source() { return &_vsync; }
+
+  TouchSource* VirtualDisplay::touch_source() { return &_touch; }
+
+  VirtualDisplay& VirtualDisplay::instance() {
+    static VirtualDisplay _instance;
+    return _instance;
+  }
+}  // namespace LVGLDisplay
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <board_traits.hpp>
+#include <simulated_panel.hpp>
+#include <touch_input.hpp>
+
+namespace LVGLDisplay {
+  struct VirtualDisplayTraits : BoardTraits {
+    static constexpr size_t hres = CONFIG_LVGL_DISPLAY_VIRTUAL_HRES;
+    static constexpr size_t vres = CONFIG_LVGL_DISPLAY_VIRTUAL_VRES;
+#if CONFIG_LVGL_DISPLAY_VIRTUAL_BUS_SPI
+    static constexpr BusModel::Bus bus = BusModel::Bus::SPI;
+    static constexpr uint8_t bus_width = 1;
+    static constexpr uint32_t clock_hz = CONFIG_LVGL_DISPLAY_SPI_CLOCK * 1000 * 1000;
+#else
+    static constexpr BusModel::Bus bus = BusModel::Bus::I80;
+    static constexpr uint8_t bus_width = CONFIG_LVGL_DISPLAY_VIRTUAL_BUS_WIDTH;
+    static constexpr uint32_t clock_hz = CONFIG_LVGL_DISPLAY_PIXEL_CLOCK * 1000 * 1000;
+#endif
+    static constexpr bool dma = false;
+    static constexpr bool spi_ram = false;
+    static constexpr size_t panel_lines = swap_xy ? hres : vres;
+    static constexpr size_t panel_columns = swap_xy ? vres : hres;
+  };
+
+  class VirtualDisplay : public Board<VirtualDisplayTraits> {
+   public:
+    VirtualDisplay();
+    ~VirtualDisplay();
+    static VirtualDisplay& instance();
+    esp_err_t backlight(const bool enable) const override;
+    esp_err_t error() const override;
+    int64_t time_us() const override;
+    VsyncSource* vsync_source() override;
+    TouchSource* touch_source() override;
+
+   protected:
+    esp_err_t init_panel() override;
+
+   private:
+    esp_err_t _err;
+    SimulatedPanel _panel;
+    SimulatedVsync _vsync;
+    ScriptedTouch _touch;
+  };
+};  // namespace LVGLDisplay
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <bring_up.hpp>
+#include <display.hpp>
+#include <pixel_convert.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+
+namespace LVGLDisplay {
+
+  BringUp::~BringUp() {
+    if(_events) {
+      vEventGroupDelete(_events);
+    }
+  }
+
+  int64_t BringUp::time_us() const { return _display.time_us(); }
+
+  esp_err_t BringUp::start(const BringUpConfig& config, Init init, void* context) {
+    if(_events || !_ready) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!_display.packer().supports(config.format)) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    _init = init;
+    _context = context;
+    _format = config.format;
+    if(config.splash_color >= 0) {
+      _splash[0].area = {0, 0, (lv_coord_t)(_display.hres() - 1), (lv_coord_t)(_display.vres() - 1)};
+      _splash[0].pixels = NULL;
+      _splash[0].color = lv_color_hex(config.splash_color);
+      _splash_fill = true;
+    }
+    if(config.async) {
+      _events = xEventGroupCreate();
+      if(!_events) {
+        return ESP_ERR_NO_MEM;
+      }
+    }
+    _state = State::STARTING;
+    _ready = false;
+    _timing.start_us = time_us();
+    if(!config.async) {
+      return run();
+    }
+
+    const BaseType_t core = config.core < 0 ? tskNO_AFFINITY : config.core;
+    if(xTaskCreatePinnedToCore(bring_up_main, "lcd_bring_up", config.stack, this, config.priority, NULL, core) != pdPASS) {
+      _err = ESP_ERR_NO_MEM;
+      _state = State::READY;
+      _ready = true;
+      xEventGroupSetBits(_events, READY_BIT);
+      return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+  }
+
+  void BringUp::bring_up_main(void* arg) {
+    ((BringUp*)arg)->run();
+    vTaskDelete(NULL);
+  }
+
+  esp_err_t BringUp::run() {
+    esp_err_t err = _init ? _init(_context) : ESP_OK;
+    if(err == ESP_OK) {
+      err = _display.packer().initialise(_format);
+    }
+
+    // Stripes queued from here on are drawn once the panel is ready.
+    portENTER_CRITICAL(&_lock);
+    _state = State::SPLASHING;
+    const size_t first = _splash_fill ? 0 : 1;
+    const size_t count = _splash_count + 1 - first;
+    portEXIT_CRITICAL(&_lock);
+    if(err == ESP_OK && count) {
+      err = draw_splash(&_splash[first], count);
+    }
+
+    // Pixels written before the panel is turned on appear all at once, without showing the panel's power on state.
+    if(err == ESP_OK) {
+      err = esp_lcd_panel_disp_on_off(_display.panel_handle(), true);
+    }
+    _timing.panel_ready_us = time_us();
+    if(err == ESP_OK && count) {
+      _timing.splash_us = _timing.panel_ready_us;
+    }
+
+    _err = err;
+    portENTER_CRITICAL(&_lock);
+    _state = State::READY;
+    portEXIT_CRITICAL(&_lock);
+    _ready = true;
+    if(_events) {
+      xEventGroupSetBits(_events, READY_BIT);
+    }
+    // A backlight switched on during the bring-up lights the panel now.
+    apply_backlight();
+    return err;
+  }
+
+  esp_err_t BringUp::wait_ready(uint32_t timeout_ms) {
+    if(_ready) {
+      return _err;
+    }
+    const TickType_t ticks = timeout_ms == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    if(!_events || !(xEventGroupWaitBits(_events, READY_BIT, pdFALSE, pdTRUE, ticks) & READY_BIT)) {
+      return ESP_ERR_TIMEOUT;
+    }
+    return _err;
+  }
+
+  esp_err_t BringUp::splash(const lv_area_t& area, const lv_color_t* pixels) {
+    if(!pixels || area.x1 < 0 || area.y1 < 0 || area.x2 < area.x1 || area.y2 < area.y1 ||
+       area.x2 >= (lv_coord_t)_display.hres() || area.y2 >= (lv_coord_t)_display.vres()) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&_lock);
+    const State state = _state;
+    if(state == State::STARTING) {
+      if(_splash_count == MAX_SPLASH) {
+        err = ESP_ERR_NO_MEM;
+      }
+      else {
+        _splash[1 + _splash_count++] = {area, pixels, lv_color_t()};
+      }
+    }
+    portEXIT_CRITICAL(&_lock);
+    if(state == State::STARTING) {
+      return err;
+    }
+
+    err = wait_ready(portMAX_DELAY);
+    if(err != ESP_OK) {
+      return err;
+    }
+    if(_display.display()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    const SplashStripe stripe = {area, pixels, lv_color_t()};
+    return draw_splash(&stripe, 1);
+  }
+
+  esp_err_t BringUp::draw_splash(const SplashStripe* stripes, size_t count) {
+    const TransferPacker& packer = _display.packer();
+    // Swapped here only when the packer sends RGB565, RGB444 is packed straight from LVGL's byte order.
+    const bool swap = _display.swap_bytes() && sizeof(lv_color_t) == sizeof(uint16_t) && packer.format() == TransferFormat::RGB565;
+    // Two chunks the bus can transfer from, one is filled while the other transfers.
+    const size_t chunk_pixels = _display.hres() * SPLASH_CHUNK_LINES;
+    lv_color_t* chunks =
+      (lv_color_t*)heap_caps_malloc(2 * chunk_pixels * sizeof(lv_color_t), _display.dma() ? MALLOC_CAP_DMA : MALLOC_CAP_DEFAULT);
+    if(!chunks) {
+      return ESP_ERR_NO_MEM;
+    }
+    // Transfer count once each chunk's last transfer completes.
+    uint32_t reuse_at[2] = {_display.submitted(), _display.submitted()};
+
+    esp_err_t err = ESP_OK;
+    size_t next = 0;
+    for(size_t i = 0; i < count && err == ESP_OK; i++) {
+      const SplashStripe& stripe = stripes[i];
+      const size_t width = lv_area_get_width(&stripe.area);
+      const size_t rows = chunk_pixels / width;
+      // A solid colour is filled in once, every transfer of the stripe sends the same chunk.
+      if(!stripe.pixels) {
+        _display.wait_transferred(reuse_at[next]);
+        std::fill(chunks + next * chunk_pixels, chunks + next * chunk_pixels + rows * width, stripe.color);
+        if(swap) {
+          PixelConvert::swap_rgb565((uint16_t*)(chunks + next * chunk_pixels), (const uint16_t*)(chunks + next * chunk_pixels),
+                                    rows * width);
+        }
+        // Every pixel is the same, so the transfer of fewer rows sends the start of the packed chunk.
+        packer.pack(chunks + next * chunk_pixels, rows * width, LV_COLOR_16_SWAP);
+      }
+      for(lv_coord_t y = stripe.area.y1; y <= stripe.area.y2 && err == ESP_OK; y += rows) {
+        const size_t lines = std::min(rows, (size_t)(stripe.area.y2 - y + 1));
+        lv_color_t* chunk = chunks + next * chunk_pixels;
+        if(stripe.pixels) {
+          _display.wait_transferred(reuse_at[next]);
+          memcpy(chunk, stripe.pixels + (y - stripe.area.y1) * width, lines * width * sizeof(lv_color_t));
+          if(swap) {
+            PixelConvert::swap_rgb565((uint16_t*)chunk, (const uint16_t*)chunk, lines * width);
+          }
+          packer.pack(chunk, lines * width, LV_COLOR_16_SWAP);
+        }
+        err = _display.send({stripe.area.x1, y, stripe.area.x2, (lv_coord_t)(y + lines - 1)}, chunk, packer.bytes(lines * width));
+        reuse_at[next] = _display.submitted();
+        if(stripe.pixels) {
+          next ^= 1;
+        }
+      }
+      if(!stripe.pixels) {
+        next ^= 1;
+      }
+    }
+    _display.wait_transferred(_display.submitted());
+    heap_caps_free(chunks);
+    return err;
+  }
+
+  esp_err_t BringUp::switch_backlight(const bool enable) { return switch_backlight(enable ? Backlight::MAX_LEVEL : 0, 0); }
+
+  esp_err_t BringUp::switch_backlight(uint8_t level, uint32_t fade_ms) {
+    _backlight_fade_ms = fade_ms;
+    _backlight_pending = level;
+    // Whichever of this and the bring-up finds the panel ready switches the backlight.
+    return _ready ? apply_backlight() : ESP_OK;
+  }
+
+  esp_err_t BringUp::apply_backlight() {
+    const int16_t pending = _backlight_pending.exchange(-1);
+    if(pending < 0) {
+      return ESP_OK;
+    }
+    Backlight* pwm = _display.pwm_backlight();
+    return pwm ? pwm->set(pending, _backlight_fade_ms) : _display.backlight(pending > 0);
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,218 @@
+#include <buffer_planner.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace LVGLDisplay {
+
+  // Queue depths considered, LVGL_DISPLAY_TQUEUE_DEPTH defaults to 10.
+  static constexpr size_t QUEUE_DEPTHS[] = {1, 2, 4, 10};
+
+  // A flush sets the column and row window with two 4 byte parameter commands, then writes the colours with RAMWR.
+  static constexpr size_t WINDOW_PARAM_BYTES = 4;
+  static constexpr size_t FLUSH_COMMAND_BYTES = 3 + 2 * WINDOW_PARAM_BYTES;
+
+  // Least squares fit of y = intercept + slope * x. Without spread in x, only the slope is fitted, through the given
+  // intercept.
+  static void fit_line(const double* xs, const double* ys, size_t count, double* intercept, double* slope) {
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for(size_t i = 0; i < count; i++) {
+      sum_x += xs[i];
+      sum_y += ys[i];
+      sum_xx += xs[i] * xs[i];
+      sum_xy += xs[i] * ys[i];
+    }
+    const double spread = count * sum_xx - sum_x * sum_x;
+    if(count > 1 && spread > 1e-6 * sum_xx) {
+      *slope = (count * sum_xy - sum_x * sum_y) / spread;
+      *intercept = (sum_y - *slope * sum_x) / count;
+    }
+    else if(sum_x > 0) {
+      *slope = (sum_y - *intercept * count) / sum_x;
+    }
+    if(*slope < 0) {
+      *slope = 0;
+    }
+    if(*intercept < 0) {
+      *intercept = 0;
+    }
+  }
+
+  BufferPlanner::Workload BufferPlanner::Workload::full_screen(size_t hres, size_t vres) {
+    Workload workload;
+    workload.name = "full_screen";
+    workload.areas[0] = {(uint16_t)hres, (uint16_t)vres};
+    workload.area_count = 1;
+    return workload;
+  }
+
+  BufferPlanner::Workload BufferPlanner::Workload::widgets(size_t hres, size_t vres, size_t count, size_t width,
+                                                          size_t height) {
+    Workload workload;
+    workload.name = "widgets";
+    workload.area_count = std::min(count, MAX_AREAS);
+    for(size_t i = 0; i < workload.area_count; i++) {
+      workload.areas[i] = {(uint16_t)std::min(width, hres), (uint16_t)std::min(height, vres)};
+    }
+    return workload;
+  }
+
+  bool BufferPlanner::calibrate(const Sample* samples, size_t count) {
+    std::vector<double> flush_bytes, flush_ns, stripe_pixels, render_ns;
+    for(size_t i = 0; i < count; i++) {
+      const Sample& sample = samples[i];
+      if(sample.flushes == 0) {
+        continue;
+      }
+      flush_bytes.push_back((double)sample.bytes / sample.flushes);
+      flush_ns.push_back(sample.latency_total_us * 1000.0 / sample.flushes);
+      stripe_pixels.push_back(flush_bytes.back() / _config.bytes_per_pixel);
+      render_ns.push_back(sample.render_total_us * 1000.0 / sample.flushes);
+    }
+    const size_t runs = flush_bytes.size();
+    if(runs == 0) {
+      return false;
+    }
+
+    // A single run fits through the fixed cost in use, nominal until calibrated.
+    double intercept = _calibration.flush_ns ? _calibration.flush_ns : BusModel(bus_config(1)).transfer_ns(FLUSH_COMMAND_BYTES);
+    double slope = 0;
+    fit_line(flush_bytes.data(), flush_ns.data(), runs, &intercept, &slope);
+    _calibration.flush_ns = intercept;
+    _calibration.bus_byte_ns = slope;
+
+    intercept = _calibration.render_stripe_ns;
+    slope = 0;
+    fit_line(stripe_pixels.data(), render_ns.data(), runs, &intercept, &slope);
+    _calibration.render_stripe_ns = intercept;
+    _calibration.render_pixel_ns = slope;
+    return true;
+  }
+
+  BusModel::Config BufferPlanner::bus_config(size_t queue_depth) const {
+    BusModel::Config config = _config.bus;
+    config.queue_depth = queue_depth;
+    const uint8_t width = config.bus == BusModel::Bus::SPI || config.bus_width == 0 ? 1 : config.bus_width;
+    if(_calibration.bus_byte_ns > 0) {
+      config.clock_hz = 8e9 / (width * _calibration.bus_byte_ns);
+    }
+    if(_calibration.flush_ns) {
+      // The measured fixed cost is spread over the three transactions of a flush, less their command bytes.
+      const uint64_t command_ns = BusModel(config).transfer_ns(FLUSH_COMMAND_BYTES);
+      config.setup_ns = _calibration.flush_ns > command_ns ? (_calibration.flush_ns - command_ns) / 3 : 0;
+    }
+    return config;
+  }
+
+  BufferPlanner::Plan BufferPlanner::evaluate(const Workload& workload, size_t buffer_lines, size_t buffer_count,
+                                              size_t queue_depth) const {
+    Plan plan;
+    plan.buffer_lines = buffer_lines = std::min(std::max(buffer_lines, (size_t)1), _config.vres);
+    plan.buffer_count = buffer_count = std::min(std::max(buffer_count, (size_t)1), MAX_BUFFERS);
+    plan.queue_depth = queue_depth;
+    const size_t buffer_pixels = _config.hres * buffer_lines;
+    plan.memory_bytes = buffer_pixels * _config.bytes_per_pixel * buffer_count;
+    if(plan.memory_bytes <= _config.internal_bytes) {
+      plan.placement = Placement::INTERNAL;
+    }
+    else if(plan.memory_bytes <= _config.psram_bytes) {
+      plan.placement = Placement::PSRAM;
+    }
+    else {
+      return plan;
+    }
+    const float render_factor = plan.placement == Placement::PSRAM ? _config.psram_render_factor : 1.0f;
+
+    BusModel bus(bus_config(queue_depth));
+    uint64_t free_ns[MAX_BUFFERS] = {}; // Time each buffer's transfer completes.
+    uint64_t last_done_ns = 0;          // Time the previous stripe's transfer completes.
+    uint64_t now = 0;                   // Time in the LVGL task.
+    size_t stripe = 0;
+    for(size_t i = 0; i < workload.area_count; i++) {
+      const Area& area = workload.areas[i];
+      if(area.width == 0 || area.height == 0) {
+        continue;
+      }
+      // LVGL renders as many full width rows of the area as fit in the buffer.
+      const size_t rows = std::max(buffer_pixels / area.width, (size_t)1);
+      for(size_t y = 0; y < area.height; y += rows, stripe++) {
+        const size_t pixels = area.width * std::min(rows, (size_t)area.height - y);
+        // Render into a buffer once its previous transfer has completed.
+        const size_t buffer = stripe % buffer_count;
+        now = std::max(now, free_ns[buffer]);
+        now += (uint64_t)(render_factor * (_calibration.render_stripe_ns + _calibration.render_pixel_ns * pixels));
+        // With two buffers, LVGL waits for the previous flush before flushing again; a ring reports flushes ready
+        // at once.
+        if(buffer_count == 2) {
+          now = std::max(now, last_done_ns);
+        }
+        now = bus.tx_param(now, WINDOW_PARAM_BYTES);
+        now = bus.tx_param(now, WINDOW_PARAM_BYTES);
+        now = bus.tx_color(now, pixels * _config.bytes_per_pixel, &last_done_ns);
+        free_ns[buffer] = last_done_ns;
+        // A single buffer is rendered again only after its transfer.
+        if(buffer_count == 1) {
+          now = last_done_ns;
+        }
+      }
+    }
+
+    const uint64_t frame_ns = std::max(now, bus.idle_at());
+    plan.frame_us = (frame_ns + 999) / 1000;
+    plan.fps = frame_ns ? 1e9f / frame_ns : 0;
+    plan.bus_utilization = frame_ns ? (float)bus.stats().busy_ns / frame_ns : 0;
+    return plan;
+  }
+
+  BufferPlanner::Plan BufferPlanner::recommend(const Workload& workload) const {
+    // The shortest buffer for each number of stripes a full screen takes, longer ones only cost memory.
+    std::vector<size_t> lines;
+    for(size_t stripes = _config.vres; stripes >= 1; stripes--) {
+      const size_t length = (_config.vres + stripes - 1) / stripes;
+      if(lines.empty() || lines.back() != length) {
+        lines.push_back(length);
+      }
+    }
+
+    float best_fps = 0;
+    for(size_t length : lines) {
+      for(size_t count = 1; count <= MAX_BUFFERS; count++) {
+        for(size_t depth : QUEUE_DEPTHS) {
+          best_fps = std::max(best_fps, evaluate(workload, length, count, depth).fps);
+        }
+      }
+    }
+
+    // The least memory within the tolerance of the best frame rate, then the fewest buffers and the shallowest queue.
+    Plan best;
+    for(size_t length : lines) {
+      for(size_t count = 1; count <= MAX_BUFFERS; count++) {
+        for(size_t depth : QUEUE_DEPTHS) {
+          const Plan plan = evaluate(workload, length, count, depth);
+          if(plan.placement == Placement::NONE || plan.fps < best_fps * (1 - _config.fps_tolerance)) {
+            continue;
+          }
+          const bool better = best.placement == Placement::NONE                 ? true
+                              : plan.memory_bytes != best.memory_bytes ? plan.memory_bytes < best.memory_bytes
+                              : plan.buffer_count != best.buffer_count ? plan.buffer_count < best.buffer_count
+                              : plan.queue_depth != best.queue_depth   ? plan.queue_depth < best.queue_depth
+                                                                       : plan.fps > best.fps;
+          if(better) {
+            best = plan;
+          }
+        }
+      }
+    }
+    return best;
+  }
+
+  const char* BufferPlanner::placement_name(Placement placement) {
+    switch(placement) {
+      case Placement::INTERNAL: return "internal";
+      case Placement::PSRAM: return "psram";
+      case Placement::NONE: break;
+    }
+    return "none";
+  }
+
+}  // namespace LVGLDisplay
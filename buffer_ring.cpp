@@ -0,0 +1,91 @@
+#include <buffer_ring.hpp>
+
+#include "esp_timer.h"
+
+namespace LVGLDisplay {
+
+  BufferRing::~BufferRing() {
+    if(_free) {
+      vQueueDelete(_free);
+    }
+    for(size_t i = 0; i < MAX_BUFFERS; i++) {
+      heap_caps_free(_allocated[i]);
+    }
+  }
+
+  // Region names of the buffers beyond the two LVGL already has.
+  static const char* const REGION_NAMES[BufferRing::MAX_BUFFERS] = {
+    NULL, NULL, "ring buffer 3", "ring buffer 4", "ring buffer 5", "ring buffer 6", "ring buffer 7", "ring buffer 8",
+  };
+
+  esp_err_t BufferRing::create(lv_disp_draw_buf_t* draw_buf, size_t count, uint32_t caps, MemoryArena* arena,
+                               uint8_t owner) {
+    if(_free) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(count < 3 || count > MAX_BUFFERS) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(!draw_buf || !draw_buf->buf1 || !draw_buf->buf2) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    _free = xQueueCreate(count, sizeof(void*));
+    if(!_free) {
+      return ESP_ERR_NO_MEM;
+    }
+    // LVGL keeps the two buffers from the port, the rest start out free. Arena regions stay reserved on failure, for
+    // the next attempt to reuse.
+    const size_t bytes = draw_buf->size * sizeof(lv_color_t);
+    for(size_t i = 2; i < count; i++) {
+      void* buffer = arena ? arena->allocate(REGION_NAMES[i], owner, bytes) : (_allocated[i] = heap_caps_malloc(bytes, caps));
+      if(!buffer) {
+        for(size_t j = 2; j < i; j++) {
+          heap_caps_free(_allocated[j]);
+          _allocated[j] = NULL;
+        }
+        vQueueDelete(_free);
+        _free = NULL;
+        return ESP_ERR_NO_MEM;
+      }
+      xQueueSend(_free, &buffer, 0);
+    }
+    _count = count;
+    return ESP_OK;
+  }
+
+  void BufferRing::rotate(lv_disp_draw_buf_t* draw_buf) {
+    void* buffer = NULL;
+    if(xQueueReceive(_free, &buffer, 0) != pdTRUE) {
+      const int64_t start = esp_timer_get_time();
+      xQueueReceive(_free, &buffer, portMAX_DELAY);
+      const uint32_t waited = esp_timer_get_time() - start;
+      _stats.stalls++;
+      _stats.stall_total_us += waited;
+      if(waited > _stats.stall_max_us) {
+        _stats.stall_max_us = waited;
+      }
+    }
+    _stats.acquires++;
+
+    // LVGL alternates buf_act between the two slots after the flush callback returns. Putting the free buffer in
+    // the rendered buffer's slot and making it active keeps the alternation, so the other slot is rendered next.
+    if(draw_buf->buf_act == draw_buf->buf1) {
+      draw_buf->buf1 = buffer;
+    }
+    else {
+      draw_buf->buf2 = buffer;
+    }
+    draw_buf->buf_act = buffer;
+  }
+
+  bool BufferRing::release(void* buffer) {
+    if(xPortInIsrContext()) {
+      BaseType_t woken = pdFALSE;
+      xQueueSendFromISR(_free, &buffer, &woken);
+      return woken == pdTRUE;
+    }
+    xQueueSend(_free, &buffer, 0);
+    return false;
+  }
+
+}  // namespace LVGLDisplay
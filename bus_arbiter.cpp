@@ -0,0 +1,254 @@
+#include <bus_arbiter.hpp>
+#include <display.hpp>
+
+#include <algorithm>
+
+namespace LVGLDisplay {
+
+  // Chunks end on a pixel in RGB565, two bytes, and on a pair of pixels in RGB444, three bytes.
+  static constexpr size_t CHUNK_ALIGNMENT = 6;
+
+  static size_t chunk_length(const BusArbiter::Config& config) {
+    if(!config.chunk_us) {
+      return 0;
+    }
+    const size_t bytes = (uint64_t)config.clock_hz * config.chunk_us / (8 * 1000000ULL);
+    return std::max(bytes - bytes % CHUNK_ALIGNMENT, CHUNK_ALIGNMENT);
+  }
+
+  static void add_wait(BusArbiter::ClientStats& stats, int64_t wait_us) {
+    stats.wait_us += wait_us;
+    if(wait_us > stats.wait_max_us) {
+      stats.wait_max_us = wait_us;
+    }
+  }
+
+  BusArbiter::~BusArbiter() {
+    if(_mutex) {
+      vSemaphoreDelete(_mutex);
+      vSemaphoreDelete(_drained);
+      vSemaphoreDelete(_clear);
+    }
+  }
+
+  esp_err_t BusArbiter::start(const Config& config, Display* display) {
+    if(!display) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    _drained = xSemaphoreCreateBinary();
+    _clear = xSemaphoreCreateBinary();
+    if(!mutex || !_drained || !_clear) {
+      if(mutex) {
+        vSemaphoreDelete(mutex);
+      }
+      if(_drained) {
+        vSemaphoreDelete(_drained);
+        _drained = NULL;
+      }
+      if(_clear) {
+        vSemaphoreDelete(_clear);
+        _clear = NULL;
+      }
+      return ESP_ERR_NO_MEM;
+    }
+    _config = config;
+    _chunk_bytes = chunk_length(config);
+    _display = display;
+    _clients[DISPLAY_CLIENT] = ClientStats();
+    _clients[DISPLAY_CLIENT].name = "display";
+    _count = 1;
+    _epoch_us = display->time_us();
+    _mutex = mutex;
+    return ESP_OK;
+  }
+
+  void BusArbiter::configure(const Config& config) {
+    if(!_mutex) {
+      _config = config;
+      return;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _config = config;
+    _chunk_bytes = chunk_length(config);
+    xSemaphoreGive(_mutex);
+  }
+
+  esp_err_t BusArbiter::add_client(const char* name, Priority priority, int* client) {
+    if(!name || !client) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(!_mutex) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    const size_t count = _count;
+    if(count == MAX_CLIENTS) {
+      xSemaphoreGive(_mutex);
+      return ESP_ERR_NO_MEM;
+    }
+    portENTER_CRITICAL_SAFE(&_lock);
+    _clients[count] = ClientStats();
+    _clients[count].name = name;
+    _clients[count].priority = priority;
+    portEXIT_CRITICAL_SAFE(&_lock);
+    _count = count + 1;
+    xSemaphoreGive(_mutex);
+    *client = count;
+    return ESP_OK;
+  }
+
+  esp_err_t BusArbiter::acquire(int client, TickType_t timeout) {
+    if(client <= DISPLAY_CLIENT || client >= (int)_count) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    const int64_t start = _display->time_us();
+    if(_clients[client].priority == Priority::HIGH) {
+      _urgent++;
+    }
+    if(xSemaphoreTake(_mutex, timeout) != pdTRUE) {
+      unblock(client);
+      return ESP_ERR_TIMEOUT;
+    }
+    // The SPI master would serve the display's queued chunks first anyway, the bus is free once they complete.
+    while(_in_flight) {
+      if(xSemaphoreTake(_drained, timeout) != pdTRUE) {
+        xSemaphoreGive(_mutex);
+        unblock(client);
+        return ESP_ERR_TIMEOUT;
+      }
+    }
+    const int64_t now = _display->time_us();
+    _acquired_us = now;
+    portENTER_CRITICAL_SAFE(&_lock);
+    add_wait(_clients[client], now - start);
+    portEXIT_CRITICAL_SAFE(&_lock);
+    return ESP_OK;
+  }
+
+  void BusArbiter::release(int client, size_t bytes) {
+    if(client <= DISPLAY_CLIENT || client >= (int)_count) {
+      return;
+    }
+    const int64_t now = _display->time_us();
+    portENTER_CRITICAL_SAFE(&_lock);
+    ClientStats& stats = _clients[client];
+    stats.transactions++;
+    stats.bytes += bytes;
+    stats.busy_us += now - _acquired_us;
+    portEXIT_CRITICAL_SAFE(&_lock);
+    xSemaphoreGive(_mutex);
+    unblock(client);
+  }
+
+  void BusArbiter::unblock(int client) {
+    if(_clients[client].priority == Priority::HIGH && --_urgent == 0) {
+      xSemaphoreGive(_clear);
+    }
+  }
+
+#if !CONFIG_IDF_TARGET_LINUX
+  esp_err_t BusArbiter::transmit(int client, spi_device_handle_t device, spi_transaction_t* transaction, TickType_t timeout) {
+    if(!device || !transaction) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = acquire(client, timeout);
+    if(err != ESP_OK) {
+      return err;
+    }
+    // With the bus free, polling saves the interrupt and task switch of a queued transaction.
+    err = spi_device_polling_transmit(device, transaction);
+    release(client, (std::max(transaction->length, transaction->rxlength) + 7) / 8);
+    return err;
+  }
+#endif
+
+  void BusArbiter::begin_chunk() {
+    const int64_t start = _display->time_us();
+    // High priority clients go first, however long they queue for each other.
+    while(_urgent) {
+      xSemaphoreTake(_clear, portMAX_DELAY);
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    const int64_t now = _display->time_us();
+    portENTER_CRITICAL_SAFE(&_lock);
+    // Counted before it is queued, a simulated panel completes the chunk before tx_color returns.
+    if(_in_flight < MAX_QUEUED) {
+      _queued_us[(_queued_head + _in_flight) % MAX_QUEUED] = now;
+    }
+    _in_flight++;
+    add_wait(_clients[DISPLAY_CLIENT], now - start);
+    portEXIT_CRITICAL_SAFE(&_lock);
+  }
+
+  void BusArbiter::end_chunk(size_t bytes, bool queued) {
+    portENTER_CRITICAL_SAFE(&_lock);
+    if(queued) {
+      _clients[DISPLAY_CLIENT].transactions++;
+      _clients[DISPLAY_CLIENT].bytes += bytes;
+    }
+    else if(_in_flight) {
+      _in_flight--;
+    }
+    portEXIT_CRITICAL_SAFE(&_lock);
+    xSemaphoreGive(_mutex);
+  }
+
+  bool BusArbiter::chunk_done() {
+    if(!_mutex) {
+      return false;
+    }
+    const int64_t now = _display->time_us();
+    portENTER_CRITICAL_SAFE(&_lock);
+    const uint32_t in_flight = _in_flight;
+    if(in_flight) {
+      // The chunk started on the bus once queued, or once the chunk before it completed.
+      const int64_t queued_us = _queued_us[_queued_head];
+      _clients[DISPLAY_CLIENT].busy_us += now - std::max(queued_us, _done_us);
+      _done_us = now;
+      _queued_head = (_queued_head + 1) % MAX_QUEUED;
+      _in_flight = in_flight - 1;
+    }
+    portEXIT_CRITICAL_SAFE(&_lock);
+    if(in_flight != 1) {
+      return false;
+    }
+    if(xPortInIsrContext()) {
+      BaseType_t woken = pdFALSE;
+      xSemaphoreGiveFromISR(_drained, &woken);
+      return woken == pdTRUE;
+    }
+    xSemaphoreGive(_drained);
+    return false;
+  }
+
+  BusArbiter::Stats BusArbiter::stats() const {
+    Stats stats;
+    const int64_t now = _display ? _display->time_us() : 0;
+    portENTER_CRITICAL_SAFE(&_lock);
+    stats.elapsed_us = now - _epoch_us;
+    stats.clients = _count;
+    std::copy(_clients, _clients + stats.clients, stats.client);
+    portEXIT_CRITICAL_SAFE(&_lock);
+    return stats;
+  }
+
+  void BusArbiter::reset_stats() {
+    const int64_t now = _display ? _display->time_us() : 0;
+    portENTER_CRITICAL_SAFE(&_lock);
+    for(size_t i = 0; i < _count; i++) {
+      ClientStats& stats = _clients[i];
+      const char* name = stats.name;
+      const Priority priority = stats.priority;
+      stats = ClientStats();
+      stats.name = name;
+      stats.priority = priority;
+    }
+    _epoch_us = now;
+    portEXIT_CRITICAL_SAFE(&_lock);
+  }
+
+}  // namespace LVGLDisplay
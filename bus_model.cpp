@@ -0,0 +1,97 @@
+#include <bus_model.hpp>
+
+#include <algorithm>
+
+namespace LVGLDisplay {
+
+  BusModel::BusModel() { configure(Config()); }
+
+  BusModel::BusModel(const Config& config) { configure(config); }
+
+  void BusModel::configure(const Config& config) {
+    _config = config;
+    if(_config.bus == Bus::SPI || _config.bus_width == 0) {
+      _config.bus_width = 1;
+    }
+    if(_config.queue_depth == 0) {
+      _config.queue_depth = 1;
+    }
+  }
+
+  uint64_t BusModel::transfer_ns(size_t bytes) const {
+    if(_config.clock_hz == 0) {
+      return 0;
+    }
+    const uint64_t cycles = (static_cast<uint64_t>(bytes) * 8 + _config.bus_width - 1) / _config.bus_width;
+    return cycles * 1000000000ULL / _config.clock_hz;
+  }
+
+  uint64_t BusModel::tx_param(uint64_t now_ns, size_t param_bytes) {
+    // esp_lcd drains the colour queue before sending a command with parameters.
+    const uint64_t start = std::max(now_ns, _busy_until);
+    const size_t bytes = _config.cmd_bits / 8 + param_bytes * (_config.param_bits / 8);
+    _stats.stall_ns += start - now_ns;
+    _stats.command_bytes += bytes;
+    const uint64_t done = schedule(start, _config.setup_ns + transfer_ns(bytes));
+    _stats.stall_ns += done - start;
+    retire(done);
+    return done;
+  }
+
+  uint64_t BusModel::tx_color(uint64_t now_ns, size_t color_bytes, uint64_t* done_ns) {
+    retire(now_ns);
+    uint64_t resume = now_ns;
+    if(_config.bus == Bus::SPI && !_in_flight.empty()) {
+      // The SPI panel IO collects every queued transaction before it polls the command out.
+      resume = _in_flight.back();
+      _stats.stall_ns += resume - now_ns;
+      retire(resume);
+    }
+    else if(_in_flight.size() >= _config.queue_depth) {
+      // No free slot in the transaction queue, the caller blocks until the oldest transfer completes.
+      resume = _in_flight.front();
+      _stats.stall_ns += resume - now_ns;
+      retire(resume);
+    }
+    const size_t cmd_bytes = _config.cmd_bits / 8;
+    _stats.command_bytes += cmd_bytes;
+    _stats.color_bytes += color_bytes;
+    const uint64_t done = schedule(resume, _config.setup_ns + transfer_ns(cmd_bytes + color_bytes));
+    _in_flight.push_back(done);
+    if(done_ns) {
+      *done_ns = done;
+    }
+    return resume;
+  }
+
+  uint64_t BusModel::tx_device(uint64_t now_ns, size_t bytes, uint64_t* start_ns) {
+    retire(now_ns);
+    const uint64_t start = std::max(now_ns, _busy_until);
+    _stats.device_bytes += bytes;
+    const uint64_t done = schedule(start, _config.setup_ns + transfer_ns(bytes));
+    if(start_ns) {
+      *start_ns = start;
+    }
+    return done;
+  }
+
+  uint64_t BusModel::schedule(uint64_t now_ns, uint64_t duration_ns) {
+    uint64_t start = _busy_until;
+    if(now_ns > _busy_until) {
+      if(_stats.transactions) {
+        _stats.idle_ns += now_ns - _busy_until;
+      }
+      start = now_ns;
+    }
+    _busy_until = start + duration_ns;
+    _stats.busy_ns += duration_ns;
+    _stats.transactions++;
+    return _busy_until;
+  }
+
+  void BusModel::retire(uint64_t now_ns) {
+    auto done = std::find_if(_in_flight.begin(), _in_flight.end(), [now_ns](uint64_t t) { return t > now_ns; });
+    _in_flight.erase(_in_flight.begin(), done);
+  }
+
+}  // namespace LVGLDisplay
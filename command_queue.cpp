@@ -0,0 +1,110 @@
+#include <command_queue.hpp>
+
+#include <new>
+
+#include "esp_heap_caps.h"
+
+namespace LVGLDisplay {
+
+  CommandQueue::~CommandQueue() { heap_caps_free(_cells); }
+
+  esp_err_t CommandQueue::create(size_t capacity) {
+    if(_cells) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(capacity == 0 || capacity > 0x10000) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    size_t cells = 1;
+    while(cells < capacity) {
+      cells <<= 1;
+    }
+    _cells = (Cell*)heap_caps_malloc(cells * sizeof(Cell), MALLOC_CAP_DEFAULT);
+    if(!_cells) {
+      return ESP_ERR_NO_MEM;
+    }
+    for(size_t i = 0; i < cells; i++) {
+      new(&_cells[i]) Cell();
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _mask = cells - 1;
+    return ESP_OK;
+  }
+
+  bool CommandQueue::post(Function function, const void* payload, size_t size) {
+    if(!_cells || size > PAYLOAD) {
+      return false;
+    }
+    // Claim a position whose cell has been applied, then fill it and publish it to the consumer.
+    uint32_t pos = _tail.load(std::memory_order_relaxed);
+    Cell* cell;
+    while(true) {
+      cell = &_cells[pos & _mask];
+      const int32_t diff = (int32_t)(cell->sequence.load(std::memory_order_acquire) - pos);
+      if(diff == 0) {
+        if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if(diff < 0) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      else {
+        pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+    cell->function = function;
+    memcpy(cell->payload, payload, size);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    _posted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t CommandQueue::apply() {
+    if(!_cells) {
+      return 0;
+    }
+    // Only the commands posted before the batch started are applied, so a command posting another can not spin here.
+    const uint32_t end = _tail.load(std::memory_order_acquire);
+    size_t count = 0;
+    while(_head != end) {
+      Cell* cell = &_cells[_head & _mask];
+      if(cell->sequence.load(std::memory_order_acquire) != _head + 1) {
+        // Claimed but not yet filled, it is applied in the next batch.
+        break;
+      }
+      cell->function(cell->payload);
+      cell->sequence.store(_head + _mask + 1, std::memory_order_release);
+      _head++;
+      count++;
+    }
+    if(count) {
+      _applied += count;
+      _batches++;
+      if(count > _max_batch) {
+        _max_batch = count;
+      }
+    }
+    return count;
+  }
+
+  CommandQueue::Stats CommandQueue::stats() const {
+    Stats stats;
+    stats.posted = _posted.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.applied = _applied;
+    stats.batches = _batches;
+    stats.max_batch = _max_batch;
+    return stats;
+  }
+
+  void CommandQueue::reset_stats() {
+    _posted = 0;
+    _dropped = 0;
+    _applied = 0;
+    _batches = 0;
+    _max_batch = 0;
+  }
+
+}  // namespace LVGLDisplay
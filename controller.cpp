@@ -2,37 +2,173 @@
 
 #include <controller.hpp>
 #include <display.hpp>
+#include <display_heap.h>
 
 #include "boards/display_factory.hpp"
 #include "esp_log.h"
 #include "esp_lvgl_port.h"
+#include "esp_timer.h"
 
 static const char* TAG = "display-controller";
 
+#ifdef CONFIG_LVGL_DISPLAY_COALESCE
+  #define LCD_COALESCE true
+  #define LCD_COALESCE_TRANSACTION_COST CONFIG_LVGL_DISPLAY_COALESCE_TRANSACTION_COST
+#else
+  #define LCD_COALESCE false
+  #define LCD_COALESCE_TRANSACTION_COST 0
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_FLUSH_TASK
+  #define LCD_FLUSH_TASK true
+  #define LCD_FLUSH_TASK_AFFINITY CONFIG_LVGL_DISPLAY_FLUSH_TASK_AFFINITY
+  #define LCD_FLUSH_TASK_PRIORITY CONFIG_LVGL_DISPLAY_FLUSH_TASK_PRIORITY
+  #define LCD_FLUSH_TASK_STACK CONFIG_LVGL_DISPLAY_FLUSH_TASK_STACK
+#else
+  #define LCD_FLUSH_TASK false
+  #define LCD_FLUSH_TASK_AFFINITY -1
+  #define LCD_FLUSH_TASK_PRIORITY 5
+  #define LCD_FLUSH_TASK_STACK 4096
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_ADAPTIVE_REFRESH
+  #define LCD_ADAPTIVE_REFRESH true
+  #define LCD_IDLE_PERIOD CONFIG_LVGL_DISPLAY_IDLE_PERIOD
+  #define LCD_IDLE_AFTER CONFIG_LVGL_DISPLAY_IDLE_AFTER
+#else
+  #define LCD_ADAPTIVE_REFRESH false
+  #define LCD_IDLE_PERIOD 0
+  #define LCD_IDLE_AFTER 0
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_FRAME_PACING
+  #define LCD_FRAME_PACING true
+#else
+  #define LCD_FRAME_PACING false
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_ARENA
+  #define LCD_ARENA true
+  #define LCD_ARENA_EXTRA (CONFIG_LVGL_DISPLAY_ARENA_EXTRA * 1024)
+#else
+  #define LCD_ARENA false
+  #define LCD_ARENA_EXTRA 0
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_TOUCH
+  #define LCD_TOUCH true
+#else
+  #define LCD_TOUCH false
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_TOUCH_DISPATCH
+  #define LCD_TOUCH_DISPATCH true
+#else
+  #define LCD_TOUCH_DISPATCH false
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_BACKLIGHT_PWM
+  #define LCD_BACKLIGHT_DIM_AFTER (CONFIG_LVGL_DISPLAY_BACKLIGHT_DIM_AFTER * 1000)
+  #define LCD_BACKLIGHT_DIM_LEVEL CONFIG_LVGL_DISPLAY_BACKLIGHT_DIM_LEVEL
+  #define LCD_BACKLIGHT_OFF_AFTER (CONFIG_LVGL_DISPLAY_BACKLIGHT_OFF_AFTER * 1000)
+  #define LCD_BACKLIGHT_FADE CONFIG_LVGL_DISPLAY_BACKLIGHT_FADE
+#else
+  #define LCD_BACKLIGHT_DIM_AFTER 0
+  #define LCD_BACKLIGHT_DIM_LEVEL 0
+  #define LCD_BACKLIGHT_OFF_AFTER 0
+  #define LCD_BACKLIGHT_FADE 0
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_GLYPH_CACHE_SPIRAM
+  #define LCD_GLYPH_CACHE_CAPS MALLOC_CAP_SPIRAM
+#else
+  #define LCD_GLYPH_CACHE_CAPS MALLOC_CAP_DEFAULT
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_GLYPH_CACHE_DEFAULT_FONT
+  #define LCD_GLYPH_CACHE_DEFAULT_FONT true
+#else
+  #define LCD_GLYPH_CACHE_DEFAULT_FONT false
+#endif
+
+#ifdef CONFIG_LVGL_DISPLAY_ARENA_LVGL_HEAP
+  #define LCD_ARENA_LVGL_HEAP true
+#else
+  #define LCD_ARENA_LVGL_HEAP false
+#endif
+
 namespace LVGLDisplay {
 
+  // Period the backlight's idle policy is applied at, also the longest wait to wake it.
+  static constexpr uint32_t BACKLIGHT_POLL_MS = 100;
+
+  // Lock usage, updated with the lock held apart from the timeouts. The spinlock keeps stats() from reading a 64 bit
+  // total half updated.
+  static LockStats lock_stats;
+  static portMUX_TYPE lock_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+  static std::atomic<uint32_t> lock_timeouts{0};
+  static uint32_t lock_depth = 0;
+  static int64_t lock_hold_start_us = 0;
+  static uint32_t lock_hold_wait_us = 0; /**< Wait of the outermost acquisition, for the trace. */
+
+  // The arena holds the active display's draw buffers, LVGL's heap if it is taken from the arena, and the extra space
+  // configured for further displays. Placed like the draw buffers would be.
+  static constexpr size_t ARENA_BUFFERS = ActiveTraits::double_buffer ? ActiveTraits::buffer_count : 1;
+  static constexpr size_t ARENA_BYTES = MemoryArena::align(ActiveDisplay::BUFFER_PIXELS * sizeof(lv_color_t)) * ARENA_BUFFERS +
+                                        (LCD_ARENA_LVGL_HEAP ? MemoryArena::align(LV_MEM_SIZE) : 0) +
+                                        MemoryArena::align(LCD_ARENA_EXTRA);
+  static constexpr uint32_t ARENA_CAPS = ActiveTraits::dma       ? MALLOC_CAP_DMA
+                                         : ActiveTraits::spi_ram ? MALLOC_CAP_SPIRAM
+                                                                 : MALLOC_CAP_DEFAULT;
+  static_assert(!LCD_ARENA_LVGL_HEAP || !LV_MEM_CUSTOM, "LVGL's heap can only be taken from the arena with LV_MEM_CUSTOM off");
+
+#ifdef CONFIG_LVGL_DISPLAY_ARENA_STATIC
+  static_assert(!ActiveTraits::spi_ram, "A statically reserved arena is in internal memory, the board places its buffers in PSRAM");
+  alignas(MemoryArena::ALIGNMENT) static uint8_t arena_memory[ARENA_BYTES];
+#endif
+
+  static esp_err_t reserve_arena(MemoryArena& arena) {
+#ifdef CONFIG_LVGL_DISPLAY_ARENA_STATIC
+    return arena.adopt(arena_memory, sizeof(arena_memory), ARENA_CAPS);
+#else
+    return arena.create(ARENA_BYTES, ARENA_CAPS);
+#endif
+  }
+
   esp_err_t Controller::initialise() {
     ESP_LOGI(TAG, "Initialize LVGL library");
     if(_display.error()) {
       return _display.error();
     }
 
+    // Reserve the arena before LVGL and the port allocate anything, while the heap is still in one piece.
+    esp_err_t err;
+    if(LCD_ARENA && !_memory.created()) {
+      err = reserve_arena(_memory);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to reserve memory arena.");
+        return err;
+      }
+    }
+
+    // Geometry and placement are compile time constants of the active board. With the arena, the port only
+    // allocates a one line buffer, replaced by buffers from the arena once the display is added.
     lvgl_port_display_cfg_t disp_cfg = {.io_handle = _display.io_handle(),
                                         .panel_handle = _display.panel_handle(),
-                                        .buffer_size = _display.buffer_size(),
-                                        .double_buffer = _display.double_buffer(),
-                                        .hres = _display.hres(),
-                                        .vres = _display.vres(),
-                                        .monochrome = _display.monochrome(),
+                                        .buffer_size = LCD_ARENA ? ActiveTraits::hres : ActiveDisplay::BUFFER_PIXELS,
+                                        .double_buffer = LCD_ARENA ? false : ActiveTraits::double_buffer,
+                                        .hres = ActiveTraits::hres,
+                                        .vres = ActiveTraits::vres,
+                                        .monochrome = ActiveTraits::monochrome,
                                         .rotation =
                                           {
-                                            .swap_xy = _display.swap_xy(),
-                                            .mirror_x = _display.mirror_x(),
-                                            .mirror_y = _display.mirror_y(),
+                                            .swap_xy = ActiveTraits::swap_xy,
+                                            .mirror_x = ActiveTraits::mirror_x,
+                                            .mirror_y = ActiveTraits::mirror_y,
                                           },
                                         .flags = {
-                                          .buff_dma = _display.dma(),
-                                          .buff_spiram = _display.spi_ram(),
+                                          .buff_dma = ActiveTraits::dma,
+                                          .buff_spiram = ActiveTraits::spi_ram,
                                         }};
 
     lvgl_port_cfg_t lvgl_cfg = {
@@ -43,21 +179,394 @@ namespace LVGLDisplay {
       .timer_period_ms = CONFIG_LVGL_DISPLAY_TIMER_PERIOD,
     };
 
-    esp_err_t err = lvgl_port_init(&lvgl_cfg);
+    err = lvgl_port_init(&lvgl_cfg);
     if(err != ESP_OK) {
       return err;
     }
 
+    if(CONFIG_LVGL_DISPLAY_FRAME_LOG_LENGTH) {
+      err = _frames.create(CONFIG_LVGL_DISPLAY_FRAME_LOG_LENGTH);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate frame log.");
+        return err;
+      }
+    }
+
+    if(CONFIG_LVGL_DISPLAY_COMMAND_QUEUE_LENGTH) {
+      err = _commands.create(CONFIG_LVGL_DISPLAY_COMMAND_QUEUE_LENGTH);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate command queue.");
+        return err;
+      }
+    }
+
+    if(CONFIG_LVGL_DISPLAY_GLYPH_CACHE) {
+      GlyphCache::Config glyph_cfg;
+      glyph_cfg.budget = CONFIG_LVGL_DISPLAY_GLYPH_CACHE * 1024;
+      glyph_cfg.caps = LCD_GLYPH_CACHE_CAPS;
+      err = _glyphs.create(glyph_cfg);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate glyph cache.");
+        return err;
+      }
+      if(LCD_GLYPH_CACHE_DEFAULT_FONT) {
+        _glyphs.add_font(LV_FONT_DEFAULT);
+      }
+    }
+
+    // The LVGL task is already running, hold the lock while the display is set up.
+    {
+      Lock lock;
+      auto disp = lvgl_port_add_disp(&disp_cfg);
+      if(!disp) {
+        return ESP_FAIL;
+      }
+
+      DisplayConfig config;
+      config.buffer_count = ActiveTraits::buffer_count;
+      config.flush_task = LCD_FLUSH_TASK;
+      config.flush.core = LCD_FLUSH_TASK_AFFINITY;
+      config.flush.priority = LCD_FLUSH_TASK_PRIORITY;
+      config.flush.stack = LCD_FLUSH_TASK_STACK;
+      config.pacing = ActiveDisplay::pacer_config();
+      config.pacing.enabled = LCD_FRAME_PACING;
+      config.vsync = _display.vsync_source();
+      err = attach(_display, disp, config, LCD_ARENA);
+      if(err != ESP_OK) {
+        return err;
+      }
+      _memory.report();
+
+      if(_display.pwm_backlight()) {
+        _backlight_timer = lv_timer_create(backlight_callback, BACKLIGHT_POLL_MS, this);
+        if(!_backlight_timer) {
+          return ESP_ERR_NO_MEM;
+        }
+        Backlight::Policy policy;
+        policy.dim_after_ms = LCD_BACKLIGHT_DIM_AFTER;
+        policy.dim_level = LCD_BACKLIGHT_DIM_LEVEL;
+        policy.off_after_ms = LCD_BACKLIGHT_OFF_AFTER;
+        policy.fade_ms = LCD_BACKLIGHT_FADE;
+        backlight_policy(policy);
+      }
+    }
+
+    // Touch takes the lock to register its input, after resetting its controller, so it starts with the lock given.
+    TouchSource* touch_source = _display.touch_source();
+    if(LCD_TOUCH && touch_source) {
+      // The dispatch task renders like the LVGL task, so it gets the same priority, stack and core.
+      TouchInput::Config touch_config;
+      touch_config.dispatch_task = LCD_TOUCH_DISPATCH;
+      touch_config.core = CONFIG_LVGL_DISPLAY_TASK_AFFINITY;
+      touch_config.priority = CONFIG_LVGL_DISPLAY_TASK_PRIORITY;
+      touch_config.stack = CONFIG_LVGL_DISPLAY_TASK_STACK;
+      err = _touch.start(touch_config, touch_source);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start touch input.");
+        return err;
+      }
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t Controller::add_display(Display& display) { return add_display(display, DisplayConfig()); }
+
+  esp_err_t Controller::add_display(Display& display, const DisplayConfig& config) {
+    if(_display_count == 0) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(display.error()) {
+      return display.error();
+    }
+    if(_display_count == MAX_DISPLAYS) {
+      return ESP_ERR_NO_MEM;
+    }
+
+    // Each display gets its own draw buffers, from the arena while it has room for them and from the port otherwise.
+    const size_t buffers = display.double_buffer() ? (config.buffer_count > 2 ? config.buffer_count : 2) : 1;
+    const bool in_arena =
+      _memory.created() && _memory.available() >= MemoryArena::align(display.buffer_size() * sizeof(lv_color_t)) * buffers;
+    lvgl_port_display_cfg_t disp_cfg = {.io_handle = display.io_handle(),
+                                        .panel_handle = display.panel_handle(),
+                                        .buffer_size = (uint32_t)(in_arena ? display.hres() : display.buffer_size()),
+                                        .double_buffer = in_arena ? false : display.double_buffer(),
+                                        .hres = (uint32_t)display.hres(),
+                                        .vres = (uint32_t)display.vres(),
+                                        .monochrome = display.monochrome(),
+                                        .rotation =
+                                          {
+                                            .swap_xy = display.swap_xy(),
+                                            .mirror_x = display.mirror_x(),
+                                            .mirror_y = display.mirror_y(),
+                                          },
+                                        .flags = {
+                                          .buff_dma = display.dma(),
+                                          .buff_spiram = display.spi_ram(),
+                                        }};
+
+    Lock lock;
     auto disp = lvgl_port_add_disp(&disp_cfg);
-    _display.display(disp);
-    return err;
+    if(!disp) {
+      return ESP_FAIL;
+    }
+    return attach(display, disp, config, in_arena);
+  }
+
+  esp_err_t Controller::attach(Display& display, lv_disp_t* disp, const DisplayConfig& config, bool in_arena) {
+    display.display(disp);
+
+    if(in_arena) {
+      esp_err_t err = display.place_buffers(_memory, _display_count);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to place draw buffers in memory arena.");
+        return err;
+      }
+    }
+
+    // Route flushes through the display, so the flush path can be measured and extended.
+    disp->driver->flush_cb = flush_callback;
+    // The display rotates in the panel, with its gaps, or with its own kernel, rather than the port or LVGL.
+    disp->driver->drv_update_cb = update_callback;
+    disp->driver->sw_rotate = 0;
+    if(_frames.created()) {
+      disp->driver->wait_cb = wait_callback;
+      display.frame_log(&_frames);
+    }
+
+    // Draw the letters of the cached fonts from the glyph atlas, the rest as LVGL would.
+    if(_glyphs.created() && disp->driver->draw_ctx->draw_letter != draw_letter_callback) {
+      _draw_letter = disp->driver->draw_ctx->draw_letter;
+      disp->driver->draw_ctx->draw_letter = draw_letter_callback;
+    }
+
+    // Coalesce invalidated areas ahead of each refresh.
+    AreaCoalescer::Config coalesce_cfg;
+    coalesce_cfg.enabled = LCD_COALESCE;
+    coalesce_cfg.transaction_cost = LCD_COALESCE_TRANSACTION_COST;
+    coalesce_cfg.bytes_per_pixel = sizeof(lv_color_t);
+    coalesce_cfg.buffer_pixels = display.buffer_size();
+    display.coalescer().configure(coalesce_cfg);
+    lv_timer_set_cb(disp->refr_timer, refresh_timer_callback);
+    if(config.refresh_period_ms) {
+      lv_timer_set_period(disp->refr_timer, config.refresh_period_ms);
+    }
+
+    // Sleep through static screens, and pace active ones no faster than the bus can carry.
+    RefreshScheduler::Config schedule_cfg;
+    schedule_cfg.enabled = LCD_ADAPTIVE_REFRESH;
+    schedule_cfg.active_period_ms = config.refresh_period_ms ? config.refresh_period_ms : LV_DISP_DEF_REFR_PERIOD;
+    schedule_cfg.idle_period_ms = LCD_IDLE_PERIOD;
+    schedule_cfg.idle_after_ms = LCD_IDLE_AFTER;
+    display.scheduler().configure(schedule_cfg);
+
+    if(config.buffer_count > 2) {
+      esp_err_t err = display.start_buffer_ring(config.buffer_count);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate buffer ring.");
+        return err;
+      }
+    }
+
+    if(config.pacing.enabled) {
+      esp_err_t err = _pacers[_display_count].start(display, config.pacing, config.vsync);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start frame pacing.");
+        return err;
+      }
+    }
+
+    if(config.flush_task) {
+      esp_err_t err = display.start_flush_task(config.flush);
+      if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start flush task.");
+        return err;
+      }
+    }
+
+    _displays[_display_count++] = &display;
+    return ESP_OK;
+  }
+
+  esp_err_t Controller::refresh() {
+    if(_display_count == 0) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    for(size_t i = 0; i < _display_count; i++) {
+      // An explicit refresh is drawn, so it waits for the panel rather than being held back.
+      _displays[i]->bring_up().wait_ready(portMAX_DELAY);
+      refresh_callback(_displays[i]->display()->refr_timer);
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t Controller::refresh(Display& display) {
+    lv_disp_t* disp = display.display();
+    if(!disp || find(disp) != &display) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    display.bring_up().wait_ready(portMAX_DELAY);
+    refresh_callback(disp->refr_timer);
+    return ESP_OK;
+  }
+
+  Display* Controller::find(lv_disp_t* disp) {
+    for(size_t i = 0; i < _display_count; i++) {
+      if(_displays[i]->display() == disp) {
+        return _displays[i];
+      }
+    }
+    return NULL;
+  }
+
+  void Controller::refresh_callback(lv_timer_t* timer) {
+    lv_disp_t* disp = (lv_disp_t*)timer->user_data;
+    Controller& controller = instance();
+    // Posted updates land in this refresh, the lock is already held by the LVGL task. Those posted from here on wake
+    // the LVGL task again.
+    controller._waking.store(false);
+    controller._commands.apply();
+    for(size_t i = 0; i < controller._display_count; i++) {
+      Display* display = controller._displays[i];
+      if(display->display() == disp) {
+        // Invalidated areas wait for the panel bring-up, without holding the lock through it, and while pixels are
+        // pushed to the whole panel.
+        if(!display->bring_up().ready() || display->taken_over()) {
+          return;
+        }
+        if(i == 0 && !controller._boot_reported) {
+          controller.report_bring_up();
+        }
+        const uint64_t lock_wait_us = Lock::stats().wait_total_us;
+        display->begin_frame(i, lock_wait_us - controller._lock_wait_us);
+        controller._lock_wait_us = lock_wait_us;
+        display->scheduler().refresh(disp, timer, display->frame_flush_us());
+        display->coalescer().coalesce(disp);
+        break;
+      }
+    }
+    _lv_disp_refr_timer(timer);
+  }
+
+  void Controller::report_bring_up() {
+    const BringUpTiming timing = _display.bring_up().timing();
+    if(!timing.first_frame_us) {
+      return;
+    }
+    _boot_reported = true;
+    ESP_LOGI(TAG, "Panel ready after %lld us, first pixel after %lld us, first frame after %lld us (flush waited %u us)",
+             (long long)(timing.panel_ready_us - timing.start_us), (long long)(timing.first_pixel_us() - timing.start_us),
+             (long long)(timing.first_frame_us - timing.start_us), (unsigned)timing.flush_wait_us);
+  }
+
+  void Controller::flush_callback(lv_disp_drv_t* drv, const lv_area_t* area, lv_color_t* color_map) {
+    Controller& controller = instance();
+    if(controller._display.display()->driver == drv) {
+      // Through the concrete board type, so the flush is specialised for the board.
+      DisplayFactory::active_display().flush(area, color_map);
+      return;
+    }
+    for(size_t i = 1; i < controller._display_count; i++) {
+      if(controller._displays[i]->display()->driver == drv) {
+        controller._displays[i]->flush(area, color_map);
+        return;
+      }
+    }
+  }
+
+  void Controller::draw_letter_callback(lv_draw_ctx_t* draw_ctx, const lv_draw_label_dsc_t* dsc, const lv_point_t* pos,
+                                        uint32_t letter) {
+    Controller& controller = instance();
+    if(!controller._glyphs.draw(draw_ctx, dsc, pos, letter)) {
+      controller._draw_letter(draw_ctx, dsc, pos, letter);
+    }
+  }
+
+  void Controller::wait_callback(lv_disp_drv_t* drv) {
+    Controller& controller = instance();
+    for(size_t i = 0; i < controller._display_count; i++) {
+      if(controller._displays[i]->display()->driver == drv) {
+        controller._displays[i]->wait_for_buffer();
+        return;
+      }
+    }
+  }
+
+  void Controller::update_callback(lv_disp_drv_t* drv) {
+    Controller& controller = instance();
+    for(size_t i = 0; i < controller._display_count; i++) {
+      if(controller._displays[i]->display()->driver == drv) {
+        if(controller._displays[i]->rotation().orient((lv_disp_rot_t)drv->rotated) != ESP_OK) {
+          ESP_LOGE(TAG, "Failed to rotate display %u.", (unsigned)i);
+        }
+        return;
+      }
+    }
   }
 
   esp_err_t Controller::backlight(const bool enable) {
     if(_display.error()) {
       return _display.error();
     }
-    return _display.backlight(enable);
+    return _display.bring_up().switch_backlight(enable);
+  }
+
+  esp_err_t Controller::backlight(uint8_t level, uint32_t fade_ms) {
+    if(_display.error()) {
+      return _display.error();
+    }
+    return _display.bring_up().switch_backlight(level, fade_ms);
+  }
+
+  esp_err_t Controller::backlight_policy(const Backlight::Policy& policy) {
+    Backlight* backlight = _display.pwm_backlight();
+    if(!backlight) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    if(!_backlight_timer) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    backlight->policy(policy);
+    // The LVGL task is not woken for a policy which never dims.
+    Lock lock;
+    if(policy.enabled()) {
+      lv_timer_resume(_backlight_timer);
+    }
+    else {
+      lv_timer_pause(_backlight_timer);
+    }
+    return ESP_OK;
+  }
+
+  void Controller::backlight_callback(lv_timer_t* timer) {
+    Controller& controller = *(Controller*)timer->user_data;
+    const uint32_t inactive_ms = lv_disp_get_inactive_time(controller._display.display());
+    if(controller._display.pwm_backlight()->idle(inactive_ms) != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to apply backlight policy.");
+    }
+  }
+
+  void Controller::refresh_timer_callback(lv_timer_t* timer) {
+    // Only the LVGL task runs LVGL's timers, so this is the task posted updates wake.
+    instance()._lvgl_task.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+    refresh_callback(timer);
+  }
+
+  void Controller::wake() {
+    TaskHandle_t task = _lvgl_task.load(std::memory_order_acquire);
+    if(!LCD_ADAPTIVE_REFRESH || !task || _waking.exchange(true)) {
+      return;
+    }
+    // Idle refresh timers run only every idle period and the LVGL task sleeps until the next one is due, so make the
+    // idle ones due and cut the sleep short. Every display, as the updates may invalidate any of them; the first refresh
+    // applies them. Readying a timer is a single store, which at worst the timer handler overwrites with the time it
+    // ran, leaving the update to the next idle refresh.
+    for(size_t i = 0; i < _display_count; i++) {
+      Display* display = _displays[i];
+      if(display->scheduler().idle()) {
+        lv_timer_ready(display->display()->refr_timer);
+      }
+    }
+    xTaskAbortDelay(task);
   }
 
   Controller& Controller::instance() {
@@ -65,14 +574,87 @@ namespace LVGLDisplay {
     return _instance;
   }
 
-  Controller::Controller() : _display(DisplayFactory::active_display()) {}
+  Controller::Controller() : _display(DisplayFactory::active_display()), _touch(_display) {}
+
+  // Take the lock and account the wait. lvgl_port_lock() treats a timeout of 0 as waiting forever.
+  static bool take_lock(uint32_t timeout_ms) {
+    const int64_t start = esp_timer_get_time();
+    if(!lvgl_port_lock(timeout_ms)) {
+      lock_timeouts++;
+      return false;
+    }
+    const int64_t now = esp_timer_get_time();
+    const uint32_t waited = now - start;
+    if(lock_depth++ == 0) {
+      lock_hold_start_us = now;
+      lock_hold_wait_us = waited;
+    }
+    portENTER_CRITICAL(&lock_stats_lock);
+    lock_stats.acquisitions++;
+    lock_stats.wait_total_us += waited;
+    if(waited >= Lock::CONTENDED_US) {
+      lock_stats.contended++;
+    }
+    if(waited > lock_stats.wait_max_us) {
+      lock_stats.wait_max_us = waited;
+    }
+    portEXIT_CRITICAL(&lock_stats_lock);
+    return true;
+  }
+
+  static void give_lock() {
+    if(lock_depth && --lock_depth == 0) {
+      const uint32_t held = esp_timer_get_time() - lock_hold_start_us;
+      portENTER_CRITICAL(&lock_stats_lock);
+      lock_stats.hold_total_us += held;
+      if(held > lock_stats.hold_max_us) {
+        lock_stats.hold_max_us = held;
+      }
+      portEXIT_CRITICAL(&lock_stats_lock);
+      // Passed on before the lock is given, a trace is only written with it held.
+      Controller& controller = Controller::instance();
+      for(size_t i = 0; i < controller.display_count(); i++) {
+        controller.display(i).lock_released(lock_hold_wait_us, held);
+      }
+    }
+    lvgl_port_unlock();
+  }
+
+  Lock::Lock() : _locked(take_lock(0)) {}
+
+  Lock::Lock(uint32_t timeout_ms) : _locked(take_lock(timeout_ms ? timeout_ms : 1)) {}
 
-  Lock::Lock() { lvgl_port_lock(0); }
-  
-  void Lock::acquire() { lvgl_port_lock(0); }
+  void Lock::acquire() { take_lock(0); }
 
-  void Lock::release() { lvgl_port_unlock(); }
+  bool Lock::try_acquire(uint32_t timeout_ms) { return take_lock(timeout_ms ? timeout_ms : 1); }
 
-  Lock::~Lock() { lvgl_port_unlock(); }
+  void Lock::release() { give_lock(); }
+
+  LockStats Lock::stats() {
+    portENTER_CRITICAL(&lock_stats_lock);
+    LockStats stats = lock_stats;
+    portEXIT_CRITICAL(&lock_stats_lock);
+    stats.timeouts = lock_timeouts;
+    return stats;
+  }
+
+  void Lock::reset_stats() {
+    portENTER_CRITICAL(&lock_stats_lock);
+    lock_stats = LockStats();
+    portEXIT_CRITICAL(&lock_stats_lock);
+    lock_timeouts = 0;
+  }
+
+  Lock::~Lock() {
+    if(_locked) {
+      give_lock();
+    }
+  }
 
 };  // namespace LVGLDisplay
+
+extern "C" void* lvgl_display_heap(size_t size) {
+  // LVGL initialises its heap from lvgl_port_init(), after the arena is reserved.
+  void* heap = LVGLDisplay::Controller::instance().memory().allocate("lvgl heap", 0, size);
+  return heap ? heap : heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+}
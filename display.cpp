@@ -0,0 +1,570 @@
+#include <display.hpp>
+#include <pixel_convert.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+#include "esp_lcd_panel_commands.h"
+#include "esp_lvgl_port.h"
+#include "esp_timer.h"
+
+namespace LVGLDisplay {
+
+  Display::Display() : _bring_up(*this), _rotation(*this), _packer(*this), _completion(xSemaphoreCreateBinary()) {}
+
+  Display::~Display() {
+    if(_completion) {
+      vSemaphoreDelete(_completion);
+    }
+  }
+
+  int64_t Display::time_us() const { return esp_timer_get_time(); }
+
+  void Display::flush(const lv_area_t* area, lv_color_t* color_map) {
+    _swap_bytes ? flush_as<true>(area, color_map) : flush_as<false>(area, color_map);
+  }
+
+  esp_err_t Display::init_main(void* context) { return ((Display*)context)->init_panel(); }
+
+  esp_err_t Display::place_buffers(MemoryArena& arena, uint8_t owner) {
+    if(!_display || _flush_queue || _ring.active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    const size_t bytes = buffer_size() * sizeof(lv_color_t);
+    void* buf1 = arena.allocate("draw buffer 1", owner, bytes);
+    void* buf2 = double_buffer() ? arena.allocate("draw buffer 2", owner, bytes) : NULL;
+    if(!buf1 || (double_buffer() && !buf2)) {
+      return ESP_ERR_NO_MEM;
+    }
+    lv_disp_draw_buf_t* draw_buf = _display->driver->draw_buf;
+    void* port_buf1 = draw_buf->buf1;
+    void* port_buf2 = draw_buf->buf2;
+    lv_disp_draw_buf_init(draw_buf, buf1, buf2, buffer_size());
+    // The buffers the port allocated are no longer used, unless they were placed before.
+    if(!arena.contains(port_buf1)) {
+      heap_caps_free(port_buf1);
+    }
+    if(!arena.contains(port_buf2)) {
+      heap_caps_free(port_buf2);
+    }
+    _arena = &arena;
+    _arena_owner = owner;
+    return ESP_OK;
+  }
+
+  esp_err_t Display::start_buffer_ring(size_t count) {
+    if(!_display || _flush_queue || !double_buffer()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    const uint32_t caps = dma() ? MALLOC_CAP_DMA : spi_ram() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_DEFAULT;
+    return _ring.create(_display->driver->draw_buf, count, caps, _arena, _arena_owner);
+  }
+
+  esp_err_t Display::start_flush_task(const FlushTaskConfig& config) {
+    if(_flush_queue) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    // One request per draw buffer is enough, LVGL or the ring waits for a buffer to be flushed before reusing it.
+    _flush_queue = xQueueCreate(_ring.active() ? _ring.depth() : double_buffer() ? 2 : 1, sizeof(FlushRequest));
+    if(!_flush_queue) {
+      return ESP_ERR_NO_MEM;
+    }
+    const BaseType_t core = config.core < 0 ? tskNO_AFFINITY : config.core;
+    if(xTaskCreatePinnedToCore(flush_task_main, "lvgl_flush", config.stack, this, config.priority, NULL, core) != pdPASS) {
+      vQueueDelete(_flush_queue);
+      _flush_queue = NULL;
+      return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+  }
+
+  void Display::flush_task_main(void* arg) {
+    Display* display = (Display*)arg;
+    FlushRequest request;
+    while(true) {
+      if(xQueueReceive(display->_flush_queue, &request, portMAX_DELAY) == pdTRUE) {
+        const FrameRecord* frame = request.last ? &request.frame : NULL;
+        const lv_area_t* window = request.first ? &request.window : NULL;
+        display->_swap_bytes ? display->transfer<true>(&request.area, request.color_map, frame, window)
+                             : display->transfer<false>(&request.area, request.color_map, frame, window);
+      }
+    }
+  }
+
+  template <bool SWAP>
+  void Display::flush_as(const lv_area_t* area, lv_color_t* color_map) {
+    const int64_t start = time_us();
+    _bring_up.flush_started(start);
+    const uint32_t in_flight = ++_flushes_started - _flushes_done;
+    FlushRequest request = {*area, color_map, _frame.areas == 0, lv_disp_flush_is_last(_display->driver), *area, FrameRecord()};
+    _frame.wait_last_us = 0;
+    _frame.areas++;
+    if(in_flight > _frame.buffers) {
+      _frame.buffers = in_flight;
+    }
+
+    // The hooks are told the frame starts with every area LVGL is about to render in this refresh.
+    if(request.first && _hook_count) {
+      for(uint16_t i = 0; i < _display->inv_p; i++) {
+        if(!_display->inv_area_joined[i]) {
+          _lv_area_join(&request.window, &request.window, &_display->inv_areas[i]);
+        }
+      }
+    }
+
+    // The LVGL side of the record is complete once the last area is rendered, the rest is added on completion.
+    if(request.last) {
+      FrameRecord& frame = request.frame;
+      frame.frame = _frame.frame++;
+      frame.display = _frame.index;
+      frame.areas = _frame.areas;
+      frame.buffers = _frame.buffers;
+      frame.start_us = _frame.start_us ? _frame.start_us : start;
+      frame.render_us = _frame.start_us ? start - _frame.start_us - _frame.callback_us - _frame.spin_us : 0;
+      frame.dma_wait_us = _frame.dma_wait_us;
+      frame.lock_wait_us = _frame.lock_wait_us;
+      frame.input_us = _frame.input_us;
+      // The frame number and display index carry over to the next frame, everything else starts again.
+      const uint32_t f = _frame.frame;
+      const uint8_t i = _frame.index;
+      _frame = FrameState();
+      _frame.frame = f;
+      _frame.index = i;
+      for(size_t h = 0; h < _hook_count; h++) {
+        _hooks[h]->frame_rendered(frame);
+      }
+    }
+
+    if(_flush_queue) {
+      xQueueSend(_flush_queue, &request, portMAX_DELAY);
+    }
+    else {
+      transfer<SWAP>(area, color_map, request.last ? &request.frame : NULL, request.first ? &request.window : NULL);
+    }
+    // With a ring the rendered buffer now belongs to the flush path, so LVGL can carry on in the next one.
+    if(_ring.active()) {
+      const uint64_t stalled = _ring.stats().stall_total_us;
+      _ring.rotate(_display->driver->draw_buf);
+      lvgl_port_flush_ready(_display);
+      // The buffer after the last area is rendered into by the next frame, which the wait is counted against.
+      _frame.dma_wait_us += _ring.stats().stall_total_us - stalled;
+    }
+    _frame.callback_us += time_us() - start;
+  }
+
+  template void Display::flush_as<true>(const lv_area_t* area, lv_color_t* color_map);
+  template void Display::flush_as<false>(const lv_area_t* area, lv_color_t* color_map);
+
+  void Display::begin_frame(uint8_t index, uint32_t lock_wait_us) {
+    _frame.start_us = time_us();
+    _frame.callback_us = 0;
+    _frame.spin_us = 0;
+    _frame.wait_last_us = 0;
+    _frame.lock_wait_us = lock_wait_us;
+    _frame.index = index;
+    _frame.areas = 0;
+    _frame.buffers = 0;
+    // Before the areas are coalesced.
+    for(size_t i = 0; i < _hook_count; i++) {
+      _hooks[i]->refresh_started(_display);
+    }
+  }
+
+  FlushTiming Display::flush_timing() const {
+    portENTER_CRITICAL_SAFE(&_records_lock);
+    const FlushTiming timing = _timing;
+    portEXIT_CRITICAL_SAFE(&_records_lock);
+    return timing;
+  }
+
+  void Display::reset_flush_timing() {
+    portENTER_CRITICAL_SAFE(&_records_lock);
+    _timing = FlushTiming();
+    portEXIT_CRITICAL_SAFE(&_records_lock);
+  }
+
+  void Display::mark_input(int64_t time_us) {
+    if(!_frame.input_us) {
+      _frame.input_us = time_us;
+    }
+  }
+
+  InputTiming Display::input_timing() const {
+    portENTER_CRITICAL_SAFE(&_records_lock);
+    const InputTiming timing = _input_timing;
+    portEXIT_CRITICAL_SAFE(&_records_lock);
+    return timing;
+  }
+
+  void Display::reset_input_timing() {
+    portENTER_CRITICAL_SAFE(&_records_lock);
+    _input_timing = InputTiming();
+    portEXIT_CRITICAL_SAFE(&_records_lock);
+  }
+
+  void Display::wait_for_buffer() {
+    // LVGL calls the wait callback in a tight loop, so the time between consecutive calls is time spent waiting.
+    const int64_t now = time_us();
+    if(_frame.wait_last_us) {
+      const uint32_t waited = now - _frame.wait_last_us;
+      _frame.spin_us += waited;
+      _frame.dma_wait_us += waited;
+    }
+    _frame.wait_last_us = now;
+  }
+
+  template <bool SWAP>
+  void Display::transfer(const lv_area_t* area, lv_color_t* color_map, const FrameRecord* frame, const lv_area_t* window) {
+    // Waiting for the scanline is not part of the flush, the frame flush time is what a pacer plans with. The panel
+    // scans in the board's orientation, however the display is rotated.
+    if(window) {
+      const lv_area_t panel = _rotation.to_panel(*window);
+      for(size_t i = 0; i < _hook_count; i++) {
+        _hooks[i]->frame_starting(panel, _frame_flush_avg_us);
+      }
+    }
+
+    FlushRecord& record = _records[_record_tail % MAX_IN_FLIGHT];
+    record.buffer = color_map;
+    record.start_us = time_us();
+    record.pixels = lv_area_get_width(area) * lv_area_get_height(area);
+    record.bytes = 0;
+    record.last_transfer = 0;
+    record.sealed = false;
+    record.last = frame != NULL;
+    if(frame) {
+      record.frame = *frame;
+    }
+    portENTER_CRITICAL_SAFE(&_records_lock);
+    _record_tail++;
+    portEXIT_CRITICAL_SAFE(&_records_lock);
+
+    if(_shadow.allocated() && sizeof(lv_color_t) == sizeof(uint16_t)) {
+      ShadowFrame::Region regions[ShadowFrame::MAX_REGIONS];
+      const size_t count = _shadow.diff(*area, (uint16_t*)color_map, regions);
+      for(size_t i = 0; i < count; i++) {
+        draw_around<SWAP>(record, regions[i].area, regions[i].pixels);
+      }
+    }
+    else {
+      draw_around<SWAP>(record, *area, color_map);
+    }
+
+    // Only once every transfer is queued can a completion finish the flush.
+    portENTER_CRITICAL_SAFE(&_records_lock);
+    record.last_transfer = _submitted;
+    record.sealed = true;
+    portEXIT_CRITICAL_SAFE(&_records_lock);
+    retire();
+
+    // Recording overlaps the frame's last transfers.
+    if(frame && _hook_count) {
+      const int64_t now = time_us();
+      for(size_t i = 0; i < _hook_count; i++) {
+        _hooks[i]->frame_sent(frame->frame, now);
+      }
+    }
+  }
+
+  template <bool SWAP>
+  void Display::draw(FlushRecord& record, const lv_area_t& area, void* pixels) {
+    const size_t count = lv_area_get_width(&area) * lv_area_get_height(&area);
+    for(size_t i = 0; i < _hook_count; i++) {
+      _hooks[i]->area_sent(area, (const lv_color_t*)pixels, false);
+    }
+    // Rotated in software, the pixels are sent to the area in the board's orientation.
+    lv_area_t target = area;
+    if(_rotation.rotating() && _rotation.rotate(&target, pixels) != ESP_OK) {
+      return;
+    }
+    // RGB444 is packed straight from the byte order LVGL rendered in, without a swap pass.
+    if(SWAP && sizeof(lv_color_t) == sizeof(uint16_t) && _packer.format() == TransferFormat::RGB565) {
+      PixelConvert::swap_rgb565((uint16_t*)pixels, (const uint16_t*)pixels, count);
+    }
+    const size_t bytes = _packer.pack(pixels, count, LV_COLOR_16_SWAP);
+    record.bytes += bytes;
+    send(target, pixels, bytes);
+  }
+
+  esp_err_t Display::send(const lv_area_t& area, const void* data, size_t bytes) {
+    BusArbiter* arbiter = bus_arbiter();
+    if(_packer.format() == TransferFormat::RGB565 && !arbiter) {
+      _submitted++;
+      const esp_err_t err = esp_lcd_panel_draw_bitmap(_panel_handle, area.x1, area.y1, area.x2 + 1, area.y2 + 1, data);
+      if(err != ESP_OK) {
+        _submitted--;
+      }
+      return err;
+    }
+    // The window is set here as the panel driver sets it: the driver sizes colour transfers for 16 bits per pixel, and
+    // sends them whole.
+    const int x1 = area.x1 + _rotation.x_gap();
+    const int x2 = area.x2 + _rotation.x_gap();
+    const int y1 = area.y1 + _rotation.y_gap();
+    const int y2 = area.y2 + _rotation.y_gap();
+    const uint8_t caset[] = {(uint8_t)(x1 >> 8), (uint8_t)(x1 & 0xff), (uint8_t)(x2 >> 8), (uint8_t)(x2 & 0xff)};
+    const uint8_t raset[] = {(uint8_t)(y1 >> 8), (uint8_t)(y1 & 0xff), (uint8_t)(y2 >> 8), (uint8_t)(y2 & 0xff)};
+    const size_t chunk_bytes = arbiter ? arbiter->chunk_bytes() : 0;
+    const size_t chunk = chunk_bytes ? chunk_bytes : bytes;
+    // On a shared bus each chunk is queued on its own, the panel continues the window from the last pixel written.
+    esp_err_t err = ESP_OK;
+    for(size_t offset = 0; offset < bytes && err == ESP_OK; offset += chunk) {
+      const size_t length = std::min(chunk, bytes - offset);
+      if(arbiter) {
+        arbiter->begin_chunk();
+      }
+      if(!offset) {
+        err = esp_lcd_panel_io_tx_param(_io_handle, LCD_CMD_CASET, caset, sizeof(caset));
+        if(err == ESP_OK) {
+          err = esp_lcd_panel_io_tx_param(_io_handle, LCD_CMD_RASET, raset, sizeof(raset));
+        }
+      }
+      if(err == ESP_OK) {
+        _submitted++;
+        const uint8_t* pixels = (const uint8_t*)data + offset;
+        err = esp_lcd_panel_io_tx_color(_io_handle, offset ? LCD_CMD_RAMWRC : LCD_CMD_RAMWR, pixels, length);
+        if(err != ESP_OK) {
+          _submitted--;
+        }
+      }
+      if(arbiter) {
+        arbiter->end_chunk(length, err == ESP_OK);
+      }
+    }
+    return err;
+  }
+
+  template <bool SWAP>
+  void Display::draw_around(FlushRecord& record, const lv_area_t& area, void* pixels) {
+    const lv_area_t* excluded = this->excluded();
+    lv_area_t overlap;
+    if(!excluded || !_lv_area_intersect(&overlap, &area, excluded)) {
+      draw<SWAP>(record, area, pixels);
+      return;
+    }
+    // The rows above and below the excluded area are sent whole, the rows beside it only outside it.
+    lv_color_t* rows = (lv_color_t*)pixels;
+    const size_t width = lv_area_get_width(&area);
+    if(overlap.y1 > area.y1) {
+      draw<SWAP>(record, {area.x1, area.y1, area.x2, (lv_coord_t)(overlap.y1 - 1)}, rows);
+    }
+    const bool left = overlap.x1 > area.x1;
+    const bool right = overlap.x2 < area.x2;
+    lv_color_t* band = rows + (overlap.y1 - area.y1) * width;
+    if(left != right) {
+      // One side, packed in place as the shadow frame packs regions; rows only move towards the start of the band.
+      const lv_coord_t x1 = left ? area.x1 : overlap.x2 + 1;
+      const lv_coord_t x2 = left ? overlap.x1 - 1 : area.x2;
+      const size_t packed = x2 - x1 + 1;
+      for(lv_coord_t y = overlap.y1; y <= overlap.y2; y++) {
+        memmove(band + (y - overlap.y1) * packed, band + (y - overlap.y1) * width + (x1 - area.x1), packed * sizeof(lv_color_t));
+      }
+      draw<SWAP>(record, {x1, overlap.y1, x2, overlap.y2}, band);
+    }
+    else if(left) {
+      for(lv_coord_t y = overlap.y1; y <= overlap.y2; y++) {
+        lv_color_t* row = band + (y - overlap.y1) * width;
+        draw<SWAP>(record, {area.x1, y, (lv_coord_t)(overlap.x1 - 1), y}, row);
+        draw<SWAP>(record, {(lv_coord_t)(overlap.x2 + 1), y, area.x2, y}, row + (overlap.x2 + 1 - area.x1));
+      }
+    }
+    if(overlap.y2 < area.y2) {
+      draw<SWAP>(record, {area.x1, (lv_coord_t)(overlap.y2 + 1), area.x2, area.y2}, rows + (overlap.y2 + 1 - area.y1) * width);
+    }
+  }
+
+  esp_err_t Display::add_hook(FlushHook* hook) {
+    if(!hook) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    // The flush path calls the hooks while it transfers.
+    wait_flushed();
+    for(size_t i = 0; i < _hook_count; i++) {
+      if(_hooks[i] == hook) {
+        return ESP_ERR_INVALID_STATE;
+      }
+    }
+    if(_hook_count == MAX_HOOKS) {
+      return ESP_ERR_NO_MEM;
+    }
+    _hooks[_hook_count++] = hook;
+    return ESP_OK;
+  }
+
+  void Display::remove_hook(FlushHook* hook) {
+    wait_flushed();
+    for(size_t i = 0; i < _hook_count; i++) {
+      if(_hooks[i] == hook) {
+        std::copy(_hooks + i + 1, _hooks + _hook_count, _hooks + i);
+        _hooks[--_hook_count] = NULL;
+        return;
+      }
+    }
+  }
+
+  const lv_area_t* Display::excluded() const {
+    for(size_t i = 0; i < _hook_count; i++) {
+      const lv_area_t* area = _hooks[i]->excluded();
+      if(area) {
+        return area;
+      }
+    }
+    return NULL;
+  }
+
+  bool Display::taken_over() const {
+    const lv_area_t* area = excluded();
+    return area && area->x1 == 0 && area->y1 == 0 && area->x2 == (lv_coord_t)(width() - 1) &&
+           area->y2 == (lv_coord_t)(height() - 1);
+  }
+
+  void Display::lock_released(uint32_t wait_us, uint32_t hold_us) {
+    if(!_hook_count) {
+      return;
+    }
+    const int64_t now = time_us();
+    for(size_t i = 0; i < _hook_count; i++) {
+      _hooks[i]->lock_released(now, wait_us, hold_us);
+    }
+  }
+
+  esp_err_t Display::push(const lv_area_t& area, void* pixels, uint32_t* done_at) {
+    if(!_bring_up.ready()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    wait_flushed();
+    // The pixels are in the byte order the flush path sends LVGL's in.
+    for(size_t i = 0; i < _hook_count; i++) {
+      _hooks[i]->area_sent(area, (const lv_color_t*)pixels, _swap_bytes);
+    }
+    lv_area_t target = area;
+    if(_rotation.rotating()) {
+      const esp_err_t err = _rotation.rotate(&target, pixels);
+      if(err != ESP_OK) {
+        return err;
+      }
+    }
+    const size_t bytes = _packer.pack(pixels, lv_area_get_size(&area), true);
+    const esp_err_t err = send(target, pixels, bytes);
+    *done_at = _submitted;
+    return err;
+  }
+
+  bool Display::flush_ready() {
+    _completed++;
+    // A client waiting for the bus is woken first.
+    BusArbiter* arbiter = bus_arbiter();
+    bool woken = arbiter && arbiter->chunk_done();
+    woken |= retire();
+    if(_completion) {
+      if(xPortInIsrContext()) {
+        BaseType_t task_woken = pdFALSE;
+        xSemaphoreGiveFromISR(_completion, &task_woken);
+        woken |= task_woken == pdTRUE;
+      }
+      else {
+        xSemaphoreGive(_completion);
+      }
+    }
+    return woken;
+  }
+
+  void Display::wait_transferred(uint32_t count) {
+    wait_until([this, count] { return transferred(count); });
+  }
+
+  void Display::wait_flushed() {
+    wait_until([this] { return !flushing(); });
+  }
+
+  template <typename Done>
+  void Display::wait_until(Done done) {
+    while(!done()) {
+      if(!_completion) {
+        vTaskDelay(1);
+      }
+      // Every waiter wakes on the same semaphore: one done passes it on, and the timeout bounds the wait of one whose
+      // completion another took.
+      else if(xSemaphoreTake(_completion, pdMS_TO_TICKS(COMPLETION_WAIT_MS)) == pdTRUE && done()) {
+        xSemaphoreGive(_completion);
+      }
+    }
+  }
+
+  bool Display::retire() {
+    void* finished[MAX_IN_FLIGHT];
+    size_t count = 0;
+    const int64_t now = time_us();
+    // Each pass ends at a frame's last flush, so the frame is published to the log and hooks with the lock given.
+    bool done = true;
+    while(done) {
+      FrameRecord frame;
+      done = false;
+      portENTER_CRITICAL_SAFE(&_records_lock);
+      const uint32_t completed = _completed;
+      while(!done && _record_head != _record_tail) {
+        const FlushRecord& record = _records[_record_head % MAX_IN_FLIGHT];
+        if(!record.sealed || (int32_t)(completed - record.last_transfer) < 0) {
+          break;
+        }
+        const uint32_t latency = now - record.start_us;
+        _timing.flushes++;
+        _timing.pixels += record.pixels;
+        _timing.bytes += record.bytes;
+        _timing.latency_total_us += latency;
+        if(latency > _timing.latency_max_us) {
+          _timing.latency_max_us = latency;
+        }
+        if(!_frame_flush_start_us) {
+          _frame_flush_start_us = record.start_us;
+        }
+        _frame_bytes += record.bytes;
+        if(record.last) {
+          _bring_up.frame_done(now);
+          frame = record.frame;
+          frame.flush_us = now - _frame_flush_start_us;
+          frame.bytes = _frame_bytes;
+          if(frame.input_us) {
+            frame.input_latency_us = now - frame.input_us;
+            _input_timing.inputs++;
+            _input_timing.latency_total_us += frame.input_latency_us;
+            if(frame.input_latency_us > _input_timing.latency_max_us) {
+              _input_timing.latency_max_us = frame.input_latency_us;
+            }
+          }
+          // An eighth of each new frame, enough to follow the workload without reacting to one slow frame.
+          const uint32_t average = _frame_flush_avg_us;
+          _frame_flush_avg_us = average ? average - average / 8 + frame.flush_us / 8 : frame.flush_us;
+          _frame_flush_start_us = 0;
+          _frame_bytes = 0;
+          done = true;
+        }
+        finished[count++] = record.buffer;
+        _record_head++;
+      }
+      portEXIT_CRITICAL_SAFE(&_records_lock);
+      if(done) {
+        if(_frame_log) {
+          _frame_log->add(frame);
+        }
+        for(size_t i = 0; i < _hook_count; i++) {
+          _hooks[i]->frame_done(frame);
+        }
+      }
+    }
+    _flushes_done += count;
+
+    bool woken = false;
+    for(size_t i = 0; i < count; i++) {
+      if(_ring.active()) {
+        woken |= _ring.release(finished[i]);
+      }
+      else if(_display) {
+        lvgl_port_flush_ready(_display);
+      }
+    }
+    return woken;
+  }
+
+};  // namespace LVGLDisplay
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <buffer_planner.hpp>
+#include <controller.hpp>
+#include <simulated_panel.hpp>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+using LVGLDisplay::BufferPlanner;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Number of measured frames for each run, within the default frame log length.
+constexpr size_t FRAMES = 30;
+
+static void reset_measurements() {
+  Display().display().reset_flush_timing();
+  Display().reset_stats();
+}
+
+// Redraw a full width band of the given height every frame, with each flush alone on the bus.
+static BufferPlanner::Sample measure_band(lv_obj_t* band, size_t lines) {
+  lv_obj_set_size(band, lv_disp_get_hor_res(NULL), lines);
+  Display().refresh();
+  Display().display().wait_flushed();
+
+  reset_measurements();
+  for(size_t frame = 0; frame < FRAMES; frame++) {
+    lv_obj_set_style_bg_color(band, lv_color_hex(frame & 1 ? 0x2060a0 : 0xa06020), LV_PART_MAIN);
+    Display().refresh();
+    Display().display().wait_flushed();
+  }
+  const auto timing = Display().display().flush_timing();
+  const auto frames = Display().stats();
+
+  BufferPlanner::Sample sample;
+  sample.flushes = timing.flushes;
+  sample.bytes = timing.bytes;
+  sample.latency_total_us = timing.latency_total_us;
+  sample.render_total_us = (uint64_t)frames.render_avg_us * frames.frames;
+  return sample;
+}
+
+// Redraw the whole screen back to back, returning the frame rate.
+static double measure_full_screen(lv_obj_t* screen) {
+  auto& display = Display().display();
+  reset_measurements();
+  const int64_t start = display.time_us();
+  for(size_t frame = 0; frame < FRAMES; frame++) {
+    lv_obj_set_style_bg_color(screen, lv_color_hex(frame & 1 ? 0x202020 : 0x404040), LV_PART_MAIN);
+    Display().refresh();
+  }
+  display.wait_flushed();
+  const int64_t elapsed_us = display.time_us() - start;
+  return elapsed_us ? FRAMES * 1e6 / elapsed_us : 0.0;
+}
+
+static void print_plan(const BufferPlanner::Workload& workload, const char* kind, const BufferPlanner::Plan& plan) {
+  printf("{\"workload\":\"%s\",\"plan\":\"%s\",\"draw_buff_len\":%u,\"buffer_count\":%u,\"tqueue_depth\":%u,\"placement\":\"%s\",",
+         workload.name, kind, (unsigned)plan.buffer_lines, (unsigned)plan.buffer_count, (unsigned)plan.queue_depth,
+         BufferPlanner::placement_name(plan.placement));
+  printf("\"memory_bytes\":%u,\"frame_us\":%u,\"fps\":%.1f,\"bus_utilization\":%.3f}\n", (unsigned)plan.memory_bytes,
+         (unsigned)plan.frame_us, plan.fps, plan.bus_utilization);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  auto& display = Display().display();
+  auto* panel = LVGLDisplay::SimulatedPanel::from_handle(display.panel_handle());
+  const size_t lines = display.buffer_size() / display.hres();
+  const size_t buffers = display.buffer_ring().active() ? display.buffer_ring().depth() : display.double_buffer() ? 2 : 1;
+
+  BufferPlanner::Config config;
+  config.hres = display.hres();
+  config.vres = display.vres();
+  config.bytes_per_pixel = sizeof(lv_color_t);
+  if(panel) {
+    config.bus = panel->bus_config();
+  }
+  else {
+    // The bus the hardware was configured with.
+#if CONFIG_LVGL_DISPLAY_TTGO_TDISPLAY
+    config.bus.bus = LVGLDisplay::BusModel::Bus::SPI;
+    config.bus.clock_hz = CONFIG_LVGL_DISPLAY_SPI_CLOCK * 1000 * 1000;
+#elif CONFIG_LVGL_DISPLAY_TDISPLAY_S3
+    config.bus.clock_hz = CONFIG_LVGL_DISPLAY_PIXEL_CLOCK * 1000 * 1000;
+#endif
+#ifdef CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH
+    config.bus.queue_depth = CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH;
+#endif
+  }
+#if CONFIG_IDF_TARGET_LINUX
+  // The host has no DMA capable memory limit, plan for the internal memory of an ESP32-S3 left after WiFi.
+  config.internal_bytes = 128 * 1024;
+#else
+  // The largest block the draw buffers could take, with the configured buffers released.
+  config.internal_bytes = heap_caps_get_largest_free_block(MALLOC_CAP_DMA) + display.buffer_size() * sizeof(lv_color_t) * buffers;
+  #if CONFIG_SPIRAM && CONFIG_IDF_TARGET_ESP32S3
+  // Only the i80 bus on the S3 transfers from PSRAM.
+  if(config.bus.bus == LVGLDisplay::BusModel::Bus::I80) {
+    config.psram_bytes = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  }
+  #endif
+#endif
+  BufferPlanner planner(config);
+
+  // The planner drives LVGL directly, so hold the lock for the whole run.
+  auto lock = LVGLDisplay::Lock();
+  lv_obj_t* screen = lv_scr_act();
+  lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+  lv_obj_t* band = lv_obj_create(screen);
+  lv_obj_set_style_border_width(band, 0, LV_PART_MAIN);
+  lv_obj_set_style_radius(band, 0, LV_PART_MAIN);
+  lv_obj_set_pos(band, 0, 0);
+
+  // Calibrate from one line and whole buffer flushes, the two ends of the flush sizes a configuration produces.
+  BufferPlanner::Sample samples[2] = {measure_band(band, 1), measure_band(band, lines)};
+  lv_obj_del(band);
+  planner.calibrate(samples, 2);
+  const auto calibration = planner.calibration();
+  printf("{\"calibration\":{\"render_pixel_ns\":%.2f,\"render_stripe_ns\":%u,\"bus_byte_ns\":%.2f,\"flush_ns\":%u}}\n",
+         calibration.render_pixel_ns, (unsigned)calibration.render_stripe_ns, calibration.bus_byte_ns, (unsigned)calibration.flush_ns);
+
+  // Check the model against the configured buffers before trusting its recommendations.
+  const auto full_screen = BufferPlanner::Workload::full_screen(config.hres, config.vres);
+  const auto configured = planner.evaluate(full_screen, lines, buffers, config.bus.queue_depth);
+  print_plan(full_screen, "configured", configured);
+  printf("{\"workload\":\"%s\",\"plan\":\"measured\",\"fps\":%.1f}\n", full_screen.name, measure_full_screen(screen));
+
+  const BufferPlanner::Workload workloads[] = {full_screen, BufferPlanner::Workload::widgets(config.hres, config.vres)};
+  for(const auto& workload : workloads) {
+    print_plan(workload, "recommended", planner.recommend(workload));
+  }
+  fflush(stdout);
+
+  exit(0);
+}
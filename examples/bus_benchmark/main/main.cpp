@@ -0,0 +1,154 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <controller.hpp>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+  #include <simulated_panel.hpp>
+#else
+  #include "driver/spi_master.h"
+#endif
+
+using LVGLDisplay::BusArbiter;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Sensor reads for each run, one every tick while the screen is redrawn continuously.
+constexpr size_t READS = 200;
+constexpr size_t READ_BYTES = 4;
+
+// Chunk lengths swept, 0 sends colour transfers whole as an unshared bus would.
+constexpr uint32_t CHUNKS_US[] = {0, 2000, 1000, 500, 250, 100};
+constexpr BusArbiter::Priority PRIORITIES[] = {BusArbiter::Priority::NORMAL, BusArbiter::Priority::HIGH};
+
+#if !CONFIG_IDF_TARGET_LINUX
+// The sensor on the T-Display's SPI bus, selected by a free header pin.
+constexpr int SENSOR_CS_GPIO = 27;
+constexpr int SENSOR_CLOCK_HZ = 8 * 1000 * 1000;
+static spi_device_handle_t sensor = NULL;
+#endif
+
+// Redraw the whole screen on every refresh, alternating its colour.
+static void redraw_cb(lv_timer_t* timer) {
+  static bool toggle = false;
+  toggle = !toggle;
+  lv_obj_set_style_bg_color(lv_scr_act(), lv_color_hex(toggle ? 0x204080 : 0x802040), LV_PART_MAIN);
+}
+
+// Read the sensor once, returning the time waited for the bus.
+static uint32_t read_sensor(BusArbiter& arbiter, int client) {
+  auto& display = Display().display();
+  const int64_t start = display.time_us();
+#if CONFIG_IDF_TARGET_LINUX
+  arbiter.acquire(client);
+  const int64_t acquired = display.time_us();
+  LVGLDisplay::SimulatedPanel::from_handle(display.panel_handle())->device_transaction(READ_BYTES);
+  arbiter.release(client, READ_BYTES);
+  return acquired - start;
+#else
+  spi_transaction_t transaction = {};
+  transaction.length = READ_BYTES * 8;
+  transaction.flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+  // The transaction's own time on the bus is known, the rest was spent waiting for it.
+  arbiter.transmit(client, sensor, &transaction);
+  const int64_t transfer_us = (int64_t)READ_BYTES * 8 * 1000000 / SENSOR_CLOCK_HZ;
+  return std::max<int64_t>(display.time_us() - start - transfer_us, 0);
+#endif
+}
+
+// Read the sensor with one chunk length while the screen is redrawn, and print the result as a single JSON line.
+static void run(BusArbiter& arbiter, int client, BusArbiter::Priority priority, uint32_t chunk_us) {
+  auto& display = Display().display();
+  BusArbiter::Config config = arbiter.config();
+  config.chunk_us = chunk_us;
+  arbiter.configure(config);
+
+  // Settle a redraw started with the previous chunk length before measuring.
+  vTaskDelay(pdMS_TO_TICKS(100));
+  const LVGLDisplay::FlushTiming before = display.flush_timing();
+  arbiter.reset_stats();
+
+  static uint32_t waits[READS];
+  for(size_t i = 0; i < READS; i++) {
+    waits[i] = read_sensor(arbiter, client);
+    vTaskDelay(1);
+  }
+
+  const BusArbiter::Stats stats = arbiter.stats();
+  const LVGLDisplay::FlushTiming after = display.flush_timing();
+  std::sort(waits, waits + READS);
+  const BusArbiter::ClientStats& screen = stats.client[BusArbiter::DISPLAY_CLIENT];
+  const BusArbiter::ClientStats& reader = stats.client[client];
+  const uint64_t screen_pixels = (uint64_t)display.width() * display.height();
+  const uint64_t elapsed_us = stats.elapsed_us ? stats.elapsed_us : 1;
+
+  printf("{\"chunk_us\":%u,\"chunk_bytes\":%u,\"priority\":\"%s\",\"reads\":%u,", (unsigned)chunk_us,
+         (unsigned)arbiter.chunk_bytes(), priority == BusArbiter::Priority::HIGH ? "high" : "normal",
+         (unsigned)reader.transactions);
+  printf("\"wait_avg_us\":%u,\"wait_p50_us\":%u,\"wait_p95_us\":%u,\"wait_max_us\":%u,",
+         (unsigned)(reader.transactions ? reader.wait_us / reader.transactions : 0), (unsigned)waits[READS / 2],
+         (unsigned)waits[READS * 95 / 100], (unsigned)waits[READS - 1]);
+  printf("\"fps\":%.1f,\"display_chunks\":%u,\"display_busy_pct\":%.1f,\"display_wait_max_us\":%u,",
+         (after.pixels - before.pixels) * 1e6 / screen_pixels / elapsed_us, (unsigned)screen.transactions,
+         screen.busy_us * 100.0 / elapsed_us, (unsigned)screen.wait_max_us);
+  printf("\"sensor_busy_pct\":%.1f,\"flush_max_us\":%u}\n", reader.busy_us * 100.0 / elapsed_us,
+         (unsigned)after.latency_max_us);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+  BusArbiter* arbiter = Display().display().bus_arbiter();
+  if(!arbiter) {
+    printf("{\"error\":\"the display's bus is not shared\"}\n");
+    exit(1);
+  }
+
+#if !CONFIG_IDF_TARGET_LINUX
+  spi_device_interface_config_t device_config = {};
+  device_config.mode = 0;
+  device_config.clock_speed_hz = SENSOR_CLOCK_HZ;
+  device_config.spics_io_num = SENSOR_CS_GPIO;
+  device_config.queue_size = 1;
+  if(spi_bus_add_device(SPI2_HOST, &device_config, &sensor) != ESP_OK) {
+    printf("{\"error\":\"sensor device not added\"}\n");
+    exit(1);
+  }
+#endif
+
+  {
+    auto lock = LVGLDisplay::Lock();
+    lv_timer_create(redraw_cb, 1, NULL);
+  }
+
+  // A client per priority, the sensor is read from this task while the LVGL task redraws.
+  for(BusArbiter::Priority priority : PRIORITIES) {
+    int client;
+    if(arbiter->add_client(priority == BusArbiter::Priority::HIGH ? "sensor_high" : "sensor", priority, &client) !=
+       ESP_OK) {
+      printf("{\"error\":\"client not added\"}\n");
+      exit(1);
+    }
+    for(uint32_t chunk_us : CHUNKS_US) {
+      run(*arbiter, client, priority, chunk_us);
+    }
+  }
+  fflush(stdout);
+
+  exit(0);
+}
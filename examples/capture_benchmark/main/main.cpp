@@ -0,0 +1,175 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <controller.hpp>
+#include <frame_capture.hpp>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+using LVGLDisplay::FrameCapture;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Number of measured frames for each run.
+constexpr size_t FRAMES = 60;
+
+enum class Scene { FILL, SCROLL_LIST, LABEL_UPDATE, ANIMATION };
+constexpr Scene SCENES[] = {Scene::FILL, Scene::SCROLL_LIST, Scene::LABEL_UPDATE, Scene::ANIMATION};
+
+// Frames between records, 0 without capturing.
+constexpr uint32_t INTERVALS[] = {0, 1, 10};
+
+static const char* scene_name(Scene scene) {
+  switch(scene) {
+    case Scene::FILL: return "fill";
+    case Scene::SCROLL_LIST: return "scroll_list";
+    case Scene::LABEL_UPDATE: return "label_update";
+    case Scene::ANIMATION: return "animation";
+  }
+  return "";
+}
+
+// Create the widgets for a scene on a new screen, returning the object each frame modifies.
+static lv_obj_t* create_scene(Scene scene) {
+  lv_obj_t* screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+  lv_obj_set_style_text_color(screen, lv_color_hex(0xffffff), LV_PART_MAIN);
+  lv_scr_load(screen);
+
+  switch(scene) {
+    case Scene::FILL: return screen;
+    case Scene::SCROLL_LIST: {
+      lv_obj_t* list = lv_list_create(screen);
+      lv_obj_set_size(list, LV_PCT(100), LV_PCT(100));
+      char text[16];
+      for(size_t i = 0; i < 40; i++) {
+        snprintf(text, sizeof(text), "Item %u", (unsigned)i);
+        lv_list_add_btn(list, NULL, text);
+      }
+      return list;
+    }
+    case Scene::LABEL_UPDATE: {
+      lv_obj_t* label = lv_label_create(screen);
+      lv_label_set_text(label, "");
+      lv_obj_align(label, LV_ALIGN_CENTER, 0, 0);
+      return label;
+    }
+    case Scene::ANIMATION: {
+      lv_obj_t* box = lv_obj_create(screen);
+      lv_obj_set_size(box, 24, 24);
+      lv_obj_set_style_bg_color(box, lv_color_hex(0xff0000), LV_PART_MAIN);
+      return box;
+    }
+  }
+  return screen;
+}
+
+// Apply one frame of change to a scene.
+static void step_scene(Scene scene, lv_obj_t* obj, size_t frame) {
+  switch(scene) {
+    case Scene::FILL: lv_obj_set_style_bg_color(obj, lv_color_hex(frame & 1 ? 0x202020 : 0x404040), LV_PART_MAIN); break;
+    case Scene::SCROLL_LIST: lv_obj_scroll_by(obj, 0, (frame / 20) & 1 ? 6 : -6, LV_ANIM_OFF); break;
+    case Scene::LABEL_UPDATE: lv_label_set_text_fmt(obj, "%u", (unsigned)frame); break;
+    case Scene::ANIMATION: {
+      const lv_coord_t range = lv_disp_get_hor_res(NULL) - lv_obj_get_width(obj);
+      lv_obj_set_pos(obj, (frame * 4) % range, lv_disp_get_ver_res(NULL) / 2 - lv_obj_get_height(obj) / 2);
+      break;
+    }
+  }
+}
+
+// On the virtual board the stream is written to a file for tools/capture_decoder.py, on hardware it is only counted.
+static esp_err_t sink(const void* data, size_t size, void* context) {
+  FILE* file = (FILE*)context;
+  return !file || fwrite(data, 1, size, file) == size ? ESP_OK : ESP_FAIL;
+}
+
+// Run a scene, capturing every nth frame, and print the result as a single JSON line.
+static void run(Scene scene, uint32_t interval) {
+  auto& display = Display().display();
+  lv_obj_t* old_screen = lv_scr_act();
+  lv_obj_t* obj = create_scene(scene);
+  lv_obj_del(old_screen);
+
+  FILE* file = NULL;
+  FrameCapture capture;
+  if(interval) {
+#if CONFIG_IDF_TARGET_LINUX
+    char name[48];
+    snprintf(name, sizeof(name), "capture_%s_%u.ldc", scene_name(scene), (unsigned)interval);
+    file = fopen(name, "wb");
+#endif
+    FrameCapture::Config config;
+    config.sink = sink;
+    config.context = file;
+    config.interval = interval;
+    auto lock = LVGLDisplay::Lock();
+    if(capture.start(display, config) != ESP_OK) {
+      printf("{\"error\":\"capture start failed\"}\n");
+      exit(1);
+    }
+  }
+  // Settle the first full screen redraw, and the key record, before measuring.
+  Display().refresh();
+  display.wait_flushed();
+
+  capture.reset_stats();
+  Display().reset_stats();
+  const int64_t start = display.time_us();
+  for(size_t frame = 0; frame < FRAMES; frame++) {
+    step_scene(scene, obj, frame);
+    Display().refresh();
+  }
+  display.wait_flushed();
+  const int64_t elapsed_us = display.time_us() - start;
+  const auto frames = Display().stats();
+  const FrameCapture::Stats stats = capture.stats();
+
+  // What support would ask for, the whole frame on request.
+  uint64_t key_bytes = 0;
+  if(interval) {
+    auto lock = LVGLDisplay::Lock();
+    capture.record(true);
+    key_bytes = capture.stats().bytes - stats.bytes;
+    capture.stop();
+  }
+  if(file) {
+    fclose(file);
+  }
+
+  const uint32_t records = stats.records ? stats.records : 1;
+  printf("{\"scene\":\"%s\",\"interval\":%u,\"fps\":%.1f,\"render_us\":%u,\"tap_us_per_frame\":%u,\"encode_us_per_record\":%u,",
+         scene_name(scene), (unsigned)interval, elapsed_us ? FRAMES * 1e6 / elapsed_us : 0.0, (unsigned)frames.render_avg_us,
+         (unsigned)(stats.tap_us / FRAMES), (unsigned)(stats.encode_us / records));
+  printf("\"records\":%u,\"tiles_per_record\":%u,\"bytes_per_record\":%u,\"key_record_bytes\":%u,\"errors\":%u}\n",
+         (unsigned)stats.records, (unsigned)(stats.tiles / records), (unsigned)(stats.bytes / records), (unsigned)key_bytes,
+         (unsigned)stats.errors);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  // The benchmark drives LVGL directly, so hold the lock for the whole run.
+  auto lock = LVGLDisplay::Lock();
+  for(Scene scene : SCENES) {
+    for(uint32_t interval : INTERVALS) {
+      run(scene, interval);
+    }
+  }
+  fflush(stdout);
+
+  exit(0);
+}
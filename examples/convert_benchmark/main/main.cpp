@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pixel_convert.hpp>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+namespace Convert = LVGLDisplay::PixelConvert;
+
+// One 320 x 170 frame, the size of the supported panels.
+constexpr size_t WIDTH = 320;
+constexpr size_t HEIGHT = 170;
+constexpr size_t PIXELS = WIDTH * HEIGHT;
+
+// Number of timed repetitions of each kernel.
+constexpr size_t ITERATIONS = 50;
+
+struct Buffers {
+  uint8_t* src;  // Random source pixels, PIXELS * 4 bytes.
+  uint16_t* dst; // Kernel output.
+  uint16_t* ref; // Scalar reference output.
+};
+
+using Kernel = Convert::Kernel;
+constexpr Kernel KERNELS[] = {Kernel::SWAP_RGB565,
+                              Kernel::RGB888_TO_RGB565,
+                              Kernel::ARGB8888_TO_RGB565,
+                              Kernel::RGB888_TO_RGB565_DITHER,
+                              Kernel::ARGB8888_TO_RGB565_DITHER,
+                              Kernel::RGB565_TO_RGB444,
+                              Kernel::ROTATE_RGB565};
+
+static const char* kernel_name(Kernel kernel) {
+  switch(kernel) {
+    case Kernel::SWAP_RGB565: return "swap_rgb565";
+    case Kernel::RGB888_TO_RGB565: return "rgb888_to_rgb565";
+    case Kernel::ARGB8888_TO_RGB565: return "argb8888_to_rgb565";
+    case Kernel::RGB888_TO_RGB565_DITHER: return "rgb888_to_rgb565_dither";
+    case Kernel::ARGB8888_TO_RGB565_DITHER: return "argb8888_to_rgb565_dither";
+    case Kernel::RGB565_TO_RGB444: return "rgb565_to_rgb444";
+    case Kernel::ROTATE_RGB565: return "rotate_rgb565";
+  }
+  return "";
+}
+
+// Bytes read from the source for one pixel.
+static size_t source_bytes(Kernel kernel) {
+  switch(kernel) {
+    case Kernel::SWAP_RGB565:
+    case Kernel::RGB565_TO_RGB444:
+    case Kernel::ROTATE_RGB565: return 2;
+    case Kernel::RGB888_TO_RGB565:
+    case Kernel::RGB888_TO_RGB565_DITHER: return 3;
+    case Kernel::ARGB8888_TO_RGB565:
+    case Kernel::ARGB8888_TO_RGB565_DITHER: return 4;
+  }
+  return 0;
+}
+
+// Quarter turns applied by the rotate kernel, the turn the flush path uses most.
+constexpr unsigned TURNS = 1;
+
+static void run_kernel(Kernel kernel, bool scalar, uint16_t* dst, const uint8_t* src, bool swap) {
+  switch(kernel) {
+    case Kernel::SWAP_RGB565:
+      scalar ? Convert::Scalar::swap_rgb565(dst, (const uint16_t*)src, PIXELS) : Convert::swap_rgb565(dst, (const uint16_t*)src, PIXELS);
+      break;
+    case Kernel::RGB888_TO_RGB565:
+      scalar ? Convert::Scalar::rgb888_to_rgb565(dst, src, PIXELS, swap) : Convert::rgb888_to_rgb565(dst, src, PIXELS, swap);
+      break;
+    case Kernel::ARGB8888_TO_RGB565:
+      scalar ? Convert::Scalar::argb8888_to_rgb565(dst, (const uint32_t*)src, PIXELS, swap)
+             : Convert::argb8888_to_rgb565(dst, (const uint32_t*)src, PIXELS, swap);
+      break;
+    case Kernel::RGB888_TO_RGB565_DITHER:
+      scalar ? Convert::Scalar::rgb888_to_rgb565_dither(dst, src, WIDTH, HEIGHT, 3, 1, swap)
+             : Convert::rgb888_to_rgb565_dither(dst, src, WIDTH, HEIGHT, 3, 1, swap);
+      break;
+    case Kernel::ARGB8888_TO_RGB565_DITHER:
+      scalar ? Convert::Scalar::argb8888_to_rgb565_dither(dst, (const uint32_t*)src, WIDTH, HEIGHT, 3, 1, swap)
+             : Convert::argb8888_to_rgb565_dither(dst, (const uint32_t*)src, WIDTH, HEIGHT, 3, 1, swap);
+      break;
+    case Kernel::RGB565_TO_RGB444:
+      scalar ? Convert::Scalar::rgb565_to_rgb444((uint8_t*)dst, (const uint16_t*)src, PIXELS, swap)
+             : Convert::rgb565_to_rgb444((uint8_t*)dst, (const uint16_t*)src, PIXELS, swap);
+      break;
+    case Kernel::ROTATE_RGB565:
+      scalar ? Convert::Scalar::rotate_rgb565(dst, (const uint16_t*)src, WIDTH, HEIGHT, TURNS)
+             : Convert::rotate_rgb565(dst, (const uint16_t*)src, WIDTH, HEIGHT, TURNS);
+      break;
+  }
+}
+
+// Returns the throughput of a kernel in MB/s of source pixels.
+static double measure(Kernel kernel, bool scalar, uint16_t* dst, const uint8_t* src) {
+  const int64_t start = esp_timer_get_time();
+  for(size_t i = 0; i < ITERATIONS; i++) {
+    run_kernel(kernel, scalar, dst, src, true);
+  }
+  const int64_t elapsed_us = esp_timer_get_time() - start;
+  return elapsed_us ? (double)ITERATIONS * PIXELS * source_bytes(kernel) / elapsed_us : 0.0;
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  Buffers buffers;
+  buffers.src = (uint8_t*)heap_caps_aligned_alloc(16, PIXELS * 4, MALLOC_CAP_DEFAULT);
+  buffers.dst = (uint16_t*)heap_caps_aligned_alloc(16, PIXELS * sizeof(uint16_t), MALLOC_CAP_DEFAULT);
+  buffers.ref = (uint16_t*)heap_caps_aligned_alloc(16, PIXELS * sizeof(uint16_t), MALLOC_CAP_DEFAULT);
+  if(!buffers.src || !buffers.dst || !buffers.ref) {
+    printf("{\"error\":\"buffer allocation failed\"}\n");
+    exit(1);
+  }
+  srand(1);
+  for(size_t i = 0; i < PIXELS * 4; i++) {
+    buffers.src[i] = rand();
+  }
+
+  for(auto kernel : KERNELS) {
+    const double mbps = measure(kernel, false, buffers.dst, buffers.src);
+    const double scalar_mbps = measure(kernel, true, buffers.ref, buffers.src);
+    printf("{\"kernel\":\"%s\",\"implementation\":\"%s\",\"pixels\":%u,\"mb_per_s\":%.1f,\"scalar_mb_per_s\":%.1f,\"speedup\":%.2f}\n",
+           kernel_name(kernel), Convert::implementation(kernel), (unsigned)PIXELS, mbps, scalar_mbps,
+           scalar_mbps > 0 ? mbps / scalar_mbps : 0.0);
+    fflush(stdout);
+  }
+
+  heap_caps_free(buffers.src);
+  heap_caps_free(buffers.dst);
+  heap_caps_free(buffers.ref);
+  exit(0);
+}
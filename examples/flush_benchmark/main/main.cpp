@@ -0,0 +1,289 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <controller.hpp>
+#include <simulated_panel.hpp>
+#include <vector>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Number of measured frames for each scene and setting.
+constexpr size_t FRAMES = 60;
+
+// Values swept for each tuning knob. Bus settings can only be changed at runtime on the virtual board.
+constexpr uint32_t PIXEL_CLOCKS_MHZ[] = {2, 5, 10, 20, 40, 80};
+constexpr uint32_t SPI_CLOCKS_MHZ[] = {10, 20, 40};
+constexpr size_t QUEUE_DEPTHS[] = {1, 2, 4, 10, 20};
+constexpr size_t DRAW_BUFF_LENS[] = {10, 20, 40, 85, 170};
+
+enum class Scene { FILL, SCROLL_LIST, LABEL_UPDATE, ANIMATION };
+constexpr Scene SCENES[] = {Scene::FILL, Scene::SCROLL_LIST, Scene::LABEL_UPDATE, Scene::ANIMATION};
+
+struct Setting {
+  const char* knob;                        // The knob varied from the Kconfig baseline.
+  LVGLDisplay::BusModel::Config bus;       // The simulated bus configuration.
+  size_t draw_lines;                       // Draw buffer length, in lines.
+  LVGLDisplay::TransferFormat format;      // The pixel format of the colour transfers.
+};
+
+static const char* format_name(LVGLDisplay::TransferFormat format) {
+  return format == LVGLDisplay::TransferFormat::RGB444 ? "rgb444" : "rgb565";
+}
+
+static const char* scene_name(Scene scene) {
+  switch(scene) {
+    case Scene::FILL: return "fill";
+    case Scene::SCROLL_LIST: return "scroll_list";
+    case Scene::LABEL_UPDATE: return "label_update";
+    case Scene::ANIMATION: return "animation";
+  }
+  return "";
+}
+
+// Create the widgets for a scene on a new screen, returning the object each frame modifies.
+static lv_obj_t* create_scene(Scene scene) {
+  lv_obj_t* screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+  lv_obj_set_style_text_color(screen, lv_color_hex(0xffffff), LV_PART_MAIN);
+  lv_scr_load(screen);
+
+  switch(scene) {
+    case Scene::FILL: return screen;
+    case Scene::SCROLL_LIST: {
+      lv_obj_t* list = lv_list_create(screen);
+      lv_obj_set_size(list, LV_PCT(100), LV_PCT(100));
+      char text[16];
+      for(size_t i = 0; i < 40; i++) {
+        snprintf(text, sizeof(text), "Item %u", (unsigned)i);
+        lv_list_add_btn(list, NULL, text);
+      }
+      return list;
+    }
+    case Scene::LABEL_UPDATE: {
+      lv_obj_t* label = lv_label_create(screen);
+      lv_label_set_text(label, "");
+      lv_obj_align(label, LV_ALIGN_CENTER, 0, 0);
+      return label;
+    }
+    case Scene::ANIMATION: {
+      lv_obj_t* box = lv_obj_create(screen);
+      lv_obj_set_size(box, 24, 24);
+      lv_obj_set_style_bg_color(box, lv_color_hex(0xff0000), LV_PART_MAIN);
+      return box;
+    }
+  }
+  return screen;
+}
+
+// Apply one frame of change to a scene.
+static void step_scene(Scene scene, lv_obj_t* obj, size_t frame) {
+  switch(scene) {
+    case Scene::FILL: lv_obj_set_style_bg_color(obj, lv_color_hex(frame & 1 ? 0x202020 : 0x404040), LV_PART_MAIN); break;
+    case Scene::SCROLL_LIST: lv_obj_scroll_by(obj, 0, (frame / 20) & 1 ? 6 : -6, LV_ANIM_OFF); break;
+    case Scene::LABEL_UPDATE: lv_label_set_text_fmt(obj, "%u", (unsigned)frame); break;
+    case Scene::ANIMATION: {
+      const lv_coord_t range = lv_disp_get_hor_res(NULL) - lv_obj_get_width(obj);
+      lv_obj_set_pos(obj, (frame * 4) % range, lv_disp_get_ver_res(NULL) / 2 - lv_obj_get_height(obj) / 2);
+      break;
+    }
+  }
+}
+
+// Replace the LVGL draw buffers with two buffers of the given number of lines. Buffers allocated by an earlier call
+// are released first, the buffers allocated by the controller are left in place.
+static bool set_draw_buffers(LVGLDisplay::Display& display, size_t lines, std::vector<void*>& buffers) {
+  lv_disp_t* disp = lv_disp_get_default();
+  for(auto buffer : buffers) {
+    heap_caps_free(buffer);
+  }
+  buffers.clear();
+
+  const size_t pixels = display.hres() * lines;
+  const uint32_t caps = display.dma() ? MALLOC_CAP_DMA : MALLOC_CAP_DEFAULT;
+  void* buf1 = heap_caps_malloc(pixels * sizeof(lv_color_t), caps);
+  void* buf2 = heap_caps_malloc(pixels * sizeof(lv_color_t), caps);
+  if(!buf1 || !buf2) {
+    heap_caps_free(buf1);
+    heap_caps_free(buf2);
+    return false;
+  }
+  lv_disp_draw_buf_init(disp->driver->draw_buf, buf1, buf2, pixels);
+  buffers.push_back(buf1);
+  buffers.push_back(buf2);
+  return true;
+}
+
+// Run a scene for one setting and print the result as a single JSON line.
+static void run(const Setting& setting, Scene scene) {
+  auto& display = Display().display();
+  auto* panel = LVGLDisplay::SimulatedPanel::from_handle(display.panel_handle());
+
+  if(panel) {
+    panel->configure(setting.bus);
+  }
+  if(display.packer().set(setting.format) != ESP_OK) {
+    printf("{\"error\":\"transfer format not supported\",\"format\":\"%s\"}\n", format_name(setting.format));
+    exit(1);
+  }
+
+  lv_obj_t* old_screen = lv_scr_act();
+  lv_obj_t* obj = create_scene(scene);
+  lv_obj_del(old_screen);
+
+  // Settle the first full screen redraw before measuring.
+  Display().refresh();
+
+  display.reset_flush_timing();
+  display.coalescer().reset_stats();
+  display.shadow().reset_stats();
+  display.reset_buffer_ring_stats();
+  Display().pacer(0).reset_stats();
+  Display().reset_stats();
+  if(panel) {
+    panel->reset_stats();
+  }
+  const int64_t start = display.time_us();
+  for(size_t frame = 0; frame < FRAMES; frame++) {
+    step_scene(scene, obj, frame);
+    Display().refresh();
+  }
+  display.wait_flushed();
+  const int64_t elapsed_us = display.time_us() - start;
+  const auto timing = display.flush_timing();
+  const auto coalesce = display.coalescer().stats();
+  const auto shadow = display.shadow().stats();
+  const auto ring = display.buffer_ring().stats();
+  const auto frames = Display().stats();
+  const auto pacing = Display().pacer(0).stats();
+
+  printf("{\"knob\":\"%s\",\"scene\":\"%s\",\"bus\":\"%s\",\"clock_hz\":%u,\"queue_depth\":%u,\"draw_buff_len\":%u,\"format\":\"%s\",",
+         setting.knob, scene_name(scene), setting.bus.bus == LVGLDisplay::BusModel::Bus::SPI ? "spi" : "i80", (unsigned)setting.bus.clock_hz,
+         (unsigned)setting.bus.queue_depth, (unsigned)setting.draw_lines, format_name(setting.format));
+  printf("\"frames\":%u,\"elapsed_us\":%lld,\"fps\":%.2f,\"flushes_per_frame\":%.2f,\"bytes_per_frame\":%.0f,", (unsigned)FRAMES,
+         (long long)elapsed_us, elapsed_us ? FRAMES * 1e6 / elapsed_us : 0.0, (double)timing.flushes / FRAMES,
+         (double)timing.bytes / FRAMES);
+  printf("\"flush_latency_avg_us\":%.1f,\"flush_latency_max_us\":%u", timing.flushes ? (double)timing.latency_total_us / timing.flushes : 0.0,
+         (unsigned)timing.latency_max_us);
+  printf(",\"coalesce_transactions_saved\":%lld,\"coalesce_bytes_saved\":%lld", (long long)(coalesce.transactions_before - coalesce.transactions_after),
+         (long long)(coalesce.bytes_before - coalesce.bytes_after));
+  if(frames.frames) {
+    printf(",\"render_avg_us\":%u,\"render_max_us\":%u,\"frame_flush_avg_us\":%u,\"dma_wait_avg_us\":%u,\"dma_wait_max_us\":%u",
+           (unsigned)frames.render_avg_us, (unsigned)frames.render_max_us, (unsigned)frames.flush_avg_us, (unsigned)frames.dma_wait_avg_us,
+           (unsigned)frames.dma_wait_max_us);
+  }
+  if(display.shadow().allocated()) {
+    printf(",\"shadow_tiles\":%llu,\"shadow_tiles_skipped\":%llu,\"shadow_bytes_saved\":%llu", (unsigned long long)shadow.tiles,
+           (unsigned long long)shadow.tiles_skipped, (unsigned long long)(shadow.bytes_in - shadow.bytes_out));
+  }
+  if(display.buffer_ring().active()) {
+    printf(",\"buffer_count\":%u,\"ring_stalls\":%u,\"ring_wait_us\":%llu,\"ring_wait_max_us\":%u", (unsigned)display.buffer_ring().depth(),
+           (unsigned)ring.stalls, (unsigned long long)ring.stall_total_us, (unsigned)ring.stall_max_us);
+  }
+  if(Display().pacer(0).active()) {
+    printf(",\"paced_delayed\":%u,\"paced_wait_avg_us\":%.1f,\"paced_wait_max_us\":%u,\"missed_vsyncs\":%u,\"overlong_frames\":%u",
+           (unsigned)pacing.delayed, pacing.frames ? (double)pacing.wait_total_us / pacing.frames : 0.0, (unsigned)pacing.wait_max_us,
+           (unsigned)pacing.missed, (unsigned)pacing.overlong);
+  }
+  if(panel) {
+    const auto stats = panel->stats();
+    printf(",\"transactions_per_frame\":%.2f,\"command_bytes_per_frame\":%.1f,\"bus_utilization\":%.4f,\"dma_idle_us\":%.1f,\"stall_us\":%.1f",
+           (double)stats.bus.transactions / FRAMES, (double)stats.bus.command_bytes / FRAMES,
+           stats.elapsed_ns ? (double)stats.bus.busy_ns / stats.elapsed_ns : 0.0, stats.bus.idle_ns / 1000.0, stats.bus.stall_ns / 1000.0);
+  }
+  printf("}\n");
+  fflush(stdout);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  auto& display = Display().display();
+  auto* panel = LVGLDisplay::SimulatedPanel::from_handle(display.panel_handle());
+  const size_t baseline_lines = display.buffer_size() / display.hres();
+  LVGLDisplay::BusModel::Config baseline;
+  if(panel) {
+    baseline = panel->bus_config();
+  }
+  else {
+    // Report the bus the hardware was configured with, it can not be changed at runtime.
+#if CONFIG_LVGL_DISPLAY_TTGO_TDISPLAY
+    baseline.bus = LVGLDisplay::BusModel::Bus::SPI;
+    baseline.clock_hz = CONFIG_LVGL_DISPLAY_SPI_CLOCK * 1000 * 1000;
+#elif CONFIG_LVGL_DISPLAY_TDISPLAY_S3
+    baseline.clock_hz = CONFIG_LVGL_DISPLAY_PIXEL_CLOCK * 1000 * 1000;
+#endif
+#ifdef CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH
+    baseline.queue_depth = CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH;
+#endif
+  }
+
+  const LVGLDisplay::TransferFormat format = display.packer().format();
+  std::vector<Setting> settings;
+  settings.push_back({"baseline", baseline, baseline_lines, format});
+  if(panel) {
+    for(auto mhz : PIXEL_CLOCKS_MHZ) {
+      Setting setting = {"pixel_clock", baseline, baseline_lines, format};
+      setting.bus.bus = LVGLDisplay::BusModel::Bus::I80;
+      setting.bus.bus_width = 8;
+      setting.bus.clock_hz = mhz * 1000 * 1000;
+      settings.push_back(setting);
+    }
+    for(auto mhz : SPI_CLOCKS_MHZ) {
+      Setting setting = {"spi_clock", baseline, baseline_lines, format};
+      setting.bus.bus = LVGLDisplay::BusModel::Bus::SPI;
+      setting.bus.clock_hz = mhz * 1000 * 1000;
+      settings.push_back(setting);
+    }
+    for(auto depth : QUEUE_DEPTHS) {
+      Setting setting = {"tqueue_depth", baseline, baseline_lines, format};
+      setting.bus.queue_depth = depth;
+      settings.push_back(setting);
+    }
+  }
+  // The buffer ring is sized for the Kconfig draw buffers, so their length is only swept without one.
+  for(auto lines : DRAW_BUFF_LENS) {
+    if(lines <= display.vres() && !display.buffer_ring().active()) {
+      settings.push_back({"draw_buff_len", baseline, lines, format});
+    }
+  }
+  // The other transfer format, a quarter fewer bytes per pixel with RGB444.
+  const LVGLDisplay::TransferFormat other =
+    format == LVGLDisplay::TransferFormat::RGB565 ? LVGLDisplay::TransferFormat::RGB444 : LVGLDisplay::TransferFormat::RGB565;
+  if(display.packer().supports(other)) {
+    settings.push_back({"transfer_format", baseline, baseline_lines, other});
+  }
+
+  // The benchmark drives LVGL directly, so hold the lock for the whole run.
+  auto lock = LVGLDisplay::Lock();
+  std::vector<void*> buffers;
+  size_t lines = baseline_lines;
+  for(const auto& setting : settings) {
+    if(setting.draw_lines != lines) {
+      if(!set_draw_buffers(display, setting.draw_lines, buffers)) {
+        printf("{\"error\":\"draw buffer allocation failed\",\"draw_buff_len\":%u}\n", (unsigned)setting.draw_lines);
+        exit(1);
+      }
+      lines = setting.draw_lines;
+    }
+    for(auto scene : SCENES) {
+      run(setting, scene);
+    }
+  }
+
+  exit(0);
+}
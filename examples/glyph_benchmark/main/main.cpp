@@ -0,0 +1,125 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <controller.hpp>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+using LVGLDisplay::GlyphCache;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Frames for each run, every numeric label is given a new value each frame.
+constexpr size_t FRAMES = 60;
+constexpr size_t LABEL_COUNTS[] = {12, 24, 36};
+constexpr lv_coord_t COLUMN_WIDTH = 80;
+constexpr lv_coord_t ROW_HEIGHT = 18;
+
+// The glyphs of the telemetry screen: readings, signs and units.
+constexpr const char* TELEMETRY_GLYPHS = "0123456789.-+%VAWC";
+static const char* const UNITS[] = {"V", "A", "W", "C", "%"};
+
+enum class Mode { LVGL, COLD, WARM };
+
+static const char* mode_name(Mode mode) {
+  switch(mode) {
+    case Mode::LVGL: return "lvgl";
+    case Mode::COLD: return "cold";
+    case Mode::WARM: return "warm";
+  }
+  return "";
+}
+
+// Update a screen of numeric labels for a number of frames, and print the render time and cache hits as a single JSON
+// line.
+static void run(size_t count, Mode mode) {
+  auto& display = Display().display();
+  GlyphCache& glyphs = Display().glyphs();
+  const lv_font_t* font = LV_FONT_DEFAULT;
+
+  lv_obj_t* old_screen = lv_scr_act();
+  lv_obj_t* screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+  lv_obj_set_style_text_color(screen, lv_color_hex(0x40ff80), LV_PART_MAIN);
+  lv_scr_load(screen);
+  lv_obj_del(old_screen);
+  // As many labels as fit the screen.
+  const size_t columns = display.width() / COLUMN_WIDTH;
+  count = std::min<size_t>(count, columns * (display.height() / ROW_HEIGHT));
+  static lv_obj_t* labels[64];
+  for(size_t i = 0; i < count; i++) {
+    labels[i] = lv_label_create(screen);
+    lv_obj_set_pos(labels[i], (i % columns) * COLUMN_WIDTH + 2, (i / columns) * ROW_HEIGHT + 2);
+  }
+
+  glyphs.clear();
+  int64_t warm_us = 0;
+  if(mode == Mode::WARM) {
+    const int64_t start = display.time_us();
+    glyphs.warm(font, TELEMETRY_GLYPHS);
+    warm_us = display.time_us() - start;
+  }
+
+  // Settle the first full screen redraw before measuring.
+  Display().refresh();
+  glyphs.reset_stats();
+  Display().reset_stats();
+  const int64_t start = display.time_us();
+  for(size_t frame = 0; frame < FRAMES; frame++) {
+    for(size_t i = 0; i < count; i++) {
+      lv_label_set_text_fmt(labels[i], "%d.%d%s", rand() % 2000 - 1000, rand() % 10, UNITS[i % 5]);
+    }
+    Display().refresh();
+  }
+  display.wait_flushed();
+  const int64_t elapsed_us = display.time_us() - start;
+  const auto frames = Display().stats();
+  const GlyphCache::Stats stats = glyphs.stats();
+
+  printf("{\"labels\":%u,\"mode\":\"%s\",\"frames\":%u,\"fps\":%.2f,\"render_avg_us\":%u,\"render_max_us\":%u,", (unsigned)count,
+         mode_name(mode), (unsigned)FRAMES, elapsed_us ? FRAMES * 1e6 / elapsed_us : 0.0, (unsigned)frames.render_avg_us,
+         (unsigned)frames.render_max_us);
+  printf("\"hits\":%u,\"misses\":%u,\"bypassed\":%u,\"evictions\":%u,\"hit_rate\":%.3f,\"glyphs\":%u,\"atlas_used\":%u,\"warm_us\":%lld}\n",
+         (unsigned)stats.hits, (unsigned)stats.misses, (unsigned)stats.bypassed, (unsigned)stats.evictions, glyphs.hit_rate(),
+         (unsigned)stats.glyphs, (unsigned)stats.used, (long long)warm_us);
+  fflush(stdout);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+  if(!Display().glyphs().created()) {
+    printf("{\"error\":\"the glyph cache is disabled\"}\n");
+    exit(1);
+  }
+
+  // The benchmark drives LVGL directly, so hold the lock for the whole run.
+  auto lock = LVGLDisplay::Lock();
+  srand(1234);
+  // The default font is drawn by LVGL until it is added to the cache, the defaults leave it out.
+  if(!Display().glyphs().cached(LV_FONT_DEFAULT)) {
+    for(size_t count : LABEL_COUNTS) {
+      run(count, Mode::LVGL);
+    }
+  }
+  Display().glyphs().add_font(LV_FONT_DEFAULT);
+  for(size_t count : LABEL_COUNTS) {
+    run(count, Mode::COLD);
+    run(count, Mode::WARM);
+  }
+
+  exit(0);
+}
@@ -51,18 +51,15 @@ extern "C" void app_main(void) {
   // Create a "Hello World" label on the display
   create_hello_world();
 
-  size_t seconds = 0;
-  char text[32] = "";
+  unsigned seconds = 0;
 
   // Loop forever
   while(1) {
-    snprintf(text, 32, "Hello world %u", seconds++);
-
-    // Update the display with the current elapsed seconds.
-    // Use a static lock, which does not rely on scope.
-    LVGLDisplay::Lock::acquire();
-    lv_label_set_text(label, text);
-    LVGLDisplay::Lock::release();
+    // Update the display with the current elapsed seconds. The update is
+    // posted to the LVGL task and applied before its next refresh, so this
+    // task never waits for the lock while a frame renders.
+    Display().post([seconds] { lv_label_set_text_fmt(label, "Hello world %u", seconds); });
+    seconds++;
 
     // Delay the task for 1000ms (1 second)
     vTaskDelay(pdMS_TO_TICKS(1000));
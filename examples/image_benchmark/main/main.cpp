@@ -0,0 +1,136 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <controller.hpp>
+#include <image_stream.hpp>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+using LVGLDisplay::ImageStream;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Number of measured frames for each run.
+constexpr size_t FRAMES = 30;
+
+// The backgrounds encoded by main/CMakeLists.txt, embedded in flash.
+extern const uint8_t background_rle_start[] asm("_binary_background_rle_ldi_start");
+extern const uint8_t background_rle_end[] asm("_binary_background_rle_ldi_end");
+extern const uint8_t background_raw_start[] asm("_binary_background_raw_ldi_start");
+extern const uint8_t background_raw_end[] asm("_binary_background_raw_ldi_end");
+
+enum class Source { LVGL_IMAGE, STREAM_RAW, STREAM_RLE };
+constexpr Source SOURCES[] = {Source::LVGL_IMAGE, Source::STREAM_RAW, Source::STREAM_RLE};
+
+enum class Scene { FULL, PARTIAL };
+constexpr Scene SCENES[] = {Scene::FULL, Scene::PARTIAL};
+
+static const char* source_name(Source source) {
+  switch(source) {
+    case Source::LVGL_IMAGE: return "lvgl_image";
+    case Source::STREAM_RAW: return "stream_raw";
+    case Source::STREAM_RLE: return "stream_rle";
+  }
+  return "";
+}
+
+static const char* scene_name(Scene scene) {
+  switch(scene) {
+    case Scene::FULL: return "full";
+    case Scene::PARTIAL: return "partial";
+  }
+  return "";
+}
+
+// Redraw the whole image, or a label sized area in its lower half, every frame.
+static void run(Source source, Scene scene, lv_obj_t* image, ImageStream* stream) {
+  auto& display = Display().display();
+  const lv_area_t partial = {128, 120, 191, 143};
+  Display().refresh();
+  display.wait_flushed();
+
+  display.reset_flush_timing();
+  Display().reset_stats();
+  if(stream) {
+    stream->reset_stats();
+  }
+  const int64_t start = display.time_us();
+  for(size_t frame = 0; frame < FRAMES; frame++) {
+    scene == Scene::FULL ? lv_obj_invalidate(image) : lv_obj_invalidate_area(image, &partial);
+    Display().refresh();
+    display.wait_flushed();
+  }
+  const int64_t elapsed_us = display.time_us() - start;
+  const auto frames = Display().stats();
+  const auto timing = display.flush_timing();
+  const ImageStream::Stats decode = stream ? stream->stats() : ImageStream::Stats();
+
+  printf("{\"source\":\"%s\",\"scene\":\"%s\",\"fps\":%.1f,\"render_us\":%u,\"flush_us\":%u,\"bytes_per_frame\":%u,",
+         source_name(source), scene_name(scene), elapsed_us ? FRAMES * 1e6 / elapsed_us : 0.0, (unsigned)frames.render_avg_us,
+         (unsigned)frames.flush_avg_us, (unsigned)(timing.bytes / FRAMES));
+  printf("\"decode_us\":%u,\"rows\":%u,\"skipped_rows\":%u,\"seeks\":%u,\"errors\":%u}\n", (unsigned)(decode.decode_us / FRAMES),
+         (unsigned)decode.rows, (unsigned)decode.skipped_rows, (unsigned)decode.seeks, (unsigned)decode.errors);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  ImageStream raw;
+  ImageStream rle;
+  if(raw.open(background_raw_start, background_raw_end - background_raw_start) != ESP_OK ||
+     rle.open(background_rle_start, background_rle_end - background_rle_start) != ESP_OK) {
+    printf("{\"error\":\"background not valid\"}\n");
+    exit(1);
+  }
+  printf("{\"image\":{\"width\":%u,\"height\":%u,\"raw_bytes\":%u,\"rle_bytes\":%u,\"stream_ram_bytes\":%u}}\n",
+         (unsigned)rle.width(), (unsigned)rle.height(), (unsigned)raw.encoded_size(), (unsigned)rle.encoded_size(),
+         (unsigned)(rle.width() * sizeof(uint16_t)));
+
+  // LVGL blits the raw image's pixels straight from flash.
+  const size_t header = sizeof(ImageStream::Header);
+  lv_img_dsc_t descriptor = {};
+  descriptor.header.cf = LV_IMG_CF_TRUE_COLOR;
+  descriptor.header.w = raw.width();
+  descriptor.header.h = raw.height();
+  descriptor.data_size = raw.encoded_size() - header;
+  descriptor.data = background_raw_start + header;
+
+  // The benchmark drives LVGL directly, so hold the lock for the whole run.
+  auto lock = LVGLDisplay::Lock();
+  for(Source source : SOURCES) {
+    lv_obj_t* screen = lv_obj_create(NULL);
+    lv_scr_load(screen);
+    ImageStream* stream = source == Source::STREAM_RAW ? &raw : source == Source::STREAM_RLE ? &rle : NULL;
+    lv_obj_t* image;
+    if(stream) {
+      image = stream->create(screen);
+    }
+    else {
+      image = lv_img_create(screen);
+      lv_img_set_src(image, &descriptor);
+    }
+    if(!image) {
+      printf("{\"error\":\"%s needs LV_COLOR_DEPTH 16\"}\n", source_name(source));
+      exit(1);
+    }
+    for(Scene scene : SCENES) {
+      run(source, scene, image, stream);
+    }
+    lv_obj_del(screen);
+  }
+  fflush(stdout);
+
+  exit(0);
+}
@@ -0,0 +1,161 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <controller.hpp>
+#include <pixel_push.hpp>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+using LVGLDisplay::PixelPush;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Number of measured frames for each run.
+constexpr size_t FRAMES = 60;
+
+enum class Source { LVGL_IMAGE, PUSH, PUSH_DIRECT };
+constexpr Source SOURCES[] = {Source::LVGL_IMAGE, Source::PUSH, Source::PUSH_DIRECT};
+
+enum class Scene { REGION, TAKEOVER };
+constexpr Scene SCENES[] = {Scene::REGION, Scene::TAKEOVER};
+
+static const char* source_name(Source source) {
+  switch(source) {
+    case Source::LVGL_IMAGE: return "lvgl_image";
+    case Source::PUSH: return "push";
+    case Source::PUSH_DIRECT: return "push_direct";
+  }
+  return "";
+}
+
+static const char* scene_name(Scene scene) {
+  switch(scene) {
+    case Scene::REGION: return "region";
+    case Scene::TAKEOVER: return "takeover";
+  }
+  return "";
+}
+
+// Render rows of a moving test pattern, standing in for a decoded video frame.
+static void render(lv_color_t* pixels, size_t width, size_t y1, size_t rows, size_t frame) {
+  for(size_t y = y1; y < y1 + rows; y++) {
+    for(size_t x = 0; x < width; x++) {
+      *pixels++ = lv_color_make((x + frame * 4) & 0xff, (y * 2 + frame) & 0xff, ((x ^ y) + frame * 2) & 0xff);
+    }
+  }
+}
+
+// Show a frame of video for each measured frame, through LVGL or pushed, with a label LVGL updates beside it in the
+// region scene.
+static void run(Source source, Scene scene) {
+  auto& display = Display().display();
+  const lv_area_t area = scene == Scene::REGION
+                           ? lv_area_t{0, 0, (lv_coord_t)(display.hres() / 2 - 1), (lv_coord_t)(display.vres() - 1)}
+                           : lv_area_t{0, 0, (lv_coord_t)(display.hres() - 1), (lv_coord_t)(display.vres() - 1)};
+  const size_t width = lv_area_get_width(&area);
+  const size_t height = lv_area_get_height(&area);
+  lv_color_t* frame = (lv_color_t*)heap_caps_malloc(width * height * sizeof(lv_color_t), MALLOC_CAP_DEFAULT);
+  if(!frame) {
+    printf("{\"error\":\"frame allocation failed\"}\n");
+    exit(1);
+  }
+
+  lv_obj_t* screen = lv_obj_create(NULL);
+  lv_scr_load(screen);
+  lv_obj_t* label = lv_label_create(screen);
+  lv_obj_align(label, LV_ALIGN_TOP_RIGHT, -8, 8);
+
+  // LVGL blits the frame from RAM, like a canvas.
+  lv_img_dsc_t descriptor = {};
+  descriptor.header.cf = LV_IMG_CF_TRUE_COLOR;
+  descriptor.header.w = width;
+  descriptor.header.h = height;
+  descriptor.data_size = width * height * sizeof(lv_color_t);
+  descriptor.data = (const uint8_t*)frame;
+  lv_obj_t* image = NULL;
+  PixelPush push(display);
+  if(source == Source::LVGL_IMAGE) {
+    image = lv_img_create(screen);
+    lv_img_set_src(image, &descriptor);
+  }
+  else if(push.begin(scene == Scene::REGION ? &area : NULL) != ESP_OK) {
+    printf("{\"error\":\"push begin failed\"}\n");
+    exit(1);
+  }
+  Display().refresh();
+  display.wait_flushed();
+
+  display.reset_flush_timing();
+  Display().reset_stats();
+  const int64_t start = display.time_us();
+  for(size_t n = 0; n < FRAMES; n++) {
+    switch(source) {
+      case Source::LVGL_IMAGE:
+        render(frame, width, 0, height, n);
+        lv_obj_invalidate(image);
+        break;
+      case Source::PUSH:
+        render(frame, width, 0, height, n);
+        push.push(area, frame);
+        break;
+      case Source::PUSH_DIRECT:
+        for(size_t y = 0; y < height;) {
+          size_t pixels;
+          lv_color_t* buffer = push.buffer(&pixels);
+          const size_t rows = std::min(pixels / width, height - y);
+          render(buffer, width, y, rows, n);
+          push.submit({area.x1, (lv_coord_t)(area.y1 + y), area.x2, (lv_coord_t)(area.y1 + y + rows - 1)});
+          y += rows;
+        }
+        break;
+    }
+    if(scene == Scene::REGION) {
+      lv_label_set_text_fmt(label, "%u", (unsigned)n);
+    }
+    Display().refresh();
+    push.wait();
+    display.wait_flushed();
+  }
+  const int64_t elapsed_us = display.time_us() - start;
+  const auto timing = display.flush_timing();
+  const PixelPush::Stats stats = push.stats();
+
+  printf("{\"source\":\"%s\",\"scene\":\"%s\",\"fps\":%.1f,\"render_us\":%u,\"lvgl_bytes_per_frame\":%u,",
+         source_name(source), scene_name(scene), elapsed_us ? FRAMES * 1e6 / elapsed_us : 0.0,
+         (unsigned)Display().stats().render_avg_us, (unsigned)(timing.bytes / FRAMES));
+  printf("\"push_bytes_per_frame\":%u,\"push_transfers\":%u,\"copy_us\":%u,\"wait_us\":%u}\n", (unsigned)(stats.bytes / FRAMES),
+         (unsigned)stats.transfers, (unsigned)(stats.copy_us / FRAMES), (unsigned)(stats.wait_us / FRAMES));
+
+  push.end();
+  lv_obj_del(screen);
+  heap_caps_free(frame);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  // The benchmark drives LVGL directly, so hold the lock for the whole run.
+  auto lock = LVGLDisplay::Lock();
+  for(Scene scene : SCENES) {
+    for(Source source : SOURCES) {
+      run(source, scene);
+    }
+  }
+  fflush(stdout);
+
+  exit(0);
+}
@@ -0,0 +1,180 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <controller.hpp>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+using LVGLDisplay::FrameRecord;
+using LVGLDisplay::ScriptedTouch;
+using LVGLDisplay::TouchInput;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// Taps, and steps of each drag, for each run. Every event redraws at most one frame, within the frame log.
+constexpr size_t TAPS = 12;
+constexpr size_t DRAG_STEPS = 24;
+constexpr lv_coord_t DRAG_STEP = 4;
+
+// Time between events, longer than a frame so each is timed on its own.
+constexpr uint32_t TAP_MS = 80;
+constexpr uint32_t DRAG_MS = 20;
+
+enum class Scene { TAP, DRAG };
+constexpr Scene SCENES[] = {Scene::TAP, Scene::DRAG};
+
+// Whether the touch input handles points in its dispatch task, or LVGL polls them.
+constexpr bool DISPATCH[] = {false, true};
+
+static const char* scene_name(Scene scene) {
+  switch(scene) {
+    case Scene::TAP: return "tap";
+    case Scene::DRAG: return "drag";
+  }
+  return "";
+}
+
+// Create the widgets for a scene on a new screen: a button which changes colour when pressed, or a list to drag.
+static void create_scene(Scene scene) {
+  lv_obj_t* old_screen = lv_scr_act();
+  lv_obj_t* screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+  lv_obj_set_style_text_color(screen, lv_color_hex(0xffffff), LV_PART_MAIN);
+  lv_scr_load(screen);
+  lv_obj_del(old_screen);
+
+  switch(scene) {
+    case Scene::TAP: {
+      lv_obj_t* button = lv_btn_create(screen);
+      lv_obj_set_size(button, LV_PCT(50), LV_PCT(50));
+      lv_obj_align(button, LV_ALIGN_CENTER, 0, 0);
+      lv_obj_set_style_bg_color(button, lv_color_hex(0xff0000), LV_STATE_PRESSED);
+      lv_obj_t* label = lv_label_create(button);
+      lv_label_set_text(label, "Tap");
+      lv_obj_center(label);
+      break;
+    }
+    case Scene::DRAG: {
+      lv_obj_t* list = lv_list_create(screen);
+      lv_obj_set_size(list, LV_PCT(100), LV_PCT(100));
+      char text[16];
+      for(size_t i = 0; i < 40; i++) {
+        snprintf(text, sizeof(text), "Item %u", (unsigned)i);
+        lv_list_add_btn(list, NULL, text);
+      }
+      break;
+    }
+  }
+}
+
+// Touch the panel as a user would, from this task while the LVGL task runs.
+static void play(Scene scene, ScriptedTouch& touch) {
+  const lv_coord_t x = lv_disp_get_hor_res(NULL) / 2;
+  const lv_coord_t y = lv_disp_get_ver_res(NULL) / 2;
+  switch(scene) {
+    case Scene::TAP:
+      for(size_t tap = 0; tap < TAPS; tap++) {
+        touch.press(x, y);
+        vTaskDelay(pdMS_TO_TICKS(TAP_MS));
+        touch.release();
+        vTaskDelay(pdMS_TO_TICKS(TAP_MS));
+      }
+      break;
+    case Scene::DRAG:
+      touch.press(x, y + DRAG_STEPS * DRAG_STEP / 2);
+      for(size_t step = 1; step <= DRAG_STEPS; step++) {
+        vTaskDelay(pdMS_TO_TICKS(DRAG_MS));
+        touch.press(x, y + DRAG_STEPS * DRAG_STEP / 2 - step * DRAG_STEP);
+      }
+      vTaskDelay(pdMS_TO_TICKS(DRAG_MS));
+      touch.release();
+      break;
+  }
+  // Let the last frame reach the panel, and a drag's momentum settle.
+  vTaskDelay(pdMS_TO_TICKS(500));
+}
+
+// Run a scene with the touch input polled or dispatched, and print the result as a single JSON line.
+static void run(Scene scene, bool dispatch, ScriptedTouch& touch) {
+  auto& display = Display().display();
+  TouchInput& input = Display().touch();
+  {
+    auto lock = LVGLDisplay::Lock();
+    create_scene(scene);
+    input.stop();
+    TouchInput::Config config;
+    config.dispatch_task = dispatch;
+    config.priority = CONFIG_LVGL_DISPLAY_TASK_PRIORITY;
+    config.stack = CONFIG_LVGL_DISPLAY_TASK_STACK;
+    if(input.start(config, &touch) != ESP_OK) {
+      printf("{\"error\":\"touch start failed\"}\n");
+      exit(1);
+    }
+  }
+  // Settle the first full screen redraw before measuring.
+  vTaskDelay(pdMS_TO_TICKS(200));
+  {
+    auto lock = LVGLDisplay::Lock();
+    display.reset_input_timing();
+    input.reset_stats();
+    Display().reset_stats();
+  }
+
+  play(scene, touch);
+
+  const auto lock = LVGLDisplay::Lock();
+  const LVGLDisplay::InputTiming timing = display.input_timing();
+  const TouchInput::Stats stats = input.stats();
+
+  // Percentiles of the frames redrawn for a touch.
+  static FrameRecord records[CONFIG_LVGL_DISPLAY_FRAME_LOG_LENGTH ? CONFIG_LVGL_DISPLAY_FRAME_LOG_LENGTH : 1];
+  static uint32_t latencies[sizeof(records) / sizeof(records[0])];
+  const size_t count = Display().frames(records, sizeof(records) / sizeof(records[0]));
+  size_t inputs = 0;
+  for(size_t i = 0; i < count; i++) {
+    if(records[i].input_us) {
+      latencies[inputs++] = records[i].input_latency_us;
+    }
+  }
+  std::sort(latencies, latencies + inputs);
+  const uint32_t p50 = inputs ? latencies[inputs / 2] : 0;
+  const uint32_t p95 = inputs ? latencies[inputs * 95 / 100] : 0;
+
+  printf("{\"scene\":\"%s\",\"mode\":\"%s\",\"points\":%u,\"dropped\":%u,\"redraws\":%u,\"dispatches\":%u,", scene_name(scene),
+         dispatch ? "dispatched" : "polled", (unsigned)stats.points, (unsigned)stats.dropped, (unsigned)stats.redraws,
+         (unsigned)stats.dispatches);
+  printf("\"latency_avg_us\":%u,\"latency_p50_us\":%u,\"latency_p95_us\":%u,\"latency_max_us\":%u}\n",
+         (unsigned)(timing.inputs ? timing.latency_total_us / timing.inputs : 0), (unsigned)p50, (unsigned)p95,
+         (unsigned)timing.latency_max_us);
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  // Touches are scripted whatever the board, so both modes see the same input. The LVGL task runs throughout, the
+  // lock is only held to set up and read each run.
+  static ScriptedTouch touch;
+  for(bool dispatch : DISPATCH) {
+    for(Scene scene : SCENES) {
+      run(scene, dispatch, touch);
+    }
+  }
+  Display().touch().stop();
+  fflush(stdout);
+
+  exit(0);
+}
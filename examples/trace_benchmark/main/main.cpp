@@ -0,0 +1,230 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <controller.hpp>
+#include <workload_trace.hpp>
+#include <vector>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+  #include <simulated_panel.hpp>
+#endif
+
+using LVGLDisplay::TraceRecorder;
+using LVGLDisplay::TraceReplayer;
+
+// Get an instance of the LVGL Display Controller
+constexpr auto Display = LVGLDisplay::Controller::instance;
+
+// The recorded session, a dashboard updated in irregular bursts.
+constexpr size_t LABELS = 6;
+constexpr uint32_t SESSION_MS = 3000;
+constexpr uint32_t SEED = 1234;
+
+#if CONFIG_IDF_TARGET_LINUX
+// A trace recorded elsewhere is replayed instead of the synthetic session when found in the working directory.
+constexpr const char* TRACE_FILE = "trace.ldt";
+// The synthetic session is saved here, for tools/trace_decoder.py.
+constexpr const char* SESSION_FILE = "session.ldt";
+// SPI clocks the trace is replayed at, bus settings can only be changed at runtime on the virtual board.
+constexpr uint32_t SPI_CLOCKS_MHZ[] = {10, 20, 40, 80};
+#endif
+
+constexpr TraceReplayer::Mode MODES[] = {TraceReplayer::Mode::FULL_SPEED, TraceReplayer::Mode::REAL_TIME};
+
+// Append the trace to a vector.
+static esp_err_t append(const void* data, size_t size, void* context) {
+  auto* trace = (std::vector<uint8_t>*)context;
+  trace->insert(trace->end(), (const uint8_t*)data, (const uint8_t*)data + size);
+  return ESP_OK;
+}
+
+// Busy wait, the work done by an application task while it holds the lock.
+static void spin(uint32_t duration_us) {
+  const int64_t end = Display().display().time_us() + duration_us;
+  while(Display().display().time_us() < end) {
+  }
+}
+
+// Record the dashboard: bursts of label updates of differing size and length, some holding the lock for a while,
+// separated by idle time.
+static esp_err_t record_session(std::vector<uint8_t>& trace) {
+  auto& display = Display().display();
+  lv_obj_t* labels[LABELS];
+  lv_obj_t* bar;
+  {
+    auto lock = LVGLDisplay::Lock();
+    lv_obj_t* screen = lv_scr_act();
+    lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_text_color(screen, lv_color_hex(0xffffff), LV_PART_MAIN);
+    for(size_t i = 0; i < LABELS; i++) {
+      labels[i] = lv_label_create(screen);
+      lv_obj_set_pos(labels[i], (i % 2) * display.width() / 2 + 4, (i / 2) * 20 + 4);
+      lv_label_set_text(labels[i], "--");
+    }
+    bar = lv_bar_create(screen);
+    lv_obj_set_size(bar, display.width() - 8, 12);
+    lv_obj_align(bar, LV_ALIGN_BOTTOM_MID, 0, -4);
+  }
+  vTaskDelay(pdMS_TO_TICKS(100));
+
+  TraceRecorder recorder;
+  TraceRecorder::Config config;
+  config.sink = append;
+  config.context = &trace;
+  esp_err_t err;
+  {
+    auto lock = LVGLDisplay::Lock();
+    err = recorder.start(display, config);
+  }
+  if(err != ESP_OK) {
+    return err;
+  }
+
+  srand(SEED);
+  const int64_t end = display.time_us() + (int64_t)SESSION_MS * 1000;
+  while(display.time_us() < end) {
+    const int updates = 1 + rand() % 8;
+    for(int i = 0; i < updates; i++) {
+      auto lock = LVGLDisplay::Lock();
+      lv_label_set_text_fmt(labels[rand() % LABELS], "%d", rand() % 10000);
+      if(rand() % 4 == 0) {
+        lv_bar_set_value(bar, rand() % 100, LV_ANIM_OFF);
+      }
+      // Now and then a long hold, as a task rebuilding a list would.
+      spin(rand() % 10 == 0 ? 2000 + rand() % 8000 : 50 + rand() % 300);
+      vTaskDelay(1);
+    }
+    vTaskDelay(pdMS_TO_TICKS(rand() % 3 == 0 ? 100 + rand() % 400 : 10 + rand() % 40));
+  }
+  auto lock = LVGLDisplay::Lock();
+  return recorder.stop();
+}
+
+static void print_summary(const char* name, const TraceReplayer::Summary& summary) {
+  printf("\"%s\":{\"frames\":%u,\"done\":%u,\"dropped\":%u,\"duration_us\":%llu,\"render_us\":%llu,", name,
+         (unsigned)summary.frames, (unsigned)summary.done, (unsigned)summary.dropped,
+         (unsigned long long)summary.duration_us, (unsigned long long)summary.render_us);
+  printf("\"dma_wait_us\":%llu,\"flush_us\":%llu,\"flush_max_us\":%u,\"bytes\":%llu,\"locks\":%u,",
+         (unsigned long long)summary.dma_wait_us, (unsigned long long)summary.flush_us, (unsigned)summary.flush_max_us,
+         (unsigned long long)summary.bytes, (unsigned)summary.locks);
+  printf("\"lock_wait_us\":%llu,\"lock_wait_max_us\":%u,\"lock_hold_us\":%llu}", (unsigned long long)summary.lock_wait_us,
+         (unsigned)summary.lock_wait_max_us, (unsigned long long)summary.lock_hold_us);
+}
+
+// Replay the trace in one mode while recording the replay, and print both summaries as a single JSON line.
+static void run(const std::vector<uint8_t>& trace, const TraceReplayer::Summary& recorded, TraceReplayer::Mode mode,
+                uint32_t clock_mhz) {
+  auto& display = Display().display();
+  std::vector<uint8_t> replayed;
+  TraceRecorder recorder;
+  TraceRecorder::Config recorder_config;
+  recorder_config.sink = append;
+  recorder_config.context = &replayed;
+
+  TraceReplayer replayer;
+  TraceReplayer::Config config;
+  config.mode = mode;
+  esp_err_t err;
+  {
+    auto lock = LVGLDisplay::Lock();
+    err = recorder.start(display, recorder_config);
+  }
+  if(err == ESP_OK) {
+    err = replayer.replay(display, trace.data(), trace.size(), config);
+    auto lock = LVGLDisplay::Lock();
+    recorder.stop();
+  }
+  TraceReplayer::Summary summary;
+  if(err == ESP_OK) {
+    err = TraceReplayer::summarise(replayed.data(), replayed.size(), &summary);
+  }
+  if(err != ESP_OK) {
+    printf("{\"error\":\"%s\"}\n", esp_err_to_name(err));
+    exit(1);
+  }
+
+  const TraceReplayer::Stats stats = replayer.stats();
+  printf("{\"mode\":\"%s\",\"clock_mhz\":%u,\"elapsed_us\":%llu,\"late_max_us\":%u,",
+         mode == TraceReplayer::Mode::REAL_TIME ? "real_time" : "full_speed", (unsigned)clock_mhz,
+         (unsigned long long)stats.elapsed_us, (unsigned)stats.late_max_us);
+  print_summary("recorded", recorded);
+  printf(",");
+  print_summary("replayed", summary);
+  printf("}\n");
+}
+
+// Main function
+extern "C" void app_main(void) {
+  // Keep stdout machine readable, every result is one JSON object per line.
+  esp_log_level_set("*", ESP_LOG_WARN);
+
+  if(Display().initialise() != ESP_OK) {
+    printf("{\"error\":\"initialise failed\"}\n");
+    exit(1);
+  }
+
+  std::vector<uint8_t> trace;
+#if CONFIG_IDF_TARGET_LINUX
+  FILE* file = fopen(TRACE_FILE, "rb");
+  if(file) {
+    uint8_t buffer[1024];
+    size_t size;
+    while((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      trace.insert(trace.end(), buffer, buffer + size);
+    }
+    fclose(file);
+  }
+#endif
+  if(trace.empty()) {
+    if(record_session(trace) != ESP_OK) {
+      printf("{\"error\":\"session not recorded\"}\n");
+      exit(1);
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    file = fopen(SESSION_FILE, "wb");
+    if(file) {
+      fwrite(trace.data(), 1, trace.size(), file);
+      fclose(file);
+    }
+#endif
+  }
+
+  TraceReplayer::Summary recorded;
+  if(TraceReplayer::summarise(trace.data(), trace.size(), &recorded) != ESP_OK) {
+    printf("{\"error\":\"trace not readable\"}\n");
+    exit(1);
+  }
+
+#if CONFIG_IDF_TARGET_LINUX
+  auto* panel = LVGLDisplay::SimulatedPanel::from_handle(Display().display().panel_handle());
+  LVGLDisplay::BusModel::Config bus = panel->bus_config();
+  for(uint32_t clock_mhz : SPI_CLOCKS_MHZ) {
+    bus.bus = LVGLDisplay::BusModel::Bus::SPI;
+    bus.clock_hz = clock_mhz * 1000 * 1000;
+    panel->configure(bus);
+    for(TraceReplayer::Mode mode : MODES) {
+      run(trace, recorded, mode, clock_mhz);
+    }
+  }
+#else
+  // The bus the hardware was configured with, it can not be changed at runtime.
+  #ifdef CONFIG_LVGL_DISPLAY_SPI_CLOCK
+  const uint32_t clock_mhz = CONFIG_LVGL_DISPLAY_SPI_CLOCK;
+  #else
+  const uint32_t clock_mhz = 0;
+  #endif
+  for(TraceReplayer::Mode mode : MODES) {
+    run(trace, recorded, mode, clock_mhz);
+  }
+#endif
+  fflush(stdout);
+
+  exit(0);
+}
@@ -0,0 +1,330 @@
+#include <display.hpp>
+#include <frame_capture.hpp>
+#include <image_stream.hpp>
+#include <pixel_convert.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+namespace LVGLDisplay {
+
+  // Tokens as ImageStream decodes them, a length field with every bit set is followed by the rest of the length.
+  static constexpr uint8_t LENGTH_MASK = 0x3f;
+  static constexpr uint32_t LONG_LENGTH = LENGTH_MASK + 1;
+
+  static bool equal_swapped(const uint16_t* frame, const uint16_t* pixels, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+      if(frame[i] != (uint16_t)(pixels[i] << 8 | pixels[i] >> 8)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  FrameCapture::~FrameCapture() { stop(); }
+
+  esp_err_t FrameCapture::start(const Config& config, size_t width, size_t height) {
+    if(active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!config.sink || config.buffer_size < sizeof(Header) || width == 0 || height == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    // A quarter turn swaps the axes, which leaves as many tiles.
+    const size_t tiles = ((width + TILE - 1) / TILE) * ((height + TILE - 1) / TILE);
+    _frame = (uint16_t*)heap_caps_malloc(width * height * sizeof(uint16_t), config.caps);
+    _changed = (uint32_t*)heap_caps_calloc((tiles + 31) / 32, sizeof(uint32_t), MALLOC_CAP_DEFAULT);
+    _out = (uint8_t*)heap_caps_malloc(config.buffer_size, MALLOC_CAP_DEFAULT);
+    if(!_frame || !_changed || !_out) {
+      stop();
+      return ESP_ERR_NO_MEM;
+    }
+    memset(_frame, 0, width * height * sizeof(uint16_t));
+    _config = config;
+    _capacity = width * height;
+    _tile_words = (tiles + 31) / 32;
+    _frames = 0;
+    _since_key = 0;
+    resize(width, height);
+    return ESP_OK;
+  }
+
+  esp_err_t FrameCapture::start(Display& display, const Config& config) {
+    if(sizeof(lv_color_t) != sizeof(uint16_t)) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    lv_disp_t* disp = display.display();
+    if(!disp || active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = start(config, display.width(), display.height());
+    if(err != ESP_OK) {
+      return err;
+    }
+    err = display.add_hook(this);
+    if(err != ESP_OK) {
+      stop();
+      return err;
+    }
+    _display = &display;
+    _last_frame = 0;
+    // Tiles the shadow frame would drop as unchanged are not yet in the frame either.
+    display.shadow().invalidate();
+    const lv_area_t screen = {0, 0, (lv_coord_t)(display.width() - 1), (lv_coord_t)(display.height() - 1)};
+    _lv_inv_area(disp, &screen);
+    return ESP_OK;
+  }
+
+  void FrameCapture::stop() {
+    if(_display) {
+      // The flush path taps into the frame while it transfers.
+      _display->remove_hook(this);
+      _display = NULL;
+    }
+    heap_caps_free(_frame);
+    heap_caps_free(_changed);
+    heap_caps_free(_out);
+    _frame = NULL;
+    _changed = NULL;
+    _out = NULL;
+    _out_size = 0;
+  }
+
+  void FrameCapture::resize(size_t width, size_t height) {
+    const size_t tiles = ((width + TILE - 1) / TILE) * ((height + TILE - 1) / TILE);
+    if(!_frame || width * height > _capacity || tiles > _tile_words * 32) {
+      return;
+    }
+    _width = width;
+    _height = height;
+    _tiles_x = (width + TILE - 1) / TILE;
+    _tiles_y = (height + TILE - 1) / TILE;
+    mark_all();
+  }
+
+  void FrameCapture::mark_all() {
+    memset(_changed, 0xff, _tile_words * sizeof(uint32_t));
+    _key = true;
+  }
+
+  void FrameCapture::tap(const lv_area_t& area, const uint16_t* pixels, bool swapped) {
+    if(!_frame || area.x1 < 0 || area.y1 < 0 || area.x2 < area.x1 || area.y2 < area.y1 || area.x2 >= (lv_coord_t)_width ||
+       area.y2 >= (lv_coord_t)_height) {
+      return;
+    }
+    const int64_t start = esp_timer_get_time();
+    const size_t width = lv_area_get_width(&area);
+    for(lv_coord_t y = area.y1; y <= area.y2; y++) {
+      const uint16_t* src = pixels + (y - area.y1) * width;
+      uint16_t* dst = _frame + y * _width + area.x1;
+      const size_t row = y / TILE * _tiles_x;
+      // Each tile's part of the row is compared, unless the tile already changed, and copied only if it differs.
+      for(size_t x = area.x1; x <= (size_t)area.x2;) {
+        const size_t end = std::min<size_t>((x / TILE + 1) * TILE, area.x2 + 1);
+        const size_t count = end - x;
+        const size_t tile = row + x / TILE;
+        const bool differs = changed(tile) || (swapped ? !equal_swapped(dst, src, count) : memcmp(dst, src, count * sizeof(uint16_t)) != 0);
+        if(differs) {
+          swapped ? PixelConvert::swap_rgb565(dst, src, count) : (void)memcpy(dst, src, count * sizeof(uint16_t));
+          mark(tile);
+        }
+        src += count;
+        dst += count;
+        x = end;
+      }
+    }
+    _stats.tap_us += esp_timer_get_time() - start;
+  }
+
+  void FrameCapture::area_sent(const lv_area_t& area, const lv_color_t* pixels, bool swapped) {
+    // After a rotation the frame takes LVGL's new resolution, and the next record is a key record.
+    if(_display->width() != _width || _display->height() != _height) {
+      resize(_display->width(), _display->height());
+    }
+    tap(area, (const uint16_t*)pixels, swapped);
+  }
+
+  void FrameCapture::frame_sent(uint32_t frame, int64_t time_us) {
+    _last_frame = frame;
+    end_frame(frame, time_us);
+  }
+
+  void FrameCapture::end_frame(uint32_t frame, int64_t time_us) {
+    if(!_frame) {
+      return;
+    }
+    _stats.frames++;
+    if(_config.interval && ++_frames >= _config.interval) {
+      _frames = 0;
+      record(false, frame, time_us);
+    }
+  }
+
+  esp_err_t FrameCapture::record(bool key) {
+    if(!_display) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    // The frame holds every area sent once the transfers are done.
+    _display->wait_flushed();
+    return record(key, _last_frame, _display->time_us());
+  }
+
+  esp_err_t FrameCapture::record(bool key, uint32_t frame, int64_t time_us) {
+    if(!_frame) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    key = key || _key || (_config.key_interval && _since_key >= _config.key_interval);
+    // Each run of changed tiles along a row of tiles is a rectangle, a key record is one rectangle.
+    size_t rects = key ? 1 : 0;
+    for(size_t ty = 0; ty < _tiles_y && !key; ty++) {
+      for(size_t tx = 0; tx < _tiles_x; tx++) {
+        const size_t tile = ty * _tiles_x + tx;
+        rects += changed(tile) && (tx == 0 || !changed(tile - 1));
+      }
+    }
+    if(!rects) {
+      return ESP_OK;
+    }
+
+    const int64_t start = esp_timer_get_time();
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.type = (uint8_t)(key ? Type::KEY : Type::DELTA);
+    header.flags = LV_COLOR_16_SWAP ? FLAG_SWAPPED : 0;
+    header.width = _width;
+    header.height = _height;
+    header.rects = rects;
+    header.frame = frame;
+    header.time_ms = time_us / 1000;
+    _sink_err = ESP_OK;
+    _out_size = 0;
+    _record_size = 0;
+    put(&header, sizeof(header));
+    if(key) {
+      encode_rect({0, 0, (uint16_t)_width, (uint16_t)_height});
+      _stats.tiles += _tiles_x * _tiles_y;
+    }
+    for(size_t ty = 0; ty < _tiles_y && !key; ty++) {
+      for(size_t tx = 0; tx < _tiles_x;) {
+        if(!changed(ty * _tiles_x + tx)) {
+          tx++;
+          continue;
+        }
+        size_t end = tx + 1;
+        while(end < _tiles_x && changed(ty * _tiles_x + end)) {
+          end++;
+        }
+        const size_t x = tx * TILE;
+        const size_t y = ty * TILE;
+        encode_rect({(uint16_t)x, (uint16_t)y, (uint16_t)(std::min(end * TILE, _width) - x), (uint16_t)(std::min(TILE, _height - y))});
+        _stats.tiles += end - tx;
+        tx = end;
+      }
+    }
+    const uint32_t size = _record_size;
+    put(&size, sizeof(size));
+    drain();
+    memset(_changed, 0, _tile_words * sizeof(uint32_t));
+    _stats.encode_us += esp_timer_get_time() - start;
+
+    // The decoder missed part of the stream, so its frame is only whole again from a key record.
+    if(_sink_err != ESP_OK) {
+      _stats.errors++;
+      mark_all();
+      return _sink_err;
+    }
+    _stats.records++;
+    _stats.key_records += key;
+    _since_key = key ? 0 : _since_key + 1;
+    _key = false;
+    return ESP_OK;
+  }
+
+  void FrameCapture::encode_rect(const Rect& rect) {
+    put(&rect, sizeof(rect));
+    // Greedy, as tools/image_encoder.py: copy up where two or more pixels match the row above, runs of three or more,
+    // literals otherwise. Tokens end with the row.
+    for(size_t row = 0; row < rect.height; row++) {
+      const uint16_t* pixels = _frame + (rect.y + row) * _width + rect.x;
+      const uint16_t* above = row ? pixels - _width : NULL;
+      const size_t count = rect.width;
+      size_t literal = 0;
+      size_t i = 0;
+      while(i < count) {
+        size_t up = 0;
+        while(above && i + up < count && pixels[i + up] == above[i + up]) {
+          up++;
+        }
+        size_t run = 1;
+        while(i + run < count && pixels[i + run] == pixels[i]) {
+          run++;
+        }
+        if(up >= 2 && up >= run) {
+          put_literal(pixels + literal, i - literal);
+          put_token(ImageStream::COPY_UP, up);
+          i += up;
+          literal = i;
+        }
+        else if(run >= 3) {
+          put_literal(pixels + literal, i - literal);
+          put_token(ImageStream::RUN, run);
+          put(pixels + i, sizeof(uint16_t));
+          i += run;
+          literal = i;
+        }
+        else {
+          i++;
+        }
+      }
+      put_literal(pixels + literal, count - literal);
+    }
+  }
+
+  void FrameCapture::put_token(uint8_t op, size_t length) {
+    if(length < LONG_LENGTH) {
+      const uint8_t token = op << 6 | (length - 1);
+      put(&token, 1);
+      return;
+    }
+    const uint8_t token[3] = {(uint8_t)(op << 6 | LENGTH_MASK), (uint8_t)((length - LONG_LENGTH) & 0xff),
+                              (uint8_t)((length - LONG_LENGTH) >> 8)};
+    put(token, sizeof(token));
+  }
+
+  void FrameCapture::put_literal(const uint16_t* pixels, size_t count) {
+    if(count) {
+      put_token(ImageStream::LITERAL, count);
+      put(pixels, count * sizeof(uint16_t));
+    }
+  }
+
+  void FrameCapture::put(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    _record_size += size;
+    while(size && _sink_err == ESP_OK) {
+      const size_t count = std::min(size, _config.buffer_size - _out_size);
+      memcpy(_out + _out_size, bytes, count);
+      _out_size += count;
+      bytes += count;
+      size -= count;
+      if(_out_size == _config.buffer_size) {
+        drain();
+      }
+    }
+  }
+
+  esp_err_t FrameCapture::drain() {
+    if(_out_size && _sink_err == ESP_OK) {
+      _sink_err = _config.sink(_out, _out_size, _config.context);
+      if(_sink_err == ESP_OK) {
+        _stats.bytes += _out_size;
+      }
+    }
+    _out_size = 0;
+    return _sink_err;
+  }
+
+}  // namespace LVGLDisplay
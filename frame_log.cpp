@@ -0,0 +1,123 @@
+#include <frame_log.hpp>
+
+#include <new>
+
+#include "esp_heap_caps.h"
+
+namespace LVGLDisplay {
+
+  FrameLog::~FrameLog() { heap_caps_free(_slots); }
+
+  esp_err_t FrameLog::create(size_t capacity) {
+    if(_slots) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(capacity == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _slots = (Slot*)heap_caps_malloc(capacity * sizeof(Slot), MALLOC_CAP_DEFAULT);
+    if(!_slots) {
+      return ESP_ERR_NO_MEM;
+    }
+    for(size_t i = 0; i < capacity; i++) {
+      new(&_slots[i]) Slot();
+      _slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+    _capacity = capacity;
+    return ESP_OK;
+  }
+
+  void FrameLog::add(const FrameRecord& record) {
+    if(!_slots) {
+      return;
+    }
+    const uint32_t index = _next.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = _slots[index % _capacity];
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+  }
+
+  bool FrameLog::copy(uint32_t index, FrameRecord* record) const {
+    const Slot& slot = _slots[index % _capacity];
+    if(slot.sequence.load(std::memory_order_acquire) != index * 2 + 2) {
+      return false;
+    }
+    *record = slot.record;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == index * 2 + 2;
+  }
+
+  size_t FrameLog::read(FrameRecord* records, size_t count) const {
+    if(!_slots || count == 0) {
+      return 0;
+    }
+    const uint32_t next = _next.load(std::memory_order_acquire);
+    uint32_t first = _first.load(std::memory_order_relaxed);
+    if(next - first > _capacity) {
+      first = next - _capacity;
+    }
+    if(next - first > count) {
+      first = next - count;
+    }
+    // Records still being written, or overwritten while copying, are skipped.
+    size_t copied = 0;
+    for(uint32_t index = first; index != next; index++) {
+      if(copy(index, &records[copied])) {
+        copied++;
+      }
+    }
+    return copied;
+  }
+
+  FrameStats FrameLog::stats() const {
+    FrameStats stats;
+    if(!_slots) {
+      return stats;
+    }
+    uint64_t render = 0, flush = 0, dma_wait = 0, bytes = 0, areas = 0, input_latency = 0;
+    const uint32_t next = _next.load(std::memory_order_acquire);
+    uint32_t first = _first.load(std::memory_order_relaxed);
+    if(next - first > _capacity) {
+      first = next - _capacity;
+    }
+    FrameRecord record;
+    for(uint32_t index = first; index != next; index++) {
+      if(!copy(index, &record)) {
+        continue;
+      }
+      stats.frames++;
+      render += record.render_us;
+      flush += record.flush_us;
+      dma_wait += record.dma_wait_us;
+      bytes += record.bytes;
+      areas += record.areas;
+      stats.render_max_us = record.render_us > stats.render_max_us ? record.render_us : stats.render_max_us;
+      stats.flush_max_us = record.flush_us > stats.flush_max_us ? record.flush_us : stats.flush_max_us;
+      stats.dma_wait_max_us = record.dma_wait_us > stats.dma_wait_max_us ? record.dma_wait_us : stats.dma_wait_max_us;
+      stats.lock_wait_max_us = record.lock_wait_us > stats.lock_wait_max_us ? record.lock_wait_us : stats.lock_wait_max_us;
+      stats.buffers_max = record.buffers > stats.buffers_max ? record.buffers : stats.buffers_max;
+      if(record.input_us) {
+        stats.inputs++;
+        input_latency += record.input_latency_us;
+        stats.input_latency_max_us =
+          record.input_latency_us > stats.input_latency_max_us ? record.input_latency_us : stats.input_latency_max_us;
+      }
+    }
+    if(stats.frames) {
+      stats.render_avg_us = render / stats.frames;
+      stats.flush_avg_us = flush / stats.frames;
+      stats.dma_wait_avg_us = dma_wait / stats.frames;
+      stats.bytes_avg = bytes / stats.frames;
+      stats.areas_avg = areas / stats.frames;
+    }
+    if(stats.inputs) {
+      stats.input_latency_avg_us = input_latency / stats.inputs;
+    }
+    return stats;
+  }
+
+  void FrameLog::clear() { _first.store(_next.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+}  // namespace LVGLDisplay
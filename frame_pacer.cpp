@@ -0,0 +1,319 @@
+#include <display.hpp>
+#include <frame_pacer.hpp>
+
+#if !CONFIG_IDF_TARGET_LINUX
+  #include "driver/gpio.h"
+#endif
+
+namespace LVGLDisplay {
+
+  // Shorter delays are not worth a timer, the transfer starts a few lines late instead.
+  static constexpr uint32_t MIN_SLEEP_US = 20;
+
+  static int64_t positive_mod(int64_t value, int64_t modulus) {
+    const int64_t result = value % modulus;
+    return result < 0 ? result + modulus : result;
+  }
+
+  static float positive_mod(float value, float modulus) {
+    const float result = value - modulus * (int64_t)(value / modulus);
+    return result < 0 ? result + modulus : result;
+  }
+
+#if !CONFIG_IDF_TARGET_LINUX
+  GpioVsync::~GpioVsync() { stop(); }
+
+  esp_err_t GpioVsync::start(FramePacer* pacer) {
+    gpio_config_t te_gpio_config = {.pin_bit_mask = 1ULL << _pin,
+                                    .mode = GPIO_MODE_INPUT,
+                                    .pull_up_en = GPIO_PULLUP_DISABLE,
+                                    .pull_down_en = GPIO_PULLDOWN_DISABLE,
+                                    .intr_type = GPIO_INTR_POSEDGE};
+    esp_err_t err = gpio_config(&te_gpio_config);
+    if(err != ESP_OK) {
+      return err;
+    }
+    // The ISR service may already be installed by the application.
+    err = gpio_install_isr_service(0);
+    if(err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+      return err;
+    }
+    _pacer = pacer;
+    err = gpio_isr_handler_add((gpio_num_t)_pin, isr, this);
+    if(err != ESP_OK) {
+      _pacer = NULL;
+    }
+    return err;
+  }
+
+  void GpioVsync::stop() {
+    if(_pacer) {
+      gpio_isr_handler_remove((gpio_num_t)_pin);
+      _pacer = NULL;
+    }
+  }
+
+  void GpioVsync::isr(void* arg) {
+    GpioVsync* source = (GpioVsync*)arg;
+    source->_pacer->vsync(esp_timer_get_time());
+  }
+#endif
+
+  esp_err_t SimulatedVsync::start(FramePacer* pacer) {
+    if(_config.period_us == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _pacer = pacer;
+    _edge = 0;
+    return ESP_OK;
+  }
+
+  void SimulatedVsync::poll(int64_t now_us) {
+    if(!_pacer) {
+      return;
+    }
+    // The first poll starts from the latest edge, earlier ones predate pacing.
+    const int64_t period = _config.period_us;
+    const int64_t elapsed = now_us - _config.phase_us;
+    if(_edge == 0 && elapsed > period) {
+      _edge = elapsed / period - 1;
+    }
+    while(true) {
+      int64_t edge = _config.phase_us + _edge * period;
+      if(_config.jitter_us) {
+        uint32_t hash = (_edge + 1) * 2654435761u;
+        hash ^= hash >> 16;
+        edge += (int64_t)(hash % (2 * _config.jitter_us + 1)) - _config.jitter_us;
+      }
+      if(edge > now_us) {
+        break;
+      }
+      _edge++;
+      if(!_config.drop_every || _edge % _config.drop_every) {
+        _pacer->vsync(edge);
+      }
+    }
+  }
+
+  FramePacer::~FramePacer() {
+    if(_display) {
+      _display->remove_hook(this);
+    }
+    if(_source) {
+      _source->stop();
+    }
+    if(_timer) {
+      esp_timer_stop(_timer);
+      esp_timer_delete(_timer);
+    }
+    if(_wake) {
+      vSemaphoreDelete(_wake);
+    }
+  }
+
+  esp_err_t FramePacer::start(const Config& config, VsyncSource* source, Clock clock, const void* context) {
+    if(_wake) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!config.enabled || !clock || config.period_us == 0 || config.lines == 0 || config.display_lines == 0 ||
+       config.first_line + config.display_lines > config.lines) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _wake = xSemaphoreCreateBinary();
+    if(!_wake) {
+      return ESP_ERR_NO_MEM;
+    }
+    const esp_timer_create_args_t timer_args = {
+      .callback = wake,
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "lvgl_pacer",
+      .skip_unhandled_events = true,
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &_timer);
+    if(err != ESP_OK) {
+      vSemaphoreDelete(_wake);
+      _wake = NULL;
+      return err;
+    }
+
+    _config = config;
+    _clock = clock;
+    _context = context;
+    // Until the first edge arrives, the estimate runs from now at the nominal period.
+    _vsync_us = clock(context);
+    _period_us = config.period_us;
+    if(source) {
+      err = source->start(this);
+      if(err != ESP_OK) {
+        esp_timer_delete(_timer);
+        _timer = NULL;
+        vSemaphoreDelete(_wake);
+        _wake = NULL;
+        return err;
+      }
+      _source = source;
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t FramePacer::start(Display& display, const Config& config, VsyncSource* source) {
+    esp_err_t err = start(config, source, display_clock, &display);
+    if(err != ESP_OK) {
+      return err;
+    }
+    err = display.add_hook(this);
+    if(err == ESP_OK) {
+      _display = &display;
+    }
+    return err;
+  }
+
+  int64_t FramePacer::display_clock(const void* context) { return ((const Display*)context)->time_us(); }
+
+  void FramePacer::vsync(int64_t time_us) {
+    portENTER_CRITICAL_SAFE(&_lock);
+    if(_synced) {
+      const int64_t gap = time_us - _vsync_us;
+      // Bounces and glitches closer than half a period are not edges.
+      if(gap < _period_us / 2) {
+        portEXIT_CRITICAL_SAFE(&_lock);
+        return;
+      }
+      const uint32_t periods = (gap + _period_us / 2) / _period_us;
+      if(periods > 1) {
+        _stats.dropped += periods - 1;
+      }
+      else {
+        // An eighth of each interval, so the estimate follows the panel's oscillator without chasing ISR latency.
+        _period_us = (int64_t)_period_us + (gap - (int64_t)_period_us) / 8;
+      }
+    }
+    _synced = true;
+    _vsync_us = time_us;
+    _stats.vsyncs++;
+    portEXIT_CRITICAL_SAFE(&_lock);
+  }
+
+  int64_t FramePacer::schedule(int64_t now_us, const lv_area_t& area, uint32_t duration_us, bool* overlong) {
+    if(_source) {
+      _source->poll(now_us);
+    }
+    if(duration_us == 0) {
+      return now_us;
+    }
+    portENTER_CRITICAL_SAFE(&_lock);
+    const int64_t vsync = _vsync_us;
+    const uint32_t period = _period_us;
+    portEXIT_CRITICAL_SAFE(&_lock);
+
+    // The frame's extent in gate lines, and the times within a refresh the scanline enters and leaves it.
+    lv_coord_t first = _config.scan_x ? area.x1 : area.y1;
+    lv_coord_t last = _config.scan_x ? area.x2 : area.y2;
+    if(_config.reversed) {
+      const lv_coord_t reversed_first = _config.display_lines - 1 - last;
+      last = _config.display_lines - 1 - first;
+      first = reversed_first;
+    }
+    const float line_us = (float)period / (_config.lines + _config.porch_lines);
+    const float enter = (_config.porch_lines + _config.first_line + first) * line_us;
+    const float leave = (_config.porch_lines + _config.first_line + last + 1) * line_us;
+    const float phase = positive_mod(now_us - vsync, (int64_t)period);
+
+    const float margin = _config.margin_lines * line_us;
+
+    // How long since the scanline passed a reference line, and the range of that time in which the frame can start.
+    float behind, earliest, latest;
+    if(!_config.scan_x && !_config.reversed) {
+      // Every transferred row is a gate line, so the writes move through the frame in scan order. Started behind the
+      // scanline, writes slower than the scan must finish before it laps them, and faster ones must not catch it up
+      // before it leaves the frame.
+      const float gain = duration_us - (leave - enter);
+      behind = positive_mod(phase - enter, (float)period);
+      earliest = margin + (gain < 0 ? -gain : 0);
+      latest = period - margin - (gain > 0 ? gain : 0);
+    }
+    else {
+      // Otherwise every gate line of the frame changes throughout the write, which must fit between the scanline
+      // leaving the frame and entering it again.
+      behind = positive_mod(phase - leave - margin, (float)period);
+      earliest = 0;
+      latest = period - (leave - enter) - 2 * margin - duration_us;
+    }
+    if(behind >= earliest && behind <= latest) {
+      return now_us;
+    }
+    if(overlong && earliest > latest) {
+      *overlong = true;
+    }
+    // Without a clear start, the earliest is where the scanline gets least of the frame.
+    return now_us + (int64_t)positive_mod(earliest - behind, (float)period) + 1;
+  }
+
+  uint32_t FramePacer::pace(const lv_area_t& area, uint32_t duration_us) {
+    if(!_wake) {
+      return 0;
+    }
+    const int64_t begin = _clock(_context);
+    int64_t now = begin;
+    bool overlong = false;
+    uint32_t missed = 0;
+    for(int waits = 0; waits < 2; waits++) {
+      const int64_t start = schedule(now, area, duration_us, &overlong);
+      if(start <= now) {
+        break;
+      }
+      // Still not clear after waking and the next start a refresh away, so the slot was missed.
+      if(waits && start - now > _period_us / 2) {
+        missed++;
+      }
+      sleep(start - now);
+      now = _clock(_context);
+      if(overlong) {
+        break;
+      }
+    }
+
+    const uint32_t waited = now - begin;
+    portENTER_CRITICAL_SAFE(&_lock);
+    _stats.frames++;
+    _stats.missed += missed;
+    _stats.overlong += overlong;
+    if(waited) {
+      _stats.delayed++;
+      _stats.wait_total_us += waited;
+      if(waited > _stats.wait_max_us) {
+        _stats.wait_max_us = waited;
+      }
+    }
+    portEXIT_CRITICAL_SAFE(&_lock);
+    return waited;
+  }
+
+  FramePacer::Stats FramePacer::stats() const {
+    portENTER_CRITICAL_SAFE(&_lock);
+    Stats stats = _stats;
+    stats.period_us = _period_us;
+    portEXIT_CRITICAL_SAFE(&_lock);
+    return stats;
+  }
+
+  void FramePacer::reset_stats() {
+    portENTER_CRITICAL_SAFE(&_lock);
+    _stats = Stats();
+    portEXIT_CRITICAL_SAFE(&_lock);
+  }
+
+  void FramePacer::wake(void* arg) {
+    FramePacer* pacer = (FramePacer*)arg;
+    xSemaphoreGive(pacer->_wake);
+  }
+
+  void FramePacer::sleep(uint32_t us) {
+    if(us < MIN_SLEEP_US || esp_timer_start_once(_timer, us) != ESP_OK) {
+      return;
+    }
+    xSemaphoreTake(_wake, portMAX_DELAY);
+  }
+
+}  // namespace LVGLDisplay
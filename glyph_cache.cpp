@@ -0,0 +1,373 @@
+#include <glyph_cache.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+namespace LVGLDisplay {
+
+  // Coverage of each value of 1, 2 and 4 bit glyphs, as LVGL expands them when it draws a letter.
+  static const uint8_t BPP1_COVERAGE[2] = {0, 255};
+  static const uint8_t BPP2_COVERAGE[4] = {0, 85, 170, 255};
+  static const uint8_t BPP4_COVERAGE[16] = {0, 17, 34, 51, 68, 85, 102, 119, 136, 153, 170, 187, 204, 221, 238, 255};
+
+  GlyphCache::~GlyphCache() {
+    heap_caps_free(_atlas);
+    heap_caps_free(_entries);
+  }
+
+  esp_err_t GlyphCache::create(const Config& config) {
+    if(_atlas) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    const size_t entries = config.entries ? config.entries : config.budget / 64;
+    if(config.budget == 0 || entries == 0 || entries > MAX_ENTRIES) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    size_t buckets = 1;
+    while(buckets < entries) {
+      buckets <<= 1;
+    }
+    // The entries are looked up for every letter, so they stay in internal memory wherever the atlas is placed.
+    _entries = (Entry*)heap_caps_malloc(entries * sizeof(Entry) + buckets * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    _atlas = (uint8_t*)heap_caps_malloc(config.budget, config.caps);
+    if(!_entries || !_atlas) {
+      heap_caps_free(_entries);
+      heap_caps_free(_atlas);
+      _entries = NULL;
+      _atlas = NULL;
+      return ESP_ERR_NO_MEM;
+    }
+    _buckets = (uint16_t*)(_entries + entries);
+    _bucket_mask = buckets - 1;
+    _capacity = entries;
+    _config = config;
+    _config.entries = entries;
+    clear();
+    return ESP_OK;
+  }
+
+  esp_err_t GlyphCache::add_font(const lv_font_t* font) {
+    if(!font) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(!_atlas) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(cached(font)) {
+      return ESP_OK;
+    }
+    if(_font_count == MAX_FONTS) {
+      return ESP_ERR_NO_MEM;
+    }
+    _fonts[_font_count++] = font;
+    return ESP_OK;
+  }
+
+  bool GlyphCache::cached(const lv_font_t* font) const {
+    for(size_t i = 0; i < _font_count; i++) {
+      if(_fonts[i] == font) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  esp_err_t GlyphCache::warm(const lv_font_t* font, const char* text) {
+    esp_err_t err = add_font(font);
+    if(err != ESP_OK) {
+      return err;
+    }
+    if(!text) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t i = 0;
+    uint32_t letter;
+    while((letter = _lv_txt_encoded_next(text, &i)) != 0) {
+      Entry* entry = find(font, letter);
+      if(entry) {
+        touch(entry - _entries);
+      }
+      else if(!rasterize(font, letter)) {
+        err = ESP_ERR_NO_MEM;
+      }
+    }
+    return err;
+  }
+
+  void GlyphCache::clear() {
+    if(!_atlas) {
+      return;
+    }
+    for(size_t i = 0; i < _capacity; i++) {
+      _entries[i] = Entry();
+      _entries[i].next = i + 1 < _capacity ? i + 1 : NONE;
+    }
+    memset(_buckets, 0xFF, (_bucket_mask + 1) * sizeof(uint16_t));
+    _free = 0;
+    _first = NONE;
+    _last = NONE;
+    _newest = NONE;
+    _oldest = NONE;
+    _end = 0;
+    _stats.glyphs = 0;
+    _stats.used = 0;
+  }
+
+  bool GlyphCache::draw(lv_draw_ctx_t* draw_ctx, const lv_draw_label_dsc_t* dsc, const lv_point_t* pos, uint32_t letter) {
+    const lv_font_t* font = dsc->font;
+    if(!_atlas || !cached(font)) {
+      return false;
+    }
+    Entry* entry = find(font, letter);
+    if(entry) {
+      _stats.hits++;
+      touch(entry - _entries);
+    }
+    else {
+      _stats.misses++;
+      entry = rasterize(font, letter);
+      if(!entry) {
+        _stats.bypassed++;
+        return false;
+      }
+    }
+    // Nothing to draw for a space.
+    if(!entry->box_w || !entry->box_h) {
+      return true;
+    }
+
+    // Placed as LVGL places the letter: its box sits on the base line of the line box.
+    lv_area_t area;
+    area.x1 = pos->x + entry->ofs_x;
+    area.y1 = pos->y + (font->line_height - font->base_line) - entry->box_h - entry->ofs_y;
+    area.x2 = area.x1 + entry->box_w - 1;
+    area.y2 = area.y1 + entry->box_h - 1;
+    lv_area_t clipped;
+    if(!_lv_area_intersect(&clipped, &area, draw_ctx->clip_area)) {
+      return true;
+    }
+#if LV_DRAW_COMPLEX
+    // LVGL applies its masks to the coverage row by row, leave those letters to it.
+    if(lv_draw_mask_is_any(&area)) {
+      _stats.bypassed++;
+      return false;
+    }
+#endif
+
+    lv_draw_sw_blend_dsc_t blend = {};
+    blend.blend_area = &clipped;
+    blend.mask_area = &area;
+    blend.mask_buf = _atlas + entry->offset;
+    blend.mask_res = LV_DRAW_MASK_RES_CHANGED;
+    blend.color = dsc->color;
+    blend.opa = dsc->opa;
+    blend.blend_mode = dsc->blend_mode;
+    lv_draw_sw_blend(draw_ctx, &blend);
+    return true;
+  }
+
+  GlyphCache::Stats GlyphCache::stats() const { return _stats; }
+
+  float GlyphCache::hit_rate() const {
+    const uint32_t lookups = _stats.hits + _stats.misses;
+    return lookups ? (float)_stats.hits / lookups : 0.0f;
+  }
+
+  void GlyphCache::reset_stats() {
+    _stats.hits = 0;
+    _stats.misses = 0;
+    _stats.evictions = 0;
+    _stats.bypassed = 0;
+  }
+
+  GlyphCache::Entry* GlyphCache::find(const lv_font_t* font, uint32_t letter) {
+    for(uint16_t i = _buckets[bucket(font, letter)]; i != NONE; i = _entries[i].chain) {
+      if(_entries[i].font == font && _entries[i].letter == letter) {
+        return &_entries[i];
+      }
+    }
+    return NULL;
+  }
+
+  GlyphCache::Entry* GlyphCache::rasterize(const lv_font_t* font, uint32_t letter) {
+    // Letters missing from the font are drawn by LVGL, with its placeholder.
+    lv_font_glyph_dsc_t glyph;
+    if(!lv_font_get_glyph_dsc(font, &glyph, letter, '\0')) {
+      return NULL;
+    }
+    if(glyph.resolved_font->subpx || (glyph.bpp != 1 && glyph.bpp != 2 && glyph.bpp != 3 && glyph.bpp != 4 && glyph.bpp != 8)) {
+      return NULL;
+    }
+    const uint8_t* bitmap = NULL;
+    if(glyph.box_w && glyph.box_h) {
+      bitmap = lv_font_get_glyph_bitmap(glyph.resolved_font, letter);
+      if(!bitmap) {
+        return NULL;
+      }
+    }
+    return insert(font, letter, glyph, bitmap);
+  }
+
+  GlyphCache::Entry* GlyphCache::insert(const lv_font_t* font, uint32_t letter, const lv_font_glyph_dsc_t& glyph,
+                                        const uint8_t* bitmap) {
+    const size_t size = glyph.box_w * glyph.box_h;
+    if(size > _config.budget / 4 || !make_room(size)) {
+      return NULL;
+    }
+    const uint16_t index = _free;
+    Entry& entry = _entries[index];
+    _free = entry.next;
+    entry.font = font;
+    entry.letter = letter;
+    entry.offset = _end;
+    entry.box_w = glyph.box_w;
+    entry.box_h = glyph.box_h;
+    entry.ofs_x = glyph.ofs_x;
+    entry.ofs_y = glyph.ofs_y;
+    entry.newer = NONE;
+    entry.older = NONE;
+    entry.next = NONE;
+
+    uint8_t* coverage = _atlas + _end;
+    if(size && glyph.bpp == 8) {
+      memcpy(coverage, bitmap, size);
+    }
+    else if(size) {
+      // As LVGL, which draws 3 bit glyphs as 4 bit ones. Rows follow each other without padding, the first pixel in
+      // the most significant bits.
+      const uint32_t bpp = glyph.bpp == 3 ? 4 : glyph.bpp;
+      const uint8_t* table = bpp == 1 ? BPP1_COVERAGE : bpp == 2 ? BPP2_COVERAGE : BPP4_COVERAGE;
+      const uint32_t mask = (1 << bpp) - 1;
+      uint32_t bit = 0;
+      for(size_t i = 0; i < size; i++, bit += bpp) {
+        coverage[i] = table[(bitmap[bit >> 3] >> (8 - bpp - (bit & 7))) & mask];
+      }
+    }
+    _end += size;
+
+    if(_last != NONE) {
+      _entries[_last].next = index;
+    }
+    else {
+      _first = index;
+    }
+    _last = index;
+    uint16_t& head = _buckets[bucket(font, letter)];
+    entry.chain = head;
+    head = index;
+    touch(index);
+    _stats.glyphs++;
+    _stats.used += size;
+    return &entry;
+  }
+
+  bool GlyphCache::make_room(size_t bytes) {
+    if(_end + bytes <= _config.budget && _free != NONE) {
+      return true;
+    }
+    // Evict the least recently drawn glyphs until this one and an eighth of the atlas more fit, so the next few misses
+    // do not move the atlas again, then close the gaps.
+    const size_t room = std::min(bytes + _config.budget / 8, _config.budget);
+    const size_t slots = std::max<size_t>(_capacity / 8, 1);
+    while(_oldest != NONE && (_config.budget - _stats.used < room || _capacity - _stats.glyphs < slots)) {
+      evict(_oldest);
+    }
+    compact();
+    return _end + bytes <= _config.budget && _free != NONE;
+  }
+
+  void GlyphCache::evict(uint16_t index) {
+    Entry& entry = _entries[index];
+    uint16_t* link = &_buckets[bucket(entry.font, entry.letter)];
+    while(*link != index) {
+      link = &_entries[*link].chain;
+    }
+    *link = entry.chain;
+    unlink(index);
+    // The coverage stays in the atlas, and the entry in atlas order, until the next compact().
+    entry.font = NULL;
+    _stats.glyphs--;
+    _stats.used -= entry.box_w * entry.box_h;
+    _stats.evictions++;
+  }
+
+  void GlyphCache::compact() {
+    // Move the glyphs down over the evicted ones in atlas order, and return the evicted entries to the free list.
+    size_t end = 0;
+    uint16_t previous = NONE;
+    uint16_t index = _first;
+    _first = NONE;
+    while(index != NONE) {
+      Entry& entry = _entries[index];
+      const uint16_t next = entry.next;
+      if(entry.font) {
+        const size_t size = entry.box_w * entry.box_h;
+        if(entry.offset != end) {
+          memmove(_atlas + end, _atlas + entry.offset, size);
+          entry.offset = end;
+        }
+        end += size;
+        if(previous != NONE) {
+          _entries[previous].next = index;
+        }
+        else {
+          _first = index;
+        }
+        previous = index;
+      }
+      else {
+        entry.next = _free;
+        _free = index;
+      }
+      index = next;
+    }
+    if(previous != NONE) {
+      _entries[previous].next = NONE;
+    }
+    _last = previous;
+    _end = end;
+  }
+
+  void GlyphCache::touch(uint16_t index) {
+    if(_newest == index) {
+      return;
+    }
+    Entry& entry = _entries[index];
+    // Every glyph in the list but the newest has a newer one, a glyph just inserted has neither.
+    if(entry.newer != NONE) {
+      unlink(index);
+    }
+    entry.older = _newest;
+    if(_newest != NONE) {
+      _entries[_newest].newer = index;
+    }
+    else {
+      _oldest = index;
+    }
+    _newest = index;
+  }
+
+  void GlyphCache::unlink(uint16_t index) {
+    Entry& entry = _entries[index];
+    if(entry.newer != NONE) {
+      _entries[entry.newer].older = entry.older;
+    }
+    else {
+      _newest = entry.older;
+    }
+    if(entry.older != NONE) {
+      _entries[entry.older].newer = entry.newer;
+    }
+    else {
+      _oldest = entry.newer;
+    }
+    entry.newer = NONE;
+    entry.older = NONE;
+  }
+
+  uint32_t GlyphCache::bucket(const lv_font_t* font, uint32_t letter) const {
+    uint32_t hash = (letter ^ (uint32_t)((uintptr_t)font >> 2) * 31) * 2654435761u;
+    return (hash ^ hash >> 16) & _bucket_mask;
+  }
+
+}  // namespace LVGLDisplay
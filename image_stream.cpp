@@ -0,0 +1,242 @@
+#include <image_stream.hpp>
+#include <pixel_convert.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+namespace LVGLDisplay {
+
+  // A length field with every bit set is followed by the rest of the length.
+  static constexpr uint8_t LENGTH_MASK = 0x3f;
+  static constexpr uint32_t LONG_LENGTH = LENGTH_MASK + 1;
+
+  ImageStream::~ImageStream() { close(); }
+
+  esp_err_t ImageStream::open(const void* data, size_t size) {
+    close();
+    Header header;
+    if(!data || size < sizeof(header)) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.width == 0 || header.height == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(header.codec != (uint8_t)Codec::RAW && header.codec != (uint8_t)Codec::RLE) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    const size_t keys = header.key_rows ? (header.height + header.key_rows - 1) / header.key_rows : 0;
+    const size_t payload_offset = sizeof(header) + keys * sizeof(uint32_t);
+    if(payload_offset + header.payload_size > size) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(header.codec == (uint8_t)Codec::RAW && header.payload_size != (size_t)header.width * header.height * sizeof(uint16_t)) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    for(size_t i = 0; i < keys; i++) {
+      uint32_t offset;
+      memcpy(&offset, (const uint8_t*)data + sizeof(header) + i * sizeof(offset), sizeof(offset));
+      if(offset >= header.payload_size) {
+        return ESP_ERR_INVALID_ARG;
+      }
+    }
+
+    // Only RLE images decode through the row buffer, RAW rows are copied straight from the image.
+    if(header.codec == (uint8_t)Codec::RLE) {
+      _line = (uint16_t*)heap_caps_malloc(header.width * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+      if(!_line) {
+        return ESP_ERR_NO_MEM;
+      }
+    }
+    _data = (const uint8_t*)data;
+    _payload = _data + payload_offset;
+    _size = size;
+    _payload_size = header.payload_size;
+    _width = header.width;
+    _height = header.height;
+    _key_rows = header.key_rows;
+    _codec = (Codec)header.codec;
+    _swap = (bool)(header.flags & FLAG_SWAPPED) != (bool)LV_COLOR_16_SWAP;
+    _row = _height;
+    _line_valid = false;
+    _stats = Stats();
+    return ESP_OK;
+  }
+
+  void ImageStream::close() {
+    if(_obj) {
+      lv_obj_del(_obj);
+    }
+    heap_caps_free(_line);
+    _line = NULL;
+    _data = NULL;
+    _payload = NULL;
+    _size = 0;
+    _width = 0;
+    _height = 0;
+  }
+
+  esp_err_t ImageStream::read(size_t y, size_t x1, size_t x2, uint16_t* pixels) {
+    if(!_payload || y >= _height || x1 > x2 || x2 >= _width) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    const size_t count = x2 - x1 + 1;
+    if(_codec == Codec::RAW) {
+      memcpy(pixels, _payload + (y * _width + x1) * sizeof(uint16_t), count * sizeof(uint16_t));
+    }
+    else {
+      const esp_err_t err = seek(y);
+      if(err != ESP_OK) {
+        return err;
+      }
+      memcpy(pixels, _line + x1, count * sizeof(uint16_t));
+    }
+    if(_swap) {
+      PixelConvert::swap_rgb565(pixels, pixels, count);
+    }
+    _stats.rows++;
+    return ESP_OK;
+  }
+
+  esp_err_t ImageStream::seek(size_t y) {
+    if(_line_valid && _row == y + 1) {
+      return ESP_OK;
+    }
+    // Decoding carries on from the last row read if the row is further on, unless a key row is closer.
+    const size_t key = _key_rows ? y / _key_rows * _key_rows : 0;
+    if(!_line_valid || _row > y || key > _row) {
+      uint32_t offset = 0;
+      if(key) {
+        memcpy(&offset, _data + sizeof(Header) + key / _key_rows * sizeof(offset), sizeof(offset));
+      }
+      _row = key;
+      _position = offset;
+      _remaining = 0;
+      _line_valid = false;
+      _stats.seeks++;
+    }
+    while(_row <= y) {
+      const esp_err_t err = decode_row();
+      if(err != ESP_OK) {
+        // Start again from a key row on the next read.
+        _line_valid = false;
+        _row = _height;
+        return err;
+      }
+      if(_row <= y) {
+        _stats.skipped_rows++;
+      }
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t ImageStream::decode_row() {
+    size_t x = 0;
+    while(x < _width) {
+      if(_remaining == 0) {
+        if(_position >= _payload_size) {
+          return ESP_ERR_INVALID_SIZE;
+        }
+        const uint8_t token = _payload[_position++];
+        _op = token >> 6;
+        _remaining = (token & LENGTH_MASK) + 1;
+        if(_remaining == LONG_LENGTH) {
+          if(_position + 2 > _payload_size) {
+            return ESP_ERR_INVALID_SIZE;
+          }
+          _remaining += _payload[_position] | _payload[_position + 1] << 8;
+          _position += 2;
+        }
+        if(_op == RUN) {
+          if(_position + sizeof(_pixel) > _payload_size) {
+            return ESP_ERR_INVALID_SIZE;
+          }
+          memcpy(&_pixel, _payload + _position, sizeof(_pixel));
+          _position += sizeof(_pixel);
+        }
+        else if(_op == LITERAL ? _position + _remaining * sizeof(uint16_t) > _payload_size : _op != COPY_UP || !_line_valid) {
+          return ESP_ERR_INVALID_SIZE;
+        }
+      }
+
+      const size_t count = std::min((size_t)_remaining, _width - x);
+      switch(_op) {
+        case LITERAL:
+          memcpy(_line + x, _payload + _position, count * sizeof(uint16_t));
+          _position += count * sizeof(uint16_t);
+          break;
+        case RUN: std::fill(_line + x, _line + x + count, _pixel); break;
+        case COPY_UP:
+          // The row buffer still holds the row above.
+          break;
+      }
+      x += count;
+      _remaining -= count;
+    }
+    _row++;
+    _line_valid = true;
+    return ESP_OK;
+  }
+
+  lv_obj_t* ImageStream::create(lv_obj_t* parent) {
+#if LV_COLOR_DEPTH == 16
+    if(!_payload || _obj) {
+      return _obj;
+    }
+    _obj = lv_obj_create(parent);
+    lv_obj_remove_style_all(_obj);
+    lv_obj_clear_flag(_obj, LV_OBJ_FLAG_SCROLLABLE | LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_set_size(_obj, _width, _height);
+    lv_obj_add_event_cb(_obj, event_callback, LV_EVENT_ALL, this);
+    return _obj;
+#else
+    return NULL;
+#endif
+  }
+
+  void ImageStream::event_callback(lv_event_t* e) {
+    ImageStream* stream = (ImageStream*)lv_event_get_user_data(e);
+    switch(lv_event_get_code(e)) {
+      case LV_EVENT_COVER_CHECK: {
+        // Without styles the object reports it covers nothing, but every pixel of the image is opaque.
+        lv_cover_check_info_t* info = (lv_cover_check_info_t*)lv_event_get_param(e);
+        if(info->res != LV_COVER_RES_MASKED) {
+          lv_area_t coords;
+          lv_obj_get_coords(stream->_obj, &coords);
+          info->res = _lv_area_is_in(info->area, &coords, 0) ? LV_COVER_RES_COVER : LV_COVER_RES_NOT_COVER;
+        }
+        break;
+      }
+      case LV_EVENT_DRAW_MAIN: stream->draw(e); break;
+      case LV_EVENT_DELETE: stream->_obj = NULL; break;
+      default: break;
+    }
+  }
+
+  void ImageStream::draw(lv_event_t* e) {
+    lv_draw_ctx_t* draw_ctx = lv_event_get_draw_ctx(e);
+    lv_area_t coords;
+    lv_area_t clip;
+    lv_obj_get_coords(_obj, &coords);
+    if(!_lv_area_intersect(&clip, &coords, draw_ctx->clip_area)) {
+      return;
+    }
+
+    // Rows are decoded straight into the stripe LVGL is rendering.
+    const int64_t start = esp_timer_get_time();
+    const lv_coord_t stride = lv_area_get_width(draw_ctx->buf_area);
+    lv_color_t* row =
+      (lv_color_t*)draw_ctx->buf + (clip.y1 - draw_ctx->buf_area->y1) * stride + (clip.x1 - draw_ctx->buf_area->x1);
+    for(lv_coord_t y = clip.y1; y <= clip.y2; y++, row += stride) {
+      if(read(y - coords.y1, clip.x1 - coords.x1, clip.x2 - coords.x1, (uint16_t*)row) != ESP_OK) {
+        _stats.errors += clip.y2 - y + 1;
+        break;
+      }
+    }
+    _stats.decode_us += esp_timer_get_time() - start;
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,98 @@
+/**
+ * @file area_coalescer.hpp
+ * @brief Defines the LVGLDisplay::AreaCoalescer class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Merges, trims and reorders LVGL's invalidated areas before they are rendered and flushed.
+   * Every flushed area costs a CASET/RASET/RAMWR window set on top of its pixel bytes, and areas taller than the draw
+   * buffer are flushed as several stripes. The coalescer uses that cost model to decide whether rendering the
+   * bounding box of two areas is cheaper than flushing them separately.
+   */
+  class AreaCoalescer {
+   public:
+    struct Config {
+      bool enabled = true;             /**< Whether areas are coalesced. */
+      uint32_t transaction_cost = 256; /**< Cost of one window set and transfer setup, in pixel bytes. */
+      uint8_t bytes_per_pixel = 2;     /**< Bytes per pixel on the bus. */
+      uint32_t buffer_pixels = 0;      /**< Draw buffer size in pixels, 0 for an unlimited buffer. */
+    };
+
+    struct Stats {
+      uint32_t frames = 0;              /**< Number of refreshes with invalidated areas. */
+      uint64_t areas_in = 0;            /**< Areas invalidated by LVGL. */
+      uint64_t areas_out = 0;           /**< Areas left to render. */
+      uint32_t merged = 0;              /**< Number of area pairs merged into their bounding box. */
+      uint32_t trimmed = 0;             /**< Number of areas trimmed where they overlap another area. */
+      uint32_t dropped = 0;             /**< Number of areas dropped as covered by another area. */
+      uint64_t transactions_before = 0; /**< Flush transactions the invalidated areas would have needed. */
+      uint64_t transactions_after = 0;  /**< Flush transactions the coalesced areas need. */
+      uint64_t bytes_before = 0;        /**< Pixel bytes the invalidated areas would have transferred. */
+      uint64_t bytes_after = 0;         /**< Pixel bytes the coalesced areas transfer. */
+    };
+
+    AreaCoalescer() = default;
+
+    /**
+     * @brief Change the cost model.
+     */
+    void configure(const Config& config) { _config = config; }
+
+    /**
+     * @brief Returns the active cost model.
+     */
+    const Config& config() const { return _config; }
+
+    /**
+     * @brief Coalesce the invalidated areas of a display in place.
+     * Must be called with the LVGL lock held, before the display is refreshed.
+     *
+     * @param disp The display to coalesce the invalidated areas of.
+     */
+    void coalesce(lv_disp_t* disp);
+
+    /**
+     * @brief Coalesce a list of areas in place.
+     *
+     * @param areas The areas, updated with the coalesced areas.
+     * @param count The number of areas, updated with the number of coalesced areas.
+     */
+    void coalesce(lv_area_t* areas, size_t* count);
+
+    /**
+     * @brief Returns the number of flush transactions needed for an area.
+     */
+    uint32_t transactions(const lv_area_t& area) const;
+
+    /**
+     * @brief Returns the cost of flushing an area, in bytes.
+     */
+    uint64_t cost(const lv_area_t& area) const;
+
+    /**
+     * @brief Returns the accumulated statistics.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+   private:
+    bool trim(lv_area_t& area, const lv_area_t& other);
+
+    Config _config;
+    Stats _stats;
+  };
+
+}  // namespace LVGLDisplay
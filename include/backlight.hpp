@@ -0,0 +1,180 @@
+/**
+ * @file backlight.hpp
+ * @brief Defines the LVGLDisplay::Backlight class.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+  #include "soc/soc_caps.h"
+#endif
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Dims a backlight with the LEDC peripheral, fading between levels in hardware.
+   * Levels are perceived brightness, 0 to MAX_LEVEL, gamma corrected to a duty cycle. A fade is handed to the LEDC
+   * fade engine, which steps the duty from its interrupt with no task involved; the duty ramps linearly between the
+   * gamma corrected ends. A new level stops a fade in progress where it is, rather than waiting for it; on the ESP32,
+   * whose LEDC can not stop a fade, the level is shown from a timer once the fade ends.
+   *
+   * The idle policy dims the backlight after a period without user activity, as LVGL measures it from its input
+   * devices and lv_disp_trig_activity(), then turns it off, and restores it on the next activity. The controller
+   * calls idle() from an LVGL timer. On the linux target there is no LEDC, the fades are simulated in time.
+   */
+  class Backlight {
+   public:
+    static constexpr uint8_t MAX_LEVEL = 255; /**< The brightest level. */
+
+    struct Config {
+      int gpio = -1;                 /**< GPIO driving the backlight. */
+      bool invert = false;           /**< Whether the backlight is lit by a low output. */
+      uint32_t frequency_hz = 2000;  /**< PWM frequency. */
+      uint8_t resolution_bits = 12;  /**< Duty resolution, frequency_hz << resolution_bits at most 80 MHz. */
+      uint8_t timer = 3;             /**< LEDC timer, the last so applications keep the first ones. */
+      uint8_t channel = 7;           /**< LEDC channel, in low speed mode. */
+      float gamma = 2.2;             /**< Exponent from level to duty, 1 for linear. */
+    };
+
+    struct Policy {
+      uint32_t dim_after_ms = 0; /**< Inactivity before dimming, 0 to never dim. */
+      uint8_t dim_level = 32;    /**< Level dimmed to, if below the level set. */
+      uint32_t off_after_ms = 0; /**< Inactivity before turning off, 0 to never turn off. */
+      uint32_t fade_ms = 500;    /**< Fade to the dimmed level or off. */
+      uint32_t wake_ms = 100;    /**< Fade back to the level set on activity. */
+
+      /**
+       * @brief Returns whether the policy dims or turns off the backlight at all.
+       */
+      bool enabled() const { return dim_after_ms || off_after_ms; }
+    };
+
+    /**
+     * @brief The backlight's state under the idle policy.
+     */
+    enum class State : uint8_t {
+      ACTIVE, /**< At the level set. */
+      DIMMED, /**< Dimmed for inactivity. */
+      OFF,    /**< Turned off for inactivity. */
+    };
+
+    Backlight() = default;
+    ~Backlight();
+
+    /**
+     * @brief Configure the LEDC timer and channel and the fade engine, with the backlight off.
+     *
+     * @param config The backlight configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if already started, ESP_ERR_NO_MEM, or an
+     * error from the LEDC driver.
+     */
+    esp_err_t start(const Config& config);
+
+    /**
+     * @brief Returns whether the backlight has been started.
+     */
+    bool active() const { return _mutex != NULL; }
+
+    /**
+     * @brief Set the level, fading to it. Applied now unless dimmed or off for inactivity, then on the next activity.
+     * Never waits for a fade in progress.
+     *
+     * @param level The level, 0 for off.
+     * @param fade_ms The time to fade over, 0 to switch.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not started, or an error from the LEDC driver.
+     */
+    esp_err_t set(uint8_t level, uint32_t fade_ms);
+
+    /**
+     * @brief Returns the level set, whatever the idle policy shows.
+     */
+    uint8_t level() const { return _level; }
+
+    /**
+     * @brief Returns the level shown, or being faded to.
+     */
+    uint8_t target() const { return _target; }
+
+    /**
+     * @brief Returns the current duty cycle, out of max_duty().
+     */
+    uint32_t duty() const;
+
+    /**
+     * @brief Returns the duty cycle of a fully lit backlight.
+     */
+    uint32_t max_duty() const { return 1u << _config.resolution_bits; }
+
+    /**
+     * @brief Returns the duty cycle a level is shown with.
+     *
+     * @param level The level.
+     */
+    uint32_t duty(uint8_t level) const;
+
+    /**
+     * @brief Set the idle policy. The controller's timer only runs while the policy is enabled.
+     *
+     * @param policy The idle policy.
+     */
+    void policy(const Policy& policy);
+
+    /**
+     * @brief Returns the idle policy.
+     */
+    Policy policy() const { return _policy; }
+
+    /**
+     * @brief Returns the state under the idle policy.
+     */
+    State state() const { return _state; }
+
+    /**
+     * @brief Apply the idle policy, dimming, turning off or restoring the backlight.
+     *
+     * @param inactive_ms The time since the last user activity.
+     * @return ESP_OK on success, or an error from the LEDC driver.
+     */
+    esp_err_t idle(uint32_t inactive_ms);
+
+    /* Delete move and copy assignment operators and constuctors */
+    Backlight(const Backlight&) = delete;
+    Backlight(Backlight&&) = delete;
+    Backlight& operator=(const Backlight&) = delete;
+    Backlight&& operator=(Backlight&&) = delete;
+
+   private:
+#if !CONFIG_IDF_TARGET_LINUX && !SOC_LEDC_SUPPORT_FADE_STOP
+    static void deferred_callback(void* arg);
+#endif
+    uint8_t shown(State state) const;
+    esp_err_t show(uint8_t level, uint32_t fade_ms);
+    esp_err_t fade(uint32_t fade_ms);
+
+    Config _config;
+    Policy _policy;
+    SemaphoreHandle_t _mutex = NULL; /**< Serialises the application's levels and the policy's. */
+    std::atomic<uint8_t> _level{0};  /**< Level set by the application. */
+    std::atomic<uint8_t> _target{0}; /**< Level shown, or being faded to. */
+    State _state = State::ACTIVE;
+    int64_t _fade_start_us = 0;      /**< Time the latest fade started. */
+    int64_t _fade_end_us = 0;        /**< Time the latest fade ends. */
+#if CONFIG_IDF_TARGET_LINUX
+    uint32_t _from_duty = 0;         /**< Duty the simulated fade started from. */
+#elif !SOC_LEDC_SUPPORT_FADE_STOP
+    esp_timer_handle_t _deferred = NULL; /**< Shows the target set during a fade once the fade ends. */
+    uint32_t _deferred_fade_ms = 0;      /**< Fade to the deferred target over. */
+#endif
+  };
+
+}  // namespace LVGLDisplay
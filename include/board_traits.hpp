@@ -0,0 +1,243 @@
+/**
+ * @file board_traits.hpp
+ * @brief Defines the LVGLDisplay::BoardTraits descriptor and the LVGLDisplay::Board adapter.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus_model.hpp"
+#include "display.hpp"
+#include "frame_pacer.hpp"
+#include "sdkconfig.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Compile time board properties shared by every board, read from Kconfig.
+   * A board describes itself with a traits struct deriving from this one, adding its resolution, bus and buffer
+   * placement, and overriding any default which does not apply:
+   * @code
+   * struct MyBoardTraits : BoardTraits {
+   *   static constexpr size_t hres = 320;
+   *   static constexpr size_t vres = 170;
+   *   static constexpr BusModel::Bus bus = BusModel::Bus::I80;
+   *   static constexpr uint8_t bus_width = 8;
+   *   static constexpr uint32_t clock_hz = CONFIG_LVGL_DISPLAY_PIXEL_CLOCK * 1000 * 1000;
+   *   static constexpr bool dma = true;
+   *   static constexpr bool spi_ram = false;
+   * };
+   * @endcode
+   */
+  struct BoardTraits {
+    static constexpr size_t buffer_lines = CONFIG_LVGL_DISPLAY_DRAW_BUFF_LEN; /**< Draw buffer height in lines. */
+    static constexpr size_t queue_depth = CONFIG_LVGL_DISPLAY_TQUEUE_DEPTH;   /**< Colour transfer queue depth. */
+    static constexpr bool double_buffer = true;                                /**< Whether two draw buffers are used. */
+    static constexpr size_t buffer_count = CONFIG_LVGL_DISPLAY_BUFFER_COUNT;   /**< Draw buffers, more than 2 for a ring. */
+    static constexpr bool monochrome = false;                                  /**< Whether the panel is monochrome. */
+    static constexpr bool swap_xy = true;                                      /**< Whether the X and Y axes are swapped. */
+    static constexpr size_t panel_lines = 320;                                 /**< Gate lines the panel controller scans. */
+    static constexpr size_t panel_columns = 240;                               /**< Source lines, columns of its memory. */
+    static constexpr size_t scan_offset = 0;                                   /**< Gate line of the first display line. */
+    static constexpr int x_gap = 0;                                            /**< Column offset in the panel's memory. */
+    static constexpr int y_gap = 0;                                            /**< Row offset in the panel's memory. */
+    static constexpr bool bus_swap = false;                                    /**< Whether the bus swaps colour bytes. */
+    /** @brief Whether the X axis is mirrored. */
+#if CONFIG_LVGL_DISPLAY_MIRROR_X
+    static constexpr bool mirror_x = true;
+#else
+    static constexpr bool mirror_x = false;
+#endif
+    /** @brief Whether the Y axis is mirrored. */
+#if CONFIG_LVGL_DISPLAY_MIRROR_Y
+    static constexpr bool mirror_y = true;
+#else
+    static constexpr bool mirror_y = false;
+#endif
+    /** @brief Whether the flush path swaps the RGB565 byte order. */
+#if CONFIG_LVGL_DISPLAY_SOFTWARE_SWAP
+    static constexpr bool software_swap = true;
+#else
+    static constexpr bool software_swap = false;
+#endif
+    /** @brief Whether the panel is brought up in its own task, overlapping LVGL's start. */
+#if CONFIG_LVGL_DISPLAY_ASYNC_BRING_UP
+    static constexpr bool async_bring_up = true;
+#else
+    static constexpr bool async_bring_up = false;
+#endif
+    /** @brief RGB888 colour the panel is filled with before it is turned on, -1 for none. */
+#if CONFIG_LVGL_DISPLAY_SPLASH
+    static constexpr int32_t splash_color = CONFIG_LVGL_DISPLAY_SPLASH_COLOR;
+#else
+    static constexpr int32_t splash_color = -1;
+#endif
+    /** @brief Pixel format of the colour transfers. */
+#if CONFIG_LVGL_DISPLAY_RGB444
+    static constexpr TransferFormat transfer_format = TransferFormat::RGB444;
+#else
+    static constexpr TransferFormat transfer_format = TransferFormat::RGB565;
+#endif
+    /** @brief Whether the backlight is dimmed with the LEDC peripheral, its PWM frequency and gamma. */
+#if CONFIG_LVGL_DISPLAY_BACKLIGHT_PWM
+    static constexpr bool pwm_backlight = true;
+    static constexpr uint32_t backlight_frequency_hz = CONFIG_LVGL_DISPLAY_BACKLIGHT_FREQUENCY;
+    static constexpr float backlight_gamma = CONFIG_LVGL_DISPLAY_BACKLIGHT_GAMMA / 10.0f;
+#else
+    static constexpr bool pwm_backlight = false;
+    static constexpr uint32_t backlight_frequency_hz = 2000;
+    static constexpr float backlight_gamma = 2.2f;
+#endif
+    /** @brief Whether the SPI bus is shared with other devices, and the longest a colour chunk holds it. */
+#if CONFIG_LVGL_DISPLAY_SPI_SHARED
+    static constexpr bool shared_bus = true;
+    static constexpr uint32_t bus_chunk_us = CONFIG_LVGL_DISPLAY_SPI_CHUNK;
+#else
+    static constexpr bool shared_bus = false;
+    static constexpr uint32_t bus_chunk_us = 0;
+#endif
+    /** @brief Shadow frame tile height in lines, 0 when the shadow frame is disabled. */
+#if CONFIG_LVGL_DISPLAY_SHADOW_FRAME
+    static constexpr size_t shadow_tile_rows = CONFIG_LVGL_DISPLAY_SHADOW_TILE_ROWS;
+#else
+    static constexpr size_t shadow_tile_rows = 0;
+#endif
+  };
+
+  /**
+   * @brief Adapts a board's compile time traits to the Display interface.
+   * The getters are final, so calls through the concrete board type resolve at compile time, and the flush path is
+   * specialised for the board's byte order.
+   *
+   * @tparam Traits The board traits, deriving from BoardTraits.
+   */
+  template <typename Traits>
+  class Board : public Display {
+   public:
+    using traits = Traits;
+
+    static constexpr size_t BUFFER_PIXELS = Traits::hres * Traits::buffer_lines; /**< Draw buffer size in pixels. */
+    static constexpr size_t BUFFER_BYTES = BUFFER_PIXELS * sizeof(uint16_t);     /**< Draw buffer size in RGB565 bytes. */
+
+    static_assert(Traits::hres > 0 && Traits::vres > 0, "Board resolution must not be zero");
+    static_assert(Traits::buffer_lines > 0 && Traits::buffer_lines <= Traits::vres, "Draw buffer must be 1 to vres lines");
+    static_assert(Traits::buffer_count <= BufferRing::MAX_BUFFERS, "Too many draw buffers");
+    static_assert(Traits::buffer_count <= 2 || Traits::double_buffer, "A buffer ring requires double buffering");
+    static_assert(Traits::bus != BusModel::Bus::SPI || Traits::bus_width == 1, "SPI boards transfer one bit per clock");
+    static_assert(Traits::scan_offset + (Traits::swap_xy ? Traits::hres : Traits::vres) <= Traits::panel_lines,
+                  "Display lines must be within the panel's gate lines");
+    static_assert((Traits::swap_xy ? Traits::vres : Traits::hres) <= Traits::panel_columns,
+                  "Display columns must be within the panel's source lines");
+    static_assert(!Traits::shared_bus || Traits::bus == BusModel::Bus::SPI, "Only an SPI bus is shared with other devices");
+    static_assert(Traits::transfer_format == TransferFormat::RGB565 || !Traits::bus_swap,
+                  "RGB444 transfers can not be swapped by the bus, swap in LVGL or the flush path instead");
+
+    size_t buffer_size() const final { return BUFFER_PIXELS; }
+    bool double_buffer() const final { return Traits::double_buffer; }
+    size_t hres() const final { return Traits::hres; }
+    size_t vres() const final { return Traits::vres; }
+    bool monochrome() const final { return Traits::monochrome; }
+    bool swap_xy() const final { return Traits::swap_xy; }
+    bool mirror_x() const final { return Traits::mirror_x; }
+    bool mirror_y() const final { return Traits::mirror_y; }
+    bool dma() const final { return Traits::dma; }
+    bool spi_ram() const final { return Traits::spi_ram; }
+
+    /**
+     * @brief Flush a rendered area to the panel, specialised for the board.
+     *
+     * @param area The area to flush, inclusive coordinates.
+     * @param color_map The rendered pixels of the area.
+     */
+    void flush(const lv_area_t* area, lv_color_t* color_map) { flush_as<Traits::software_swap>(area, color_map); }
+
+    /**
+     * @brief Returns the bus configuration described by the traits, as used by the bus model.
+     */
+    static constexpr BusModel::Config bus_config() {
+      BusModel::Config config;
+      config.bus = Traits::bus;
+      config.clock_hz = Traits::clock_hz;
+      config.bus_width = Traits::bus_width;
+      config.queue_depth = Traits::queue_depth;
+      return config;
+    }
+
+    /**
+     * @brief Returns the scan geometry described by the traits, as used by the frame pacer.
+     * The panel scans its gate lines along LVGL's X axis when the axes are swapped, and along Y otherwise.
+     */
+    static constexpr FramePacer::Config pacer_config() {
+      FramePacer::Config config;
+      config.enabled = true;
+      config.lines = Traits::panel_lines;
+      config.first_line = Traits::scan_offset;
+      config.display_lines = Traits::swap_xy ? Traits::hres : Traits::vres;
+      config.scan_x = Traits::swap_xy;
+      config.reversed = Traits::swap_xy ? Traits::mirror_x : Traits::mirror_y;
+      return config;
+    }
+
+    /**
+     * @brief Returns the panel bring-up described by the traits.
+     */
+    static constexpr BringUpConfig bring_up_config() {
+      BringUpConfig config;
+      config.async = Traits::async_bring_up;
+      config.splash_color = Traits::splash_color;
+      config.format = Traits::transfer_format;
+      return config;
+    }
+
+    /**
+     * @brief Returns the geometry of the panel controller's memory described by the traits, as used by the rotation.
+     */
+    static constexpr PanelRotation::Config rotation_config() {
+      PanelRotation::Config config;
+      config.x_gap = Traits::x_gap;
+      config.y_gap = Traits::y_gap;
+      config.columns = Traits::panel_columns;
+      config.rows = Traits::panel_lines;
+      return config;
+    }
+
+    /**
+     * @brief Returns the backlight configuration described by the traits.
+     *
+     * @param gpio The GPIO driving the backlight.
+     */
+    static constexpr Backlight::Config backlight_config(int gpio) {
+      Backlight::Config config;
+      config.gpio = gpio;
+      config.frequency_hz = Traits::backlight_frequency_hz;
+      config.gamma = Traits::backlight_gamma;
+      return config;
+    }
+
+    /**
+     * @brief Returns the bus arbiter configuration described by the traits.
+     */
+    static constexpr BusArbiter::Config arbiter_config() {
+      BusArbiter::Config config;
+      config.clock_hz = Traits::clock_hz;
+      config.chunk_us = Traits::bus_chunk_us;
+      return config;
+    }
+
+    Backlight* pwm_backlight() override { return _backlight.active() ? &_backlight : NULL; }
+    BusArbiter* bus_arbiter() override { return _arbiter.active() ? &_arbiter : NULL; }
+
+   protected:
+    mutable Backlight _backlight; /**< Started by the board when the traits enable the PWM backlight. */
+    BusArbiter _arbiter;          /**< Started by the board when the traits share the bus. */
+
+    Board() {
+      _swap_bytes = Traits::software_swap;
+      _bus_swap = Traits::bus_swap;
+      rotation().configure(rotation_config());
+    }
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,213 @@
+/**
+ * @file bring_up.hpp
+ * @brief Defines the LVGLDisplay::BringUp class and its configuration and timing.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "lvgl.h"
+#include "transfer_packer.hpp"
+
+namespace LVGLDisplay {
+
+  class Display;
+
+  /**
+   * @brief Configuration of a display's panel bring-up.
+   */
+  struct BringUpConfig {
+    bool async = false;         /**< Bring the panel up in its own task, overlapping LVGL's start. */
+    int core = -1;              /**< Core the task is pinned to, -1 for either core. */
+    UBaseType_t priority = 5;   /**< FreeRTOS task priority. */
+    uint32_t stack = 4096;      /**< Task stack size in bytes. */
+    int32_t splash_color = -1;  /**< RGB888 colour the panel is filled with before it is turned on, -1 for none. */
+    TransferFormat format = TransferFormat::RGB565; /**< Pixel format set once the panel is initialised. */
+  };
+
+  /**
+   * @brief Time line of a display's start, in the display's time base.
+   */
+  struct BringUpTiming {
+    int64_t start_us = 0;       /**< Time the panel bring-up started. */
+    int64_t panel_ready_us = 0; /**< Time the panel was initialised and turned on. */
+    int64_t splash_us = 0;      /**< Time the splash became visible, 0 without a splash. */
+    int64_t first_flush_us = 0; /**< Time LVGL flushed its first area. */
+    int64_t first_frame_us = 0; /**< Time the last transfer of LVGL's first frame completed. */
+    uint32_t flush_wait_us = 0; /**< Time the first flush waited for the bring-up to finish. */
+
+    /**
+     * @brief Returns the time the first intended pixels were on the panel, the splash or LVGL's first frame.
+     */
+    int64_t first_pixel_us() const { return splash_us ? splash_us : first_frame_us; }
+  };
+
+  /**
+   * @brief Brings a display's panel up: initialises it, draws the splash and turns it on, then switches the backlight.
+   * Asynchronously, the reset and initialisation delays of the panel, over 100 ms on an ST7789, overlap with LVGL's
+   * start; the display's flushes wait for the panel to be ready. Displays which do not start a bring-up are always
+   * ready.
+   */
+  class BringUp {
+   public:
+    static constexpr size_t MAX_SPLASH = 4; /**< Stripes splash() can queue during the bring-up. */
+
+    /**
+     * @brief Initialises the panel, from reset to just before it is turned on.
+     */
+    using Init = esp_err_t (*)(void* context);
+
+    explicit BringUp(Display& display) : _display(display) {}
+    ~BringUp();
+
+    /**
+     * @brief Start the bring-up, called by the display once the bus and panel IO are installed.
+     *
+     * @param config The bring-up configuration.
+     * @param init Initialises the panel, in the bring-up's task if asynchronous.
+     * @param context Passed to init.
+     * @return ESP_OK on success, the bring-up result if synchronous, ESP_ERR_INVALID_STATE if already started,
+     * ESP_ERR_NOT_SUPPORTED for a transfer format the display does not support, or ESP_ERR_NO_MEM if its task can not
+     * start.
+     */
+    esp_err_t start(const BringUpConfig& config, Init init, void* context);
+
+    /**
+     * @brief Returns whether the panel has been brought up and turned on.
+     */
+    bool ready() const { return _ready; }
+
+    /**
+     * @brief Wait for the panel bring-up to finish.
+     *
+     * @param timeout_ms The longest time to wait, portMAX_DELAY to wait forever.
+     * @return The bring-up result, or ESP_ERR_TIMEOUT.
+     */
+    esp_err_t wait_ready(uint32_t timeout_ms);
+
+    /**
+     * @brief Returns the result of the bring-up, ESP_OK while it runs.
+     */
+    esp_err_t error() const { return _err; }
+
+    /**
+     * @brief Returns the start time line of the display, filled in as the display starts.
+     */
+    BringUpTiming timing() const { return _timing; }
+
+    /**
+     * @brief Draw a stripe of pixels on the panel before LVGL draws its first frame, such as a logo.
+     * While the panel is initialised, the stripe is queued and drawn after the splash colour, before the panel is
+     * turned on. Later, and until the display is added to LVGL, the stripe is drawn once the panel is ready. The
+     * pixels may be in flash, they are copied in chunks to memory the bus can transfer from.
+     *
+     * @param area The area of the stripe, inclusive coordinates within the display.
+     * @param pixels The pixels of the area in LVGL's colour format, valid until the stripe is drawn.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM if MAX_SPLASH stripes are queued, or
+     * ESP_ERR_INVALID_STATE once LVGL owns the display.
+     */
+    esp_err_t splash(const lv_area_t& area, const lv_color_t* pixels);
+
+    /**
+     * @brief Enables or disables the backlight once the panel is ready.
+     * Switched straight away if it is, otherwise once the panel is turned on, so the backlight never shows an
+     * uninitialised panel.
+     *
+     * @param enable Whether to enable or disable the backlight.
+     * @return ESP_OK on success, or an error code from the backlight.
+     */
+    esp_err_t switch_backlight(const bool enable);
+
+    /**
+     * @brief Sets the backlight level once the panel is ready, as switch_backlight(). Boards without a dimmable
+     * backlight switch it on for any level above 0.
+     *
+     * @param level The level, 0 to Backlight::MAX_LEVEL.
+     * @param fade_ms The time to fade over, 0 to switch.
+     * @return ESP_OK on success, or an error code from the backlight.
+     */
+    esp_err_t switch_backlight(uint8_t level, uint32_t fade_ms);
+
+    /**
+     * @brief Hold a flush until the panel is ready, timing the first. Called by the display as each flush starts.
+     *
+     * @param start_us The time the flush started.
+     */
+    void flush_started(int64_t start_us) {
+      if(!_timing.first_flush_us) {
+        // The controller holds refreshes back until the panel is ready, LVGL refreshing directly waits here.
+        wait_ready(portMAX_DELAY);
+        _timing.first_flush_us = start_us;
+        _timing.flush_wait_us = time_us() - start_us;
+      }
+    }
+
+    /**
+     * @brief Time the first frame, called by the display as the last transfer of each frame completes, which may be in
+     * an ISR.
+     *
+     * @param time_us The time the transfer completed.
+     */
+    void frame_done(int64_t time_us) {
+      if(!_timing.first_frame_us) {
+        _timing.first_frame_us = time_us;
+      }
+    }
+
+    /* Delete move and copy assignment operators and constuctors */
+    BringUp(const BringUp&) = delete;
+    BringUp(BringUp&&) = delete;
+    BringUp& operator=(const BringUp&) = delete;
+    BringUp&& operator=(BringUp&&) = delete;
+
+   private:
+    /**
+     * @brief A stripe drawn by the bring-up, a solid colour if it has no pixels.
+     */
+    struct SplashStripe {
+      lv_area_t area;
+      const lv_color_t* pixels;
+      lv_color_t color;
+    };
+
+    enum class State : uint8_t {
+      STARTING,  /**< Initialising the panel, splash stripes are queued. */
+      SPLASHING, /**< Drawing the queued stripes. */
+      READY,     /**< Finished successfully or not, or never started. */
+    };
+
+    static constexpr size_t SPLASH_CHUNK_LINES = 16; /**< Lines of a splash stripe copied for each transfer. */
+    static constexpr EventBits_t READY_BIT = 1;
+
+    static void bring_up_main(void* arg);
+
+    esp_err_t run();
+    esp_err_t draw_splash(const SplashStripe* stripes, size_t count);
+    esp_err_t apply_backlight();
+    int64_t time_us() const;
+
+    Display& _display;
+    Init _init = NULL;
+    void* _context = NULL;
+    TransferFormat _format = TransferFormat::RGB565; /**< Transfer format set once the panel is initialised. */
+    SplashStripe _splash[MAX_SPLASH + 1] = {};       /**< The splash colour, then the queued stripes. */
+    bool _splash_fill = false;                       /**< Whether the panel is filled with the splash colour. */
+    size_t _splash_count = 0;                        /**< Queued stripes, guarded by the lock. */
+    State _state = State::READY;                     /**< Guarded by the lock. */
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    EventGroupHandle_t _events = NULL;
+    std::atomic<bool> _ready{true};
+    std::atomic<esp_err_t> _err{ESP_OK};
+    std::atomic<int16_t> _backlight_pending{-1}; /**< Backlight level to switch to once ready, -1 for none. */
+    std::atomic<uint32_t> _backlight_fade_ms{0}; /**< Fade to the pending level over. */
+    BringUpTiming _timing;
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,173 @@
+/**
+ * @file buffer_planner.hpp
+ * @brief Defines the LVGLDisplay::BufferPlanner class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus_model.hpp"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Recommends a draw buffer and bus queue configuration for a panel, bus, memory budget and workload.
+   * Each candidate configuration is run through a model of one frame: LVGL renders each area in stripes of the draw
+   * buffer length, waiting for a free buffer, and each stripe is flushed through a BusModel, whose parameter
+   * transactions wait for the colour queue to drain as esp_lcd does. Rendering and bus costs default to nominal
+   * values, and are calibrated from flush timings and frame records measured on the target.
+   * The recommendation is the configuration using the least memory among those within a tolerance of the best frame
+   * rate.
+   */
+  class BufferPlanner {
+   public:
+    static constexpr size_t MAX_AREAS = 8;   /**< Maximum number of areas in a workload. */
+    static constexpr size_t MAX_BUFFERS = 4; /**< Largest draw buffer count considered, more than 2 as a ring. */
+
+    enum class Placement : uint8_t {
+      NONE,     /**< The buffers do not fit in the memory available. */
+      INTERNAL, /**< Internal DMA capable memory. */
+      PSRAM,    /**< PSRAM, for buses which can transfer from it. */
+    };
+
+    struct Area {
+      uint16_t width = 0;  /**< Width of the area in pixels. */
+      uint16_t height = 0; /**< Height of the area in lines. */
+    };
+
+    /**
+     * @brief The areas a typical frame of the workload invalidates.
+     */
+    struct Workload {
+      const char* name = "";     /**< Name of the workload, for reports. */
+      Area areas[MAX_AREAS] = {}; /**< Invalidated areas, after coalescing. */
+      size_t area_count = 0;     /**< Number of areas. */
+
+      /**
+       * @brief Returns a workload redrawing the whole screen every frame, as full screen animations and scrolling do.
+       */
+      static Workload full_screen(size_t hres, size_t vres);
+
+      /**
+       * @brief Returns a workload updating a few small widgets every frame, such as labels and indicators.
+       *
+       * @param count The number of widgets, at most MAX_AREAS.
+       * @param width The width of each widget, clipped to the screen.
+       * @param height The height of each widget, clipped to the screen.
+       */
+      static Workload widgets(size_t hres, size_t vres, size_t count = 4, size_t width = 64, size_t height = 24);
+    };
+
+    /**
+     * @brief Costs of rendering and flushing, nominal until calibrated.
+     */
+    struct Calibration {
+      float render_pixel_ns = 12.0f;     /**< Time LVGL takes to render a pixel. */
+      uint32_t render_stripe_ns = 50000; /**< Fixed time LVGL takes to render a stripe, walking the object tree. */
+      float bus_byte_ns = 0;             /**< Bus time per colour byte, 0 for the bus model's clock. */
+      uint32_t flush_ns = 30000;         /**< Fixed time per flush, 0 for the bus model's command bytes alone. */
+    };
+
+    /**
+     * @brief One measured run of a workload, from Display::flush_timing() and the frame log.
+     * Runs of isolated flushes calibrate best, as the flush latency then does not include waits for earlier flushes.
+     */
+    struct Sample {
+      uint32_t flushes = 0;         /**< Number of flushes, FlushTiming::flushes. */
+      uint64_t bytes = 0;           /**< Pixel bytes flushed, FlushTiming::bytes. */
+      uint64_t latency_total_us = 0; /**< Sum of flush latencies, FlushTiming::latency_total_us. */
+      uint64_t render_total_us = 0; /**< Sum of frame render times, FrameStats::render_avg_us times the frames. */
+    };
+
+    struct Config {
+      size_t hres = 320;                /**< Horizontal resolution of the display. */
+      size_t vres = 170;                /**< Vertical resolution of the display. */
+      size_t bytes_per_pixel = 2;       /**< Bytes per rendered pixel. */
+      BusModel::Config bus;             /**< The panel bus, the queue depth is planned. */
+      size_t internal_bytes = 64 * 1024; /**< Internal DMA capable memory available for draw buffers. */
+      size_t psram_bytes = 0;           /**< PSRAM available for draw buffers, 0 unless the bus can transfer from it. */
+      float psram_render_factor = 1.5f; /**< How much slower LVGL renders into PSRAM than internal memory. */
+      float fps_tolerance = 0.05f;      /**< Fraction of the best frame rate within which less memory is preferred. */
+    };
+
+    /**
+     * @brief A configuration and its predicted performance on a workload.
+     */
+    struct Plan {
+      size_t buffer_lines = 0;              /**< Draw buffer length in lines, LVGL_DISPLAY_DRAW_BUFF_LEN. */
+      size_t buffer_count = 0;              /**< 1 for single, 2 for double buffering, more for a buffer ring. */
+      size_t queue_depth = 0;               /**< Colour transfer queue depth, LVGL_DISPLAY_TQUEUE_DEPTH. */
+      Placement placement = Placement::NONE; /**< Where the draw buffers fit. */
+      size_t memory_bytes = 0;              /**< Memory used by the draw buffers. */
+      uint32_t frame_us = 0;                /**< Time to render and transfer a frame from idle. */
+      float fps = 0;                        /**< Frame rate, if frames are rendered back to back. */
+      float bus_utilization = 0;            /**< Fraction of the frame time the bus is busy. */
+    };
+
+    BufferPlanner() = default;
+
+    /**
+     * @param config The planner configuration.
+     */
+    explicit BufferPlanner(const Config& config) : _config(config) {}
+
+    /**
+     * @brief Returns the planner configuration.
+     */
+    const Config& config() const { return _config; }
+
+    /**
+     * @brief Set the rendering and bus costs.
+     */
+    void calibrate(const Calibration& calibration) { _calibration = calibration; }
+
+    /**
+     * @brief Fit the rendering and bus costs to measured runs, by least squares over the runs' average flush sizes.
+     * A single run, or runs with the same flush size, only fit the per byte and per pixel costs, keeping the fixed
+     * costs as they were.
+     *
+     * @param samples The measured runs.
+     * @param count The number of runs.
+     * @return Whether the costs were fitted, false without a run with flushes.
+     */
+    bool calibrate(const Sample* samples, size_t count);
+
+    /**
+     * @brief Returns the rendering and bus costs in use.
+     */
+    const Calibration& calibration() const { return _calibration; }
+
+    /**
+     * @brief Predict the performance of a configuration on a workload.
+     *
+     * @param workload The workload.
+     * @param buffer_lines The draw buffer length in lines.
+     * @param buffer_count The number of draw buffers, 1 to MAX_BUFFERS.
+     * @param queue_depth The colour transfer queue depth.
+     * @return The plan, with Placement::NONE if the buffers do not fit.
+     */
+    Plan evaluate(const Workload& workload, size_t buffer_lines, size_t buffer_count, size_t queue_depth) const;
+
+    /**
+     * @brief Returns the recommended configuration for a workload.
+     *
+     * @param workload The workload.
+     * @return The plan, with Placement::NONE if not even a one line buffer fits.
+     */
+    Plan recommend(const Workload& workload) const;
+
+    /**
+     * @brief Returns the name of a placement, for reports.
+     */
+    static const char* placement_name(Placement placement);
+
+   private:
+    BusModel::Config bus_config(size_t queue_depth) const;
+
+    Config _config;
+    Calibration _calibration;
+  };
+
+}  // namespace LVGLDisplay
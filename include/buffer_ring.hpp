@@ -0,0 +1,104 @@
+/**
+ * @file buffer_ring.hpp
+ * @brief Defines the LVGLDisplay::BufferRing class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "lvgl.h"
+#include "memory_arena.hpp"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief A ring of draw buffers handed to LVGL in turn, so rendering runs ahead of the bus by more than one stripe.
+   * LVGL keeps its two draw buffer slots. When a rendered buffer is flushed, its slot is given a free buffer from the
+   * ring and LVGL is told the flush is ready at once; the flushed buffer returns to the ring when its transfers have
+   * completed. The renderer only waits when every buffer is still queued for the bus, which is counted as a stall.
+   */
+  class BufferRing {
+   public:
+    static constexpr size_t MAX_BUFFERS = 8; /**< Maximum number of buffers in the ring. */
+
+    struct Stats {
+      uint32_t acquires = 0;       /**< Number of buffers handed to LVGL. */
+      uint32_t stalls = 0;         /**< Number of times no buffer was free and the renderer waited. */
+      uint64_t stall_total_us = 0; /**< Time the renderer spent waiting for a free buffer, in microseconds. */
+      uint32_t stall_max_us = 0;   /**< Longest wait for a free buffer, in microseconds. */
+    };
+
+    BufferRing() = default;
+    ~BufferRing();
+
+    /**
+     * @brief Create the ring around the draw buffers of an LVGL display, allocating the buffers beyond the two LVGL
+     * already has. The display must be double buffered.
+     *
+     * @param draw_buf The draw buffer descriptor of the display.
+     * @param count The number of buffers in the ring, 3 to MAX_BUFFERS.
+     * @param caps Heap capabilities of the additional buffers.
+     * @param arena Arena to take the additional buffers from instead of the heap, may be NULL.
+     * @param owner The index of the display, distinguishing its regions in the arena.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM.
+     */
+    esp_err_t create(lv_disp_draw_buf_t* draw_buf, size_t count, uint32_t caps, MemoryArena* arena = NULL,
+                     uint8_t owner = 0);
+
+    /**
+     * @brief Returns whether the ring has been created.
+     */
+    bool active() const { return _free != NULL; }
+
+    /**
+     * @brief Returns the number of buffers in the ring.
+     */
+    size_t depth() const { return _count; }
+
+    /**
+     * @brief Replace the buffer LVGL just rendered with a free one, waiting for a buffer if none is free.
+     * Called from the flush callback, before LVGL is told the flush is ready. The rendered buffer then belongs to the
+     * flush path until it is returned with release().
+     *
+     * @param draw_buf The draw buffer descriptor of the display.
+     */
+    void rotate(lv_disp_draw_buf_t* draw_buf);
+
+    /**
+     * @brief Return a flushed buffer to the ring. May be called from an ISR.
+     *
+     * @param buffer The buffer, as passed to the flush callback.
+     * @return Whether a higher priority task was woken.
+     */
+    bool release(void* buffer);
+
+    /**
+     * @brief Returns the statistics accumulated since the last reset.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+    /* Delete move and copy assignment operators and constuctors */
+    BufferRing(const BufferRing&) = delete;
+    BufferRing(BufferRing&&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+    BufferRing&& operator=(BufferRing&&) = delete;
+
+   private:
+    QueueHandle_t _free = NULL;
+    void* _allocated[MAX_BUFFERS] = {}; /**< Buffers allocated from the heap by the ring, beyond the two owned by the port. */
+    size_t _count = 0;
+    Stats _stats;
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,207 @@
+/**
+ * @file bus_arbiter.hpp
+ * @brief Defines the LVGLDisplay::BusArbiter class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+  #include "driver/spi_master.h"
+#endif
+
+namespace LVGLDisplay {
+
+  class Display;
+
+  /**
+   * @brief Shares the display's SPI bus with other devices, such as an SD card or an ADC.
+   * The SPI master serves a device's queued transactions back to back, so another device waits for the whole colour
+   * transfer in progress, a draw buffer of several milliseconds. Through the arbiter the display sends its colour
+   * transfers in chunks no longer than the configured time at the bus clock, the first with RAMWR and the rest with
+   * RAMWRC, and queues each only while no client holds the bus. A client acquiring the bus waits for the chunk on the
+   * bus and the one queued behind it at most. High priority clients also hold back the display's chunks while they
+   * wait for each other, normal ones take turns with the display.
+   *
+   * Every client's bus time is accounted in the display's time base: the display's from each chunk queued to its
+   * completion, another client's from acquire() returning to release(), with the time each waited for the bus.
+   */
+  class BusArbiter {
+   public:
+    static constexpr size_t MAX_CLIENTS = 8; /**< Clients, including the display. */
+    static constexpr int DISPLAY_CLIENT = 0; /**< The display, added by start(). */
+
+    enum class Priority : uint8_t {
+      NORMAL, /**< Takes turns with the display's chunks. */
+      HIGH,   /**< Holds back the display's chunks while waiting for the bus. */
+    };
+
+    struct Config {
+      uint32_t clock_hz = 20 * 1000 * 1000; /**< SPI clock of the display's colour transfers. */
+      uint32_t chunk_us = 500;              /**< Longest a colour chunk holds the bus, 0 to send transfers whole. */
+    };
+
+    struct ClientStats {
+      const char* name = NULL;              /**< Name the client was added with. */
+      Priority priority = Priority::NORMAL; /**< Priority the client was added with. */
+      uint32_t transactions = 0;            /**< Transactions, chunks for the display. */
+      uint64_t bytes = 0;                   /**< Bytes transferred. */
+      uint64_t busy_us = 0;                 /**< Time holding the bus. */
+      uint64_t wait_us = 0;                 /**< Time waiting for the bus. */
+      uint32_t wait_max_us = 0;             /**< Longest wait for the bus. */
+    };
+
+    struct Stats {
+      uint64_t elapsed_us = 0;         /**< Time since start or the last reset. */
+      size_t clients = 0;              /**< Clients added, the display first. */
+      ClientStats client[MAX_CLIENTS]; /**< Each client's bus time. */
+    };
+
+    BusArbiter() = default;
+    ~BusArbiter();
+
+    /**
+     * @brief Start arbitrating the display's bus, adding the display as the first client.
+     *
+     * @param config The arbiter configuration.
+     * @param display The display whose colour transfers are chunked, and whose time base is used.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG without a display, ESP_ERR_INVALID_STATE if already started, or
+     * ESP_ERR_NO_MEM.
+     */
+    esp_err_t start(const Config& config, Display* display);
+
+    /**
+     * @brief Returns whether the arbiter has been started.
+     */
+    bool active() const { return _mutex != NULL; }
+
+    /**
+     * @brief Change the chunk length, from the next colour transfer.
+     *
+     * @param config The arbiter configuration.
+     */
+    void configure(const Config& config);
+
+    /**
+     * @brief Returns the arbiter configuration.
+     */
+    Config config() const { return _config; }
+
+    /**
+     * @brief Returns the longest colour chunk in bytes, a whole number of RGB565 and RGB444 pixels, 0 when transfers
+     * are sent whole.
+     */
+    size_t chunk_bytes() const { return _chunk_bytes; }
+
+    /**
+     * @brief Add a client of the bus.
+     *
+     * @param name The client's name, kept for its statistics.
+     * @param priority The client's priority over the display.
+     * @param client Set to the client, passed to acquire() and release().
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if not started, or ESP_ERR_NO_MEM once
+     * MAX_CLIENTS have been added.
+     */
+    esp_err_t add_client(const char* name, Priority priority, int* client);
+
+    /**
+     * @brief Wait for the bus, once the display's queued chunks have completed. Not from an ISR.
+     *
+     * @param client The client.
+     * @param timeout The longest to wait.
+     * @return ESP_OK once the client holds the bus, ESP_ERR_INVALID_ARG, or ESP_ERR_TIMEOUT.
+     */
+    esp_err_t acquire(int client, TickType_t timeout = portMAX_DELAY);
+
+    /**
+     * @brief Return the bus, accounting the time it was held.
+     *
+     * @param client The client, which acquired the bus.
+     * @param bytes The bytes the client transferred.
+     */
+    void release(int client, size_t bytes);
+
+#if !CONFIG_IDF_TARGET_LINUX
+    /**
+     * @brief Acquire the bus, run a polling transaction on a device added to it and return the bus.
+     *
+     * @param client The client.
+     * @param device The client's device on the display's SPI host.
+     * @param transaction The transaction.
+     * @param timeout The longest to wait for the bus.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_TIMEOUT, or an error from the SPI master.
+     */
+    esp_err_t transmit(int client, spi_device_handle_t device, spi_transaction_t* transaction,
+                       TickType_t timeout = portMAX_DELAY);
+#endif
+
+    /**
+     * @brief Wait for the bus to queue a colour chunk, called by the display.
+     */
+    void begin_chunk();
+
+    /**
+     * @brief Return the bus once a colour chunk is queued, called by the display.
+     *
+     * @param bytes The bytes of the chunk.
+     * @param queued Whether the chunk was queued, its completion is then awaited.
+     */
+    void end_chunk(size_t bytes, bool queued);
+
+    /**
+     * @brief Signal that a colour chunk completed, called by the display from its transfer callback, which may run in
+     * an ISR.
+     *
+     * @return Whether a higher priority task was woken.
+     */
+    bool chunk_done();
+
+    /**
+     * @brief Returns the statistics accumulated since start or the last reset.
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats();
+
+    /* Delete move and copy assignment operators and constuctors */
+    BusArbiter(const BusArbiter&) = delete;
+    BusArbiter(BusArbiter&&) = delete;
+    BusArbiter& operator=(const BusArbiter&) = delete;
+    BusArbiter&& operator=(BusArbiter&&) = delete;
+
+   private:
+    static constexpr size_t MAX_QUEUED = 4; /**< Chunks timed in flight, the panel IO drains each before the next. */
+
+    void unblock(int client);
+
+    Config _config;
+    Display* _display = NULL;
+    SemaphoreHandle_t _mutex = NULL;     /**< Held by a client, or by the display while it queues a chunk. */
+    SemaphoreHandle_t _drained = NULL;   /**< Given when the display's last queued chunk completes. */
+    SemaphoreHandle_t _clear = NULL;     /**< Given when no high priority client is waiting or holding the bus. */
+    std::atomic<size_t> _chunk_bytes{0}; /**< Longest colour chunk, from the configuration. */
+    std::atomic<uint32_t> _in_flight{0}; /**< The display's chunks queued and not yet completed. */
+    std::atomic<uint32_t> _urgent{0};    /**< High priority clients waiting for or holding the bus. */
+    std::atomic<size_t> _count{0};       /**< Clients added. */
+    ClientStats _clients[MAX_CLIENTS];   /**< Guarded by the stats lock. */
+    int64_t _acquired_us = 0;            /**< Time the bus was acquired by the client holding it. */
+    int64_t _queued_us[MAX_QUEUED] = {}; /**< Times the chunks in flight were queued, guarded by the stats lock. */
+    size_t _queued_head = 0;             /**< Oldest chunk in flight, guarded by the stats lock. */
+    int64_t _done_us = 0;                /**< Time the latest chunk completed, guarded by the stats lock. */
+    int64_t _epoch_us = 0;               /**< Time of start or the last reset. */
+    mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+  };
+
+}  // namespace LVGLDisplay
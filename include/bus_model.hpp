@@ -0,0 +1,125 @@
+/**
+ * @file bus_model.hpp
+ * @brief Defines the LVGLDisplay::BusModel class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief A timing model of an LCD panel bus.
+   * Models how long the Intel 8080 or SPI panel IO takes to move command, parameter and colour bytes, including the
+   * blocking behaviour of esp_lcd: parameter transactions wait for every queued colour transaction to finish, and
+   * colour transactions wait for a free slot once trans_queue_depth transactions are in flight. The SPI panel IO sends
+   * the command of a colour transaction by polling, so on SPI colour transactions wait for the queue to drain too.
+   * Transactions of other devices sharing an SPI bus can be modelled alongside.
+   * All times are in nanoseconds on a caller supplied clock.
+   */
+  class BusModel {
+   public:
+    enum class Bus : uint8_t {
+      I80, /**< Intel 8080 parallel bus, one pixel clock per bus_width bits. */
+      SPI, /**< SPI bus, one clock per bit. */
+    };
+
+    struct Config {
+      Bus bus = Bus::I80;                  /**< The bus type. */
+      uint32_t clock_hz = 10 * 1000 * 1000; /**< Pixel clock (i80) or SPI clock frequency. */
+      uint8_t bus_width = 8;               /**< Number of data lines. Forced to 1 for SPI. */
+      uint8_t cmd_bits = 8;                /**< Width of a command, as lcd_cmd_bits. */
+      uint8_t param_bits = 8;              /**< Width of a parameter, as lcd_param_bits. */
+      size_t queue_depth = 10;             /**< Colour transaction queue length, as trans_queue_depth. */
+      uint32_t setup_ns = 0;               /**< Fixed driver overhead added to every transaction. */
+    };
+
+    struct Stats {
+      uint64_t transactions = 0;  /**< Total number of transactions. */
+      uint64_t command_bytes = 0; /**< Bytes spent on commands and their parameters. */
+      uint64_t color_bytes = 0;   /**< Bytes spent on pixel data. */
+      uint64_t device_bytes = 0;  /**< Bytes of other devices sharing the bus. */
+      uint64_t busy_ns = 0;       /**< Time the bus spent transferring. */
+      uint64_t idle_ns = 0;       /**< Time the bus sat idle between transfers. */
+      uint64_t stall_ns = 0;      /**< Time callers were blocked waiting for the bus or queue. */
+    };
+
+    BusModel();
+    explicit BusModel(const Config& config);
+
+    /**
+     * @brief Change the bus configuration. Statistics and queue state are kept.
+     */
+    void configure(const Config& config);
+
+    /**
+     * @brief Returns the active bus configuration.
+     */
+    const Config& config() const { return _config; }
+
+    /**
+     * @brief Returns the time taken to clock a number of bytes onto the bus.
+     */
+    uint64_t transfer_ns(size_t bytes) const;
+
+    /**
+     * @brief Model a blocking command transaction with parameters (esp_lcd_panel_io_tx_param).
+     *
+     * @param now_ns The time the caller issued the transaction.
+     * @param param_bytes The number of parameter bytes following the command.
+     * @return The time at which the caller returns.
+     */
+    uint64_t tx_param(uint64_t now_ns, size_t param_bytes);
+
+    /**
+     * @brief Model a queued colour transaction (esp_lcd_panel_io_tx_color).
+     *
+     * @param now_ns The time the caller issued the transaction.
+     * @param color_bytes The number of pixel bytes following the command.
+     * @param done_ns Set to the time the transfer completes on the bus.
+     * @return The time at which the caller returns.
+     */
+    uint64_t tx_color(uint64_t now_ns, size_t color_bytes, uint64_t* done_ns);
+
+    /**
+     * @brief Model a polling transaction of another device sharing the SPI bus (spi_device_polling_transmit).
+     * The SPI master serves a device's queued transactions back to back, so it starts once every queued colour
+     * transaction has completed.
+     *
+     * @param now_ns The time the device issued the transaction.
+     * @param bytes The number of bytes the device transfers.
+     * @param start_ns Set to the time the transaction started on the bus.
+     * @return The time at which the transaction completes.
+     */
+    uint64_t tx_device(uint64_t now_ns, size_t bytes, uint64_t* start_ns);
+
+    /**
+     * @brief Returns the time at which every queued transaction has completed.
+     */
+    uint64_t idle_at() const { return _busy_until; }
+
+    /**
+     * @brief Returns the accumulated statistics.
+     */
+    const Stats& stats() const { return _stats; }
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+   private:
+    uint64_t schedule(uint64_t now_ns, uint64_t duration_ns);
+    void retire(uint64_t now_ns);
+
+    Config _config;
+    Stats _stats;
+    uint64_t _busy_until = 0;         /**< Completion time of the last scheduled transfer. */
+    std::vector<uint64_t> _in_flight; /**< Completion times of queued colour transfers, oldest first. */
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,128 @@
+/**
+ * @file command_queue.hpp
+ * @brief Defines the LVGLDisplay::CommandQueue class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#include "esp_err.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief A bounded lock-free queue of UI commands, posted by any task and applied by the LVGL task.
+   * Posting never blocks: a command is copied into a free slot with one compare and swap, or dropped if the queue is
+   * full. The LVGL task applies every pending command in a batch before it renders, so a task updating a value does
+   * not wait for a render cycle to release the LVGL lock.
+   */
+  class CommandQueue {
+   public:
+    static constexpr size_t PAYLOAD = 32; /**< Maximum size of a command's captured state in bytes. */
+
+    using Function = void (*)(void* payload);
+
+    struct Stats {
+      uint32_t posted = 0;    /**< Number of commands posted. */
+      uint32_t dropped = 0;   /**< Number of commands dropped because the queue was full. */
+      uint32_t applied = 0;   /**< Number of commands applied. */
+      uint32_t batches = 0;   /**< Number of batches in which commands were applied. */
+      uint32_t max_batch = 0; /**< Largest number of commands applied in one batch. */
+    };
+
+    CommandQueue() = default;
+    ~CommandQueue();
+
+    /**
+     * @brief Allocate the queue.
+     *
+     * @param capacity The number of commands the queue holds, rounded up to a power of two.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM.
+     */
+    esp_err_t create(size_t capacity);
+
+    /**
+     * @brief Returns whether the queue has been created.
+     */
+    bool created() const { return _cells != NULL; }
+
+    /**
+     * @brief Post a command, a function applied to a copy of the payload. Safe from any task, never blocks.
+     *
+     * @param function The function to apply in the LVGL task, with the lock held.
+     * @param payload The state passed to the function, copied into the queue.
+     * @param size The size of the payload, at most PAYLOAD bytes.
+     * @return Whether the command was queued, false if the queue is full or not created.
+     */
+    bool post(Function function, const void* payload, size_t size);
+
+    /**
+     * @brief Post a callable, for example a lambda capturing the values to apply.
+     * The callable is copied into the queue, so it must be trivially copyable and at most PAYLOAD bytes:
+     * @code
+     * queue.post([label, value] { lv_label_set_text_fmt(label, "%d", value); });
+     * @endcode
+     *
+     * @param callable The callable to invoke in the LVGL task, with the lock held.
+     * @return Whether the command was queued, false if the queue is full or not created.
+     */
+    template <typename Callable>
+    bool post(const Callable& callable) {
+      static_assert(std::is_trivially_copyable<Callable>::value, "Commands are copied, capture values or pointers only");
+      static_assert(sizeof(Callable) <= PAYLOAD, "Command captures too much state");
+      return post([](void* payload) { (*(Callable*)payload)(); }, &callable, sizeof(Callable));
+    }
+
+    /**
+     * @brief Apply the pending commands, in the order they were posted. Called by the LVGL task with the lock held.
+     *
+     * @return The number of commands applied.
+     */
+    size_t apply();
+
+    /**
+     * @brief Returns whether commands are waiting to be applied. Called by the LVGL task.
+     */
+    bool pending() const { return _tail.load(std::memory_order_acquire) != _head; }
+
+    /**
+     * @brief Returns the statistics accumulated since the last reset.
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats();
+
+    /* Delete move and copy assignment operators and constuctors */
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue(CommandQueue&&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+    CommandQueue&& operator=(CommandQueue&&) = delete;
+
+   private:
+    struct Cell {
+      std::atomic<uint32_t> sequence; /**< Position the cell is ready for: writable at pos, readable at pos + 1. */
+      Function function;
+      alignas(8) uint8_t payload[PAYLOAD];
+    };
+
+    Cell* _cells = NULL;
+    uint32_t _mask = 0;
+    std::atomic<uint32_t> _tail{0}; /**< Next position to post to, shared by the producers. */
+    uint32_t _head = 0;             /**< Next position to apply, owned by the LVGL task. */
+    std::atomic<uint32_t> _posted{0};
+    std::atomic<uint32_t> _dropped{0};
+    uint32_t _applied = 0;
+    uint32_t _batches = 0;
+    uint32_t _max_batch = 0;
+  };
+
+}  // namespace LVGLDisplay
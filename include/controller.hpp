@@ -1,14 +1,36 @@
 #pragma once
 
+#include <atomic>
+
+#include "command_queue.hpp"
 #include "display.hpp"
 #include "esp_err.h"
+#include "frame_pacer.hpp"
+#include "glyph_cache.hpp"
+#include "memory_arena.hpp"
+#include "touch_input.hpp"
 
 namespace LVGLDisplay {
   /**
-   * @brief A singleton class that controls the display through LVGL.
+   * @brief Per display settings for displays added to the controller.
+   */
+  struct DisplayConfig {
+    uint32_t refresh_period_ms = 0; /**< Refresh period in milliseconds, 0 for LV_DISP_DEF_REFR_PERIOD. */
+    size_t buffer_count = 2;        /**< Number of draw buffers, more than 2 renders into a BufferRing. */
+    bool flush_task = false;        /**< Whether the display flushes from its own task. */
+    FlushTaskConfig flush;          /**< The flush task configuration, if enabled. */
+    FramePacer::Config pacing;      /**< The frame pacer configuration, if enabled. */
+    VsyncSource* vsync = NULL;      /**< Vsync source for the frame pacer, NULL for a free-running estimate. */
+  };
+
+  /**
+   * @brief A singleton class that controls the displays through LVGL.
+   * The active display from the factory is added by initialise(), further displays with add_display().
    */
   class Controller {
    public:
+    static constexpr size_t MAX_DISPLAYS = 4; /**< Maximum number of displays driven at once. */
+
     /**
      * @brief Allocate resources and start the LVGL main task and timer.
      *
@@ -16,14 +38,171 @@ namespace LVGLDisplay {
      */
     esp_err_t initialise();
 
+    /**
+     * @brief Add a further display, with its own draw buffers, flush path and refresh timer.
+     * Must be called after initialise(). The display stays owned by the caller and must outlive the controller.
+     * LVGL objects are created on the new display by passing lv_disp_get_scr_act() of its LVGL handle as parent.
+     *
+     * @param display The display to add.
+     * @param config The display settings.
+     * @return An esp_err_t indicating the status of the operation.
+     */
+    esp_err_t add_display(Display& display, const DisplayConfig& config);
+
+    /**
+     * @brief Add a further display with the default settings.
+     *
+     * @param display The display to add.
+     * @return An esp_err_t indicating the status of the operation.
+     */
+    esp_err_t add_display(Display& display);
+
     /**
      * @brief Enables or disables the display backlight.
+     * While the panel is being brought up, the backlight is switched once the panel is turned on.
      *
      * @param enable Whether to enable or disable the backlight.
      * @return An esp_err_t indicating the status of the operation.
      */
     esp_err_t backlight(const bool enable);
 
+    /**
+     * @brief Sets the display backlight level, fading to it in hardware with the PWM backlight.
+     * While the panel is being brought up, the level is set once the panel is turned on. While the idle policy has
+     * dimmed or turned off the backlight, the level is shown on the next user activity.
+     *
+     * @param level The level, perceived brightness from 0 to Backlight::MAX_LEVEL. Without the PWM backlight, any level
+     * above 0 switches it on.
+     * @param fade_ms The time to fade over, 0 to switch.
+     * @return An esp_err_t indicating the status of the operation.
+     */
+    esp_err_t backlight(uint8_t level, uint32_t fade_ms);
+
+    /**
+     * @brief Sets the policy dimming the backlight, then turning it off, after a period without user activity.
+     * The initial policy is read from Kconfig. Requires the PWM backlight.
+     *
+     * @param policy The idle policy.
+     * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED without the PWM backlight, or ESP_ERR_INVALID_STATE before
+     * initialise().
+     */
+    esp_err_t backlight_policy(const Backlight::Policy& policy);
+
+    /**
+     * @brief Redraw the invalidated areas of every display now, through the same path as the periodic refresh.
+     * Use instead of lv_refr_now(), which bypasses area coalescing. Waits for the panel bring-up to finish. The lock
+     * must be held.
+     *
+     * @return An esp_err_t indicating the status of the operation.
+     */
+    esp_err_t refresh();
+
+    /**
+     * @brief Redraw the invalidated areas of one display now. The lock must be held.
+     *
+     * @param display The display to refresh.
+     * @return An esp_err_t indicating the status of the operation.
+     */
+    esp_err_t refresh(Display& display);
+
+    /**
+     * @brief Returns the active display from the factory.
+     *
+     * @return The display being controlled.
+     */
+    Display& display() { return _display; }
+
+    /**
+     * @brief Returns a display by the order it was added, 0 being the active display.
+     *
+     * @param index The index of the display, less than display_count().
+     * @return The display.
+     */
+    Display& display(size_t index) { return *_displays[index]; }
+
+    /**
+     * @brief Returns the number of displays driven, 0 before initialise().
+     */
+    size_t display_count() const { return _display_count; }
+
+    /**
+     * @brief Returns the frame pacer of a display, started when its DisplayConfig enables pacing.
+     *
+     * @param index The index of the display, less than display_count().
+     * @return The frame pacer, inactive unless started.
+     */
+    FramePacer& pacer(size_t index) { return _pacers[index]; }
+
+    /**
+     * @brief Returns a summary of the recent frames of every display, from the frame log.
+     * Empty if the frame log is disabled with LVGL_DISPLAY_FRAME_LOG_LENGTH.
+     *
+     * @return The frame summary.
+     */
+    FrameStats stats() const { return _frames.stats(); }
+
+    /**
+     * @brief Copy the most recent frame records of every display, oldest first.
+     *
+     * @param records Set to the records.
+     * @param count The most records to copy.
+     * @return The number of records copied.
+     */
+    size_t frames(FrameRecord* records, size_t count) const { return _frames.read(records, count); }
+
+    /**
+     * @brief Discard the recorded frames.
+     */
+    void reset_stats() { _frames.clear(); }
+
+    /**
+     * @brief Post a UI update to be applied by the LVGL task before its next refresh, without taking the lock.
+     * Safe from any task and never blocks; see CommandQueue::post() for what the callable may capture. The LVGL task is
+     * woken to refresh idle displays straight away rather than after their idle period.
+     *
+     * @param callable The callable to invoke in the LVGL task, with the lock held.
+     * @return Whether the update was queued, false if the queue is full or disabled.
+     */
+    template <typename Callable>
+    bool post(const Callable& callable) {
+      if(!_commands.post(callable)) {
+        return false;
+      }
+      wake();
+      return true;
+    }
+
+    /**
+     * @brief Returns the queue of UI updates posted with post().
+     *
+     * @return The command queue.
+     */
+    CommandQueue& commands() { return _commands; }
+
+    /**
+     * @brief Returns the arena holding the draw buffers, not created unless enabled with LVGL_DISPLAY_ARENA.
+     * Call MemoryArena::report() to log the memory budget.
+     *
+     * @return The memory arena.
+     */
+    MemoryArena& memory() { return _memory; }
+
+    /**
+     * @brief Returns the touch input of the active display, started by initialise() if enabled with
+     * LVGL_DISPLAY_TOUCH and the board has a touch controller. Restart it with another source or configuration.
+     *
+     * @return The touch input.
+     */
+    TouchInput& touch() { return _touch; }
+
+    /**
+     * @brief Returns the glyph cache every display draws the letters of its fonts from, not created unless enabled with
+     * LVGL_DISPLAY_GLYPH_CACHE. Add fonts to it, or warm it with the glyphs of a screen, with the lock held.
+     *
+     * @return The glyph cache.
+     */
+    GlyphCache& glyphs() { return _glyphs; }
+
     /**
      * @brief Returns the singleton instance of the display controller.
      *
@@ -39,37 +218,114 @@ namespace LVGLDisplay {
 
    private:
     Controller();
-    Display& _display; /**< The display being controlled. */
+    static void flush_callback(lv_disp_drv_t* drv, const lv_area_t* area, lv_color_t* color_map);
+    static void refresh_callback(lv_timer_t* timer);
+    static void refresh_timer_callback(lv_timer_t* timer);
+    static void wait_callback(lv_disp_drv_t* drv);
+    static void update_callback(lv_disp_drv_t* drv);
+    static void backlight_callback(lv_timer_t* timer);
+    static void draw_letter_callback(lv_draw_ctx_t* draw_ctx, const lv_draw_label_dsc_t* dsc, const lv_point_t* pos, uint32_t letter);
+    Display* find(lv_disp_t* disp);
+    void report_bring_up();
+    void wake();
+    esp_err_t attach(Display& display, lv_disp_t* disp, const DisplayConfig& config, bool in_arena);
+    Display& _display;                    /**< The active display from the factory. */
+    Display* _displays[MAX_DISPLAYS] = {}; /**< Every display driven, the active display first. */
+    FramePacer _pacers[MAX_DISPLAYS];      /**< Frame pacer of each display, if enabled. */
+    size_t _display_count = 0;
+    MemoryArena _memory;                  /**< Draw buffers and LVGL's heap, if enabled. */
+    CommandQueue _commands;               /**< UI updates posted by other tasks. */
+    FrameLog _frames;                     /**< Recent frame records of every display. */
+    TouchInput _touch;                    /**< Touch input of the active display. */
+    GlyphCache _glyphs;                   /**< Glyphs of the cached fonts, if enabled. */
+    void (*_draw_letter)(lv_draw_ctx_t*, const lv_draw_label_dsc_t*, const lv_point_t*, uint32_t) = NULL; /**< LVGL's letter drawing. */
+    lv_timer_t* _backlight_timer = NULL;  /**< Applies the backlight's idle policy, paused without one. */
+    std::atomic<TaskHandle_t> _lvgl_task{NULL}; /**< The task running LVGL's timers, once it has refreshed. */
+    std::atomic<bool> _waking{false};     /**< Whether posted updates have woken the LVGL task since its last refresh. */
+    uint64_t _lock_wait_us = 0;           /**< Lock wait total at the previous frame. */
+    bool _boot_reported = false;          /**< Whether the start time line of the display has been logged. */
+  };
+
+  /**
+   * @brief Lock usage accumulated by Lock, covering the tasks using it but not the LVGL task itself.
+   */
+  struct LockStats {
+    uint32_t acquisitions = 0;   /**< Number of times the lock was acquired. */
+    uint32_t contended = 0;      /**< Number of acquisitions which waited at least Lock::CONTENDED_US. */
+    uint32_t timeouts = 0;       /**< Number of try acquisitions which timed out. */
+    uint64_t wait_total_us = 0;  /**< Time spent waiting for the lock, in microseconds. */
+    uint32_t wait_max_us = 0;    /**< Longest wait for the lock, in microseconds. */
+    uint64_t hold_total_us = 0;  /**< Time the lock was held, outermost acquisitions only, in microseconds. */
+    uint32_t hold_max_us = 0;    /**< Longest time the lock was held, in microseconds. */
   };
 
   /**
    * @brief A class for controlling access to the display.
    * Aquires the lock using scope. Ie. the lock is acquired on consturction,
    * and released on destruction.
+   * LVGL's core is single threaded, so the one lock covers every display. Flush work runs outside the lock.
+   * Tasks which only update values should post them with Controller::post() instead, which never waits.
    */
   class Lock {
    public:
+    /** @brief Waits at least this long, in microseconds, are counted as contended. An uncontended take is a few. */
+    static constexpr uint32_t CONTENDED_US = 50;
+
     /**
      * @brief Acquires the lock for the display.
      * This should be used before any LVGL operation
      */
     Lock();
 
+    /**
+     * @brief Tries to acquire the lock for the display, waiting at most the timeout.
+     * Check locked() before any LVGL operation; the lock is only released on destruction if it was acquired.
+     *
+     * @param timeout_ms The longest time to wait in milliseconds, 0 to wait at most one tick.
+     */
+    explicit Lock(uint32_t timeout_ms);
+
+    /**
+     * @brief Returns whether the lock was acquired.
+     */
+    bool locked() const { return _locked; }
+
     /**
      * @brief Acquires the lock for the display.
      * This should be used before any LVGL operation
      */
     static void acquire();
 
+    /**
+     * @brief Tries to acquire the lock for the display, waiting at most the timeout.
+     *
+     * @param timeout_ms The longest time to wait in milliseconds, 0 to wait at most one tick.
+     * @return Whether the lock was acquired, in which case release() must be called.
+     */
+    static bool try_acquire(uint32_t timeout_ms);
+
     /**
      * @brief Releases the lock for the display.
      * This should be used before any LVGL operation
      */
     static void release();
 
+    /**
+     * @brief Returns the lock usage accumulated since the last reset.
+     */
+    static LockStats stats();
+
+    /**
+     * @brief Clears the accumulated lock usage.
+     */
+    static void reset_stats();
+
     /**
      * @brief Releases the lock for the display.
      */
     ~Lock();
+
+   private:
+    bool _locked;
   };
 };  // namespace LVGLDisplay
@@ -1,25 +1,75 @@
 #pragma once
 
+#include <atomic>
+
+#include "area_coalescer.hpp"
+#include "backlight.hpp"
+#include "bring_up.hpp"
+#include "buffer_ring.hpp"
+#include "bus_arbiter.hpp"
 #include "esp_err.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
+#include "flush_hook.hpp"
+#include "frame_log.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "lvgl.h"
+#include "memory_arena.hpp"
+#include "panel_rotation.hpp"
+#include "refresh_scheduler.hpp"
+#include "shadow_frame.hpp"
+#include "transfer_packer.hpp"
 
 namespace LVGLDisplay {
+  class TouchSource;
+  class VsyncSource;
+
+  /**
+   * @brief Timing of the flush path, from the LVGL flush callback to the colour transfer completing.
+   */
+  struct FlushTiming {
+    uint32_t flushes = 0;          /**< Number of completed flushes. */
+    uint64_t pixels = 0;           /**< Number of pixels flushed. */
+    uint64_t bytes = 0;            /**< Number of pixel bytes transferred to the panel. */
+    uint64_t latency_total_us = 0; /**< Sum of flush latencies, in microseconds. */
+    uint32_t latency_max_us = 0;   /**< Largest flush latency, in microseconds. */
+  };
+
+  /**
+   * @brief Timing of input events, from the event to the last transfer of the frame redrawn for it completing.
+   */
+  struct InputTiming {
+    uint32_t inputs = 0;           /**< Number of input events whose frame reached the panel. */
+    uint64_t latency_total_us = 0; /**< Sum of touch to photon latencies, in microseconds. */
+    uint32_t latency_max_us = 0;   /**< Largest touch to photon latency, in microseconds. */
+  };
+
+  /**
+   * @brief Configuration of a display's flush task.
+   */
+  struct FlushTaskConfig {
+    int core = -1;             /**< Core the task is pinned to, -1 for either core. */
+    UBaseType_t priority = 5;  /**< FreeRTOS task priority. */
+    uint32_t stack = 4096;     /**< Task stack size in bytes. */
+  };
+
   /**
    * @brief An abstract base class representing a display.
    */
   class Display {
    public:
     /**
-     * @brief Default constructor.
+     * @brief Default constructor, creates the semaphore transfer completions are signalled on.
      */
-    Display() = default;
+    Display();
 
     /**
-     * @brief Default destructor.
+     * @brief Destructor, releases the completion semaphore.
      */
-    virtual ~Display() = default;
+    virtual ~Display();
 
     /**
      * @brief Returns the size of the display buffer in bytes.
@@ -107,6 +157,330 @@ namespace LVGLDisplay {
      */
     virtual esp_err_t error() const = 0;
 
+    /**
+     * @brief Returns the panel bring-up, which flushes wait for.
+     *
+     * @return The bring-up for the display.
+     */
+    BringUp& bring_up() { return _bring_up; }
+    const BringUp& bring_up() const { return _bring_up; }
+
+    /**
+     * @brief Returns the rotation of the display, applied in the panel or the flush path.
+     *
+     * @return The rotation for the display.
+     */
+    PanelRotation& rotation() { return _rotation; }
+
+    /**
+     * @brief Returns the packer of colour transfers into the display's transfer format.
+     *
+     * @return The transfer packer for the display.
+     */
+    TransferPacker& packer() { return _packer; }
+
+    /**
+     * @brief Attach a feature to the flush path, see FlushHook. Waits for flushes in progress. The lock must be held.
+     *
+     * @param hook The hook, which must stay attached no longer than it lives.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if already attached, or ESP_ERR_NO_MEM
+     * once MAX_HOOKS are attached.
+     */
+    esp_err_t add_hook(FlushHook* hook);
+
+    /**
+     * @brief Detach a feature from the flush path, once the flushes it was called for have completed. The lock must
+     * be held.
+     *
+     * @param hook The hook, which may not be attached.
+     */
+    void remove_hook(FlushHook* hook);
+
+    /**
+     * @brief Returns the area an attached hook keeps off LVGL's flushes, or NULL if LVGL draws the whole panel.
+     */
+    const lv_area_t* excluded() const;
+
+    /**
+     * @brief Returns whether the whole panel is excluded from LVGL. The controller then stops refreshing the display
+     * and keeps its invalidated areas until it is handed back.
+     */
+    bool taken_over() const;
+
+    /**
+     * @brief Pass another task's hold of the lock to the attached hooks, called by Lock as the lock is released.
+     *
+     * @param wait_us The time the task waited for the lock.
+     * @param hold_us The time the task held the lock.
+     */
+    void lock_released(uint32_t wait_us, uint32_t hold_us);
+
+    /**
+     * @brief Queue a transfer of pixels outside LVGL's flushes, used by PixelPush.
+     * Waits for flushes in progress first, so the transfer's commands do not interleave with those of a flush task.
+     * The lock must be held, so LVGL does not start another. The pixels are sent as they are, in the panel's byte order,
+     * or packed in place first with an RGB444 transfer format, from big endian RGB565. Rotated in software, they are
+     * rotated in place first too.
+     *
+     * @param area The area, inclusive coordinates within the display as LVGL draws it.
+     * @param pixels The pixels, in memory the bus can transfer from, valid until the transfer completes.
+     * @param done_at Set to the transfer count to pass to transferred().
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE before the panel is ready, ESP_ERR_NO_MEM, or an error from the
+     * panel.
+     */
+    esp_err_t push(const lv_area_t& area, void* pixels, uint32_t* done_at);
+
+    /**
+     * @brief Queue a colour transfer to an area of the panel, in the board's orientation, as the bytes are.
+     * On a shared bus the transfer is queued in chunks, each holding the bus on its own.
+     *
+     * @param area The area, inclusive coordinates within the display in the board's orientation.
+     * @param data The bytes, in the transfer format, valid until the transfer completes.
+     * @param bytes The number of bytes.
+     * @return ESP_OK on success, or an error from the panel.
+     */
+    esp_err_t send(const lv_area_t& area, const void* data, size_t bytes);
+
+    /**
+     * @brief Returns the count of colour transfers queued, to pass to transferred().
+     */
+    uint32_t submitted() const { return _submitted; }
+
+    /**
+     * @brief Returns whether the transfers up to a count have completed.
+     *
+     * @param count The transfer count.
+     */
+    bool transferred(uint32_t count) const { return (int32_t)(_completed - count) >= 0; }
+
+    /**
+     * @brief Block until the transfers up to a count have completed.
+     *
+     * @param count The transfer count.
+     */
+    void wait_transferred(uint32_t count);
+
+    /**
+     * @brief Returns whether RGB565 pixels are byte swapped on their way to the panel.
+     */
+    bool swap_bytes() const { return _swap_bytes; }
+
+    /**
+     * @brief Returns whether the bus swaps the colour bytes of each transfer in hardware.
+     */
+    bool bus_swap() const { return _bus_swap; }
+
+    /**
+     * @brief Returns the horizontal resolution LVGL draws in, which follows the rotation.
+     */
+    size_t width() const { return _rotation.angle() & 1 ? vres() : hres(); }
+
+    /**
+     * @brief Returns the vertical resolution LVGL draws in, which follows the rotation.
+     */
+    size_t height() const { return _rotation.angle() & 1 ? hres() : vres(); }
+
+    /**
+     * @brief Returns the time used to measure the flush path, in microseconds.
+     * Defaults to esp_timer_get_time(). Simulated displays return their simulated time.
+     *
+     * @return The current time in microseconds.
+     */
+    virtual int64_t time_us() const;
+
+    /**
+     * @brief Returns the source of vsync edges for frame pacing.
+     * Defaults to NULL, pacing then runs from a free-running estimate of the panel refresh.
+     *
+     * @return The vsync source, or NULL.
+     */
+    virtual VsyncSource* vsync_source() { return NULL; }
+
+    /**
+     * @brief Returns the board's touch controller, registered with LVGL by the controller when touch input is enabled.
+     * Defaults to NULL, for boards without one.
+     *
+     * @return The touch source, or NULL.
+     */
+    virtual TouchSource* touch_source() { return NULL; }
+
+    /**
+     * @brief Returns the board's dimmable backlight, started by the board when the PWM backlight is enabled.
+     * Defaults to NULL, the backlight is then switched on and off with backlight().
+     *
+     * @return The backlight, or NULL.
+     */
+    virtual Backlight* pwm_backlight() { return NULL; }
+
+    /**
+     * @brief Returns the arbiter sharing the board's SPI bus with other devices, started by the board when the bus is
+     * shared. Defaults to NULL, colour transfers are then sent whole.
+     *
+     * @return The bus arbiter, or NULL.
+     */
+    virtual BusArbiter* bus_arbiter() { return NULL; }
+
+    /**
+     * @brief Flush a rendered area to the panel.
+     * Called from the LVGL flush callback installed by the controller.
+     *
+     * @param area The area to flush, inclusive coordinates.
+     * @param color_map The rendered pixels of the area.
+     */
+    void flush(const lv_area_t* area, lv_color_t* color_map);
+
+    /**
+     * @brief Move the flush work of this display to its own task.
+     * The LVGL task then only queues rendered areas; diffing, byte swapping and waiting for the bus happen in the
+     * flush task, so a slow panel does not hold up rendering for other displays. Pin the flush task to the core the
+     * LVGL task does not run on to render and transfer in parallel.
+     *
+     * @param config The flush task configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE if already started, or ESP_ERR_NO_MEM.
+     */
+    esp_err_t start_flush_task(const FlushTaskConfig& config);
+
+    /**
+     * @brief Move the draw buffers of the display into an arena, releasing the buffers the port allocated.
+     * Buffers are taken from the arena by name, so placing them again after re-initialising reuses the same memory.
+     * A buffer ring started afterwards takes its buffers from the arena too. Must be placed before the buffer ring
+     * and the flush task are started.
+     *
+     * @param arena The arena, which must outlive the display's use of LVGL.
+     * @param owner The index of the display, distinguishing its regions from those of other displays.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM if the arena is too small.
+     */
+    esp_err_t place_buffers(MemoryArena& arena, uint8_t owner);
+
+    /**
+     * @brief Render into a ring of draw buffers instead of LVGL's two.
+     * LVGL is told each flush is ready as soon as the next buffer is handed to it, so rendering only waits for the
+     * bus once every buffer in the ring is queued for transfer. Must be started before the flush task, and requires
+     * a double buffered display.
+     *
+     * @param count The number of draw buffers, 3 to BufferRing::MAX_BUFFERS.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM.
+     */
+    esp_err_t start_buffer_ring(size_t count);
+
+    /**
+     * @brief Returns the buffer ring, inactive unless started.
+     *
+     * @return The buffer ring for the display.
+     */
+    const BufferRing& buffer_ring() const { return _ring; }
+
+    /**
+     * @brief Clears the buffer ring statistics.
+     */
+    void reset_buffer_ring_stats() { _ring.reset_stats(); }
+
+    /**
+     * @brief Returns whether flushes are handed to a flush task.
+     */
+    bool flush_task() const { return _flush_queue != NULL; }
+
+    /**
+     * @brief Returns whether any flush has yet to complete, queued for the flush task or transferring.
+     */
+    bool flushing() const { return _flushes_started != _flushes_done; }
+
+    /**
+     * @brief Block until every flush has completed, woken by the completion of the last transfer.
+     */
+    void wait_flushed();
+
+    /**
+     * @brief Signal that a colour transfer started by flush() has completed.
+     * Called from the on_color_trans_done callback of the panel IO, which may run in an ISR. Once every transfer of a
+     * flush has completed, its buffer returns to the ring, or without a ring LVGL is told the flush is ready.
+     *
+     * @return Whether a higher priority task was woken.
+     */
+    bool flush_ready();
+
+    /**
+     * @brief Start recording a frame, called by the controller before each refresh of the display.
+     * The record is added to the frame log once the last transfer of the frame completes.
+     *
+     * @param index The index of the display in the controller.
+     * @param lock_wait_us Time other tasks waited for the lock since the previous frame.
+     */
+    void begin_frame(uint8_t index, uint32_t lock_wait_us);
+
+    /**
+     * @brief Account time LVGL spends waiting for a draw buffer, called from the LVGL wait callback.
+     */
+    void wait_for_buffer();
+
+    /**
+     * @brief Set the log frame records are added to, NULL to stop recording.
+     *
+     * @param log The frame log.
+     */
+    void frame_log(FrameLog* log) { _frame_log = log; }
+
+    /**
+     * @brief Returns the flush timing accumulated since the last reset.
+     *
+     * @return The flush timing.
+     */
+    FlushTiming flush_timing() const;
+
+    /**
+     * @brief Clears the accumulated flush timing.
+     */
+    void reset_flush_timing();
+
+    /**
+     * @brief Time the next frame from an input event, to the last transfer of the frame completing.
+     * Called by TouchInput once LVGL's handling of the event has invalidated an area, with the lock held. The earliest
+     * event counts when several are handled before the frame is rendered.
+     *
+     * @param time_us The time of the event, in the display's time base.
+     */
+    void mark_input(int64_t time_us);
+
+    /**
+     * @brief Returns the input timing accumulated since the last reset.
+     *
+     * @return The input timing.
+     */
+    InputTiming input_timing() const;
+
+    /**
+     * @brief Clears the accumulated input timing.
+     */
+    void reset_input_timing();
+
+    /**
+     * @brief Returns the coalescer applied to invalidated areas before they are rendered.
+     *
+     * @return The area coalescer for the display.
+     */
+    AreaCoalescer& coalescer() { return _coalescer; }
+
+    /**
+     * @brief Returns the scheduler adapting the refresh period of the display.
+     *
+     * @return The refresh scheduler for the display.
+     */
+    RefreshScheduler& scheduler() { return _scheduler; }
+
+    /**
+     * @brief Returns the average time from the first flush of a frame to its last transfer completing.
+     *
+     * @return The average frame flush time in microseconds, 0 before the first frame.
+     */
+    uint32_t frame_flush_us() const { return _frame_flush_avg_us; }
+
+    /**
+     * @brief Returns the shadow frame used to skip unchanged tiles, unallocated unless enabled by the board.
+     *
+     * @return The shadow frame for the display.
+     */
+    ShadowFrame& shadow() { return _shadow; }
+
     /**
      * @brief Returns the panel handle for the display.
      *
@@ -128,10 +502,138 @@ namespace LVGLDisplay {
      */
     void display(lv_disp_t* display) { _display = display; };
 
+    /**
+     * @brief Returns the LVGL display handle, NULL until the controller is initialised.
+     *
+     * @return The LVGL display handle.
+     */
+    lv_disp_t* display() const { return _display; }
+
+    static constexpr size_t MAX_HOOKS = 6; /**< Hooks attached to the flush path at once. */
+
    protected:
     esp_lcd_panel_handle_t _panel_handle = NULL;
     esp_lcd_panel_io_handle_t _io_handle = NULL;
     lv_disp_t* _display = NULL;
+
+    /**
+     * @brief Flush a rendered area to the panel, with the byte order swap resolved at compile time.
+     * Hands the area to the flush task if one is running, and the next buffer to LVGL if a ring is in use.
+     *
+     * @tparam SWAP Whether to swap the RGB565 byte order before the transfer.
+     * @param area The area to flush, inclusive coordinates.
+     * @param color_map The rendered pixels of the area.
+     */
+    template <bool SWAP>
+    void flush_as(const lv_area_t* area, lv_color_t* color_map);
+
+    /**
+     * @brief Initialise the panel, from reset to just before it is turned on.
+     * Called by the bring-up, in its own task if asynchronous. Defaults to doing nothing, for displays whose
+     * constructor initialises the panel.
+     *
+     * @return ESP_OK on success, or an error code on failure.
+     */
+    virtual esp_err_t init_panel() { return ESP_OK; }
+
+    /**
+     * @brief Bring the panel up with init_panel(), see BringUp.
+     * Called by the board constructor once the bus and panel IO are installed.
+     *
+     * @param config The bring-up configuration.
+     * @return As BringUp::start().
+     */
+    esp_err_t start_bring_up(const BringUpConfig& config) { return _bring_up.start(config, init_main, this); }
+
+    ShadowFrame _shadow;
+    bool _swap_bytes = false; /**< Swap the RGB565 byte order in the flush path, for buses which can not swap. */
+    bool _bus_swap = false;   /**< Whether the bus swaps the colour bytes of each transfer in hardware. */
+
+   private:
+    struct FlushRequest {
+      lv_area_t area;
+      lv_color_t* color_map;
+      bool first;         /**< Whether this is the first area of a frame. */
+      bool last;          /**< Whether this is the last area of a frame. */
+      lv_area_t window;   /**< The area the frame covers, if first and hooks are attached. */
+      FrameRecord frame;  /**< The LVGL side of the frame record, if last. */
+    };
+
+    /**
+     * @brief The LVGL side of the frame being rendered, only touched by the LVGL task.
+     */
+    struct FrameState {
+      int64_t start_us = 0;      /**< Time the refresh started, 0 outside the controller's refresh. */
+      uint32_t callback_us = 0;  /**< Time spent in the flush callback. */
+      uint32_t spin_us = 0;      /**< Time LVGL spent in the wait callback. */
+      uint32_t dma_wait_us = 0;  /**< Time waiting for a draw buffer, in the wait callback or the ring. */
+      int64_t wait_last_us = 0;  /**< Time of the last wait callback, 0 if not waiting. */
+      uint32_t lock_wait_us = 0; /**< Lock wait of other tasks since the previous frame. */
+      uint32_t frame = 0;        /**< Frame number. */
+      uint8_t index = 0;         /**< Display index. */
+      uint8_t areas = 0;         /**< Areas flushed so far. */
+      uint8_t buffers = 0;       /**< Most draw buffers queued for the bus at once. */
+      int64_t input_us = 0;      /**< Time of the first input event the frame redraws for, 0 without one. */
+    };
+
+    /**
+     * @brief A flush whose transfers are in flight. Transfers complete in the order they are queued, so a flush is
+     * done once the completed transfer count reaches the count after its last transfer was queued.
+     */
+    struct FlushRecord {
+      void* buffer;           /**< The rendered buffer. */
+      int64_t start_us;       /**< Time the flush started. */
+      uint32_t pixels;        /**< Pixels in the flushed area. */
+      uint32_t bytes;         /**< Pixel bytes queued for transfer. */
+      uint32_t last_transfer; /**< Transfer count after the last transfer of the flush was queued. */
+      bool sealed;            /**< Whether every transfer of the flush has been queued. */
+      bool last;              /**< Whether the flush is the last of a frame. */
+      FrameRecord frame;      /**< The LVGL side of the frame record, if last. */
+    };
+
+    static constexpr size_t MAX_IN_FLIGHT = BufferRing::MAX_BUFFERS;
+    static constexpr uint32_t COMPLETION_WAIT_MS = 10; /**< Longest wait for a completion another waiter was woken by. */
+
+    static void flush_task_main(void* arg);
+    static esp_err_t init_main(void* context);
+
+    template <bool SWAP>
+    void transfer(const lv_area_t* area, lv_color_t* color_map, const FrameRecord* frame, const lv_area_t* window);
+    template <bool SWAP>
+    void draw(FlushRecord& record, const lv_area_t& area, void* pixels);
+    template <bool SWAP>
+    void draw_around(FlushRecord& record, const lv_area_t& area, void* pixels);
+    bool retire();
+    template <typename Done>
+    void wait_until(Done done);
+
+    AreaCoalescer _coalescer;
+    RefreshScheduler _scheduler;
+    BufferRing _ring;
+    BringUp _bring_up;
+    PanelRotation _rotation;
+    TransferPacker _packer;
+    FlushHook* _hooks[MAX_HOOKS] = {}; /**< Features attached to the flush path, changed only while no flush is in flight. */
+    size_t _hook_count = 0;
+    MemoryArena* _arena = NULL; /**< Arena the draw buffers were placed in, NULL if they came from the heap. */
+    uint8_t _arena_owner = 0;   /**< Owner of the display's regions in the arena. */
+    QueueHandle_t _flush_queue = NULL;
+    FlushRecord _records[MAX_IN_FLIGHT] = {};
+    size_t _record_head = 0; /**< Oldest flush in flight, advanced by retire(). */
+    size_t _record_tail = 0; /**< Next free record, advanced by the flushing task. */
+    std::atomic<uint32_t> _flushes_started{0};
+    std::atomic<uint32_t> _flushes_done{0};
+    std::atomic<uint32_t> _submitted{0};
+    std::atomic<uint32_t> _completed{0};
+    SemaphoreHandle_t _completion = NULL; /**< Given whenever a transfer completes. */
+    mutable portMUX_TYPE _records_lock = portMUX_INITIALIZER_UNLOCKED; /**< Guards the flush records and timing. */
+    FlushTiming _timing;
+    InputTiming _input_timing;
+    FrameLog* _frame_log = NULL;
+    FrameState _frame;
+    int64_t _frame_flush_start_us = 0; /**< Start of the first flush of the frame completing, guarded by the records lock. */
+    uint32_t _frame_bytes = 0;         /**< Bytes of the frame completing, guarded by the records lock. */
+    std::atomic<uint32_t> _frame_flush_avg_us{0}; /**< Moving average of the frame flush time. */
   };
 
 };  // namespace LVGLDisplay
\ No newline at end of file
@@ -0,0 +1,25 @@
+/**
+ * @file display_heap.h
+ * @brief Declares the hook giving LVGL its heap from the display memory arena.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Returns memory for LVGL's heap, from the memory arena if it has room and from the heap otherwise.
+ * Set LV_MEM_POOL_INCLUDE to this header and LV_MEM_POOL_ALLOC to lvgl_display_heap to use it.
+ *
+ * @param size The size of LVGL's heap, LV_MEM_SIZE.
+ * @return The memory, or NULL if none is free.
+ */
+void* lvgl_display_heap(size_t size);
+
+#ifdef __cplusplus
+}
+#endif
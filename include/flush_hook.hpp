@@ -0,0 +1,89 @@
+/**
+ * @file flush_hook.hpp
+ * @brief Defines the LVGLDisplay::FlushHook interface features attach to a display's flush path with.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_log.hpp"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief A feature attached to a display's flush path, such as FrameCapture, TraceRecorder, FramePacer or PixelPush.
+   * The display calls each attached hook at the points of a refresh below, and keeps none of their state. Every point
+   * defaults to doing nothing, so a hook overrides only those it needs. Hooks are attached and detached with
+   * Display::add_hook() and Display::remove_hook(), with the lock held.
+   */
+  class FlushHook {
+   public:
+    virtual ~FlushHook() = default;
+
+    /**
+     * @brief A refresh of the display is starting, its invalidated areas not yet coalesced. Called in the LVGL task.
+     *
+     * @param disp The LVGL display.
+     */
+    virtual void refresh_started(lv_disp_t* disp) {}
+
+    /**
+     * @brief The last area of a frame was rendered. Called in the LVGL task.
+     *
+     * @param frame The LVGL side of the frame record.
+     */
+    virtual void frame_rendered(const FrameRecord& frame) {}
+
+    /**
+     * @brief The first transfer of a frame is about to be queued. Called in the flushing task, which it may delay.
+     *
+     * @param window The area the frame covers, in the board's orientation.
+     * @param frame_flush_us The average frame flush time, 0 before the first frame.
+     */
+    virtual void frame_starting(const lv_area_t& window, uint32_t frame_flush_us) {}
+
+    /**
+     * @brief An area is about to be sent to the panel, by a flush or by Display::push(). Called in the flushing task.
+     *
+     * @param area The area, inclusive coordinates within the display as LVGL draws it.
+     * @param pixels The pixels of the area, packed with a stride of the area width.
+     * @param swapped Whether the pixels are in the other byte order to LVGL's.
+     */
+    virtual void area_sent(const lv_area_t& area, const lv_color_t* pixels, bool swapped) {}
+
+    /**
+     * @brief Every transfer of a frame has been queued, its last ones may still be on the bus. Called in the flushing
+     * task.
+     *
+     * @param frame The frame number of the display.
+     * @param time_us The time of the display.
+     */
+    virtual void frame_sent(uint32_t frame, int64_t time_us) {}
+
+    /**
+     * @brief The last transfer of a frame completed. Called from the transfer callback, which may run in an ISR.
+     *
+     * @param frame The completed frame record.
+     */
+    virtual void frame_done(const FrameRecord& frame) {}
+
+    /**
+     * @brief Another task released the lock through Lock. Called with the lock still held.
+     *
+     * @param time_us The time of the display.
+     * @param wait_us The time the task waited for the lock.
+     * @param hold_us The time the task held the lock.
+     */
+    virtual void lock_released(int64_t time_us, uint32_t wait_us, uint32_t hold_us) {}
+
+    /**
+     * @brief Returns an area kept off LVGL's flushes, inclusive coordinates within the display as LVGL draws it, or
+     * NULL. Flushed areas are clipped around it.
+     */
+    virtual const lv_area_t* excluded() const { return NULL; }
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,247 @@
+/**
+ * @file frame_capture.hpp
+ * @brief Defines the LVGLDisplay::FrameCapture class and its capture stream format.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "flush_hook.hpp"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  class Display;
+
+  /**
+   * @brief Captures what a display shows into a compressed stream, for remote monitoring and golden image tests.
+   * The flush path taps every area sent to the panel into a copy of the frame, comparing it in tiles of TILE x TILE
+   * pixels and marking the tiles which changed. A record is encoded every Config::interval frames, or on request, and
+   * holds only the changed tiles since the previous record, each rectangle of them coded with the token format of
+   * ImageStream. The stream is handed to a sink a buffer at a time. Decode it on the host with tools/capture_decoder.py.
+   *
+   * A stream is a sequence of records, each a Header followed by Header::rects rectangles, a Rect followed by its rows
+   * of RLE tokens, and the size of the record up to there as a little endian 32 bit word, so a decoder can tell a
+   * record cut short by a sink error. Unlike ImageStream's, tokens never run on from one row to the next, and COPY_UP copies from the row
+   * above within the rectangle, so the first row of a rectangle does not copy up. KEY records hold the whole frame and
+   * start a stream; a decoder joining a stream waits for one. DELTA records change the frame of the previous record.
+   *
+   * Pixels are in LVGL's byte order and coordinates, whatever the display's rotation and transfer format. Requires
+   * LV_COLOR_DEPTH 16.
+   */
+  class FrameCapture : public FlushHook {
+   public:
+    static constexpr uint8_t MAGIC[4] = {'L', 'D', 'C', '1'}; /**< First bytes of every record. */
+    static constexpr uint8_t FLAG_SWAPPED = 0x01;               /**< Pixels are stored big endian (LV_COLOR_16_SWAP). */
+    static constexpr size_t TILE = 16;                          /**< Width and height of the tiles changes are found in. */
+
+    enum class Type : uint8_t {
+      KEY = 0,   /**< The whole frame. */
+      DELTA = 1, /**< The tiles changed since the previous record. */
+    };
+
+    /**
+     * @brief Header of a record, little endian.
+     */
+    struct __attribute__((packed)) Header {
+      uint8_t magic[4]; /**< MAGIC. */
+      uint8_t type;     /**< Type of the record. */
+      uint8_t flags;    /**< FLAG_SWAPPED. */
+      uint16_t width;   /**< Width of the frame in pixels, as LVGL draws it. */
+      uint16_t height;  /**< Height of the frame in pixels. */
+      uint16_t rects;   /**< Rectangles following. */
+      uint32_t frame;   /**< Frame number of the display. */
+      uint32_t time_ms; /**< Time the frame was captured, in milliseconds of the display's time. */
+    };
+
+    /**
+     * @brief A rectangle of a record, little endian, followed by its tokens.
+     */
+    struct __attribute__((packed)) Rect {
+      uint16_t x;
+      uint16_t y;
+      uint16_t width;
+      uint16_t height;
+    };
+
+    /**
+     * @brief Receives the stream, a buffer at a time, from the flush path.
+     * Queue the bytes rather than block, to a stream buffer, a socket or a file. Returning an error drops the rest of
+     * the record, and the next record is a key record.
+     */
+    using Sink = esp_err_t (*)(const void* data, size_t size, void* context);
+
+    struct Config {
+      Sink sink = NULL;                   /**< Receives the stream. */
+      void* context = NULL;               /**< Passed to the sink. */
+      uint32_t interval = 1;              /**< Record every nth frame, 0 to record only on request. */
+      uint32_t key_interval = 0;          /**< Records between key records, 0 for a key record only when needed. */
+      size_t buffer_size = 2048;          /**< Bytes encoded before they are handed to the sink. */
+      uint32_t caps = MALLOC_CAP_DEFAULT; /**< Heap capabilities of the frame copy, such as MALLOC_CAP_SPIRAM. */
+    };
+
+    struct Stats {
+      uint32_t frames = 0;      /**< Frames ended while capturing. */
+      uint32_t records = 0;     /**< Records encoded. */
+      uint32_t key_records = 0; /**< Key records encoded. */
+      uint32_t tiles = 0;       /**< Tiles encoded. */
+      uint32_t errors = 0;      /**< Records the sink failed. */
+      uint64_t bytes = 0;       /**< Bytes handed to the sink. */
+      uint64_t tap_us = 0;      /**< Time comparing and copying areas into the frame. */
+      uint64_t encode_us = 0;   /**< Time encoding records, the sink included. */
+    };
+
+    FrameCapture() = default;
+    ~FrameCapture();
+
+    /**
+     * @brief Start capturing what a display shows, attached to its flush path. LVGL's screen is invalidated, so the
+     * first record holds the frame it redraws in full. Areas pushed around LVGL are captured too, and the frame follows
+     * the display's rotation. Waits for flushes in progress. The lock must be held.
+     *
+     * @param display The display, added to LVGL.
+     * @param config The capture configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE before the display is added to LVGL or if already started,
+     * ESP_ERR_NOT_SUPPORTED unless LVGL renders RGB565, or an error from start() or Display::add_hook().
+     */
+    esp_err_t start(Display& display, const Config& config);
+
+    /**
+     * @brief Allocate the frame and start capturing. The first record is a key record, so the frame must be drawn in
+     * full before it is recorded.
+     *
+     * @param config The capture configuration.
+     * @param width The width of the frame in pixels.
+     * @param height The height of the frame in pixels.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG without a sink or frame, ESP_ERR_INVALID_STATE if already started,
+     * or ESP_ERR_NO_MEM.
+     */
+    esp_err_t start(const Config& config, size_t width, size_t height);
+
+    /**
+     * @brief Stop capturing, detaching from the display's flush path, and release the frame. Attached to a display,
+     * waits for flushes in progress and the lock must be held.
+     */
+    void stop();
+
+    /**
+     * @brief Returns whether capturing has started.
+     */
+    bool active() const { return _frame != NULL; }
+
+    /**
+     * @brief Change the size of the frame, after the display was rotated. The frame keeps its allocation, its contents
+     * are forgotten and the next record is a key record.
+     *
+     * @param width The width of the frame in pixels, width times height no more than when started.
+     * @param height The height of the frame in pixels.
+     */
+    void resize(size_t width, size_t height);
+
+    /**
+     * @brief Copy an area sent to the panel into the frame, marking the tiles which changed.
+     *
+     * @param area The area, inclusive coordinates within the frame.
+     * @param pixels The pixels of the area, packed with a stride of the area width.
+     * @param swapped Whether the pixels are in the other byte order to LVGL's.
+     */
+    void tap(const lv_area_t& area, const uint16_t* pixels, bool swapped);
+
+    /**
+     * @brief Count a frame sent to the panel, recording it every Config::interval frames.
+     *
+     * @param frame The frame number of the display.
+     * @param time_us The time of the display.
+     */
+    void end_frame(uint32_t frame, int64_t time_us);
+
+    /**
+     * @brief Encode a record of the frame now and hand it to the sink.
+     * A delta record with no changes is not encoded.
+     *
+     * @param key Whether to record the whole frame, rather than the changes since the previous record.
+     * @param frame The frame number of the display.
+     * @param time_us The time of the display.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not started, or the error from the sink.
+     */
+    esp_err_t record(bool key, uint32_t frame, int64_t time_us);
+
+    /**
+     * @brief Record the frame on the display's panel now, whether or not it is due to be recorded, such as when
+     * support asks what a unit shows. Waits for flushes in progress. The lock must be held.
+     *
+     * @param key Whether to record the whole frame, rather than the changes since the previous record.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE unless started on a display, or the error from the sink.
+     */
+    esp_err_t record(bool key);
+
+    void area_sent(const lv_area_t& area, const lv_color_t* pixels, bool swapped) override;
+    void frame_sent(uint32_t frame, int64_t time_us) override;
+
+    /**
+     * @brief Returns the captured frame, width() * height() pixels in LVGL's byte order, or NULL if not started.
+     */
+    const uint16_t* pixels() const { return _frame; }
+
+    /**
+     * @brief Returns the width of the frame in pixels.
+     */
+    size_t width() const { return _width; }
+
+    /**
+     * @brief Returns the height of the frame in pixels.
+     */
+    size_t height() const { return _height; }
+
+    /**
+     * @brief Returns the statistics since the last reset.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+    /* Delete move and copy assignment operators and constuctors */
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture(FrameCapture&&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+    FrameCapture&& operator=(FrameCapture&&) = delete;
+
+   private:
+    void mark(size_t tile) { _changed[tile / 32] |= 1u << (tile % 32); }
+    bool changed(size_t tile) const { return _changed[tile / 32] & (1u << (tile % 32)); }
+    void mark_all();
+    void put(const void* data, size_t size);
+    void put_token(uint8_t op, size_t length);
+    void put_literal(const uint16_t* pixels, size_t count);
+    void encode_rect(const Rect& rect);
+    esp_err_t drain();
+
+    Config _config;
+    Stats _stats;
+    Display* _display = NULL;     /**< The display attached to, NULL when fed directly. */
+    uint32_t _last_frame = 0;     /**< Frame number of the display's last frame sent. */
+    uint16_t* _frame = NULL;
+    uint32_t* _changed = NULL;    /**< Bitmap of tiles changed since the previous record, row by row. */
+    uint8_t* _out = NULL;         /**< Encoded bytes not yet handed to the sink. */
+    size_t _out_size = 0;
+    size_t _record_size = 0;      /**< Bytes of the record being encoded. */
+    esp_err_t _sink_err = ESP_OK; /**< Error from the sink during the record being encoded. */
+    size_t _capacity = 0;         /**< Pixels of the frame allocation. */
+    size_t _width = 0;
+    size_t _height = 0;
+    size_t _tiles_x = 0;
+    size_t _tiles_y = 0;
+    size_t _tile_words = 0;       /**< Words of the bitmap. */
+    bool _key = true;             /**< Whether the next record must be a key record. */
+    uint32_t _frames = 0;         /**< Frames ended since the last sampled record. */
+    uint32_t _since_key = 0;      /**< Records since the last key record. */
+  };
+
+}  // namespace LVGLDisplay
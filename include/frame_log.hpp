@@ -0,0 +1,127 @@
+/**
+ * @file frame_log.hpp
+ * @brief Defines the LVGLDisplay::FrameLog class and the per-frame records it holds.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "esp_err.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Performance counters of one refresh of one display, from the refresh timer to the last transfer completing.
+   */
+  struct FrameRecord {
+    uint32_t frame = 0;            /**< Frame number of the display. */
+    uint8_t display = 0;           /**< Index of the display in the controller. */
+    uint8_t areas = 0;             /**< Number of flushed areas. */
+    uint8_t buffers = 0;           /**< Most draw buffers queued for the bus at once. */
+    int64_t start_us = 0;          /**< Time the refresh started. */
+    uint32_t render_us = 0;        /**< Time LVGL spent rendering, the refresh up to the last flush less the flush callbacks. */
+    uint32_t flush_us = 0;         /**< Time from the first flush to the last transfer completing. */
+    uint32_t dma_wait_us = 0;      /**< Time LVGL waited for a draw buffer to be transferred. */
+    uint32_t lock_wait_us = 0;     /**< Time other tasks waited for the lock since the previous frame. */
+    uint32_t bytes = 0;            /**< Pixel bytes transferred. */
+    int64_t input_us = 0;          /**< Time of the input event the frame redraws for, 0 without one. */
+    uint32_t input_latency_us = 0; /**< Time from the input event to the last transfer completing, touch to photon. */
+  };
+
+  /**
+   * @brief Summary of the frames held in a FrameLog.
+   */
+  struct FrameStats {
+    uint32_t frames = 0;          /**< Number of frames summarised. */
+    uint32_t render_avg_us = 0;   /**< Average render time. */
+    uint32_t render_max_us = 0;   /**< Longest render time. */
+    uint32_t flush_avg_us = 0;    /**< Average flush time. */
+    uint32_t flush_max_us = 0;    /**< Longest flush time. */
+    uint32_t dma_wait_avg_us = 0; /**< Average wait for a draw buffer. */
+    uint32_t dma_wait_max_us = 0; /**< Longest wait for a draw buffer. */
+    uint32_t lock_wait_max_us = 0; /**< Longest lock wait between two frames. */
+    uint32_t bytes_avg = 0;       /**< Average pixel bytes transferred. */
+    uint32_t areas_avg = 0;       /**< Average number of flushed areas. */
+    uint32_t buffers_max = 0;     /**< Most draw buffers queued for the bus at once. */
+    uint32_t inputs = 0;          /**< Number of frames redrawn for an input event. */
+    uint32_t input_latency_avg_us = 0; /**< Average time from an input event to its frame on the panel. */
+    uint32_t input_latency_max_us = 0; /**< Longest time from an input event to its frame on the panel. */
+  };
+
+  /**
+   * @brief A fixed size ring of the most recent frame records.
+   * Records are added from the flush completion path of any display, possibly in an ISR, without locks: a writer
+   * claims a slot with one atomic increment and stamps it with a sequence number, and readers retry a slot which
+   * was rewritten while they copied it. When the ring is full the oldest records are overwritten.
+   */
+  class FrameLog {
+   public:
+    FrameLog() = default;
+    ~FrameLog();
+
+    /**
+     * @brief Allocate the ring.
+     *
+     * @param capacity The number of records kept.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM.
+     */
+    esp_err_t create(size_t capacity);
+
+    /**
+     * @brief Returns whether the ring has been created.
+     */
+    bool created() const { return _slots != NULL; }
+
+    /**
+     * @brief Add a record, overwriting the oldest if the ring is full. Safe from any task or ISR.
+     *
+     * @param record The record to add.
+     */
+    void add(const FrameRecord& record);
+
+    /**
+     * @brief Copy the most recent records, oldest first.
+     *
+     * @param records Set to the records.
+     * @param count The most records to copy.
+     * @return The number of records copied.
+     */
+    size_t read(FrameRecord* records, size_t count) const;
+
+    /**
+     * @brief Summarise the records in the ring.
+     *
+     * @return The summary.
+     */
+    FrameStats stats() const;
+
+    /**
+     * @brief Discard every record.
+     */
+    void clear();
+
+    /* Delete move and copy assignment operators and constuctors */
+    FrameLog(const FrameLog&) = delete;
+    FrameLog(FrameLog&&) = delete;
+    FrameLog& operator=(const FrameLog&) = delete;
+    FrameLog&& operator=(FrameLog&&) = delete;
+
+   private:
+    struct Slot {
+      std::atomic<uint32_t> sequence; /**< 2n + 1 while record n is written, 2n + 2 once written. */
+      FrameRecord record;
+    };
+
+    bool copy(uint32_t index, FrameRecord* record) const;
+
+    Slot* _slots = NULL;
+    size_t _capacity = 0;
+    std::atomic<uint32_t> _next{0};  /**< Index of the next record added. */
+    std::atomic<uint32_t> _first{0}; /**< Index of the oldest record not cleared. */
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,265 @@
+/**
+ * @file frame_pacer.hpp
+ * @brief Defines the LVGLDisplay::FramePacer class and the vsync sources driving it.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "flush_hook.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lvgl.h"
+#include "sdkconfig.h"
+
+namespace LVGLDisplay {
+
+  class Display;
+  class FramePacer;
+
+  /**
+   * @brief A source of vsync edges, the start of the panel's vertical blanking.
+   * Interrupt driven sources call FramePacer::vsync() as edges arrive; sources without an interrupt deliver the edges
+   * up to the current time from poll(), which the pacer calls before scheduling a frame.
+   */
+  class VsyncSource {
+   public:
+    virtual ~VsyncSource() = default;
+
+    /**
+     * @brief Start delivering edges to the pacer.
+     *
+     * @param pacer The pacer to deliver edges to.
+     * @return ESP_OK on success, or an error code on failure.
+     */
+    virtual esp_err_t start(FramePacer* pacer) = 0;
+
+    /**
+     * @brief Stop delivering edges.
+     */
+    virtual void stop() = 0;
+
+    /**
+     * @brief Deliver the edges up to the given time, for sources without an interrupt.
+     *
+     * @param now_us The current time of the display.
+     */
+    virtual void poll(int64_t now_us) {}
+  };
+
+#if !CONFIG_IDF_TARGET_LINUX
+  /**
+   * @brief Vsync edges from the panel's tearing effect (TE) output, on the rising edge of a GPIO interrupt.
+   * The panel must have TE output enabled with TEON (0x35) in V-blank mode.
+   */
+  class GpioVsync : public VsyncSource {
+   public:
+    /**
+     * @param pin The GPIO the TE output is connected to.
+     */
+    explicit GpioVsync(int pin) : _pin(pin) {}
+    ~GpioVsync();
+
+    esp_err_t start(FramePacer* pacer) override;
+    void stop() override;
+
+    /* Delete move and copy assignment operators and constuctors */
+    GpioVsync(const GpioVsync&) = delete;
+    GpioVsync(GpioVsync&&) = delete;
+    GpioVsync& operator=(const GpioVsync&) = delete;
+    GpioVsync&& operator=(GpioVsync&&) = delete;
+
+   private:
+    static void isr(void* arg);
+
+    int _pin;
+    FramePacer* _pacer = NULL;
+  };
+#endif
+
+  /**
+   * @brief Generates the vsync edges of a simulated panel, for the virtual board and host tests.
+   * Edges are produced in the display's time base as time passes, with optional jitter and periodically dropped
+   * edges to exercise the pacer's missed edge accounting.
+   */
+  class SimulatedVsync : public VsyncSource {
+   public:
+    struct Config {
+      uint32_t period_us = 16856; /**< Refresh period, an ST7789 after reset refreshes at 59.3 Hz. */
+      int64_t phase_us = 0;       /**< Time of the first edge. */
+      uint32_t jitter_us = 0;     /**< Largest deviation of an edge from the period, pseudo random. */
+      uint32_t drop_every = 0;    /**< Drop every nth edge, 0 to deliver every edge. */
+    };
+
+    SimulatedVsync() = default;
+
+    /**
+     * @param config The generator configuration.
+     */
+    explicit SimulatedVsync(const Config& config) : _config(config) {}
+
+    esp_err_t start(FramePacer* pacer) override;
+    void stop() override { _pacer = NULL; }
+    void poll(int64_t now_us) override;
+
+    /**
+     * @brief Returns the generator configuration.
+     */
+    const Config& config() const { return _config; }
+
+    /**
+     * @brief Returns the number of edges generated, dropped ones included.
+     */
+    uint32_t edges() const { return _edge; }
+
+   private:
+    Config _config;
+    FramePacer* _pacer = NULL;
+    uint32_t _edge = 0; /**< Index of the next edge. */
+  };
+
+  /**
+   * @brief Aligns the colour transfers of a frame to the panel's scan, so the scanline does not cross the pixels
+   * being written.
+   * The pacer models the panel's gate scan from vsync edges, or without a source from a free-running estimate of
+   * the refresh period anchored when pacing started. Before the first transfer of a frame, it checks whether the
+   * scanline would cross the frame's area while the frame is written, and if so delays the transfer until the
+   * scanline has just passed the area: right behind the scanline when pixels are written in scan order, so the
+   * writes never overtake it, or right after it leaves the area otherwise.
+   */
+  class FramePacer : public FlushHook {
+   public:
+    struct Config {
+      bool enabled = false;         /**< Whether frames are paced. */
+      uint32_t period_us = 16856;   /**< Nominal refresh period, an ST7789 after reset refreshes at 59.3 Hz. */
+      uint16_t lines = 320;         /**< Gate lines the panel scans each refresh. */
+      uint16_t porch_lines = 24;    /**< Blanking lines between the vsync edge and the first gate line. */
+      uint16_t first_line = 0;      /**< Gate line of the first display line along the scan. */
+      uint16_t display_lines = 320; /**< Display lines along the scan. */
+      bool scan_x = true;           /**< Whether the scan advances along LVGL's X axis, as with swapped axes. */
+      bool reversed = false;        /**< Whether the scan runs from the last display line to the first. */
+      uint16_t margin_lines = 4;    /**< Lines kept clear of the scanline, for vsync jitter and wake up latency. */
+    };
+
+    struct Stats {
+      uint32_t vsyncs = 0;         /**< Vsync edges received. */
+      uint32_t dropped = 0;        /**< Vsync edges expected but not received. */
+      uint32_t frames = 0;         /**< Frames paced. */
+      uint32_t delayed = 0;        /**< Frames whose transfer was delayed for the scanline. */
+      uint32_t missed = 0;         /**< Frames not clear of the scanline after waiting, which waited for a later refresh. */
+      uint32_t overlong = 0;       /**< Frames written slower than the scanline allows, which can not avoid it. */
+      uint64_t wait_total_us = 0;  /**< Total time transfers were delayed. */
+      uint32_t wait_max_us = 0;    /**< Longest delay. */
+      uint32_t period_us = 0;      /**< Refresh period, as measured or configured. */
+    };
+
+    /**
+     * @brief A clock returning the display's time in microseconds.
+     */
+    using Clock = int64_t (*)(const void* context);
+
+    FramePacer() = default;
+    ~FramePacer();
+
+    /**
+     * @brief Start pacing frames.
+     *
+     * @param config The pacer configuration.
+     * @param source The vsync source, NULL for a free-running estimate. Must outlive the pacer.
+     * @param clock The display's clock, in the time base of the source.
+     * @param context Passed to the clock.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE, ESP_ERR_NO_MEM or an error from the source.
+     */
+    esp_err_t start(const Config& config, VsyncSource* source, Clock clock, const void* context);
+
+    /**
+     * @brief Start pacing the frames of a display, attached to its flush path and timed by its clock. The pacer
+     * follows the panel's scan in the board's orientation, however the display is rotated. The lock must be held.
+     *
+     * @param display The display.
+     * @param config The pacer configuration.
+     * @param source The vsync source, NULL for a free-running estimate. Must outlive the pacer.
+     * @return ESP_OK on success, or an error from start() or Display::add_hook().
+     */
+    esp_err_t start(Display& display, const Config& config, VsyncSource* source);
+
+    /**
+     * @brief Returns whether frames are paced.
+     */
+    bool active() const { return _wake != NULL; }
+
+    /**
+     * @brief Returns the pacer configuration.
+     */
+    const Config& config() const { return _config; }
+
+    /**
+     * @brief Record a vsync edge. Safe from any task or ISR.
+     *
+     * @param time_us Time of the edge, in the display's time base.
+     */
+    void vsync(int64_t time_us);
+
+    /**
+     * @brief Returns the earliest time a frame can start without the scanline crossing it.
+     *
+     * @param now_us The current time.
+     * @param area The area the frame covers.
+     * @param duration_us The time the frame takes to write, 0 if unknown.
+     * @param overlong Set to true if the frame is written too slowly to avoid the scanline at any start, may be NULL.
+     * @return The start time, now_us if the frame can start straight away.
+     */
+    int64_t schedule(int64_t now_us, const lv_area_t& area, uint32_t duration_us, bool* overlong = NULL);
+
+    /**
+     * @brief Wait until the frame can start, called before its first transfer.
+     *
+     * @param area The area the frame covers.
+     * @param duration_us The time the frame takes to write, 0 if unknown.
+     * @return The time waited in microseconds.
+     */
+    uint32_t pace(const lv_area_t& area, uint32_t duration_us);
+
+    void frame_starting(const lv_area_t& window, uint32_t frame_flush_us) override { pace(window, frame_flush_us); }
+
+    /**
+     * @brief Returns the statistics accumulated since the last reset.
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats();
+
+    /* Delete move and copy assignment operators and constuctors */
+    FramePacer(const FramePacer&) = delete;
+    FramePacer(FramePacer&&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+    FramePacer&& operator=(FramePacer&&) = delete;
+
+   private:
+    static void wake(void* arg);
+    static int64_t display_clock(const void* context);
+
+    void sleep(uint32_t us);
+
+    Config _config;
+    Stats _stats;
+    Display* _display = NULL; /**< The display attached to, NULL when paced directly. */
+    VsyncSource* _source = NULL;
+    Clock _clock = NULL;
+    const void* _context = NULL;
+    esp_timer_handle_t _timer = NULL;
+    SemaphoreHandle_t _wake = NULL;
+    bool _synced = false;    /**< Whether an edge has been received, so the next interval can be measured. */
+    int64_t _vsync_us = 0;   /**< Time of the last vsync edge, or the estimate's anchor. */
+    uint32_t _period_us = 0; /**< Refresh period, a moving average of the edge intervals. */
+    mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+  };
+
+}  // namespace LVGLDisplay
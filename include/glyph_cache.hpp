@@ -0,0 +1,174 @@
+/**
+ * @file glyph_cache.hpp
+ * @brief Defines the LVGLDisplay::GlyphCache class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief An LRU atlas of rasterized glyphs, drawn instead of decoding them from the font on every label update.
+   * LVGL looks each letter up in its font, decompresses its bitmap and expands it to 8 bit coverage, a row at a time,
+   * every time the letter is drawn. For the fonts added to the cache, the glyph's box and its coverage are kept in one
+   * block of memory on first use, and each later draw is a lookup and a single blend of the coverage in the label's
+   * colour and opacity. Coverage is kept rather than pixels blended with a colour, so a glyph drawn in several colours
+   * or over several backgrounds is cached once.
+   *
+   * When the atlas or its entries run out, the least recently drawn glyphs are evicted and the rest moved down to make
+   * room. Glyphs of other fonts, subpixel fonts, glyphs drawn under an LVGL mask, such as a rounded parent's, and
+   * glyphs larger than a quarter of the atlas are drawn by LVGL as before.
+   *
+   * Called by the LVGL task through Controller, which routes each display's draw_letter through draw(). Add fonts and
+   * warm the cache with the lock held.
+   */
+  class GlyphCache {
+   public:
+    static constexpr size_t MAX_FONTS = 8;     /**< Maximum number of fonts cached. */
+    static constexpr size_t MAX_ENTRIES = 4096; /**< Maximum number of glyphs cached. */
+
+    struct Config {
+      size_t budget = 8 * 1024;           /**< Bytes of the atlas, a byte per pixel of each glyph. */
+      size_t entries = 0;                 /**< Glyphs held at most, 0 for one per 64 bytes of the atlas. */
+      uint32_t caps = MALLOC_CAP_DEFAULT; /**< Heap capabilities of the atlas, such as MALLOC_CAP_SPIRAM. */
+    };
+
+    struct Stats {
+      uint32_t hits = 0;      /**< Letters of cached fonts found in the atlas. */
+      uint32_t misses = 0;    /**< Letters of cached fonts not in the atlas, rasterized into it if they fit. */
+      uint32_t evictions = 0; /**< Glyphs evicted to make room. */
+      uint32_t bypassed = 0;  /**< Letters of cached fonts drawn by LVGL: under a mask, missing or not fitting. */
+      uint32_t glyphs = 0;    /**< Glyphs in the atlas. */
+      size_t used = 0;        /**< Bytes of the atlas holding glyphs. */
+    };
+
+    GlyphCache() = default;
+    ~GlyphCache();
+
+    /**
+     * @brief Allocate the atlas and its entries.
+     *
+     * @param config The cache configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG without a budget or with more than MAX_ENTRIES entries,
+     * ESP_ERR_INVALID_STATE if already created, or ESP_ERR_NO_MEM.
+     */
+    esp_err_t create(const Config& config);
+
+    /**
+     * @brief Returns whether the cache has been created.
+     */
+    bool created() const { return _atlas != NULL; }
+
+    /**
+     * @brief Cache the glyphs of a font, one size of a typeface. The lock must be held.
+     *
+     * @param font The font, which must outlive the cache.
+     * @return ESP_OK on success or if already added, ESP_ERR_INVALID_ARG without a font, ESP_ERR_INVALID_STATE before
+     * create(), or ESP_ERR_NO_MEM if MAX_FONTS are cached.
+     */
+    esp_err_t add_font(const lv_font_t* font);
+
+    /**
+     * @brief Returns whether the glyphs of a font are cached.
+     */
+    bool cached(const lv_font_t* font) const;
+
+    /**
+     * @brief Rasterize the glyphs of a text into the atlas ahead of their first draw, such as the digits, sign and
+     * units of a numeric label at boot. The font is added if it is not cached yet. The lock must be held.
+     *
+     * @param font The font.
+     * @param text The glyphs, UTF-8 encoded.
+     * @return ESP_OK on success, ESP_ERR_NO_MEM if a glyph does not fit the atlas, or as add_font().
+     */
+    esp_err_t warm(const lv_font_t* font, const char* text);
+
+    /**
+     * @brief Evict every glyph, keeping the fonts. The lock must be held.
+     */
+    void clear();
+
+    /**
+     * @brief Draw a letter from the atlas, rasterizing it on first use, as LVGL's draw_letter.
+     *
+     * @param draw_ctx The draw context rendering.
+     * @param dsc The label's draw descriptor.
+     * @param pos The position of the letter's line box.
+     * @param letter The letter's code point.
+     * @return Whether the letter was handled, false to draw it with LVGL's draw_letter.
+     */
+    bool draw(lv_draw_ctx_t* draw_ctx, const lv_draw_label_dsc_t* dsc, const lv_point_t* pos, uint32_t letter);
+
+    /**
+     * @brief Returns the cache statistics.
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Returns the share of letters of cached fonts found in the atlas, from 0 to 1.
+     */
+    float hit_rate() const;
+
+    /**
+     * @brief Reset the hit, miss, eviction and bypass counts.
+     */
+    void reset_stats();
+
+    /* Delete move and copy assignment operators and constuctors */
+    GlyphCache(const GlyphCache&) = delete;
+    GlyphCache(GlyphCache&&) = delete;
+    GlyphCache& operator=(const GlyphCache&) = delete;
+    GlyphCache&& operator=(GlyphCache&&) = delete;
+
+   private:
+    static constexpr uint16_t NONE = 0xFFFF;
+
+    struct Entry {
+      const lv_font_t* font = NULL; /**< Font the glyph was drawn with, NULL if evicted or free. */
+      uint32_t letter = 0;          /**< The letter's code point. */
+      uint32_t offset = 0;          /**< Offset of the coverage in the atlas, box_w * box_h bytes. */
+      uint16_t box_w = 0;           /**< Width of the glyph's box. */
+      uint16_t box_h = 0;           /**< Height of the glyph's box. */
+      int16_t ofs_x = 0;            /**< Offset of the box from the letter's position. */
+      int16_t ofs_y = 0;            /**< Offset of the box from the font's base line. */
+      uint16_t newer = NONE;        /**< Next more recently drawn glyph. */
+      uint16_t older = NONE;        /**< Next less recently drawn glyph. */
+      uint16_t chain = NONE;        /**< Next glyph in the same hash bucket. */
+      uint16_t next = NONE;         /**< Next glyph in atlas order, or next free entry. */
+    };
+
+    Entry* find(const lv_font_t* font, uint32_t letter);
+    Entry* insert(const lv_font_t* font, uint32_t letter, const lv_font_glyph_dsc_t& glyph, const uint8_t* bitmap);
+    Entry* rasterize(const lv_font_t* font, uint32_t letter);
+    bool make_room(size_t bytes);
+    void evict(uint16_t index);
+    void compact();
+    void touch(uint16_t index);
+    void unlink(uint16_t index);
+    uint32_t bucket(const lv_font_t* font, uint32_t letter) const;
+
+    Config _config;
+    Stats _stats;
+    uint8_t* _atlas = NULL;              /**< Coverage of the glyphs, in atlas order from the start. */
+    Entry* _entries = NULL;
+    uint16_t* _buckets = NULL;           /**< First glyph of each hash bucket. */
+    uint32_t _bucket_mask = 0;
+    size_t _capacity = 0;                /**< Number of entries. */
+    size_t _end = 0;                     /**< Bytes of the atlas in use, including evicted glyphs not yet compacted. */
+    uint16_t _free = NONE;               /**< First free entry. */
+    uint16_t _first = NONE;              /**< First glyph in atlas order. */
+    uint16_t _last = NONE;               /**< Last glyph in atlas order. */
+    uint16_t _newest = NONE;             /**< Most recently drawn glyph. */
+    uint16_t _oldest = NONE;             /**< Least recently drawn glyph. */
+    const lv_font_t* _fonts[MAX_FONTS] = {};
+    size_t _font_count = 0;
+  };
+
+}  // namespace LVGLDisplay
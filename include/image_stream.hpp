@@ -0,0 +1,183 @@
+/**
+ * @file image_stream.hpp
+ * @brief Defines the LVGLDisplay::ImageStream class and its encoded image format.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Streams an encoded RGB565 image, typically in memory mapped flash, into LVGL's draw buffers.
+   * The image is shown by an LVGL object which decodes the rows of each draw stripe as LVGL renders it, so the image is
+   * never held in RAM; only the current row is, hres * 2 bytes. Images are produced by tools/image_encoder.py.
+   *
+   * An encoded image is a Header, an index of key rows, and the payload. RAW payloads are the rows one after another.
+   * RLE payloads are a sequence of tokens, each a byte holding the Op in the top two bits and the length less one in
+   * the bottom six, followed by a little endian 16 bit length less 64 if those are all set:
+   * - LITERAL: the pixels follow.
+   * - RUN: the pixel follows, repeated.
+   * - COPY_UP: the pixels are those of the row above.
+   *
+   * Tokens run on from row to row, except at key rows, which start with a new token and do not copy from the row above.
+   * The index holds the payload offset of every key row, so rendering can start there instead of from the top.
+   */
+  class ImageStream {
+   public:
+    static constexpr uint8_t MAGIC[4] = {'L', 'D', 'I', '1'}; /**< First bytes of an encoded image. */
+    static constexpr uint8_t FLAG_SWAPPED = 0x01;               /**< Pixels are stored big endian (LV_COLOR_16_SWAP). */
+
+    enum class Codec : uint8_t {
+      RAW = 0, /**< Uncompressed rows. */
+      RLE = 1, /**< Literal, run and copy up tokens. */
+    };
+
+    enum Op : uint8_t {
+      LITERAL = 0,
+      RUN = 1,
+      COPY_UP = 2,
+    };
+
+    /**
+     * @brief Header of an encoded image, little endian.
+     */
+    struct __attribute__((packed)) Header {
+      uint8_t magic[4];      /**< MAGIC. */
+      uint16_t width;        /**< Width in pixels. */
+      uint16_t height;       /**< Height in pixels. */
+      uint8_t codec;         /**< Codec of the payload. */
+      uint8_t flags;         /**< FLAG_SWAPPED. */
+      uint16_t key_rows;     /**< Rows between key rows, 0 without an index. */
+      uint32_t payload_size; /**< Size of the payload in bytes. */
+    };
+
+    struct Stats {
+      uint32_t rows = 0;         /**< Rows decoded for drawing. */
+      uint32_t skipped_rows = 0; /**< Rows decoded to reach a row further on. */
+      uint32_t seeks = 0;        /**< Restarts from a key row or the top. */
+      uint32_t errors = 0;       /**< Rows not drawn as the payload is corrupt. */
+      uint64_t decode_us = 0;    /**< Time spent decoding and copying rows. */
+    };
+
+    ImageStream() = default;
+    ~ImageStream();
+
+    /**
+     * @brief Open an encoded image.
+     * The image is read in place and must stay mapped while the stream is open.
+     *
+     * @param data The encoded image.
+     * @param size The size of the encoded image in bytes.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the image is not valid, ESP_ERR_NOT_SUPPORTED for an unknown
+     * codec, or ESP_ERR_NO_MEM.
+     */
+    esp_err_t open(const void* data, size_t size);
+
+    /**
+     * @brief Close the image, deleting its object and releasing the row buffer.
+     * The lock must be held if the object was created.
+     */
+    void close();
+
+    /**
+     * @brief Returns whether an image is open.
+     */
+    bool opened() const { return _payload != NULL; }
+
+    /**
+     * @brief Returns the width of the image in pixels.
+     */
+    size_t width() const { return _width; }
+
+    /**
+     * @brief Returns the height of the image in pixels.
+     */
+    size_t height() const { return _height; }
+
+    /**
+     * @brief Returns the codec of the image.
+     */
+    Codec codec() const { return _codec; }
+
+    /**
+     * @brief Returns the size of the encoded image in bytes.
+     */
+    size_t encoded_size() const { return _size; }
+
+    /**
+     * @brief Copy part of a row of the image, in LVGL's byte order.
+     * Rows are decoded in order; reading a row above the last one read restarts at the key row above it.
+     *
+     * @param y The row.
+     * @param x1 The first column.
+     * @param x2 The last column, inclusive.
+     * @param pixels The destination, x2 - x1 + 1 pixels.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG outside the image, or ESP_ERR_INVALID_SIZE if the payload is corrupt.
+     */
+    esp_err_t read(size_t y, size_t x1, size_t x2, uint16_t* pixels);
+
+    /**
+     * @brief Create an LVGL object showing the image, sized to it.
+     * The object draws the image over whatever is behind it, and tells LVGL it covers its area, so nothing behind it is
+     * rendered. Requires LV_COLOR_DEPTH 16. The lock must be held.
+     *
+     * @param parent The parent object.
+     * @return The object, or NULL if no image is open or LVGL does not render RGB565.
+     */
+    lv_obj_t* create(lv_obj_t* parent);
+
+    /**
+     * @brief Returns the object showing the image, NULL until created.
+     */
+    lv_obj_t* object() const { return _obj; }
+
+    /**
+     * @brief Returns the decoding statistics since the last reset.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the decoding statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+    /* Delete move and copy assignment operators and constuctors */
+    ImageStream(const ImageStream&) = delete;
+    ImageStream(ImageStream&&) = delete;
+    ImageStream& operator=(const ImageStream&) = delete;
+    ImageStream&& operator=(ImageStream&&) = delete;
+
+   private:
+    static void event_callback(lv_event_t* e);
+
+    esp_err_t seek(size_t y);
+    esp_err_t decode_row();
+    void draw(lv_event_t* e);
+
+    const uint8_t* _data = NULL;
+    const uint8_t* _payload = NULL;
+    size_t _size = 0;
+    size_t _payload_size = 0;
+    size_t _width = 0;
+    size_t _height = 0;
+    size_t _key_rows = 0;
+    Codec _codec = Codec::RAW;
+    bool _swap = false;         /**< Whether stored pixels are in the other byte order to LVGL's. */
+    uint16_t* _line = NULL;     /**< The last row decoded, stored byte order. */
+    bool _line_valid = false;   /**< Whether _line holds the row above the next one. */
+    size_t _row = 0;            /**< Next row to decode. */
+    size_t _position = 0;       /**< Next payload byte. */
+    uint8_t _op = LITERAL;      /**< Op of the token being decoded. */
+    uint32_t _remaining = 0;    /**< Pixels left in the token being decoded. */
+    uint16_t _pixel = 0;        /**< Pixel of a RUN token. */
+    lv_obj_t* _obj = NULL;
+    Stats _stats;
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,144 @@
+/**
+ * @file memory_arena.hpp
+ * @brief Defines the LVGLDisplay::MemoryArena class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief One contiguous block of memory, reserved at boot or link time, carved into the buffers the displays need.
+   * Draw buffers, transfer bounce buffers and optionally LVGL's heap are taken from the arena in aligned regions
+   * instead of from the heap, so they do not depend on how fragmented the heap has become by the time they are
+   * needed. Regions are never returned; asking for a region by the name and owner it was first allocated with
+   * returns the same memory, so re-initialising reuses it.
+   */
+  class MemoryArena {
+   public:
+    static constexpr size_t MAX_REGIONS = 16; /**< Maximum number of regions. */
+    static constexpr size_t ALIGNMENT = 64;   /**< Alignment of every region, a cache line and a PSRAM DMA block. */
+
+    /**
+     * @brief Returns a size rounded up to the region alignment.
+     */
+    static constexpr size_t align(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    struct Region {
+      const char* name = NULL; /**< What the region holds. */
+      uint8_t owner = 0;       /**< Index of the display the region belongs to. */
+      size_t offset = 0;       /**< Offset from the start of the arena. */
+      size_t size = 0;         /**< Size in bytes, a multiple of ALIGNMENT. */
+    };
+
+    MemoryArena() = default;
+    ~MemoryArena();
+
+    /**
+     * @brief Reserve the arena from the heap, best done early in boot before the heap fragments.
+     *
+     * @param capacity The size of the arena in bytes.
+     * @param caps Heap capabilities of the arena, MALLOC_CAP_DMA for internal DMA capable memory or MALLOC_CAP_SPIRAM.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM.
+     */
+    esp_err_t create(size_t capacity, uint32_t caps);
+
+    /**
+     * @brief Use memory reserved at link time as the arena.
+     *
+     * @param memory The memory, aligned to ALIGNMENT.
+     * @param capacity The size of the memory in bytes.
+     * @param caps The capabilities of the memory, as for create().
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG or ESP_ERR_INVALID_STATE.
+     */
+    esp_err_t adopt(void* memory, size_t capacity, uint32_t caps);
+
+    /**
+     * @brief Returns whether the arena has been created or adopted.
+     */
+    bool created() const { return _base != NULL; }
+
+    /**
+     * @brief Returns a region, allocating it if the name and owner have not been allocated before.
+     *
+     * @param name What the region holds, a string literal.
+     * @param owner Index of the display the region belongs to.
+     * @param size The size in bytes.
+     * @return The region's memory, or NULL if the arena is too small or a previous region of the name is smaller.
+     */
+    void* allocate(const char* name, uint8_t owner, size_t size);
+
+    /**
+     * @brief Returns whether memory lies within the arena.
+     */
+    bool contains(const void* memory) const {
+      return memory >= _base && (const uint8_t*)memory < _base + _capacity;
+    }
+
+    /**
+     * @brief Returns the heap capabilities of the arena's memory.
+     */
+    uint32_t caps() const { return _caps; }
+
+    /**
+     * @brief Returns whether the arena was reserved at link time.
+     */
+    bool reserved_statically() const { return created() && !_owned; }
+
+    /**
+     * @brief Returns the size of the arena in bytes.
+     */
+    size_t capacity() const { return _capacity; }
+
+    /**
+     * @brief Returns the bytes allocated to regions.
+     */
+    size_t used() const { return _used; }
+
+    /**
+     * @brief Returns the bytes still free.
+     */
+    size_t available() const { return _capacity - _used; }
+
+    /**
+     * @brief Copy the regions, in allocation order.
+     *
+     * @param regions Set to the regions.
+     * @param count The most regions to copy.
+     * @return The number of regions copied.
+     */
+    size_t regions(Region* regions, size_t count) const;
+
+    /**
+     * @brief Returns a description of the arena's placement, such as "internal DMA" or "PSRAM".
+     */
+    const char* placement() const;
+
+    /**
+     * @brief Log the memory budget: the arena's size and placement, and each region with its offset and size.
+     */
+    void report() const;
+
+    /* Delete move and copy assignment operators and constuctors */
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena(MemoryArena&&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+    MemoryArena&& operator=(MemoryArena&&) = delete;
+
+   private:
+    uint8_t* _base = NULL;
+    size_t _capacity = 0;
+    size_t _used = 0;
+    uint32_t _caps = 0;
+    bool _owned = false; /**< Whether the memory came from the heap and is freed with the arena. */
+    Region _regions[MAX_REGIONS];
+    size_t _region_count = 0;
+  };
+
+}  // namespace LVGLDisplay
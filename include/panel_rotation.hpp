@@ -0,0 +1,151 @@
+/**
+ * @file panel_rotation.hpp
+ * @brief Defines the LVGLDisplay::PanelRotation class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  class Display;
+
+  /**
+   * @brief Rotates a display in quarter turns, without re-initialising the panel or reallocating the draw buffers.
+   * In the panel, the controller's memory access order (MADCTL) is switched with esp_lcd_panel_swap_xy() and
+   * esp_lcd_panel_mirror(), and the gaps are recomputed, as the display's window in the panel's memory is then
+   * addressed from another corner. In software, the panel keeps its orientation and each transfer is rotated in place
+   * with PixelConvert::rotate_rgb565(), for panels which can not rotate, or to keep the transfers in the panel's scan
+   * order. LVGL's resolution follows and its screen is redrawn; the frame pacer keeps the panel's scan.
+   */
+  class PanelRotation {
+   public:
+    /**
+     * @brief The geometry of the panel controller's memory around the display.
+     */
+    struct Config {
+      int x_gap = 0;      /**< Column offset of the display in the panel controller's memory. */
+      int y_gap = 0;      /**< Row offset of the display in the panel controller's memory. */
+      size_t columns = 0; /**< Columns of the panel controller's memory, 0 if the panel can not rotate. */
+      size_t rows = 0;    /**< Rows of the panel controller's memory. */
+    };
+
+    explicit PanelRotation(Display& display) : _display(display) {}
+    ~PanelRotation();
+
+    /**
+     * @brief Set the panel geometry, called by the board before the panel is brought up.
+     *
+     * @param config The panel geometry.
+     */
+    void configure(const Config& config);
+
+    /**
+     * @brief Rotate the display. Waits for the bring-up and for flushes in progress. The lock must be held.
+     *
+     * @param angle The rotation, anticlockwise as LVGL rotates its screen.
+     * @param software Whether to rotate the pixels in the flush path, rather than the panel's addressing.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE before the display is added to LVGL or
+     * while an area is excluded, ESP_ERR_NOT_SUPPORTED, ESP_ERR_NO_MEM, or an error from the bring-up or the panel.
+     */
+    esp_err_t set(lv_disp_rot_t angle, bool software);
+
+    /**
+     * @brief Rotate the display in the panel if it can rotate, and in software otherwise.
+     *
+     * @param angle The rotation, anticlockwise as LVGL rotates its screen.
+     * @return As set(lv_disp_rot_t, bool).
+     */
+    esp_err_t set(lv_disp_rot_t angle) { return set(angle, !_config.columns); }
+
+    /**
+     * @brief Apply a rotation LVGL was given, called from the driver update callback installed by the controller, so
+     * lv_disp_set_rotation() rotates the display too. Rotates as set() last did, in software if the panel can not
+     * rotate.
+     *
+     * @param angle The rotation.
+     * @return ESP_OK on success, ESP_ERR_NO_MEM, or an error from the panel.
+     */
+    esp_err_t orient(lv_disp_rot_t angle);
+
+    /**
+     * @brief Returns the rotation of the display.
+     */
+    lv_disp_rot_t angle() const { return _angle; }
+
+    /**
+     * @brief Returns whether the rotation is applied in the flush path rather than the panel.
+     */
+    bool software() const { return _software; }
+
+    /**
+     * @brief Returns whether areas are rotated in the flush path before they are sent.
+     */
+    bool rotating() const { return _software && _angle != LV_DISP_ROT_NONE; }
+
+    /**
+     * @brief Returns the column offset of the display in the panel controller's memory, for the current orientation.
+     */
+    int x_gap() const { return _x_gap; }
+
+    /**
+     * @brief Returns the row offset of the display in the panel controller's memory, for the current orientation.
+     */
+    int y_gap() const { return _y_gap; }
+
+    /**
+     * @brief Returns an area in LVGL's rotated coordinates in the board's orientation.
+     *
+     * @param area The area, inclusive coordinates within the display as LVGL draws it.
+     */
+    lv_area_t to_panel(const lv_area_t& area) const { return to_panel(area, _angle); }
+
+    /**
+     * @brief Rotate the pixels of an area in place and move the area to the board's orientation, called by the flush
+     * path when rotating().
+     *
+     * @param area The area, moved to the board's orientation.
+     * @param pixels The RGB565 pixels of the area.
+     * @return ESP_OK on success, or ESP_ERR_NO_MEM.
+     */
+    esp_err_t rotate(lv_area_t* area, void* pixels);
+
+    /* Delete move and copy assignment operators and constuctors */
+    PanelRotation(const PanelRotation&) = delete;
+    PanelRotation(PanelRotation&&) = delete;
+    PanelRotation& operator=(const PanelRotation&) = delete;
+    PanelRotation&& operator=(PanelRotation&&) = delete;
+
+   private:
+    /**
+     * @brief A memory access order of the panel controller: the axes are exchanged, then the columns and rows of its
+     * memory are mirrored, as esp_lcd_panel_swap_xy() and esp_lcd_panel_mirror() set them.
+     */
+    struct Orientation {
+      bool swap_xy;
+      bool mirror_x;
+      bool mirror_y;
+    };
+
+    Orientation orientation(lv_disp_rot_t angle) const;
+    esp_err_t orient_panel(lv_disp_rot_t angle);
+    lv_area_t to_panel(const lv_area_t& area, lv_disp_rot_t angle) const;
+    esp_err_t reserve_scratch(size_t pixels);
+
+    Display& _display;
+    Config _config;
+    int _x_gap = 0;                                   /**< Column offset for the orientation set in the panel. */
+    int _y_gap = 0;                                   /**< Row offset for the orientation set in the panel. */
+    lv_disp_rot_t _angle = LV_DISP_ROT_NONE;          /**< Rotation of LVGL's screen. */
+    lv_disp_rot_t _panel_angle = LV_DISP_ROT_NONE;    /**< Rotation set in the panel, none when rotating in software. */
+    bool _software = false;
+    uint16_t* _scratch = NULL; /**< Pixels are rotated into this, then copied back, when rotating in software. */
+    size_t _scratch_pixels = 0;
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,144 @@
+/**
+ * @file pixel_convert.hpp
+ * @brief Declares the LVGLDisplay::PixelConvert colour swap and conversion kernels.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Colour byte swap and conversion kernels for the flush path.
+   * The byte swap uses the ESP32-S3 PIE vector instructions where available, the other kernels are portable code. Each
+   * gives the same result bit for bit as the reference implementations in PixelConvert::Scalar.
+   * RGB888 pixels are three bytes in R, G, B order. ARGB8888 pixels are 0xAARRGGBB words, the alpha is ignored.
+   * Where a swap flag is taken, the RGB565 result is written big endian as ST7789 panels expect.
+   */
+  namespace PixelConvert {
+
+    /**
+     * @brief The kernels, to ask which implementation each uses.
+     */
+    enum class Kernel : uint8_t {
+      SWAP_RGB565,
+      RGB888_TO_RGB565,
+      ARGB8888_TO_RGB565,
+      RGB888_TO_RGB565_DITHER,
+      ARGB8888_TO_RGB565_DITHER,
+      RGB565_TO_RGB444,
+      ROTATE_RGB565,
+    };
+
+    /**
+     * @brief Returns the name of the implementation a kernel uses on this target, "pie" or "portable".
+     * Only swap_rgb565() has a PIE implementation, on the ESP32-S3.
+     *
+     * @param kernel The kernel.
+     */
+    const char* implementation(Kernel kernel);
+
+    /**
+     * @brief Swap the byte order of RGB565 pixels. dst may equal src.
+     *
+     * @param dst The destination pixels.
+     * @param src The source pixels.
+     * @param count The number of pixels.
+     */
+    void swap_rgb565(uint16_t* dst, const uint16_t* src, size_t count);
+
+    /**
+     * @brief Convert RGB888 pixels to RGB565.
+     *
+     * @param dst The destination pixels.
+     * @param src The source pixels, count * 3 bytes.
+     * @param count The number of pixels.
+     * @param swap Whether to write the result big endian.
+     */
+    void rgb888_to_rgb565(uint16_t* dst, const uint8_t* src, size_t count, bool swap);
+
+    /**
+     * @brief Convert ARGB8888 pixels to RGB565.
+     *
+     * @param dst The destination pixels.
+     * @param src The source pixels.
+     * @param count The number of pixels.
+     * @param swap Whether to write the result big endian.
+     */
+    void argb8888_to_rgb565(uint16_t* dst, const uint32_t* src, size_t count, bool swap);
+
+    /**
+     * @brief Convert a rectangle of RGB888 pixels to RGB565 with a 4x4 ordered dither.
+     * The dither pattern is anchored to the screen, so adjacent areas line up.
+     *
+     * @param dst The destination pixels, width * height.
+     * @param src The source pixels, width * height * 3 bytes.
+     * @param width The width of the rectangle.
+     * @param height The height of the rectangle.
+     * @param x The screen column of the first pixel.
+     * @param y The screen row of the first pixel.
+     * @param swap Whether to write the result big endian.
+     */
+    void rgb888_to_rgb565_dither(uint16_t* dst, const uint8_t* src, size_t width, size_t height, size_t x, size_t y, bool swap);
+
+    /**
+     * @brief Convert a rectangle of ARGB8888 pixels to RGB565 with a 4x4 ordered dither.
+     *
+     * @param dst The destination pixels, width * height.
+     * @param src The source pixels, width * height.
+     * @param width The width of the rectangle.
+     * @param height The height of the rectangle.
+     * @param x The screen column of the first pixel.
+     * @param y The screen row of the first pixel.
+     * @param swap Whether to write the result big endian.
+     */
+    void argb8888_to_rgb565_dither(uint16_t* dst, const uint32_t* src, size_t width, size_t height, size_t x, size_t y, bool swap);
+
+    /**
+     * @brief Returns the bytes of count pixels packed as RGB444, 12 bits each. An odd count ends with half a byte.
+     */
+    inline size_t rgb444_bytes(size_t count) { return (count * 3 + 1) / 2; }
+
+    /**
+     * @brief Pack RGB565 pixels into RGB444 for the ST7789's 12 bit interface format, dropping the low bits of each
+     * channel. Two pixels are three bytes, R0G0 B0R1 G1B1, an odd last pixel is padded with zero bits. dst may equal
+     * src, so a buffer can be packed in place.
+     *
+     * @param dst The destination, rgb444_bytes(count) bytes.
+     * @param src The source pixels.
+     * @param count The number of pixels.
+     * @param swapped Whether the source pixels are big endian.
+     */
+    void rgb565_to_rgb444(uint8_t* dst, const uint16_t* src, size_t count, bool swapped);
+
+    /**
+     * @brief Rotate a rectangle of RGB565 pixels by quarter turns anticlockwise, as LVGL's lv_disp_rot_t rotates the
+     * screen. Quarter turns transpose the rectangle in square tiles, so the rows read and the columns written stay in
+     * the cache. dst must not overlap src.
+     *
+     * @param dst The destination pixels, width * height, height pixels wide after a quarter or three quarter turn.
+     * @param src The source pixels, width * height.
+     * @param width The width of the rectangle.
+     * @param height The height of the rectangle.
+     * @param turns The number of quarter turns, 0 to 3.
+     */
+    void rotate_rgb565(uint16_t* dst, const uint16_t* src, size_t width, size_t height, unsigned turns);
+
+    /**
+     * @brief One pixel at a time reference implementations, used to verify the kernels.
+     */
+    namespace Scalar {
+      void swap_rgb565(uint16_t* dst, const uint16_t* src, size_t count);
+      void rgb888_to_rgb565(uint16_t* dst, const uint8_t* src, size_t count, bool swap);
+      void argb8888_to_rgb565(uint16_t* dst, const uint32_t* src, size_t count, bool swap);
+      void rgb888_to_rgb565_dither(uint16_t* dst, const uint8_t* src, size_t width, size_t height, size_t x, size_t y, bool swap);
+      void argb8888_to_rgb565_dither(uint16_t* dst, const uint32_t* src, size_t width, size_t height, size_t x, size_t y, bool swap);
+      void rgb565_to_rgb444(uint8_t* dst, const uint16_t* src, size_t count, bool swapped);
+      void rotate_rgb565(uint16_t* dst, const uint16_t* src, size_t width, size_t height, unsigned turns);
+    }  // namespace Scalar
+
+  }  // namespace PixelConvert
+
+}  // namespace LVGLDisplay
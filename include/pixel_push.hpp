@@ -0,0 +1,152 @@
+/**
+ * @file pixel_push.hpp
+ * @brief Defines the LVGLDisplay::PixelPush class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "display.hpp"
+#include "esp_err.h"
+#include "flush_hook.hpp"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Pushes RGB565 pixels straight to the panel, around LVGL's renderer, such as camera or video frames.
+   * While pushing, the pusher is attached to the display's flush path and excludes its area from LVGL's flushes, or
+   * takes the whole panel over. Flushed areas are clipped around the area; keep it against the left or right edge of
+   * the panel, or full width, or the rows beside it are sent one at a time. Pixels are
+   * transferred from two buffers the bus can transfer from: one is filled while the other is on the bus. Fill them
+   * with buffer() and submit() to render straight into them, or let push() copy pixels from anywhere into them.
+   *
+   * Transfers are queued with the lock held and LVGL's flushes finished, so they never interleave with LVGL's, and
+   * LVGL carries on rendering the rest of the screen in between. With an RGB444 transfer format the buffers are
+   * packed in place as they are queued. Requires LV_COLOR_DEPTH 16.
+   */
+  class PixelPush : public FlushHook {
+   public:
+    struct Config {
+      size_t lines = 16;        /**< Rows of the area each buffer holds. */
+      bool panel_order = false; /**< Pixels are sent as given, without the software byte swap, as from a camera. */
+    };
+
+    struct Stats {
+      uint32_t pushes = 0;    /**< Calls of push() and submit(). */
+      uint32_t transfers = 0; /**< Transfers queued. */
+      uint64_t bytes = 0;     /**< Pixel bytes transferred, in the display's transfer format. */
+      uint64_t copy_us = 0;   /**< Time copying and swapping pixels into the buffers. */
+      uint64_t wait_us = 0;   /**< Time waiting for a free buffer, the lock, LVGL's flushes and the bus. */
+    };
+
+    explicit PixelPush(Display& display) : _display(display) {}
+    ~PixelPush();
+
+    /**
+     * @brief Start pushing to an area, excluding it from LVGL's flushes, and allocate the buffers.
+     * The display must have been added to the controller. Takes the lock, which may already be held.
+     *
+     * @param area The area, inclusive coordinates within the display, or NULL to take over the whole panel.
+     * @param config The buffer configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if already started, the display is not
+     * added or another area is excluded, ESP_ERR_NOT_SUPPORTED unless LVGL renders RGB565, or ESP_ERR_NO_MEM.
+     */
+    esp_err_t begin(const lv_area_t* area, const Config& config);
+
+    /**
+     * @brief Start pushing to an area with the default buffer configuration.
+     *
+     * @param area The area, inclusive coordinates within the display, or NULL to take over the whole panel.
+     * @return As begin(const lv_area_t*, const Config&).
+     */
+    esp_err_t begin(const lv_area_t* area) { return begin(area, Config()); }
+
+    /**
+     * @brief Wait for the transfers, hand the area back to LVGL, which redraws it, and release the buffers.
+     * Takes the lock, which may already be held.
+     */
+    void end();
+
+    /**
+     * @brief Returns whether pushing has started.
+     */
+    bool active() const { return _buffers[0] != NULL; }
+
+    /**
+     * @brief Returns the area pushed to.
+     */
+    const lv_area_t& area() const { return _area; }
+
+    const lv_area_t* excluded() const override { return active() ? &_area : NULL; }
+
+    /**
+     * @brief Returns the next free buffer to render into, waiting for its previous transfer to complete.
+     * Pass the area rendered to submit(); rows are packed with a stride of the submitted area's width.
+     *
+     * @param pixels Set to the size of the buffer in pixels, the area width times Config::lines.
+     * @return The buffer, or NULL if not started.
+     */
+    lv_color_t* buffer(size_t* pixels);
+
+    /**
+     * @brief Transfer the buffer returned by buffer(). Returns once the transfer is queued.
+     *
+     * @param area The area rendered, inclusive coordinates within the pushed area, no more pixels than the buffer.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE without a buffer, or an error from the
+     * panel.
+     */
+    esp_err_t submit(const lv_area_t& area);
+
+    /**
+     * @brief Copy pixels into the buffers and transfer them, a buffer at a time.
+     * Returns once the last buffer is queued, the pixels may then be reused.
+     *
+     * @param area The area, inclusive coordinates within the pushed area.
+     * @param pixels The pixels of the area in LVGL's colour format, or the panel's byte order with Config::panel_order.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if not started, or an error from the panel.
+     */
+    esp_err_t push(const lv_area_t& area, const lv_color_t* pixels);
+
+    /**
+     * @brief Wait for every transfer queued to complete.
+     */
+    void wait();
+
+    /**
+     * @brief Returns the statistics since the last reset.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+    /* Delete move and copy assignment operators and constuctors */
+    PixelPush(const PixelPush&) = delete;
+    PixelPush(PixelPush&&) = delete;
+    PixelPush& operator=(const PixelPush&) = delete;
+    PixelPush&& operator=(PixelPush&&) = delete;
+
+   private:
+    bool inside(const lv_area_t& area) const;
+    void wait_for(size_t buffer);
+    esp_err_t transfer(const lv_area_t& area);
+
+    Display& _display;
+    Config _config;
+    lv_area_t _area = {};
+    lv_color_t* _buffers[2] = {};
+    uint32_t _reuse_at[2] = {}; /**< Transfer count once each buffer's transfer completes. */
+    bool _queued[2] = {};       /**< Whether each buffer has been transferred from. */
+    size_t _buffer_pixels = 0;
+    size_t _next = 0;           /**< Buffer filled next. */
+    bool _filling = false;      /**< Whether buffer() handed out the next buffer. */
+    bool _swap = false;         /**< Whether pixels are swapped into the panel's byte order. */
+    Stats _stats;
+  };
+
+}  // namespace LVGLDisplay
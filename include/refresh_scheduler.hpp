@@ -0,0 +1,91 @@
+/**
+ * @file refresh_scheduler.hpp
+ * @brief Defines the LVGLDisplay::RefreshScheduler class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief Adapts the refresh period of a display to its activity.
+   * While areas are invalidated or input is active, the display refreshes every active period, raised to the time the
+   * bus needs to transfer a frame so frames do not queue up behind the bus. Refreshes are paced from the previous due
+   * time rather than from when the LVGL task got round to them, so animations advance evenly. Once nothing has been
+   * invalidated and there has been no input for a while, the period drops to the idle period, so the LVGL task sleeps
+   * through static screens. An idle display woken for posted updates refreshes at once, other updates made while idle
+   * are drawn within one idle period.
+   */
+  class RefreshScheduler {
+   public:
+    struct Config {
+      bool enabled = false;                             /**< Whether the period is adapted, otherwise left alone. */
+      uint32_t active_period_ms = LV_DISP_DEF_REFR_PERIOD; /**< Refresh period while active. */
+      uint32_t idle_period_ms = 200;                    /**< Refresh period while idle. */
+      uint32_t idle_after_ms = 1000;                    /**< Time without invalidation or input before going idle. */
+    };
+
+    struct Stats {
+      uint32_t refreshes = 0;    /**< Number of refreshes scheduled. */
+      uint32_t rendered = 0;     /**< Number of refreshes with invalidated areas. */
+      uint32_t idle_entries = 0; /**< Number of times the display went idle. */
+      uint32_t bus_limited = 0;  /**< Number of refreshes whose period was raised to what the bus sustains. */
+      uint32_t late = 0;         /**< Number of refreshes more than a period late, where pacing restarted. */
+    };
+
+    /**
+     * @brief Set the scheduler configuration.
+     *
+     * @param config The scheduler configuration.
+     */
+    void configure(const Config& config);
+
+    /**
+     * @brief Returns the scheduler configuration.
+     */
+    const Config& config() const { return _config; }
+
+    /**
+     * @brief Schedule the next refresh, called by the refresh timer before the display is rendered.
+     *
+     * @param disp The LVGL display.
+     * @param timer The refresh timer of the display.
+     * @param flush_us The time the bus currently needs to transfer a frame, 0 if unknown.
+     */
+    void refresh(lv_disp_t* disp, lv_timer_t* timer, uint32_t flush_us);
+
+    /**
+     * @brief Returns whether the display is idle.
+     */
+    bool idle() const { return _idle; }
+
+    /**
+     * @brief Returns the refresh period in use, in milliseconds, 0 before the first refresh.
+     */
+    uint32_t period_ms() const { return _period_ms; }
+
+    /**
+     * @brief Returns the statistics accumulated since the last reset.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+   private:
+    Config _config;
+    Stats _stats;
+    bool _idle = false;
+    uint32_t _period_ms = 0;  /**< Period the timer is set to. */
+    uint32_t _due_ms = 0;     /**< Tick the current refresh was due. */
+    uint32_t _active_ms = 0;  /**< Tick of the last refresh with invalidated areas. */
+  };
+
+}  // namespace LVGLDisplay
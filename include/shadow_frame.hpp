@@ -0,0 +1,129 @@
+/**
+ * @file shadow_frame.hpp
+ * @brief Defines the LVGLDisplay::ShadowFrame class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief A full frame copy of the panel contents, used to skip transfers of unchanged pixels.
+   * Flushed areas are compared against the shadow in tiles of whole rows. Tiles LVGL redrew with identical pixels
+   * are dropped, and consecutive changed tiles are narrowed to the changed columns and sent as one region.
+   */
+  class ShadowFrame {
+   public:
+    static constexpr size_t MAX_REGIONS = 16; /**< Maximum number of regions a flushed area is split into. */
+
+    struct Config {
+      size_t hres = 0;         /**< Horizontal resolution in pixels. */
+      size_t vres = 0;         /**< Vertical resolution in pixels. */
+      size_t tile_rows = 8;    /**< Height of a tile in rows. */
+      size_t alignment = 64;   /**< Alignment of the frame allocation in bytes. */
+      uint32_t caps = MALLOC_CAP_DEFAULT; /**< Heap capabilities of the frame allocation. */
+    };
+
+    struct Region {
+      lv_area_t area;          /**< The area to transfer, inclusive coordinates. */
+      uint16_t* pixels;        /**< The pixels of the area, packed with a stride of the area width. */
+    };
+
+    struct Stats {
+      uint64_t tiles = 0;      /**< Number of tiles compared. */
+      uint64_t tiles_skipped = 0; /**< Number of tiles found unchanged and not transferred. */
+      uint64_t bytes_in = 0;   /**< Pixel bytes flushed by LVGL. */
+      uint64_t bytes_out = 0;  /**< Pixel bytes left to transfer. */
+    };
+
+    ShadowFrame() = default;
+    ~ShadowFrame();
+
+    /**
+     * @brief Allocate the shadow frame. Until every row has been flushed in full once, nothing is skipped.
+     *
+     * @param config The shadow frame configuration.
+     * @return ESP_OK on success, or an error code on failure.
+     */
+    esp_err_t allocate(const Config& config);
+
+    /**
+     * @brief Release the shadow frame, every flush is then transferred in full.
+     */
+    void release();
+
+    /**
+     * @brief Returns whether the shadow frame is allocated.
+     */
+    bool allocated() const { return _frame != NULL; }
+
+    /**
+     * @brief Forget the panel contents, for example after the panel was reset or rotated.
+     */
+    void invalidate();
+
+    /**
+     * @brief Forget the panel contents of the rows an area covers, for example after they were drawn around LVGL.
+     * Nothing is skipped until those rows have been flushed in full again.
+     *
+     * @param area The area, inclusive coordinates.
+     */
+    void invalidate(const lv_area_t& area);
+
+    /**
+     * @brief Exchange the horizontal and vertical resolution, after the display was rotated a quarter turn. The frame is
+     * reused and its contents forgotten.
+     */
+    void swap_axes();
+
+    /**
+     * @brief Compare a flushed area against the shadow, update it, and find the regions to transfer.
+     * Changed regions are packed in place within pixels, so the buffer must not be used by anything else until the
+     * regions have been transferred.
+     *
+     * @param area The flushed area, inclusive coordinates.
+     * @param pixels The pixels of the area.
+     * @param regions Set to the regions to transfer, at most MAX_REGIONS.
+     * @return The number of regions to transfer.
+     */
+    size_t diff(const lv_area_t& area, uint16_t* pixels, Region* regions);
+
+    /**
+     * @brief Returns the shadow frame, hres * vres pixels, or NULL if not allocated.
+     */
+    const uint16_t* pixels() const { return _frame; }
+
+    /**
+     * @brief Returns the accumulated statistics.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+    /* Delete move and copy assignment operators and constuctors */
+    ShadowFrame(const ShadowFrame&) = delete;
+    ShadowFrame(ShadowFrame&&) = delete;
+    ShadowFrame& operator=(const ShadowFrame&) = delete;
+    ShadowFrame&& operator=(ShadowFrame&&) = delete;
+
+   private:
+    void pack(const lv_area_t& area, uint16_t* pixels, size_t row0, size_t row1, size_t col0, size_t col1, Region* region);
+
+    Config _config;
+    Stats _stats;
+    uint16_t* _frame = NULL;
+    uint32_t* _rows_valid = NULL; /**< Bitmap of rows flushed in full since the last invalidate(). */
+    size_t _rows_pending = 0;     /**< Rows not yet flushed in full. */
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,191 @@
+/**
+ * @file simulated_panel.hpp
+ * @brief Defines the LVGLDisplay::SimulatedPanel class.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "bus_model.hpp"
+#include "esp_err.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+
+namespace LVGLDisplay {
+
+  /**
+   * @brief A software ST7789 panel and panel IO.
+   * Stands in for esp_lcd_new_panel_io_i80/esp_lcd_new_panel_io_spi and esp_lcd_new_panel_st7789 where no hardware is
+   * available. The panel issues the same CASET/RASET/RAMWR sequence as the ST7789 driver, the IO decodes it into a
+   * framebuffer, keeps a log of transactions and accounts bus time with a BusModel. Writes are addressed through
+   * MADCTL into the controller's memory, and the framebuffer shows that memory in the board's orientation, so a
+   * display rotated at runtime still appears upright.
+   */
+  class SimulatedPanel {
+   public:
+    struct Config {
+      size_t hres = 320;                                             /**< Horizontal resolution in pixels. */
+      size_t vres = 170;                                             /**< Vertical resolution in pixels. */
+      bool swap_xy = false;                                          /**< Axes exchanged in the board's orientation. */
+      bool mirror_x = false;                                         /**< Memory columns mirrored in the board's orientation. */
+      bool mirror_y = false;                                         /**< Memory rows mirrored in the board's orientation. */
+      int x_gap = 0;                                                 /**< Column gap in the board's orientation. */
+      int y_gap = 0;                                                 /**< Row gap in the board's orientation. */
+      size_t columns = 0;                                            /**< Columns of the controller's memory, 0 to fit. */
+      size_t rows = 0;                                               /**< Rows of the controller's memory, 0 to fit. */
+      BusModel::Config bus;                                          /**< Bus timing configuration. */
+      size_t log_depth = 64;                                         /**< Number of transactions kept in the log. */
+      esp_lcd_panel_io_color_trans_done_cb_t on_color_trans_done = NULL; /**< As esp_lcd_panel_io_*_config_t. */
+      void* user_ctx = NULL;                                         /**< Passed to on_color_trans_done. */
+    };
+
+    struct Transaction {
+      uint8_t cmd;        /**< The LCD command. */
+      uint32_t bytes;     /**< Parameter or colour bytes following the command. */
+      uint64_t submit_ns; /**< Time the transaction was issued. */
+      uint64_t done_ns;   /**< Time the transaction completed on the bus. */
+    };
+
+    struct Stats {
+      BusModel::Stats bus;    /**< Bus statistics. */
+      uint64_t caset = 0;     /**< Number of CASET commands. */
+      uint64_t raset = 0;     /**< Number of RASET commands. */
+      uint64_t ramwr = 0;     /**< Number of RAMWR commands. */
+      uint64_t pixels = 0;    /**< Number of pixels written. */
+      uint64_t elapsed_ns = 0; /**< Simulated time since creation or the last reset_stats(). */
+    };
+
+    SimulatedPanel() = default;
+    ~SimulatedPanel();
+
+    /**
+     * @brief Create the panel IO and panel handles.
+     *
+     * @param config The panel configuration.
+     * @param io_handle Set to the simulated panel IO.
+     * @param panel_handle Set to the simulated panel.
+     * @return ESP_OK on success, or an error code on failure.
+     */
+    esp_err_t create(const Config& config, esp_lcd_panel_io_handle_t* io_handle, esp_lcd_panel_handle_t* panel_handle);
+
+    /**
+     * @brief Change the bus timing configuration.
+     */
+    void configure(const BusModel::Config& config);
+
+    /**
+     * @brief Returns the bus timing configuration.
+     */
+    const BusModel::Config& bus_config() const { return _config.bus; }
+
+    /**
+     * @brief Returns a copy of the statistics.
+     */
+    Stats stats();
+
+    /**
+     * @brief Clears the statistics and the transaction log.
+     */
+    void reset_stats();
+
+    /**
+     * @brief Copies up to count of the most recent transactions, oldest first.
+     *
+     * @return The number of transactions copied.
+     */
+    size_t transactions(Transaction* out, size_t count);
+
+    /**
+     * @brief Model a transaction of another device sharing the bus, as spi_device_polling_transmit() from its task.
+     * The caller is blocked until it completes, first waiting for the colour transfers queued on the bus.
+     *
+     * @param bytes The bytes the device transfers.
+     * @return The time the transaction waited for the bus, in nanoseconds.
+     */
+    uint64_t device_transaction(size_t bytes);
+
+    /**
+     * @brief Returns the simulated time in nanoseconds.
+     * Host time plus the time callers would have been blocked on the bus. From within on_color_trans_done this is
+     * the time the transfer completed on the bus.
+     */
+    uint64_t now_ns() const;
+
+    /**
+     * @brief Returns the panel framebuffer, hres() * vres() RGB565 pixels in bus byte order, in the board's orientation.
+     * Pixels written in the 12 bit interface format are widened to RGB565, big endian.
+     */
+    const uint16_t* framebuffer() const { return _framebuffer.data(); }
+
+    size_t hres() const { return _config.hres; }
+    size_t vres() const { return _config.vres; }
+
+    /**
+     * @brief Returns the simulated panel owning a panel handle, or NULL if the handle is not simulated.
+     */
+    static SimulatedPanel* from_handle(esp_lcd_panel_handle_t panel_handle);
+
+    /* Delete move and copy assignment operators and constuctors */
+    SimulatedPanel(const SimulatedPanel&) = delete;
+    SimulatedPanel(SimulatedPanel&&) = delete;
+    SimulatedPanel& operator=(const SimulatedPanel&) = delete;
+    SimulatedPanel&& operator=(SimulatedPanel&&) = delete;
+
+   private:
+    struct IO;
+    struct Panel;
+
+    static esp_err_t io_rx_param(esp_lcd_panel_io_t* io, int lcd_cmd, void* param, size_t param_size);
+    static esp_err_t io_tx_param(esp_lcd_panel_io_t* io, int lcd_cmd, const void* param, size_t param_size);
+    static esp_err_t io_tx_color(esp_lcd_panel_io_t* io, int lcd_cmd, const void* color, size_t color_size);
+    static esp_err_t io_del(esp_lcd_panel_io_t* io);
+
+    static esp_err_t panel_reset(esp_lcd_panel_t* panel);
+    static esp_err_t panel_init(esp_lcd_panel_t* panel);
+    static esp_err_t panel_del(esp_lcd_panel_t* panel);
+    static esp_err_t panel_draw_bitmap(esp_lcd_panel_t* panel, int x_start, int y_start, int x_end, int y_end, const void* color_data);
+    static esp_err_t panel_mirror(esp_lcd_panel_t* panel, bool mirror_x, bool mirror_y);
+    static esp_err_t panel_swap_xy(esp_lcd_panel_t* panel, bool swap_axes);
+    static esp_err_t panel_set_gap(esp_lcd_panel_t* panel, int x_gap, int y_gap);
+    static esp_err_t panel_invert_color(esp_lcd_panel_t* panel, bool invert_color_data);
+    static esp_err_t panel_disp_on_off(esp_lcd_panel_t* panel, bool on_off);
+
+    void command(int lcd_cmd, const uint8_t* param, size_t param_size);
+    bool locate(int column, int row, int* x, int* y) const;
+    void write_pixels(const uint16_t* color, size_t pixels);
+    void write_rgb444(const uint8_t* color, size_t bytes);
+    void log(uint8_t cmd, size_t bytes, uint64_t submit_ns, uint64_t done_ns);
+    void delay(uint64_t ns);
+    uint64_t host_ns() const;
+
+    Config _config;
+    BusModel _bus;
+    std::mutex _mutex;
+    std::vector<uint16_t> _framebuffer;
+    std::vector<Transaction> _log;
+    size_t _log_head = 0;
+    size_t _log_count = 0;
+    Stats _stats;
+    uint64_t _epoch_ns = 0;
+    uint64_t _stall_ns = 0;
+    uint64_t _stats_epoch_ns = 0;
+    uint64_t _event_ns = 0; /**< Completion time reported while on_color_trans_done runs. */
+
+    // Controller state, as the ST7789 would hold it.
+    uint16_t _col_start = 0, _col_end = 0, _row_start = 0, _row_end = 0;
+    size_t _cursor = 0;
+    uint8_t _madctl = 0;
+    uint8_t _colmod = 0x55;
+    int _x_gap = 0, _y_gap = 0;
+    bool _inverted = false, _on = false;
+
+    IO* _io = NULL;
+    Panel* _panel = NULL;
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,256 @@
+/**
+ * @file touch_input.hpp
+ * @brief Defines the LVGLDisplay::TouchInput class and the touch controllers feeding it.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "display.hpp"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "lvgl.h"
+#include "sdkconfig.h"
+
+namespace LVGLDisplay {
+
+  class TouchInput;
+
+  /**
+   * @brief A point reported by a touch controller.
+   */
+  struct TouchPoint {
+    lv_coord_t x = 0;     /**< Column, in LVGL's coordinates before rotation. */
+    lv_coord_t y = 0;     /**< Row, in LVGL's coordinates before rotation. */
+    bool pressed = false; /**< Whether the panel is touched, the point is the last one touched if not. */
+    int64_t time_us = 0;  /**< Time the controller signalled the point, in the display's time base, 0 for when reported. */
+  };
+
+  /**
+   * @brief A touch controller, reporting points to a TouchInput as they happen.
+   */
+  class TouchSource {
+   public:
+    virtual ~TouchSource() = default;
+
+    /**
+     * @brief Start reporting points to the input.
+     *
+     * @param input The input to report points to.
+     * @return ESP_OK on success, or an error code on failure.
+     */
+    virtual esp_err_t start(TouchInput* input) = 0;
+
+    /**
+     * @brief Stop reporting points.
+     */
+    virtual void stop() = 0;
+  };
+
+#if !CONFIG_IDF_TARGET_LINUX
+  /**
+   * @brief A Hynitron CST816 capacitive touch controller on I2C, as fitted to the touch variant of the T-Display-S3.
+   * The controller pulls its interrupt line low when a touch starts, moves or ends. The interrupt only timestamps the
+   * point and wakes the source's task, which reads the point over I2C and reports it. Stopping leaves the task and the
+   * I2C driver installed, to start again.
+   */
+  class Cst816Touch : public TouchSource {
+   public:
+    static constexpr uint8_t ADDRESS = 0x15; /**< I2C address of the CST816. */
+
+    struct Config {
+      int port = 0;               /**< I2C port. */
+      bool install_driver = true; /**< Install the port's I2C driver, false if the application shares the bus. */
+      int sda = -1;               /**< I2C data GPIO. */
+      int scl = -1;               /**< I2C clock GPIO. */
+      uint32_t clock_hz = 400000; /**< I2C clock frequency. */
+      int interrupt = -1;         /**< Interrupt GPIO. */
+      int reset = -1;             /**< Reset GPIO, -1 if not connected. */
+      uint16_t columns = 0;       /**< Width of the controller's coordinates. */
+      uint16_t rows = 0;          /**< Height of the controller's coordinates. */
+      bool swap_xy = false;       /**< Exchange the controller's axes to LVGL's, before mirroring. */
+      bool mirror_x = false;      /**< Mirror LVGL's X axis. */
+      bool mirror_y = false;      /**< Mirror LVGL's Y axis. */
+      UBaseType_t priority = 5;   /**< FreeRTOS priority of the task reading points. */
+      int core = -1;              /**< Core the task is pinned to, -1 for either core. */
+    };
+
+    /**
+     * @param config The controller configuration.
+     */
+    explicit Cst816Touch(const Config& config) : _config(config) {}
+    ~Cst816Touch();
+
+    esp_err_t start(TouchInput* input) override;
+    void stop() override;
+
+    /* Delete move and copy assignment operators and constuctors */
+    Cst816Touch(const Cst816Touch&) = delete;
+    Cst816Touch(Cst816Touch&&) = delete;
+    Cst816Touch& operator=(const Cst816Touch&) = delete;
+    Cst816Touch&& operator=(Cst816Touch&&) = delete;
+
+   private:
+    static void isr(void* arg);
+    static void task_main(void* arg);
+    esp_err_t read(TouchPoint* point);
+
+    Config _config;
+    TouchInput* _input = NULL;
+    TaskHandle_t _task = NULL;
+    std::atomic<int64_t> _irq_us{0}; /**< Time of the latest interrupt. */
+    TouchPoint _last;                /**< The last point reported. */
+    bool _installed = false;         /**< Whether the I2C driver was installed. */
+  };
+#endif
+
+  /**
+   * @brief A scriptable stand-in for a touch controller, for the virtual board and host tests.
+   * Each call reports a point as a controller's interrupt would, timestamped in the display's time base.
+   */
+  class ScriptedTouch : public TouchSource {
+   public:
+    esp_err_t start(TouchInput* input) override;
+    void stop() override { _input = NULL; }
+
+    /**
+     * @brief Touch the panel at a point, or move the touch there while touched.
+     *
+     * @param x The column, in LVGL's coordinates before rotation.
+     * @param y The row, in LVGL's coordinates before rotation.
+     * @return Whether the point was queued, false if the queue is full or the source is not started.
+     */
+    bool press(lv_coord_t x, lv_coord_t y);
+
+    /**
+     * @brief Lift the touch from the panel, where it was last pressed.
+     *
+     * @return Whether the point was queued, false if the queue is full or the source is not started.
+     */
+    bool release();
+
+   private:
+    TouchInput* _input = NULL;
+    TouchPoint _point;
+  };
+
+  /**
+   * @brief Registers a touch controller with LVGL as a pointer, handling each point as soon as it is reported.
+   * Sources report points into a queue, from any task. With the dispatch task, the task takes the lock as soon as a
+   * point is queued, LVGL reads the queue and handles the points, and if they invalidated an area the display is
+   * refreshed there and then, rather than waiting for LVGL's read timer and the display's refresh period, which is
+   * the idle period on a static screen. While the panel is touched the points are also read every read period, for
+   * LVGL's long press and scroll timing. Without the task LVGL reads the queue every read period, as it polls a
+   * pointer.
+   *
+   * The display marks the frame redrawn for the first point of each read, and times it from the point to its last
+   * transfer completing, see Display::input_timing() and FrameRecord::input_latency_us.
+   */
+  class TouchInput {
+   public:
+    struct Config {
+      size_t queue_length = 16;                           /**< Points held until LVGL reads them. */
+      uint32_t read_period_ms = LV_INDEV_DEF_READ_PERIOD; /**< Period the queue is read at, while touched if dispatched. */
+      bool dispatch_task = true;                          /**< Whether a task handles points as they are reported. */
+      int core = -1;                                      /**< Core the dispatch task is pinned to, -1 for either core. */
+      UBaseType_t priority = 5;                           /**< FreeRTOS priority of the dispatch task. */
+      uint32_t stack = 4096;                              /**< Dispatch task stack, it renders like the LVGL task. */
+    };
+
+    struct Stats {
+      uint32_t points = 0;     /**< Points reported. */
+      uint32_t dropped = 0;    /**< Points dropped because the queue was full. */
+      uint32_t read = 0;       /**< Points read by LVGL. */
+      uint32_t dispatches = 0; /**< Times the dispatch task handled the queue. */
+      uint32_t redraws = 0;    /**< Reads whose points invalidated an area, timed to the panel. */
+    };
+
+    /**
+     * @param display The display the pointer acts on.
+     */
+    explicit TouchInput(Display& display) : _display(display) {}
+    ~TouchInput();
+
+    /**
+     * @brief Register the pointer with LVGL and start the source. The display must have been added to the controller.
+     *
+     * @param config The input configuration.
+     * @param source The touch controller.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG without a source, ESP_ERR_INVALID_STATE if already started or the
+     * display is not added, ESP_ERR_NO_MEM, or an error from the source.
+     */
+    esp_err_t start(const Config& config, TouchSource* source);
+
+    /**
+     * @brief Stop the source and remove the pointer from LVGL.
+     */
+    void stop();
+
+    /**
+     * @brief Returns whether the input has been started.
+     */
+    bool active() const { return _indev != NULL; }
+
+    /**
+     * @brief Queue a point for LVGL. Called by the source from any task, not from an ISR, and never blocks.
+     *
+     * @param point The point.
+     * @return Whether the point was queued, false if the queue is full or the input is not started.
+     */
+    bool report(const TouchPoint& point);
+
+    /**
+     * @brief Returns the display the pointer acts on.
+     */
+    Display& display() { return _display; }
+
+    /**
+     * @brief Returns LVGL's input device, NULL unless started. Use it to assign a cursor or a group.
+     */
+    lv_indev_t* indev() const { return _indev; }
+
+    /**
+     * @brief Returns the statistics accumulated since the last reset.
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Clears the accumulated statistics.
+     */
+    void reset_stats();
+
+    /* Delete move and copy assignment operators and constuctors */
+    TouchInput(const TouchInput&) = delete;
+    TouchInput(TouchInput&&) = delete;
+    TouchInput& operator=(const TouchInput&) = delete;
+    TouchInput&& operator=(TouchInput&&) = delete;
+
+   private:
+    static void read_callback(lv_indev_drv_t* drv, lv_indev_data_t* data);
+    static void timer_callback(lv_timer_t* timer);
+    static void dispatch_main(void* arg);
+    void handle();
+
+    Display& _display;
+    Config _config;
+    TouchSource* _source = NULL;
+    lv_indev_drv_t _driver;
+    lv_indev_t* _indev = NULL;
+    QueueHandle_t _queue = NULL;
+    TaskHandle_t _task = NULL;
+    TouchPoint _last;      /**< The point LVGL last read. */
+    int64_t _first_us = 0; /**< Time of the first point of the read in progress, 0 if none. */
+    std::atomic<uint32_t> _points{0};
+    std::atomic<uint32_t> _dropped{0};
+    uint32_t _read = 0;
+    uint32_t _dispatches = 0;
+    uint32_t _redraws = 0;
+  };
+
+}  // namespace LVGLDisplay
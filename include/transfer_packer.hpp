@@ -0,0 +1,97 @@
+/**
+ * @file transfer_packer.hpp
+ * @brief Defines the LVGLDisplay::TransferPacker class and the pixel formats it sends.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+namespace LVGLDisplay {
+
+  class Display;
+
+  /**
+   * @brief The pixel format colour transfers are sent to the panel in.
+   */
+  enum class TransferFormat : uint8_t {
+    RGB565, /**< 16 bits per pixel, as LVGL renders. */
+    RGB444, /**< 12 bits per pixel, packed in the flush path, a quarter fewer bytes on the bus. */
+  };
+
+  /**
+   * @brief Holds the pixel format a display's colour transfers are sent in, and packs them into it.
+   * In RGB444 each transfer is packed in place from RGB565 just before it is queued, dropping the low bits of each
+   * channel, so a quarter fewer bytes are sent, which directly raises the frame rate of a bus bound panel. The panel's
+   * interface pixel format (COLMOD) is set to match.
+   */
+  class TransferPacker {
+   public:
+    explicit TransferPacker(Display& display) : _display(display) {}
+
+    /**
+     * @brief Returns whether the display can transfer pixels in a format.
+     * RGB444 requires LV_COLOR_DEPTH 16 and a bus which does not swap the colour bytes itself, as the packed bytes
+     * are no longer pairs.
+     *
+     * @param format The transfer format.
+     */
+    bool supports(TransferFormat format) const;
+
+    /**
+     * @brief Change the pixel format colour transfers are sent in, setting the panel's interface pixel format.
+     * Waits for the bring-up and for flushes in progress. The lock must be held.
+     *
+     * @param format The transfer format.
+     * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED, or an error from the bring-up or the panel IO.
+     */
+    esp_err_t set(TransferFormat format);
+
+    /**
+     * @brief Set the format once the panel is initialised, called by the bring-up. Initialising the panel sets 16 bits
+     * per pixel, so only another format is sent.
+     *
+     * @param format The transfer format, which the display supports.
+     * @return ESP_OK on success, or an error from the panel IO.
+     */
+    esp_err_t initialise(TransferFormat format);
+
+    /**
+     * @brief Returns the pixel format colour transfers are sent in.
+     */
+    TransferFormat format() const { return _format; }
+
+    /**
+     * @brief Returns the bytes sent to the panel for a number of pixels in the transfer format.
+     *
+     * @param pixels The number of pixels.
+     */
+    size_t bytes(size_t pixels) const;
+
+    /**
+     * @brief Pack RGB565 pixels in place into the transfer format.
+     *
+     * @param pixels The pixels.
+     * @param count The number of pixels.
+     * @param swapped Whether the pixels are big endian.
+     * @return The bytes to send.
+     */
+    size_t pack(void* pixels, size_t count, bool swapped) const;
+
+    /* Delete move and copy assignment operators and constuctors */
+    TransferPacker(const TransferPacker&) = delete;
+    TransferPacker(TransferPacker&&) = delete;
+    TransferPacker& operator=(const TransferPacker&) = delete;
+    TransferPacker&& operator=(TransferPacker&&) = delete;
+
+   private:
+    esp_err_t send_format();
+
+    Display& _display;
+    TransferFormat _format = TransferFormat::RGB565;
+  };
+
+}  // namespace LVGLDisplay
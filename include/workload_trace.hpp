@@ -0,0 +1,311 @@
+/**
+ * @file workload_trace.hpp
+ * @brief Defines the LVGLDisplay::TraceRecorder and LVGLDisplay::TraceReplayer classes and their trace format.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "flush_hook.hpp"
+#include "frame_log.hpp"
+#include "freertos/FreeRTOS.h"
+#include "lvgl.h"
+
+namespace LVGLDisplay {
+
+  class Display;
+
+  /**
+   * @brief Records the workload a display's UI puts on the flush path into a compact trace, for replaying it elsewhere.
+   * For each frame, the areas LVGL invalidated, before they are coalesced, and the time LVGL spent rendering them; for
+   * each frame completed, its flush time and bytes; and for each hold of the lock through Lock by another task, how
+   * long it waited and held it. Pixels are not recorded. The trace is handed to a sink a buffer at a time, and is
+   * replayed by TraceReplayer, on the device or on the linux target, or read on the host with tools/trace_decoder.py.
+   *
+   * A trace is a Header followed by events, each a type byte and its fields as unsigned LEB128 varints, times as
+   * zigzag coded signed varints in microseconds since the previous FRAME or LOCK event, in the display's time base:
+   *  - FRAME: time the refresh started, frame number, lock wait, render time, buffer wait, areas flushed, areas
+   *    invalidated, then x1, y1, width - 1 and height - 1 of each invalidated area.
+   *  - DONE: frame number, flush time, bytes transferred, most draw buffers queued. Completions are recorded from the
+   *    flush path, which may run in an ISR, so they follow the FRAME they complete by one event or more.
+   *  - LOCK: time the lock was released, wait for the lock, time it was held.
+   *  - END: completions dropped, the last event of a stopped trace.
+   *
+   * Events are written with the lock held: frames by the refresh, locks as they are released. The sink is called
+   * there too, so keep it short.
+   */
+  class TraceRecorder : public FlushHook {
+   public:
+    static constexpr uint8_t MAGIC[4] = {'L', 'D', 'T', '1'}; /**< First bytes of a trace. */
+    static constexpr size_t MAX_PENDING = 8;                    /**< Completions held until the next event is written. */
+
+    enum class Event : uint8_t {
+      END = 0,   /**< The trace was stopped. */
+      FRAME = 1, /**< A frame was refreshed. */
+      DONE = 2,  /**< A frame's last transfer completed. */
+      LOCK = 3,  /**< Another task released the lock. */
+    };
+
+    /**
+     * @brief Header of a trace, little endian, describing the display it was recorded on.
+     */
+    struct __attribute__((packed)) Header {
+      uint8_t magic[4];       /**< MAGIC. */
+      uint16_t width;         /**< Width of LVGL's screen in pixels. */
+      uint16_t height;        /**< Height of LVGL's screen in pixels. */
+      uint32_t buffer_pixels; /**< Pixels of a draw buffer. */
+      uint8_t buffers;        /**< Draw buffers. */
+      uint8_t format;         /**< TransferFormat of the colour transfers. */
+      uint8_t rotation;       /**< Rotation of LVGL's screen. */
+      uint8_t reserved;
+    };
+
+    /**
+     * @brief Receives the trace, a buffer at a time, with the lock held.
+     * Queue the bytes rather than block, to a stream buffer, a socket or a file. Returning an error ends the trace.
+     */
+    using Sink = esp_err_t (*)(const void* data, size_t size, void* context);
+
+    struct Config {
+      Sink sink = NULL;                   /**< Receives the trace. */
+      void* context = NULL;               /**< Passed to the sink. */
+      size_t buffer_size = 1024;          /**< Bytes encoded before they are handed to the sink. */
+      uint32_t caps = MALLOC_CAP_DEFAULT; /**< Heap capabilities of the buffer. */
+    };
+
+    struct Stats {
+      uint32_t frames = 0;  /**< Frames recorded. */
+      uint32_t done = 0;    /**< Completions recorded. */
+      uint32_t locks = 0;   /**< Lock holds recorded. */
+      uint32_t dropped = 0; /**< Completions dropped, more than MAX_PENDING between two events. */
+      uint64_t bytes = 0;   /**< Bytes handed to the sink. */
+    };
+
+    TraceRecorder() = default;
+    ~TraceRecorder();
+
+    /**
+     * @brief Allocate the buffer and start the trace with its header.
+     *
+     * @param config The recorder configuration.
+     * @param header The display's description, its magic is set here.
+     * @param time_us The time of the display, events are timed from it.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG without a sink or with a buffer smaller than the header,
+     * ESP_ERR_INVALID_STATE if already started, ESP_ERR_NO_MEM, or the error from the sink.
+     */
+    esp_err_t start(const Config& config, Header header, int64_t time_us);
+
+    /**
+     * @brief Start recording a display's workload, attached to its flush path and described by its settings. Waits
+     * for flushes in progress, so frames refreshed before the trace complete outside it. The lock must be held.
+     *
+     * @param display The display, added to LVGL.
+     * @param config The recorder configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE before the display is added to LVGL or if already started, or
+     * an error from start() or Display::add_hook().
+     */
+    esp_err_t start(Display& display, const Config& config);
+
+    /**
+     * @brief Write the completions pending and an END event, hand the rest of the trace to the sink and release the
+     * buffer. Attached to a display, the trace ends with the completions of its frames, and the lock must be held.
+     *
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not started, or the first error from the sink.
+     */
+    esp_err_t stop();
+
+    /**
+     * @brief Returns whether a trace has started.
+     */
+    bool active() const { return _out != NULL; }
+
+    /**
+     * @brief Keep the areas LVGL is about to refresh, recorded with the frame once it is rendered.
+     *
+     * @param areas LVGL's invalidated areas.
+     * @param joined Whether each area was joined into another.
+     * @param count The number of areas.
+     */
+    void begin_frame(const lv_area_t* areas, const uint8_t* joined, size_t count);
+
+    /**
+     * @brief Record a frame once its last area is rendered, with the areas kept by begin_frame().
+     *
+     * @param frame The LVGL side of the frame record.
+     */
+    void end_frame(const FrameRecord& frame);
+
+    /**
+     * @brief Record a frame's last transfer completing. Safe from an ISR, written with the next event.
+     *
+     * @param frame The completed frame record.
+     */
+    void frame_done(const FrameRecord& frame) override;
+
+    /**
+     * @brief Record another task's hold of the lock, as it releases it.
+     *
+     * @param time_us The time of the display.
+     * @param wait_us The time the task waited for the lock.
+     * @param hold_us The time the task held the lock.
+     */
+    void lock(int64_t time_us, uint32_t wait_us, uint32_t hold_us);
+
+    void refresh_started(lv_disp_t* disp) override;
+    void frame_rendered(const FrameRecord& frame) override { end_frame(frame); }
+    void lock_released(int64_t time_us, uint32_t wait_us, uint32_t hold_us) override { lock(time_us, wait_us, hold_us); }
+
+    /**
+     * @brief Returns the statistics since the last reset.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Clears the statistics.
+     */
+    void reset_stats() { _stats = Stats(); }
+
+    /* Delete move and copy assignment operators and constuctors */
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder(TraceRecorder&&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+    TraceRecorder&& operator=(TraceRecorder&&) = delete;
+
+   private:
+    struct Done {
+      uint32_t frame;
+      uint32_t flush_us;
+      uint32_t bytes;
+      uint8_t buffers;
+    };
+
+    void write_pending();
+    void put_time(int64_t time_us);
+    void put_varint(uint64_t value);
+    void put(const void* data, size_t size);
+    esp_err_t drain();
+
+    Config _config;
+    Stats _stats;
+    Display* _display = NULL;      /**< The display attached to, NULL when fed directly. */
+    uint8_t* _out = NULL;          /**< Encoded bytes not yet handed to the sink. */
+    size_t _out_size = 0;
+    esp_err_t _sink_err = ESP_OK;  /**< First error from the sink, nothing is written after it. */
+    int64_t _last_us = 0;          /**< Time of the previous FRAME or LOCK event. */
+    lv_area_t _areas[LV_INV_BUF_SIZE] = {}; /**< Areas of the frame being refreshed. */
+    size_t _area_count = 0;
+    Done _pending[MAX_PENDING] = {}; /**< Completions not yet written, guarded by the pending lock. */
+    size_t _pending_count = 0;
+    portMUX_TYPE _pending_lock = portMUX_INITIALIZER_UNLOCKED;
+  };
+
+  /**
+   * @brief Replays a trace recorded by TraceRecorder on a display, through LVGL's refresh and the flush path.
+   * Each frame invalidates the recorded areas on a screen of the replayer's and refreshes the display as the LVGL task
+   * would, so the areas are coalesced, split into draw buffers and transferred with the display's own settings. The
+   * screen draws a colour changing every frame, taking as long to render as the recorded frame did, in proportion to
+   * each area's pixels. Each recorded lock hold takes the lock through Lock for as long again.
+   *
+   * In real time frames and lock holds start when they did in the trace; at full speed the time between them is
+   * dropped. Compare the replay with the display's flush timing and frame log, or record the replay and compare its
+   * summary with the trace's.
+   */
+  class TraceReplayer {
+   public:
+    enum class Mode : uint8_t {
+      FULL_SPEED, /**< Each event as soon as the previous one is done. */
+      REAL_TIME,  /**< Each event at its time in the trace. */
+    };
+
+    struct Config {
+      Mode mode = Mode::FULL_SPEED; /**< How the trace is timed. */
+      bool render = true;           /**< Whether rendering takes as long as recorded, or as long as the colour fill. */
+      bool locks = true;            /**< Whether lock holds are replayed. */
+    };
+
+    struct Stats {
+      uint32_t frames = 0;      /**< Frames replayed. */
+      uint32_t areas = 0;       /**< Areas invalidated. */
+      uint32_t locks = 0;       /**< Lock holds replayed. */
+      uint64_t duration_us = 0; /**< Time from the start of the trace to its last event. */
+      uint64_t elapsed_us = 0;  /**< Time the replay took. */
+      uint32_t late_max_us = 0; /**< In real time, the most an event started after its time in the trace. */
+    };
+
+    /**
+     * @brief Totals of a trace, of the session recorded or of a replay recorded in turn.
+     */
+    struct Summary {
+      uint32_t frames = 0;          /**< Frames refreshed. */
+      uint32_t done = 0;            /**< Frames completed. */
+      uint32_t locks = 0;           /**< Lock holds. */
+      uint32_t dropped = 0;         /**< Completions the recorder dropped. */
+      uint64_t duration_us = 0;     /**< Time from the start of the trace to its last event. */
+      uint64_t render_us = 0;       /**< Total render time. */
+      uint64_t dma_wait_us = 0;     /**< Total wait for a draw buffer. */
+      uint64_t flush_us = 0;        /**< Total flush time of the completed frames. */
+      uint32_t flush_max_us = 0;    /**< Longest flush time. */
+      uint64_t bytes = 0;           /**< Pixel bytes transferred. */
+      uint64_t lock_wait_us = 0;    /**< Total wait for the lock by other tasks. */
+      uint32_t lock_wait_max_us = 0; /**< Longest wait for the lock. */
+      uint64_t lock_hold_us = 0;    /**< Total time other tasks held the lock. */
+    };
+
+    TraceReplayer() = default;
+
+    /**
+     * @brief Replay a trace on a display added to the controller, from another task than the LVGL task, without the
+     * lock held. The display's screen is replaced for the replay and restored after.
+     *
+     * @param display The display to replay on.
+     * @param data The trace.
+     * @param size The bytes of the trace.
+     * @param config The replay configuration.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG without a trace, ESP_ERR_INVALID_VERSION if it is not a trace,
+     * ESP_ERR_INVALID_SIZE if it ends inside an event, ESP_ERR_INVALID_STATE if the display is not added, or
+     * ESP_ERR_NO_MEM.
+     */
+    esp_err_t replay(Display& display, const uint8_t* data, size_t size, const Config& config);
+
+    /**
+     * @brief Returns the statistics of the last replay.
+     */
+    Stats stats() const { return _stats; }
+
+    /**
+     * @brief Total a trace's events.
+     *
+     * @param data The trace.
+     * @param size The bytes of the trace.
+     * @param summary Set to the totals.
+     * @param header Set to the trace's header, if not NULL.
+     * @return ESP_OK on success, or as replay() for a trace which can not be read.
+     */
+    static esp_err_t summarise(const uint8_t* data, size_t size, Summary* summary, TraceRecorder::Header* header = NULL);
+
+    /* Delete move and copy assignment operators and constuctors */
+    TraceReplayer(const TraceReplayer&) = delete;
+    TraceReplayer(TraceReplayer&&) = delete;
+    TraceReplayer& operator=(const TraceReplayer&) = delete;
+    TraceReplayer&& operator=(TraceReplayer&&) = delete;
+
+   private:
+    static void event_callback(lv_event_t* e);
+    void draw(lv_event_t* e);
+    void wait_until(int64_t time_us);
+    void spin(int64_t duration_us);
+
+    Config _config;
+    Stats _stats;
+    Display* _display = NULL;
+    lv_obj_t* _screen = NULL;     /**< The replay's screen. */
+    lv_color_t _color = {};       /**< Colour the screen draws in this frame. */
+    uint32_t _render_us = 0;      /**< Recorded render time of the frame. */
+    uint64_t _render_pixels = 0;  /**< Pixels invalidated in the frame, the render time is shared over. */
+  };
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,101 @@
+#include <memory_arena.hpp>
+
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char* TAG = "memory-arena";
+
+namespace LVGLDisplay {
+
+  MemoryArena::~MemoryArena() {
+    if(_owned) {
+      heap_caps_free(_base);
+    }
+  }
+
+  esp_err_t MemoryArena::create(size_t capacity, uint32_t caps) {
+    if(_base) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(capacity == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    capacity = align(capacity);
+    _base = (uint8_t*)heap_caps_aligned_alloc(ALIGNMENT, capacity, caps);
+    if(!_base) {
+      return ESP_ERR_NO_MEM;
+    }
+    _capacity = capacity;
+    _caps = caps;
+    _owned = true;
+    return ESP_OK;
+  }
+
+  esp_err_t MemoryArena::adopt(void* memory, size_t capacity, uint32_t caps) {
+    if(_base) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!memory || capacity == 0 || (uintptr_t)memory % ALIGNMENT) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _base = (uint8_t*)memory;
+    _capacity = capacity & ~(ALIGNMENT - 1);
+    _caps = caps;
+    _owned = false;
+    return ESP_OK;
+  }
+
+  void* MemoryArena::allocate(const char* name, uint8_t owner, size_t size) {
+    if(!_base) {
+      return NULL;
+    }
+    size = align(size);
+    for(size_t i = 0; i < _region_count; i++) {
+      const Region& region = _regions[i];
+      if(region.owner == owner && strcmp(region.name, name) == 0) {
+        return region.size >= size ? _base + region.offset : NULL;
+      }
+    }
+    if(_region_count == MAX_REGIONS || size > available()) {
+      return NULL;
+    }
+    Region& region = _regions[_region_count++];
+    region.name = name;
+    region.owner = owner;
+    region.offset = _used;
+    region.size = size;
+    _used += size;
+    return _base + region.offset;
+  }
+
+  size_t MemoryArena::regions(Region* regions, size_t count) const {
+    const size_t copied = count < _region_count ? count : _region_count;
+    for(size_t i = 0; i < copied; i++) {
+      regions[i] = _regions[i];
+    }
+    return copied;
+  }
+
+  const char* MemoryArena::placement() const {
+    if(_caps & MALLOC_CAP_SPIRAM) {
+      return "PSRAM";
+    }
+    return _caps & MALLOC_CAP_DMA ? "internal DMA" : "internal";
+  }
+
+  void MemoryArena::report() const {
+    if(!_base) {
+      ESP_LOGI(TAG, "No arena, display memory comes from the heap");
+      return;
+    }
+    ESP_LOGI(TAG, "Arena of %u bytes in %s, %s at %p, %u used, %u free", (unsigned)_capacity, placement(),
+             _owned ? "reserved at boot" : "reserved at link time", _base, (unsigned)_used, (unsigned)available());
+    for(size_t i = 0; i < _region_count; i++) {
+      const Region& region = _regions[i];
+      ESP_LOGI(TAG, "  display %u %-14s offset %7u size %7u", region.owner, region.name, (unsigned)region.offset,
+               (unsigned)region.size);
+    }
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,193 @@
+#include <display.hpp>
+#include <panel_rotation.hpp>
+#include <pixel_convert.hpp>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "esp_heap_caps.h"
+
+namespace LVGLDisplay {
+
+  PanelRotation::~PanelRotation() { heap_caps_free(_scratch); }
+
+  void PanelRotation::configure(const Config& config) {
+    _config = config;
+    _x_gap = config.x_gap;
+    _y_gap = config.y_gap;
+  }
+
+  esp_err_t PanelRotation::set(lv_disp_rot_t angle, bool software) {
+    if(angle > LV_DISP_ROT_270) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    lv_disp_t* disp = _display.display();
+    if(!disp || _display.excluded()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if((!software && !_config.columns) || (software && sizeof(lv_color_t) != sizeof(uint16_t))) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_err_t err = _display.bring_up().wait_ready(portMAX_DELAY);
+    if(err != ESP_OK) {
+      return err;
+    }
+    const bool previous = _software;
+    _software = software;
+    err = orient(angle);
+    if(err != ESP_OK) {
+      _software = previous;
+      return err;
+    }
+    // LVGL swaps its resolution, lays its screens out again and redraws them; the update callback finds the
+    // display already rotated.
+    lv_disp_set_rotation(disp, angle);
+    return ESP_OK;
+  }
+
+  esp_err_t PanelRotation::orient(lv_disp_rot_t angle) {
+    if(!_config.columns) {
+      _software = true;
+    }
+    const lv_disp_rot_t panel = _software ? LV_DISP_ROT_NONE : angle;
+    if(angle == _angle && panel == _panel_angle) {
+      return ESP_OK;
+    }
+    // Areas already queued were rendered and addressed for the previous rotation.
+    _display.wait_flushed();
+    // Half turns reverse the pixels in place, quarter turns go through scratch pixels, as many as a draw buffer so
+    // the flush path never allocates.
+    if(_software && (angle & 1)) {
+      const esp_err_t err = reserve_scratch(_display.buffer_size());
+      if(err != ESP_OK) {
+        return err;
+      }
+    }
+    if(panel != _panel_angle) {
+      const esp_err_t err = orient_panel(panel);
+      if(err != ESP_OK) {
+        return err;
+      }
+    }
+    ShadowFrame& shadow = _display.shadow();
+    if((angle ^ _angle) & 1) {
+      shadow.swap_axes();
+    }
+    // What the shadow holds is no longer where it was drawn, even where LVGL draws the same pixels again.
+    shadow.invalidate();
+    _angle = angle;
+    return ESP_OK;
+  }
+
+  PanelRotation::Orientation PanelRotation::orientation(lv_disp_rot_t angle) const {
+    // The display's window in the panel's memory, and where a pixel lands in it for an orientation.
+    const size_t hres = _display.hres();
+    const size_t vres = _display.vres();
+    const int columns = _display.swap_xy() ? vres : hres;
+    const int rows = _display.swap_xy() ? hres : vres;
+    auto locate = [columns, rows](const Orientation& orientation, const lv_area_t& pixel) {
+      const int column = orientation.swap_xy ? pixel.y1 : pixel.x1;
+      const int row = orientation.swap_xy ? pixel.x1 : pixel.y1;
+      return std::make_pair(orientation.mirror_x ? columns - 1 - column : column, orientation.mirror_y ? rows - 1 - row : row);
+    };
+    // Three corners of LVGL's rotated screen pick the orientation putting them where the board's orientation puts
+    // the pixels they are rotated to.
+    const Orientation base = {_display.swap_xy(), _display.mirror_x(), _display.mirror_y()};
+    const lv_coord_t right = (angle & 1 ? vres : hres) - 1;
+    const lv_coord_t bottom = (angle & 1 ? hres : vres) - 1;
+    const lv_area_t corners[] = {{0, 0, 0, 0}, {right, 0, right, 0}, {0, bottom, 0, bottom}};
+    for(uint8_t bits = 0; bits < 8; bits++) {
+      const Orientation candidate = {(bits & 1) != 0, (bits & 2) != 0, (bits & 4) != 0};
+      bool match = true;
+      for(const lv_area_t& corner : corners) {
+        match = match && locate(candidate, corner) == locate(base, to_panel(corner, angle));
+      }
+      if(match) {
+        return candidate;
+      }
+    }
+    return base;
+  }
+
+  esp_err_t PanelRotation::orient_panel(lv_disp_rot_t angle) {
+    const Orientation from = orientation(_panel_angle);
+    const Orientation to = orientation(angle);
+    // The window stays where it is in the panel's memory, the gaps are its offsets from the corner addressed first.
+    const int columns = _display.swap_xy() ? _display.vres() : _display.hres();
+    const int rows = _display.swap_xy() ? _display.hres() : _display.vres();
+    const int column_gap = from.swap_xy ? _y_gap : _x_gap;
+    const int row_gap = from.swap_xy ? _x_gap : _y_gap;
+    const int column = from.mirror_x ? _config.columns - column_gap - columns : column_gap;
+    const int row = from.mirror_y ? _config.rows - row_gap - rows : row_gap;
+    const int to_column_gap = to.mirror_x ? _config.columns - column - columns : column;
+    const int to_row_gap = to.mirror_y ? _config.rows - row - rows : row;
+    const int x_gap = to.swap_xy ? to_row_gap : to_column_gap;
+    const int y_gap = to.swap_xy ? to_column_gap : to_row_gap;
+
+    esp_lcd_panel_handle_t panel = _display.panel_handle();
+    esp_err_t err = esp_lcd_panel_swap_xy(panel, to.swap_xy);
+    if(err == ESP_OK) {
+      err = esp_lcd_panel_mirror(panel, to.mirror_x, to.mirror_y);
+    }
+    if(err == ESP_OK) {
+      err = esp_lcd_panel_set_gap(panel, x_gap, y_gap);
+    }
+    if(err != ESP_OK) {
+      return err;
+    }
+    _x_gap = x_gap;
+    _y_gap = y_gap;
+    _panel_angle = angle;
+    return ESP_OK;
+  }
+
+  lv_area_t PanelRotation::to_panel(const lv_area_t& area, lv_disp_rot_t angle) const {
+    // LVGL's rotated coordinates to the board's, as LVGL rotates its own draw buffers.
+    const lv_coord_t right = _display.hres() - 1;
+    const lv_coord_t bottom = _display.vres() - 1;
+    switch(angle) {
+      case LV_DISP_ROT_90: return {area.y1, (lv_coord_t)(bottom - area.x2), area.y2, (lv_coord_t)(bottom - area.x1)};
+      case LV_DISP_ROT_180:
+        return {(lv_coord_t)(right - area.x2), (lv_coord_t)(bottom - area.y2), (lv_coord_t)(right - area.x1),
+                (lv_coord_t)(bottom - area.y1)};
+      case LV_DISP_ROT_270: return {(lv_coord_t)(right - area.y2), area.x1, (lv_coord_t)(right - area.y1), area.x2};
+      default: return area;
+    }
+  }
+
+  esp_err_t PanelRotation::reserve_scratch(size_t pixels) {
+    if(pixels <= _scratch_pixels) {
+      return ESP_OK;
+    }
+    uint16_t* scratch = (uint16_t*)heap_caps_malloc(pixels * sizeof(uint16_t), MALLOC_CAP_DEFAULT);
+    if(!scratch) {
+      return ESP_ERR_NO_MEM;
+    }
+    heap_caps_free(_scratch);
+    _scratch = scratch;
+    _scratch_pixels = pixels;
+    return ESP_OK;
+  }
+
+  esp_err_t PanelRotation::rotate(lv_area_t* area, void* pixels) {
+    const size_t width = lv_area_get_width(area);
+    const size_t height = lv_area_get_height(area);
+    uint16_t* rotated = (uint16_t*)pixels;
+    if(_angle == LV_DISP_ROT_180) {
+      std::reverse(rotated, rotated + width * height);
+    }
+    else if(_angle & 1) {
+      // The pixels go back where they came from, so the buffer keeps its lifetime and its place in the flush records.
+      const esp_err_t err = reserve_scratch(width * height);
+      if(err != ESP_OK) {
+        return err;
+      }
+      PixelConvert::rotate_rgb565(_scratch, rotated, width, height, _angle);
+      memcpy(rotated, _scratch, width * height * sizeof(uint16_t));
+    }
+    *area = to_panel(*area, _angle);
+    return ESP_OK;
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,313 @@
+#include <pixel_convert.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_ESP32S3
+  #define PIXEL_CONVERT_PIE 1
+#else
+  #define PIXEL_CONVERT_PIE 0
+#endif
+
+namespace LVGLDisplay {
+
+  namespace PixelConvert {
+
+    // 4x4 Bayer matrix, thresholds 0-15.
+    static const uint8_t BAYER[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+    static inline uint16_t swap16(uint16_t pixel) { return (uint16_t)((pixel << 8) | (pixel >> 8)); }
+
+    static inline uint16_t pack(uint32_t r, uint32_t g, uint32_t b) { return (uint16_t)(((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3)); }
+
+    // The top 4 bits of each channel of an RGB565 pixel, as 12 bits 0xRGB.
+    static inline uint32_t pack444(uint32_t pixel) { return ((pixel >> 4) & 0xf00) | ((pixel >> 3) & 0x0f0) | ((pixel >> 1) & 0x00f); }
+
+    static inline uint32_t saturate(uint32_t value) { return value > 0xff ? 0xff : value; }
+
+    static inline uint16_t pack_dither(uint32_t r, uint32_t g, uint32_t b, uint32_t threshold) {
+      // Red and blue lose 3 bits, green loses 2, so the threshold is scaled to each channel's step.
+      return pack(saturate(r + (threshold >> 1)), saturate(g + (threshold >> 2)), saturate(b + (threshold >> 1)));
+    }
+
+    namespace Scalar {
+
+      void swap_rgb565(uint16_t* dst, const uint16_t* src, size_t count) {
+        for(size_t i = 0; i < count; i++) {
+          dst[i] = swap16(src[i]);
+        }
+      }
+
+      void rgb888_to_rgb565(uint16_t* dst, const uint8_t* src, size_t count, bool swap) {
+        for(size_t i = 0; i < count; i++) {
+          const uint16_t pixel = pack(src[i * 3], src[i * 3 + 1], src[i * 3 + 2]);
+          dst[i] = swap ? swap16(pixel) : pixel;
+        }
+      }
+
+      void argb8888_to_rgb565(uint16_t* dst, const uint32_t* src, size_t count, bool swap) {
+        for(size_t i = 0; i < count; i++) {
+          const uint16_t pixel = pack((src[i] >> 16) & 0xff, (src[i] >> 8) & 0xff, src[i] & 0xff);
+          dst[i] = swap ? swap16(pixel) : pixel;
+        }
+      }
+
+      void rgb888_to_rgb565_dither(uint16_t* dst, const uint8_t* src, size_t width, size_t height, size_t x, size_t y, bool swap) {
+        for(size_t row = 0; row < height; row++) {
+          for(size_t col = 0; col < width; col++) {
+            const uint8_t* p = src + (row * width + col) * 3;
+            const uint16_t pixel = pack_dither(p[0], p[1], p[2], BAYER[(y + row) & 3][(x + col) & 3]);
+            dst[row * width + col] = swap ? swap16(pixel) : pixel;
+          }
+        }
+      }
+
+      void argb8888_to_rgb565_dither(uint16_t* dst, const uint32_t* src, size_t width, size_t height, size_t x, size_t y, bool swap) {
+        for(size_t row = 0; row < height; row++) {
+          for(size_t col = 0; col < width; col++) {
+            const uint32_t p = src[row * width + col];
+            const uint16_t pixel = pack_dither((p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff, BAYER[(y + row) & 3][(x + col) & 3]);
+            dst[row * width + col] = swap ? swap16(pixel) : pixel;
+          }
+        }
+      }
+
+      void rgb565_to_rgb444(uint8_t* dst, const uint16_t* src, size_t count, bool swapped) {
+        for(size_t i = 0; i < count; i += 2) {
+          const uint32_t first = pack444(swapped ? swap16(src[i]) : src[i]);
+          const uint32_t second = i + 1 < count ? pack444(swapped ? swap16(src[i + 1]) : src[i + 1]) : 0;
+          const uint32_t pair = (first << 12) | second;
+          *dst++ = pair >> 16;
+          *dst++ = pair >> 8;
+          if(i + 1 < count) {
+            *dst++ = pair;
+          }
+        }
+      }
+
+      void rotate_rgb565(uint16_t* dst, const uint16_t* src, size_t width, size_t height, unsigned turns) {
+        for(size_t row = 0; row < height; row++) {
+          for(size_t col = 0; col < width; col++) {
+            const uint16_t pixel = src[row * width + col];
+            switch(turns & 3) {
+              case 0: dst[row * width + col] = pixel; break;
+              case 1: dst[(width - 1 - col) * height + row] = pixel; break;
+              case 2: dst[(height - 1 - row) * width + (width - 1 - col)] = pixel; break;
+              case 3: dst[col * height + (height - 1 - row)] = pixel; break;
+            }
+          }
+        }
+      }
+
+    }  // namespace Scalar
+
+    const char* implementation(Kernel kernel) { return PIXEL_CONVERT_PIE && kernel == Kernel::SWAP_RGB565 ? "pie" : "portable"; }
+
+    // Swap two pixels per 32-bit word.
+    static void swap_words(uint16_t* dst, const uint16_t* src, size_t count) {
+      uint32_t* out = (uint32_t*)dst;
+      const uint32_t* in = (const uint32_t*)src;
+      for(size_t i = 0; i < count / 2; i++) {
+        const uint32_t word = in[i];
+        out[i] = ((word & 0x00ff00ff) << 8) | ((word >> 8) & 0x00ff00ff);
+      }
+      if(count & 1) {
+        dst[count - 1] = swap16(src[count - 1]);
+      }
+    }
+
+#if PIXEL_CONVERT_PIE
+    // Swap 16 pixels per iteration: unzip the 32 bytes into low and high bytes, then zip them back in reverse order.
+    // Both pointers must be 16 byte aligned.
+    static void swap_pie(uint16_t* dst, const uint16_t* src, size_t blocks) {
+      for(size_t i = 0; i < blocks; i++) {
+        asm volatile(
+          "ee.vld.128.ip q0, %[src], 16 \n"
+          "ee.vld.128.ip q1, %[src], 16 \n"
+          "ee.vunzip.8 q0, q1 \n"
+          "ee.vzip.8 q1, q0 \n"
+          "ee.vst.128.ip q1, %[dst], 16 \n"
+          "ee.vst.128.ip q0, %[dst], 16 \n"
+          : [src] "+r"(src), [dst] "+r"(dst)
+          :
+          : "memory");
+      }
+    }
+#endif
+
+    void swap_rgb565(uint16_t* dst, const uint16_t* src, size_t count) {
+#if PIXEL_CONVERT_PIE
+      constexpr uintptr_t ALIGN = 16;
+#else
+      constexpr uintptr_t ALIGN = 4;
+#endif
+      // Pixels up to the first aligned destination are swapped one at a time.
+      while(count && ((uintptr_t)dst & (ALIGN - 1))) {
+        *dst++ = swap16(*src++);
+        count--;
+      }
+      if(((uintptr_t)src & (ALIGN - 1)) != 0) {
+        if(((uintptr_t)src & 3) == 0 && ((uintptr_t)dst & 3) == 0) {
+          swap_words(dst, src, count);
+        }
+        else {
+          Scalar::swap_rgb565(dst, src, count);
+        }
+        return;
+      }
+#if PIXEL_CONVERT_PIE
+      const size_t blocks = count / 16;
+      swap_pie(dst, src, blocks);
+      dst += blocks * 16;
+      src += blocks * 16;
+      count -= blocks * 16;
+#endif
+      swap_words(dst, src, count);
+    }
+
+    template <bool SWAP>
+    static void rgb888_to_rgb565(uint16_t* dst, const uint8_t* src, size_t count) {
+      // Four pixels are twelve bytes, unrolled so the loads and stores pipeline.
+      size_t i = 0;
+      for(; i + 4 <= count; i += 4, src += 12) {
+        const uint16_t p0 = pack(src[0], src[1], src[2]);
+        const uint16_t p1 = pack(src[3], src[4], src[5]);
+        const uint16_t p2 = pack(src[6], src[7], src[8]);
+        const uint16_t p3 = pack(src[9], src[10], src[11]);
+        dst[i] = SWAP ? swap16(p0) : p0;
+        dst[i + 1] = SWAP ? swap16(p1) : p1;
+        dst[i + 2] = SWAP ? swap16(p2) : p2;
+        dst[i + 3] = SWAP ? swap16(p3) : p3;
+      }
+      for(; i < count; i++, src += 3) {
+        const uint16_t pixel = pack(src[0], src[1], src[2]);
+        dst[i] = SWAP ? swap16(pixel) : pixel;
+      }
+    }
+
+    void rgb888_to_rgb565(uint16_t* dst, const uint8_t* src, size_t count, bool swap) {
+      swap ? rgb888_to_rgb565<true>(dst, src, count) : rgb888_to_rgb565<false>(dst, src, count);
+    }
+
+    template <bool SWAP>
+    static void argb8888_to_rgb565(uint16_t* dst, const uint32_t* src, size_t count) {
+      for(size_t i = 0; i < count; i++) {
+        const uint32_t p = src[i];
+        // Select the top bits of each channel directly from the word.
+        const uint16_t pixel = (uint16_t)(((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x001f));
+        dst[i] = SWAP ? swap16(pixel) : pixel;
+      }
+    }
+
+    void argb8888_to_rgb565(uint16_t* dst, const uint32_t* src, size_t count, bool swap) {
+      swap ? argb8888_to_rgb565<true>(dst, src, count) : argb8888_to_rgb565<false>(dst, src, count);
+    }
+
+    template <bool SWAP>
+    static void rgb888_to_rgb565_dither(uint16_t* dst, const uint8_t* src, size_t width, size_t height, size_t x, size_t y) {
+      for(size_t row = 0; row < height; row++) {
+        const uint8_t* thresholds = BAYER[(y + row) & 3];
+        for(size_t col = 0; col < width; col++, src += 3) {
+          const uint16_t pixel = pack_dither(src[0], src[1], src[2], thresholds[(x + col) & 3]);
+          *dst++ = SWAP ? swap16(pixel) : pixel;
+        }
+      }
+    }
+
+    void rgb888_to_rgb565_dither(uint16_t* dst, const uint8_t* src, size_t width, size_t height, size_t x, size_t y, bool swap) {
+      swap ? rgb888_to_rgb565_dither<true>(dst, src, width, height, x, y) : rgb888_to_rgb565_dither<false>(dst, src, width, height, x, y);
+    }
+
+    template <bool SWAP>
+    static void argb8888_to_rgb565_dither(uint16_t* dst, const uint32_t* src, size_t width, size_t height, size_t x, size_t y) {
+      for(size_t row = 0; row < height; row++) {
+        const uint8_t* thresholds = BAYER[(y + row) & 3];
+        for(size_t col = 0; col < width; col++) {
+          const uint32_t p = *src++;
+          const uint16_t pixel = pack_dither((p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff, thresholds[(x + col) & 3]);
+          *dst++ = SWAP ? swap16(pixel) : pixel;
+        }
+      }
+    }
+
+    void argb8888_to_rgb565_dither(uint16_t* dst, const uint32_t* src, size_t width, size_t height, size_t x, size_t y, bool swap) {
+      swap ? argb8888_to_rgb565_dither<true>(dst, src, width, height, x, y) : argb8888_to_rgb565_dither<false>(dst, src, width, height, x, y);
+    }
+
+    template <bool SWAPPED>
+    static void rgb565_to_rgb444(uint8_t* dst, const uint16_t* src, size_t count) {
+      // Two pixels per word, packed side by side in one pass: 0x0RGB0RGB. Four pixels in, six bytes out, read before
+      // they are written, so the output never overtakes the input when packing in place.
+      auto pack_pair = [](uint32_t word) {
+        if(SWAPPED) {
+          word = ((word & 0x00ff00ff) << 8) | ((word >> 8) & 0x00ff00ff);
+        }
+        const uint32_t packed = ((word >> 4) & 0x0f000f00) | ((word >> 3) & 0x00f000f0) | ((word >> 1) & 0x000f000f);
+        return ((packed & 0xfff) << 12) | (packed >> 16);
+      };
+      if(((uintptr_t)src & 3) == 0) {
+        const uint32_t* in = (const uint32_t*)src;
+        for(; count >= 4; count -= 4, src += 4) {
+          const uint32_t first = pack_pair(*in++);
+          const uint32_t second = pack_pair(*in++);
+          dst[0] = first >> 16;
+          dst[1] = first >> 8;
+          dst[2] = first;
+          dst[3] = second >> 16;
+          dst[4] = second >> 8;
+          dst[5] = second;
+          dst += 6;
+        }
+      }
+      Scalar::rgb565_to_rgb444(dst, src, count, SWAPPED);
+    }
+
+    void rgb565_to_rgb444(uint8_t* dst, const uint16_t* src, size_t count, bool swapped) {
+      swapped ? rgb565_to_rgb444<true>(dst, src, count) : rgb565_to_rgb444<false>(dst, src, count);
+    }
+
+    // Pixels along a tile's edge, a 32 byte cache line of RGB565.
+    static constexpr size_t ROTATE_TILE = 16;
+
+    template <bool CLOCKWISE>
+    static void transpose_rgb565(uint16_t* dst, const uint16_t* src, size_t width, size_t height) {
+      // Each source row of a tile is a single cache line, and the tile's destination rows are touched by every one of
+      // them, so both stay cached until the tile is done, however far apart the rows of the rectangle are.
+      for(size_t y0 = 0; y0 < height; y0 += ROTATE_TILE) {
+        const size_t y1 = std::min(height, y0 + ROTATE_TILE);
+        for(size_t x0 = 0; x0 < width; x0 += ROTATE_TILE) {
+          const size_t x1 = std::min(width, x0 + ROTATE_TILE);
+          for(size_t row = y0; row < y1; row++) {
+            const uint16_t* in = src + row * width;
+            if(CLOCKWISE) {
+              uint16_t* out = dst + x0 * height + (height - 1 - row);
+              for(size_t col = x0; col < x1; col++, out += height) {
+                *out = in[col];
+              }
+            }
+            else {
+              uint16_t* out = dst + (width - 1 - x0) * height + row;
+              for(size_t col = x0; col < x1; col++, out -= height) {
+                *out = in[col];
+              }
+            }
+          }
+        }
+      }
+    }
+
+    void rotate_rgb565(uint16_t* dst, const uint16_t* src, size_t width, size_t height, unsigned turns) {
+      const size_t count = width * height;
+      switch(turns & 3) {
+        case 0: memcpy(dst, src, count * sizeof(uint16_t)); break;
+        case 1: transpose_rgb565<false>(dst, src, width, height); break;
+        case 2: std::reverse_copy(src, src + count, dst); break;
+        case 3: transpose_rgb565<true>(dst, src, width, height); break;
+      }
+    }
+
+  }  // namespace PixelConvert
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,177 @@
+#include <controller.hpp>
+#include <pixel_convert.hpp>
+#include <pixel_push.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+namespace LVGLDisplay {
+
+  PixelPush::~PixelPush() { end(); }
+
+  esp_err_t PixelPush::begin(const lv_area_t* area, const Config& config) {
+    if(sizeof(lv_color_t) != sizeof(uint16_t)) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    if(active() || !_display.display()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    const lv_area_t panel = {0, 0, (lv_coord_t)(_display.width() - 1), (lv_coord_t)(_display.height() - 1)};
+    if(config.lines == 0 || (area && !_lv_area_is_in(area, &panel, 0))) {
+      return ESP_ERR_INVALID_ARG;
+    }
+
+    _area = area ? *area : panel;
+    _buffer_pixels = lv_area_get_width(&_area) * config.lines;
+    const uint32_t caps = _display.dma() ? MALLOC_CAP_DMA : MALLOC_CAP_DEFAULT;
+    for(lv_color_t*& buffer : _buffers) {
+      buffer = (lv_color_t*)heap_caps_malloc(_buffer_pixels * sizeof(lv_color_t), caps);
+    }
+    if(!_buffers[0] || !_buffers[1]) {
+      heap_caps_free(_buffers[0]);
+      heap_caps_free(_buffers[1]);
+      _buffers[0] = _buffers[1] = NULL;
+      return ESP_ERR_NO_MEM;
+    }
+
+    Lock lock;
+    const esp_err_t err = _display.excluded() ? ESP_ERR_INVALID_STATE : _display.add_hook(this);
+    if(err != ESP_OK) {
+      heap_caps_free(_buffers[0]);
+      heap_caps_free(_buffers[1]);
+      _buffers[0] = _buffers[1] = NULL;
+      return err;
+    }
+    _config = config;
+    _swap = _display.swap_bytes() && !config.panel_order;
+    _next = 0;
+    _filling = false;
+    _queued[0] = _queued[1] = false;
+    return ESP_OK;
+  }
+
+  void PixelPush::end() {
+    if(!active()) {
+      return;
+    }
+    wait();
+    {
+      Lock lock;
+      _display.remove_hook(this);
+      // The shadow no longer matches the panel there, and only learns it again from rows flushed in full.
+      const lv_area_t rows = {0, _area.y1, (lv_coord_t)(_display.width() - 1), _area.y2};
+      ShadowFrame& shadow = _display.shadow();
+      if(shadow.allocated()) {
+        shadow.invalidate(rows);
+      }
+      _lv_inv_area(_display.display(), shadow.allocated() ? &rows : &_area);
+    }
+    heap_caps_free(_buffers[0]);
+    heap_caps_free(_buffers[1]);
+    _buffers[0] = _buffers[1] = NULL;
+  }
+
+  bool PixelPush::inside(const lv_area_t& area) const {
+    return area.x1 <= area.x2 && area.y1 <= area.y2 && _lv_area_is_in(&area, &_area, 0);
+  }
+
+  void PixelPush::wait_for(size_t buffer) {
+    if(!_queued[buffer] || _display.transferred(_reuse_at[buffer])) {
+      return;
+    }
+    // Queueing the next transfer usually waits for this one on the bus, so this rarely blocks.
+    const int64_t start = esp_timer_get_time();
+    _display.wait_transferred(_reuse_at[buffer]);
+    _stats.wait_us += esp_timer_get_time() - start;
+  }
+
+  void PixelPush::wait() {
+    wait_for(0);
+    wait_for(1);
+  }
+
+  lv_color_t* PixelPush::buffer(size_t* pixels) {
+    if(!active()) {
+      return NULL;
+    }
+    wait_for(_next);
+    _filling = true;
+    *pixels = _buffer_pixels;
+    return _buffers[_next];
+  }
+
+  esp_err_t PixelPush::submit(const lv_area_t& area) {
+    if(!_filling) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!inside(area) || lv_area_get_size(&area) > _buffer_pixels) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _stats.pushes++;
+    if(_swap) {
+      const int64_t start = esp_timer_get_time();
+      PixelConvert::swap_rgb565((uint16_t*)_buffers[_next], (const uint16_t*)_buffers[_next], lv_area_get_size(&area));
+      _stats.copy_us += esp_timer_get_time() - start;
+    }
+    return transfer(area);
+  }
+
+  esp_err_t PixelPush::push(const lv_area_t& area, const lv_color_t* pixels) {
+    if(!active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!pixels || !inside(area)) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _stats.pushes++;
+    const size_t width = lv_area_get_width(&area);
+    const size_t rows = _buffer_pixels / width;
+    for(lv_coord_t y = area.y1; y <= area.y2; y += rows) {
+      const size_t lines = std::min(rows, (size_t)(area.y2 - y + 1));
+      const size_t count = lines * width;
+      wait_for(_next);
+
+      // The copy into one buffer overlaps the transfer of the other.
+      const int64_t start = esp_timer_get_time();
+      const lv_color_t* src = pixels + (y - area.y1) * width;
+      if(_swap) {
+        PixelConvert::swap_rgb565((uint16_t*)_buffers[_next], (const uint16_t*)src, count);
+      }
+      else {
+        memcpy(_buffers[_next], src, count * sizeof(lv_color_t));
+      }
+      _stats.copy_us += esp_timer_get_time() - start;
+
+      _filling = true;
+      const esp_err_t err = transfer({area.x1, y, area.x2, (lv_coord_t)(y + lines - 1)});
+      if(err != ESP_OK) {
+        return err;
+      }
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t PixelPush::transfer(const lv_area_t& area) {
+    const int64_t start = esp_timer_get_time();
+    esp_err_t err;
+    {
+      // With the lock held LVGL starts no flush, and the display waits for those in progress.
+      Lock lock;
+      err = _display.push(area, _buffers[_next], &_reuse_at[_next]);
+    }
+    _stats.wait_us += esp_timer_get_time() - start;
+    _filling = false;
+    if(err != ESP_OK) {
+      return err;
+    }
+    _queued[_next] = true;
+    _stats.transfers++;
+    _stats.bytes += _display.packer().bytes(lv_area_get_size(&area));
+    _next ^= 1;
+    return ESP_OK;
+  }
+
+}  // namespace LVGLDisplay
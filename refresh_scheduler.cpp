@@ -0,0 +1,59 @@
+#include <refresh_scheduler.hpp>
+
+namespace LVGLDisplay {
+
+  void RefreshScheduler::configure(const Config& config) {
+    _config = config;
+    _period_ms = 0;
+    _idle = false;
+  }
+
+  void RefreshScheduler::refresh(lv_disp_t* disp, lv_timer_t* timer, uint32_t flush_us) {
+    if(!_config.enabled) {
+      return;
+    }
+    const uint32_t now = lv_tick_get();
+    _stats.refreshes++;
+    if(disp->inv_p) {
+      _stats.rendered++;
+      _active_ms = now;
+    }
+
+    uint32_t period;
+    const bool input = lv_disp_get_inactive_time(disp) < _config.idle_after_ms;
+    if(disp->inv_p || input || now - _active_ms < _config.idle_after_ms) {
+      _idle = false;
+      period = _config.active_period_ms;
+      const uint32_t bus_ms = (flush_us + 999) / 1000;
+      if(bus_ms > period) {
+        period = bus_ms;
+        _stats.bus_limited++;
+      }
+    }
+    else {
+      if(!_idle) {
+        _idle = true;
+        _stats.idle_entries++;
+      }
+      period = _config.idle_period_ms;
+    }
+
+    // LVGL restarts the period from when the timer ran. Running a little late keeps the original phase instead, so
+    // frames stay evenly spaced; more than a period late and the schedule restarts from now.
+    if(period == _period_ms) {
+      const uint32_t late = now - _due_ms;
+      if((int32_t)late >= 0 && late < period) {
+        timer->last_run = _due_ms;
+      }
+      else if((int32_t)late >= 0) {
+        _stats.late++;
+      }
+    }
+    else {
+      lv_timer_set_period(timer, period);
+      _period_ms = period;
+    }
+    _due_ms = timer->last_run + period;
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,172 @@
+#include <shadow_frame.hpp>
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+
+namespace LVGLDisplay {
+
+  ShadowFrame::~ShadowFrame() { release(); }
+
+  esp_err_t ShadowFrame::allocate(const Config& config) {
+    release();
+    if(config.hres == 0 || config.vres == 0 || config.tile_rows == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _config = config;
+    _frame = (uint16_t*)heap_caps_aligned_alloc(config.alignment, config.hres * config.vres * sizeof(uint16_t), config.caps);
+    // Room for the rows of either orientation, so the axes can be swapped.
+    _rows_valid = (uint32_t*)heap_caps_calloc((std::max(config.hres, config.vres) + 31) / 32, sizeof(uint32_t), MALLOC_CAP_DEFAULT);
+    if(!_frame || !_rows_valid) {
+      release();
+      return ESP_ERR_NO_MEM;
+    }
+    invalidate();
+    return ESP_OK;
+  }
+
+  void ShadowFrame::release() {
+    heap_caps_free(_frame);
+    heap_caps_free(_rows_valid);
+    _frame = NULL;
+    _rows_valid = NULL;
+    _rows_pending = 0;
+  }
+
+  void ShadowFrame::invalidate() {
+    if(!_rows_valid) {
+      return;
+    }
+    memset(_rows_valid, 0, (_config.vres + 31) / 32 * sizeof(uint32_t));
+    _rows_pending = _config.vres;
+  }
+
+  void ShadowFrame::swap_axes() {
+    std::swap(_config.hres, _config.vres);
+    invalidate();
+  }
+
+  void ShadowFrame::invalidate(const lv_area_t& area) {
+    if(!_rows_valid) {
+      return;
+    }
+    const size_t y1 = std::max<lv_coord_t>(area.y1, 0);
+    const size_t y2 = std::min<size_t>(std::max<lv_coord_t>(area.y2, 0), _config.vres - 1);
+    for(size_t y = y1; y <= y2; y++) {
+      if(_rows_valid[y / 32] & (1u << (y % 32))) {
+        _rows_valid[y / 32] &= ~(1u << (y % 32));
+        _rows_pending++;
+      }
+    }
+  }
+
+  void ShadowFrame::pack(const lv_area_t& area, uint16_t* pixels, size_t row0, size_t row1, size_t col0, size_t col1, Region* region) {
+    const size_t width = lv_area_get_width(&area);
+    const size_t packed = col1 - col0 + 1;
+    uint16_t* out = pixels + row0 * width;
+    if(packed < width) {
+      // Rows move towards the start of the buffer, so a forward copy never overwrites a row not yet moved.
+      for(size_t row = row0; row <= row1; row++) {
+        memmove(out + (row - row0) * packed, pixels + row * width + col0, packed * sizeof(uint16_t));
+      }
+    }
+    region->area = {(lv_coord_t)(area.x1 + col0), (lv_coord_t)(area.y1 + row0), (lv_coord_t)(area.x1 + col1), (lv_coord_t)(area.y1 + row1)};
+    region->pixels = out;
+    _stats.bytes_out += (row1 - row0 + 1) * packed * sizeof(uint16_t);
+  }
+
+  size_t ShadowFrame::diff(const lv_area_t& area, uint16_t* pixels, Region* regions) {
+    const size_t width = lv_area_get_width(&area);
+    const size_t height = lv_area_get_height(&area);
+    const size_t bytes = width * height * sizeof(uint16_t);
+    _stats.bytes_in += bytes;
+
+    if(!_frame || area.x1 < 0 || area.y1 < 0 || (size_t)area.x2 >= _config.hres || (size_t)area.y2 >= _config.vres) {
+      regions[0] = {area, pixels};
+      _stats.bytes_out += bytes;
+      return 1;
+    }
+
+    // Until the panel contents are known, every row is sent and recorded.
+    const bool full_width = area.x1 == 0 && (size_t)area.x2 == _config.hres - 1;
+    if(_rows_pending) {
+      for(size_t row = 0; row < height; row++) {
+        const size_t y = area.y1 + row;
+        memcpy(_frame + y * _config.hres + area.x1, pixels + row * width, width * sizeof(uint16_t));
+        if(full_width && !(_rows_valid[y / 32] & (1u << (y % 32)))) {
+          _rows_valid[y / 32] |= 1u << (y % 32);
+          _rows_pending--;
+        }
+      }
+      regions[0] = {area, pixels};
+      _stats.bytes_out += bytes;
+      return 1;
+    }
+
+    size_t count = 0;
+    bool open = false;
+    size_t run_row0 = 0, run_row1 = 0, run_col0 = 0, run_col1 = 0;
+    for(size_t tile = 0; tile < height; tile += _config.tile_rows) {
+      const size_t tile_end = std::min(height, tile + _config.tile_rows);
+      size_t col0 = width, col1 = 0;
+      for(size_t row = tile; row < tile_end; row++) {
+        const uint16_t* src = pixels + row * width;
+        uint16_t* dst = _frame + (area.y1 + row) * _config.hres + area.x1;
+        if(memcmp(src, dst, width * sizeof(uint16_t)) == 0) {
+          continue;
+        }
+        size_t first = 0, last = width - 1;
+        while(src[first] == dst[first]) {
+          first++;
+        }
+        while(src[last] == dst[last]) {
+          last--;
+        }
+        memcpy(dst + first, src + first, (last - first + 1) * sizeof(uint16_t));
+        col0 = std::min(col0, first);
+        col1 = std::max(col1, last);
+      }
+      _stats.tiles++;
+
+      if(col0 > col1) {
+        _stats.tiles_skipped++;
+        if(open) {
+          pack(area, pixels, run_row0, run_row1, run_col0, run_col1, &regions[count++]);
+          open = false;
+        }
+        continue;
+      }
+      if(open) {
+        run_row1 = tile_end - 1;
+        run_col0 = std::min(run_col0, col0);
+        run_col1 = std::max(run_col1, col1);
+      }
+      else if(count == MAX_REGIONS - 1) {
+        // Out of regions, the last one extends to the bottom of the area.
+        open = true;
+        run_row0 = tile;
+        run_row1 = height - 1;
+        run_col0 = 0;
+        run_col1 = width - 1;
+        for(size_t row = tile; row < height; row++) {
+          memcpy(_frame + (area.y1 + row) * _config.hres + area.x1, pixels + row * width, width * sizeof(uint16_t));
+        }
+        break;
+      }
+      else {
+        open = true;
+        run_row0 = tile;
+        run_row1 = tile_end - 1;
+        run_col0 = col0;
+        run_col1 = col1;
+      }
+    }
+    if(open) {
+      pack(area, pixels, run_row0, run_row1, run_col0, run_col1, &regions[count++]);
+    }
+    return count;
+  }
+
+}  // namespace LVGLDisplay
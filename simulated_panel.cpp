@@ -0,0 +1,377 @@
+#include <simulated_panel.hpp>
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "esp_lcd_panel_commands.h"
+#include "esp_lcd_panel_interface.h"
+#include "esp_lcd_panel_io_interface.h"
+#include "esp_log.h"
+
+static const char* TAG = "simulated-panel";
+
+// Delays the ST7789 driver waits for after reset and sleep out.
+#define LCD_RESET_DELAY_NS   (20ULL * 1000 * 1000)
+#define LCD_SLPOUT_DELAY_NS  (100ULL * 1000 * 1000)
+
+namespace LVGLDisplay {
+
+  struct SimulatedPanel::IO {
+    esp_lcd_panel_io_t base;
+    SimulatedPanel* owner;
+  };
+
+  struct SimulatedPanel::Panel {
+    esp_lcd_panel_t base;
+    SimulatedPanel* owner;
+  };
+
+  SimulatedPanel::~SimulatedPanel() {
+    delete _io;
+    delete _panel;
+  }
+
+  esp_err_t SimulatedPanel::create(const Config& config, esp_lcd_panel_io_handle_t* io_handle, esp_lcd_panel_handle_t* panel_handle) {
+    if(!io_handle || !panel_handle || !config.hres || !config.vres || _io) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _config = config;
+    // Without a memory size, the memory holds just the display's window and the gaps before it.
+    if(!_config.columns) {
+      _config.columns = (config.swap_xy ? config.vres : config.hres) + (config.swap_xy ? config.y_gap : config.x_gap);
+    }
+    if(!_config.rows) {
+      _config.rows = (config.swap_xy ? config.hres : config.vres) + (config.swap_xy ? config.x_gap : config.y_gap);
+    }
+    _bus.configure(config.bus);
+    _framebuffer.assign(config.hres * config.vres, 0);
+    _log.resize(config.log_depth);
+    _epoch_ns = host_ns();
+
+    _io = new IO();
+    _io->owner = this;
+    _io->base.rx_param = io_rx_param;
+    _io->base.tx_param = io_tx_param;
+    _io->base.tx_color = io_tx_color;
+    _io->base.del = io_del;
+
+    _panel = new Panel();
+    _panel->owner = this;
+    _panel->base.reset = panel_reset;
+    _panel->base.init = panel_init;
+    _panel->base.del = panel_del;
+    _panel->base.draw_bitmap = panel_draw_bitmap;
+    _panel->base.mirror = panel_mirror;
+    _panel->base.swap_xy = panel_swap_xy;
+    _panel->base.set_gap = panel_set_gap;
+    _panel->base.invert_color = panel_invert_color;
+    _panel->base.disp_on_off = panel_disp_on_off;
+    _panel->base.user_data = this;
+
+    *io_handle = &_io->base;
+    *panel_handle = &_panel->base;
+    ESP_LOGI(TAG, "Simulated %ux%u panel on %s bus at %u Hz", (unsigned)config.hres, (unsigned)config.vres,
+             _bus.config().bus == BusModel::Bus::SPI ? "SPI" : "i80", (unsigned)config.bus.clock_hz);
+    return ESP_OK;
+  }
+
+  void SimulatedPanel::configure(const BusModel::Config& config) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _config.bus = config;
+    _bus.configure(config);
+  }
+
+  SimulatedPanel::Stats SimulatedPanel::stats() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    Stats stats = _stats;
+    stats.bus = _bus.stats();
+    stats.elapsed_ns = host_ns() - _epoch_ns + _stall_ns - _stats_epoch_ns;
+    return stats;
+  }
+
+  void SimulatedPanel::reset_stats() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _stats = Stats();
+    _bus.reset_stats();
+    _log_head = 0;
+    _log_count = 0;
+    _stats_epoch_ns = host_ns() - _epoch_ns + _stall_ns;
+  }
+
+  size_t SimulatedPanel::transactions(Transaction* out, size_t count) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    count = std::min(count, _log_count);
+    const size_t first = (_log_head + _log.size() - count) % std::max<size_t>(_log.size(), 1);
+    for(size_t i = 0; i < count; i++) {
+      out[i] = _log[(first + i) % _log.size()];
+    }
+    return count;
+  }
+
+  uint64_t SimulatedPanel::device_transaction(size_t bytes) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    const uint64_t submit = now_ns();
+    uint64_t start = submit;
+    const uint64_t done = _bus.tx_device(submit, bytes, &start);
+    delay(done - submit);
+    return start - submit;
+  }
+
+  uint64_t SimulatedPanel::now_ns() const {
+    if(_event_ns) {
+      return _event_ns;
+    }
+    return host_ns() - _epoch_ns + _stall_ns;
+  }
+
+  SimulatedPanel* SimulatedPanel::from_handle(esp_lcd_panel_handle_t panel_handle) {
+    if(!panel_handle || panel_handle->draw_bitmap != panel_draw_bitmap) {
+      return NULL;
+    }
+    return static_cast<SimulatedPanel*>(panel_handle->user_data);
+  }
+
+  uint64_t SimulatedPanel::host_ns() const {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  void SimulatedPanel::delay(uint64_t ns) { _stall_ns += ns; }
+
+  void SimulatedPanel::log(uint8_t cmd, size_t bytes, uint64_t submit_ns, uint64_t done_ns) {
+    ESP_LOGV(TAG, "cmd 0x%02x, %u bytes, %llu..%llu ns", cmd, (unsigned)bytes, (unsigned long long)submit_ns,
+             (unsigned long long)done_ns);
+    if(_log.empty()) {
+      return;
+    }
+    _log[_log_head] = {cmd, static_cast<uint32_t>(bytes), submit_ns, done_ns};
+    _log_head = (_log_head + 1) % _log.size();
+    _log_count = std::min(_log_count + 1, _log.size());
+  }
+
+  void SimulatedPanel::command(int lcd_cmd, const uint8_t* param, size_t param_size) {
+    switch(lcd_cmd) {
+      case LCD_CMD_CASET:
+        if(param_size == 4) {
+          _col_start = (param[0] << 8) | param[1];
+          _col_end = (param[2] << 8) | param[3];
+          _stats.caset++;
+        }
+        break;
+      case LCD_CMD_RASET:
+        if(param_size == 4) {
+          _row_start = (param[0] << 8) | param[1];
+          _row_end = (param[2] << 8) | param[3];
+          _stats.raset++;
+        }
+        break;
+      case LCD_CMD_MADCTL:
+        if(param_size) {
+          _madctl = param[0];
+        }
+        break;
+      case LCD_CMD_COLMOD:
+        if(param_size) {
+          _colmod = param[0];
+        }
+        break;
+      case LCD_CMD_INVON: _inverted = true; break;
+      case LCD_CMD_INVOFF: _inverted = false; break;
+      case LCD_CMD_DISPON: _on = true; break;
+      case LCD_CMD_DISPOFF: _on = false; break;
+      case LCD_CMD_SWRESET: delay(LCD_RESET_DELAY_NS); break;
+      case LCD_CMD_SLPOUT: delay(LCD_SLPOUT_DELAY_NS); break;
+      default: break;
+    }
+  }
+
+  bool SimulatedPanel::locate(int column, int row, int* x, int* y) const {
+    // The address is exchanged and mirrored into memory by MADCTL, as the ST7789 does, then read back out of memory
+    // in the board's orientation.
+    const int columns = static_cast<int>(_config.columns);
+    const int rows = static_cast<int>(_config.rows);
+    int memory_column = (_madctl & LCD_CMD_MV_BIT) ? row : column;
+    int memory_row = (_madctl & LCD_CMD_MV_BIT) ? column : row;
+    if(_madctl & LCD_CMD_MX_BIT) {
+      memory_column = columns - 1 - memory_column;
+    }
+    if(_madctl & LCD_CMD_MY_BIT) {
+      memory_row = rows - 1 - memory_row;
+    }
+    const int board_column = _config.mirror_x ? columns - 1 - memory_column : memory_column;
+    const int board_row = _config.mirror_y ? rows - 1 - memory_row : memory_row;
+    *x = (_config.swap_xy ? board_row : board_column) - _config.x_gap;
+    *y = (_config.swap_xy ? board_column : board_row) - _config.y_gap;
+    return *x >= 0 && *y >= 0 && *x < static_cast<int>(_config.hres) && *y < static_cast<int>(_config.vres);
+  }
+
+  void SimulatedPanel::write_pixels(const uint16_t* color, size_t pixels) {
+    const int width = _col_end - _col_start + 1;
+    const int height = _row_end - _row_start + 1;
+    if(width <= 0 || height <= 0) {
+      return;
+    }
+    for(size_t i = 0; i < pixels && _cursor < static_cast<size_t>(width * height); i++, _cursor++) {
+      int x, y;
+      if(locate(_col_start + static_cast<int>(_cursor % width), _row_start + static_cast<int>(_cursor / width), &x, &y)) {
+        _framebuffer[y * _config.hres + x] = color[i];
+      }
+    }
+    _stats.pixels += pixels;
+  }
+
+  void SimulatedPanel::write_rgb444(const uint8_t* color, size_t bytes) {
+    // Three bytes hold two pixels, widened to RGB565 by repeating the top bits of each channel.
+    uint16_t pixels[64];
+    size_t count = 0;
+    for(size_t i = 0; i < bytes * 2 / 3; i++) {
+      const size_t bit = i * 12;
+      const uint32_t pair = (color[bit / 8] << 8) | (bit / 8 + 1 < bytes ? color[bit / 8 + 1] : 0);
+      const uint32_t rgb = (bit % 8 ? pair : pair >> 4) & 0xfff;
+      const uint32_t r = rgb >> 8, g = (rgb >> 4) & 0xf, b = rgb & 0xf;
+      const uint16_t pixel = (uint16_t)(((r << 1 | r >> 3) << 11) | ((g << 2 | g >> 2) << 5) | (b << 1 | b >> 3));
+      pixels[count++] = (uint16_t)((pixel << 8) | (pixel >> 8));
+      if(count == sizeof(pixels) / sizeof(pixels[0])) {
+        write_pixels(pixels, count);
+        count = 0;
+      }
+    }
+    write_pixels(pixels, count);
+  }
+
+  esp_err_t SimulatedPanel::io_rx_param(esp_lcd_panel_io_t* io, int lcd_cmd, void* param, size_t param_size) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  esp_err_t SimulatedPanel::io_tx_param(esp_lcd_panel_io_t* io, int lcd_cmd, const void* param, size_t param_size) {
+    SimulatedPanel* self = reinterpret_cast<IO*>(io)->owner;
+    std::lock_guard<std::mutex> guard(self->_mutex);
+    const uint64_t submit = self->now_ns();
+    const uint64_t done = self->_bus.tx_param(submit, param_size);
+    self->delay(done - submit);
+    self->log(lcd_cmd, param_size, submit, done);
+    self->command(lcd_cmd, static_cast<const uint8_t*>(param), param_size);
+    return ESP_OK;
+  }
+
+  esp_err_t SimulatedPanel::io_tx_color(esp_lcd_panel_io_t* io, int lcd_cmd, const void* color, size_t color_size) {
+    SimulatedPanel* self = reinterpret_cast<IO*>(io)->owner;
+    uint64_t done = 0;
+    {
+      std::lock_guard<std::mutex> guard(self->_mutex);
+      const uint64_t submit = self->now_ns();
+      self->delay(self->_bus.tx_color(submit, color_size, &done) - submit);
+      self->log(lcd_cmd, color_size, submit, done);
+      if(lcd_cmd == LCD_CMD_RAMWR) {
+        self->_cursor = 0;
+        self->_stats.ramwr++;
+      }
+      if((lcd_cmd == LCD_CMD_RAMWR || lcd_cmd == LCD_CMD_RAMWRC) && (self->_colmod & 0x07) == 0x03) {
+        self->write_rgb444(static_cast<const uint8_t*>(color), color_size);
+      }
+      else if(lcd_cmd == LCD_CMD_RAMWR || lcd_cmd == LCD_CMD_RAMWRC) {
+        self->write_pixels(static_cast<const uint16_t*>(color), color_size / sizeof(uint16_t));
+      }
+    }
+    // The callback runs straight away, timestamped with the modelled completion time of the transfer.
+    if(self->_config.on_color_trans_done) {
+      esp_lcd_panel_io_event_data_t edata = {};
+      self->_event_ns = done;
+      self->_config.on_color_trans_done(io, &edata, self->_config.user_ctx);
+      self->_event_ns = 0;
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t SimulatedPanel::io_del(esp_lcd_panel_io_t* io) { return ESP_OK; }
+
+  esp_err_t SimulatedPanel::panel_reset(esp_lcd_panel_t* panel) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    esp_lcd_panel_io_tx_param(&self->_io->base, LCD_CMD_SWRESET, NULL, 0);
+    std::lock_guard<std::mutex> guard(self->_mutex);
+    self->_madctl = 0;
+    self->_colmod = 0x55;
+    self->_inverted = false;
+    self->_on = false;
+    std::fill(self->_framebuffer.begin(), self->_framebuffer.end(), 0);
+    return ESP_OK;
+  }
+
+  esp_err_t SimulatedPanel::panel_init(esp_lcd_panel_t* panel) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    esp_lcd_panel_io_handle_t io = &self->_io->base;
+    const uint8_t madctl = self->_madctl;
+    const uint8_t colmod = 0x55;
+    esp_lcd_panel_io_tx_param(io, LCD_CMD_SLPOUT, NULL, 0);
+    esp_lcd_panel_io_tx_param(io, LCD_CMD_MADCTL, &madctl, 1);
+    esp_lcd_panel_io_tx_param(io, LCD_CMD_COLMOD, &colmod, 1);
+    return ESP_OK;
+  }
+
+  esp_err_t SimulatedPanel::panel_del(esp_lcd_panel_t* panel) { return ESP_OK; }
+
+  esp_err_t SimulatedPanel::panel_draw_bitmap(esp_lcd_panel_t* panel, int x_start, int y_start, int x_end, int y_end,
+                                              const void* color_data) {
+    if(x_start >= x_end || y_start >= y_end) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    esp_lcd_panel_io_handle_t io = &self->_io->base;
+    x_start += self->_x_gap;
+    x_end += self->_x_gap;
+    y_start += self->_y_gap;
+    y_end += self->_y_gap;
+
+    const uint8_t caset[] = {
+      static_cast<uint8_t>(x_start >> 8),
+      static_cast<uint8_t>(x_start & 0xff),
+      static_cast<uint8_t>((x_end - 1) >> 8),
+      static_cast<uint8_t>((x_end - 1) & 0xff),
+    };
+    const uint8_t raset[] = {
+      static_cast<uint8_t>(y_start >> 8),
+      static_cast<uint8_t>(y_start & 0xff),
+      static_cast<uint8_t>((y_end - 1) >> 8),
+      static_cast<uint8_t>((y_end - 1) & 0xff),
+    };
+    esp_lcd_panel_io_tx_param(io, LCD_CMD_CASET, caset, sizeof(caset));
+    esp_lcd_panel_io_tx_param(io, LCD_CMD_RASET, raset, sizeof(raset));
+    const size_t len = (x_end - x_start) * (y_end - y_start) * sizeof(uint16_t);
+    return esp_lcd_panel_io_tx_color(io, LCD_CMD_RAMWR, color_data, len);
+  }
+
+  esp_err_t SimulatedPanel::panel_mirror(esp_lcd_panel_t* panel, bool mirror_x, bool mirror_y) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    uint8_t madctl = self->_madctl & ~(LCD_CMD_MX_BIT | LCD_CMD_MY_BIT);
+    madctl |= (mirror_x ? LCD_CMD_MX_BIT : 0) | (mirror_y ? LCD_CMD_MY_BIT : 0);
+    return esp_lcd_panel_io_tx_param(&self->_io->base, LCD_CMD_MADCTL, &madctl, 1);
+  }
+
+  esp_err_t SimulatedPanel::panel_swap_xy(esp_lcd_panel_t* panel, bool swap_axes) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    uint8_t madctl = self->_madctl & ~LCD_CMD_MV_BIT;
+    madctl |= swap_axes ? LCD_CMD_MV_BIT : 0;
+    return esp_lcd_panel_io_tx_param(&self->_io->base, LCD_CMD_MADCTL, &madctl, 1);
+  }
+
+  esp_err_t SimulatedPanel::panel_set_gap(esp_lcd_panel_t* panel, int x_gap, int y_gap) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    std::lock_guard<std::mutex> guard(self->_mutex);
+    self->_x_gap = x_gap;
+    self->_y_gap = y_gap;
+    return ESP_OK;
+  }
+
+  esp_err_t SimulatedPanel::panel_invert_color(esp_lcd_panel_t* panel, bool invert_color_data) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    return esp_lcd_panel_io_tx_param(&self->_io->base, invert_color_data ? LCD_CMD_INVON : LCD_CMD_INVOFF, NULL, 0);
+  }
+
+  esp_err_t SimulatedPanel::panel_disp_on_off(esp_lcd_panel_t* panel, bool on_off) {
+    SimulatedPanel* self = reinterpret_cast<Panel*>(panel)->owner;
+    return esp_lcd_panel_io_tx_param(&self->_io->base, on_off ? LCD_CMD_DISPON : LCD_CMD_DISPOFF, NULL, 0);
+  }
+
+}  // namespace LVGLDisplay
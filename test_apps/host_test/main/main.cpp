@@ -0,0 +1,14 @@
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "unity.h"
+
+// Main function
+extern "C" void app_main(void) {
+  // Only Unity's report, the components log their errors as the tests provoke them.
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  UNITY_BEGIN();
+  unity_run_all_tests();
+  exit(UNITY_END());
+}
@@ -0,0 +1,123 @@
+#include <command_queue.hpp>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "unity.h"
+
+using LVGLDisplay::CommandQueue;
+
+TEST_CASE("CommandQueue applies commands in order and drops them when full", "[command_queue]") {
+  CommandQueue queue;
+  TEST_ASSERT_FALSE(queue.post([] {}));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, queue.create(0));
+  // Rounded up to 8 commands.
+  TEST_ASSERT_EQUAL(ESP_OK, queue.create(5));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, queue.create(5));
+
+  static int applied[16];
+  static size_t count;
+  count = 0;
+  for(int i = 0; i < 10; i++) {
+    const bool posted = queue.post([i] { applied[count++] = i; });
+    TEST_ASSERT_EQUAL(i < 8, posted);
+  }
+  uint8_t payload[CommandQueue::PAYLOAD + 1] = {};
+  TEST_ASSERT_FALSE(queue.post([](void*) {}, payload, sizeof(payload)));
+
+  TEST_ASSERT_TRUE(queue.pending());
+  TEST_ASSERT_EQUAL(8, queue.apply());
+  TEST_ASSERT_FALSE(queue.pending());
+  TEST_ASSERT_EQUAL(8, count);
+  for(int i = 0; i < 8; i++) {
+    TEST_ASSERT_EQUAL(i, applied[i]);
+  }
+  TEST_ASSERT_EQUAL(0, queue.apply());
+
+  // The cells applied are free again.
+  TEST_ASSERT_TRUE(queue.post([] { applied[count++] = 100; }));
+  TEST_ASSERT_EQUAL(1, queue.apply());
+  TEST_ASSERT_EQUAL(100, applied[8]);
+
+  const CommandQueue::Stats stats = queue.stats();
+  TEST_ASSERT_EQUAL(9, stats.posted);
+  TEST_ASSERT_EQUAL(2, stats.dropped);
+  TEST_ASSERT_EQUAL(9, stats.applied);
+  TEST_ASSERT_EQUAL(2, stats.batches);
+  TEST_ASSERT_EQUAL(8, stats.max_batch);
+  queue.reset_stats();
+  TEST_ASSERT_EQUAL(0, queue.stats().posted);
+}
+
+TEST_CASE("CommandQueue applies a command posted by a command in the next batch", "[command_queue]") {
+  static CommandQueue queue;
+  static int applied;
+  if(!queue.created()) {
+    TEST_ASSERT_EQUAL(ESP_OK, queue.create(4));
+  }
+  applied = 0;
+  TEST_ASSERT_TRUE(queue.post([] {
+    applied++;
+    queue.post([] { applied++; });
+  }));
+  TEST_ASSERT_EQUAL(1, queue.apply());
+  TEST_ASSERT_EQUAL(1, applied);
+  TEST_ASSERT_EQUAL(1, queue.apply());
+  TEST_ASSERT_EQUAL(2, applied);
+}
+
+// Each producer posts its commands numbered in order, and the consumer checks each producer's arrive in that order.
+static constexpr int PRODUCERS = 4;
+static constexpr int COMMANDS = 2000;
+
+struct Producers {
+  CommandQueue queue;
+  SemaphoreHandle_t done;
+  int next[PRODUCERS];
+  bool ordered = true;
+};
+
+static void produce(void* arg) {
+  static int started = 0;
+  Producers* producers = (Producers*)arg;
+  const int producer = __atomic_fetch_add(&started, 1, __ATOMIC_RELAXED) % PRODUCERS;
+  for(int i = 0; i < COMMANDS;) {
+    const bool posted = producers->queue.post([producers, producer, i] {
+      producers->ordered = producers->ordered && producers->next[producer] == i;
+      producers->next[producer] = i + 1;
+    });
+    if(posted) {
+      i++;
+    }
+    else {
+      taskYIELD();
+    }
+  }
+  xSemaphoreGive(producers->done);
+  vTaskDelete(NULL);
+}
+
+TEST_CASE("CommandQueue keeps each producer's order with several producers", "[command_queue]") {
+  Producers producers = {};
+  producers.ordered = true;
+  producers.done = xSemaphoreCreateCounting(PRODUCERS, 0);
+  TEST_ASSERT_NOT_NULL(producers.done);
+  TEST_ASSERT_EQUAL(ESP_OK, producers.queue.create(64));
+  for(int i = 0; i < PRODUCERS; i++) {
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(produce, "producer", 4096, &producers, uxTaskPriorityGet(NULL), NULL));
+  }
+  int finished = 0;
+  while(finished < PRODUCERS) {
+    producers.queue.apply();
+    finished += xSemaphoreTake(producers.done, 0) == pdTRUE;
+    taskYIELD();
+  }
+  producers.queue.apply();
+  vSemaphoreDelete(producers.done);
+
+  TEST_ASSERT_TRUE(producers.ordered);
+  for(int i = 0; i < PRODUCERS; i++) {
+    TEST_ASSERT_EQUAL(COMMANDS, producers.next[i]);
+  }
+  TEST_ASSERT_EQUAL(PRODUCERS * COMMANDS, producers.queue.stats().applied);
+}
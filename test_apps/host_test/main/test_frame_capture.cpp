@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <frame_capture.hpp>
+#include <image_stream.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "unity.h"
+
+using LVGLDisplay::FrameCapture;
+using LVGLDisplay::ImageStream;
+
+// Not a multiple of the tile size, so the last row and column of tiles are partial.
+static constexpr size_t WIDTH = 50;
+static constexpr size_t HEIGHT = 40;
+
+struct Sink {
+  std::vector<uint8_t> data;
+  esp_err_t err = ESP_OK;
+
+  static esp_err_t write(const void* data, size_t size, void* context) {
+    Sink* sink = (Sink*)context;
+    if(sink->err == ESP_OK) {
+      sink->data.insert(sink->data.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+    }
+    return sink->err;
+  }
+};
+
+// As tools/capture_decoder.py, pixels are kept in the stream's byte order, which is LVGL's. Returns whether the record
+// at position decoded into frame, and moves position past it.
+static bool decode(const std::vector<uint8_t>& data, size_t& position, std::vector<uint16_t>& frame, FrameCapture::Header* header) {
+  const size_t start = position;
+  if(position + sizeof(*header) > data.size()) {
+    return false;
+  }
+  memcpy(header, &data[position], sizeof(*header));
+  position += sizeof(*header);
+  if(memcmp(header->magic, FrameCapture::MAGIC, sizeof(header->magic)) != 0 || header->width != WIDTH || header->height != HEIGHT) {
+    return false;
+  }
+  if(header->type == (uint8_t)FrameCapture::Type::KEY) {
+    frame.assign(WIDTH * HEIGHT, 0);
+  }
+  for(size_t r = 0; r < header->rects; r++) {
+    FrameCapture::Rect rect;
+    if(position + sizeof(rect) > data.size()) {
+      return false;
+    }
+    memcpy(&rect, &data[position], sizeof(rect));
+    position += sizeof(rect);
+    if(rect.x + rect.width > WIDTH || rect.y + rect.height > HEIGHT) {
+      return false;
+    }
+    for(size_t row = 0; row < rect.height; row++) {
+      uint16_t* pixels = &frame[(rect.y + row) * WIDTH + rect.x];
+      for(size_t x = 0; x < rect.width;) {
+        if(position >= data.size()) {
+          return false;
+        }
+        const uint8_t op = data[position] >> 6;
+        size_t length = (data[position] & 0x3f) + 1;
+        position++;
+        if(length == 0x40) {
+          length += data[position] | data[position + 1] << 8;
+          position += 2;
+        }
+        if(x + length > rect.width) {
+          return false;
+        }
+        if(op == ImageStream::LITERAL) {
+          memcpy(pixels + x, &data[position], length * sizeof(uint16_t));
+          position += length * sizeof(uint16_t);
+        }
+        else if(op == ImageStream::RUN) {
+          uint16_t pixel;
+          memcpy(&pixel, &data[position], sizeof(pixel));
+          position += sizeof(pixel);
+          std::fill(pixels + x, pixels + x + length, pixel);
+        }
+        else if(op == ImageStream::COPY_UP && row) {
+          memcpy(pixels + x, pixels + x - WIDTH, length * sizeof(uint16_t));
+        }
+        else {
+          return false;
+        }
+        x += length;
+      }
+    }
+  }
+  uint32_t size;
+  if(position + sizeof(size) > data.size()) {
+    return false;
+  }
+  memcpy(&size, &data[position], sizeof(size));
+  position += sizeof(size);
+  return size == position - start - sizeof(size);
+}
+
+static void tap(FrameCapture& capture, std::vector<uint16_t>& frame, lv_area_t area, bool swapped) {
+  std::vector<uint16_t> pixels;
+  for(lv_coord_t y = area.y1; y <= area.y2; y++) {
+    for(lv_coord_t x = area.x1; x <= area.x2; x++) {
+      const uint16_t pixel = frame[y * WIDTH + x];
+      pixels.push_back(swapped ? (uint16_t)(pixel << 8 | pixel >> 8) : pixel);
+    }
+  }
+  capture.tap(area, pixels.data(), swapped);
+}
+
+static std::vector<uint16_t> test_frame() {
+  std::vector<uint16_t> frame(WIDTH * HEIGHT);
+  srand(3);
+  for(size_t y = 0; y < HEIGHT; y++) {
+    for(size_t x = 0; x < WIDTH; x++) {
+      // Runs, rows repeating the row above, and noise.
+      frame[y * WIDTH + x] = y < 10 ? 0x001f : y % 2 && x < 30 ? frame[(y - 1) * WIDTH + x] : rand();
+    }
+  }
+  return frame;
+}
+
+TEST_CASE("FrameCapture key and delta records decode to the frame", "[frame_capture]") {
+  Sink sink;
+  FrameCapture::Config config;
+  config.sink = Sink::write;
+  config.context = &sink;
+  config.interval = 0;
+  // Smaller than a record, so records reach the sink in several parts.
+  config.buffer_size = 64;
+  FrameCapture capture;
+  TEST_ASSERT_EQUAL(ESP_OK, capture.start(config, WIDTH, HEIGHT));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, capture.start(config, WIDTH, HEIGHT));
+
+  std::vector<uint16_t> frame = test_frame();
+  tap(capture, frame, {0, 0, WIDTH - 1, HEIGHT - 1}, false);
+  TEST_ASSERT_EQUAL_MEMORY(frame.data(), capture.pixels(), frame.size() * sizeof(uint16_t));
+
+  // The first record is a key record, whatever is asked for.
+  TEST_ASSERT_EQUAL(ESP_OK, capture.record(false, 1, 1000));
+  std::vector<uint16_t> decoded;
+  FrameCapture::Header header;
+  size_t position = 0;
+  TEST_ASSERT_TRUE(decode(sink.data, position, decoded, &header));
+  TEST_ASSERT_EQUAL(sink.data.size(), position);
+  TEST_ASSERT_EQUAL((uint8_t)FrameCapture::Type::KEY, header.type);
+  TEST_ASSERT_EQUAL(1, header.rects);
+  TEST_ASSERT_EQUAL(1, header.frame);
+  TEST_ASSERT_EQUAL(1, header.time_ms);
+  TEST_ASSERT_EQUAL_MEMORY(frame.data(), decoded.data(), frame.size() * sizeof(uint16_t));
+
+  // A change within one tile, and one across the last two tiles of a row of tiles, tapped swapped as the flush path
+  // taps areas it swapped for the panel.
+  for(size_t x = 20; x < 28; x++) {
+    frame[18 * WIDTH + x] = 0xffff;
+  }
+  for(size_t x = 30; x < 40; x++) {
+    frame[35 * WIDTH + x] = 0x1234;
+  }
+  tap(capture, frame, {20, 18, 27, 18}, true);
+  tap(capture, frame, {30, 35, 39, 35}, false);
+  TEST_ASSERT_EQUAL_MEMORY(frame.data(), capture.pixels(), frame.size() * sizeof(uint16_t));
+  TEST_ASSERT_EQUAL(ESP_OK, capture.record(false, 2, 2000));
+  TEST_ASSERT_TRUE(decode(sink.data, position, decoded, &header));
+  TEST_ASSERT_EQUAL(sink.data.size(), position);
+  TEST_ASSERT_EQUAL((uint8_t)FrameCapture::Type::DELTA, header.type);
+  TEST_ASSERT_EQUAL(2, header.rects);
+  TEST_ASSERT_EQUAL_MEMORY(frame.data(), decoded.data(), frame.size() * sizeof(uint16_t));
+
+  // Tapping what is already there changes nothing, so there is nothing to record.
+  tap(capture, frame, {0, 0, WIDTH - 1, HEIGHT - 1}, false);
+  TEST_ASSERT_EQUAL(ESP_OK, capture.record(false, 3, 3000));
+  TEST_ASSERT_EQUAL(sink.data.size(), position);
+
+  const FrameCapture::Stats stats = capture.stats();
+  TEST_ASSERT_EQUAL(2, stats.records);
+  TEST_ASSERT_EQUAL(1, stats.key_records);
+  TEST_ASSERT_EQUAL(4 * 3 + 3, stats.tiles);
+  TEST_ASSERT_EQUAL(sink.data.size(), stats.bytes);
+}
+
+TEST_CASE("FrameCapture starts again from a key record after a sink error", "[frame_capture]") {
+  Sink sink;
+  FrameCapture::Config config;
+  config.sink = Sink::write;
+  config.context = &sink;
+  config.interval = 2;
+  FrameCapture capture;
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, capture.start(FrameCapture::Config(), WIDTH, HEIGHT));
+  TEST_ASSERT_EQUAL(ESP_OK, capture.start(config, WIDTH, HEIGHT));
+
+  std::vector<uint16_t> frame = test_frame();
+  tap(capture, frame, {0, 0, WIDTH - 1, HEIGHT - 1}, false);
+  capture.end_frame(1, 0);
+  TEST_ASSERT_EQUAL(0, capture.stats().records);
+  capture.end_frame(2, 0);
+  TEST_ASSERT_EQUAL(1, capture.stats().records);
+
+  std::vector<uint16_t> decoded;
+  FrameCapture::Header header;
+  size_t position = 0;
+  TEST_ASSERT_TRUE(decode(sink.data, position, decoded, &header));
+
+  // The sink fails a delta record, which leaves the decoder's frame behind.
+  frame[0] = 0x4321;
+  tap(capture, frame, {0, 0, 0, 0}, false);
+  sink.err = ESP_FAIL;
+  TEST_ASSERT_EQUAL(ESP_FAIL, capture.record(false, 3, 0));
+  TEST_ASSERT_EQUAL(1, capture.stats().errors);
+
+  sink.err = ESP_OK;
+  TEST_ASSERT_EQUAL(ESP_OK, capture.record(false, 4, 0));
+  TEST_ASSERT_TRUE(decode(sink.data, position, decoded, &header));
+  TEST_ASSERT_EQUAL((uint8_t)FrameCapture::Type::KEY, header.type);
+  TEST_ASSERT_EQUAL_MEMORY(frame.data(), decoded.data(), frame.size() * sizeof(uint16_t));
+}
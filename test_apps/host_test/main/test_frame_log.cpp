@@ -0,0 +1,77 @@
+#include <frame_log.hpp>
+
+#include "unity.h"
+
+using LVGLDisplay::FrameLog;
+using LVGLDisplay::FrameRecord;
+using LVGLDisplay::FrameStats;
+
+static FrameRecord record(uint32_t frame) {
+  FrameRecord record;
+  record.frame = frame;
+  record.areas = 2;
+  record.buffers = frame % 3;
+  record.render_us = frame * 100;
+  record.flush_us = 1000;
+  record.bytes = 4096;
+  if(frame % 2) {
+    record.input_us = frame;
+    record.input_latency_us = frame * 10;
+  }
+  return record;
+}
+
+TEST_CASE("FrameLog keeps the latest records oldest first", "[frame_log]") {
+  FrameLog log;
+  FrameRecord records[8];
+  TEST_ASSERT_EQUAL(0, log.read(records, 8));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, log.create(0));
+  TEST_ASSERT_EQUAL(ESP_OK, log.create(4));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, log.create(4));
+
+  log.add(record(1));
+  log.add(record(2));
+  TEST_ASSERT_EQUAL(2, log.read(records, 8));
+  TEST_ASSERT_EQUAL(1, records[0].frame);
+  TEST_ASSERT_EQUAL(2, records[1].frame);
+
+  // The ring overwrites the oldest records.
+  for(uint32_t frame = 3; frame <= 10; frame++) {
+    log.add(record(frame));
+  }
+  TEST_ASSERT_EQUAL(4, log.read(records, 8));
+  for(size_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(7 + i, records[i].frame);
+  }
+  // Fewer than are kept are the latest.
+  TEST_ASSERT_EQUAL(2, log.read(records, 2));
+  TEST_ASSERT_EQUAL(9, records[0].frame);
+  TEST_ASSERT_EQUAL(10, records[1].frame);
+
+  log.clear();
+  TEST_ASSERT_EQUAL(0, log.read(records, 8));
+  log.add(record(11));
+  TEST_ASSERT_EQUAL(1, log.read(records, 8));
+  TEST_ASSERT_EQUAL(11, records[0].frame);
+}
+
+TEST_CASE("FrameLog summarises the records it keeps", "[frame_log]") {
+  FrameLog log;
+  TEST_ASSERT_EQUAL(0, log.stats().frames);
+  TEST_ASSERT_EQUAL(ESP_OK, log.create(4));
+  for(uint32_t frame = 1; frame <= 6; frame++) {
+    log.add(record(frame));
+  }
+  // Frames 3 to 6, of which 3 and 5 redraw for input.
+  const FrameStats stats = log.stats();
+  TEST_ASSERT_EQUAL(4, stats.frames);
+  TEST_ASSERT_EQUAL(450, stats.render_avg_us);
+  TEST_ASSERT_EQUAL(600, stats.render_max_us);
+  TEST_ASSERT_EQUAL(1000, stats.flush_avg_us);
+  TEST_ASSERT_EQUAL(4096, stats.bytes_avg);
+  TEST_ASSERT_EQUAL(2, stats.areas_avg);
+  TEST_ASSERT_EQUAL(2, stats.buffers_max);
+  TEST_ASSERT_EQUAL(2, stats.inputs);
+  TEST_ASSERT_EQUAL(40, stats.input_latency_avg_us);
+  TEST_ASSERT_EQUAL(50, stats.input_latency_max_us);
+}
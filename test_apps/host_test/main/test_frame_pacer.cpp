@@ -0,0 +1,135 @@
+#include <frame_pacer.hpp>
+
+#include "unity.h"
+
+using LVGLDisplay::FramePacer;
+using LVGLDisplay::SimulatedVsync;
+
+// 320 lines a refresh at 16 ms make a line 50 us, so the windows below are whole microseconds.
+static constexpr uint32_t PERIOD_US = 16000;
+
+// The pacer's clock, advancing by a fixed step on every read so the time after each sleep is known.
+struct Clock {
+  int64_t now_us = 0;
+  int64_t step_us = 0;
+
+  static int64_t read(const void* context) {
+    Clock* clock = (Clock*)context;
+    const int64_t now_us = clock->now_us;
+    clock->now_us += clock->step_us;
+    return now_us;
+  }
+};
+
+static FramePacer::Config config(bool scan_x) {
+  FramePacer::Config config;
+  config.enabled = true;
+  config.period_us = PERIOD_US;
+  config.lines = 300;
+  config.porch_lines = 20;
+  config.display_lines = 300;
+  config.scan_x = scan_x;
+  config.margin_lines = 4;
+  return config;
+}
+
+static SimulatedVsync::Config vsync_config(uint32_t jitter_us, uint32_t drop_every) {
+  SimulatedVsync::Config config;
+  config.period_us = PERIOD_US;
+  config.jitter_us = jitter_us;
+  config.drop_every = drop_every;
+  return config;
+}
+
+// Lines 100 to 149: the scanline enters the area 6000 us after the edge and leaves it at 8500 us.
+static constexpr lv_area_t AREA = {100, 100, 149, 149};
+
+TEST_CASE("FramePacer starts a frame in scan order behind the scanline", "[frame_pacer]") {
+  SimulatedVsync vsync(vsync_config(0, 0));
+  Clock clock;
+  FramePacer pacer;
+  TEST_ASSERT_EQUAL(ESP_OK, pacer.start(config(false), &vsync, Clock::read, &clock));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, pacer.start(config(false), &vsync, Clock::read, &clock));
+
+  // Written as fast as the scan, the frame may start anywhere from the margin behind the scanline to the margin ahead.
+  TEST_ASSERT_EQUAL(6300, pacer.schedule(6300, AREA, 2500));
+  TEST_ASSERT_EQUAL(21700, pacer.schedule(21700, AREA, 2500));
+  TEST_ASSERT_EQUAL(6201, pacer.schedule(6000, AREA, 2500));
+  TEST_ASSERT_EQUAL(6201, pacer.schedule(5900, AREA, 2500));
+  TEST_ASSERT_EQUAL(2, vsync.edges());
+
+  // Written slower, it must finish before the scanline laps it.
+  TEST_ASSERT_EQUAL(38300, pacer.schedule(38300, AREA, 4500));
+  TEST_ASSERT_EQUAL(54201, pacer.schedule(52000, AREA, 4500));
+  TEST_ASSERT_EQUAL(4, vsync.edges());
+
+  // Slower than a refresh, no start avoids the scanline.
+  bool overlong = false;
+  pacer.schedule(70000, AREA, 2500, &overlong);
+  TEST_ASSERT_FALSE(overlong);
+  pacer.schedule(70000, AREA, 20000, &overlong);
+  TEST_ASSERT_TRUE(overlong);
+
+  // An unknown duration is never delayed.
+  TEST_ASSERT_EQUAL(86000, pacer.schedule(86000, AREA, 0));
+}
+
+TEST_CASE("FramePacer fits a frame across the scan between the scanline's passes", "[frame_pacer]") {
+  SimulatedVsync vsync(vsync_config(0, 0));
+  Clock clock;
+  FramePacer pacer;
+  TEST_ASSERT_EQUAL(ESP_OK, pacer.start(config(true), &vsync, Clock::read, &clock));
+
+  // Every gate line changes throughout the write, so it starts a margin after the scanline leaves and ends a margin
+  // before it enters again.
+  TEST_ASSERT_EQUAL(8700, pacer.schedule(8700, AREA, 1000));
+  TEST_ASSERT_EQUAL(20800, pacer.schedule(20800, AREA, 1000));
+  TEST_ASSERT_EQUAL(24701, pacer.schedule(20801, AREA, 1000));
+  TEST_ASSERT_EQUAL(8701, pacer.schedule(8600, AREA, 1000));
+}
+
+TEST_CASE("FramePacer waits for the window and counts missed slots", "[frame_pacer]") {
+  SimulatedVsync vsync(vsync_config(0, 0));
+  Clock clock;
+  FramePacer pacer;
+  TEST_ASSERT_EQUAL(ESP_OK, pacer.start(config(true), &vsync, Clock::read, &clock));
+
+  // Clear of the scanline, the frame starts straight away.
+  clock.now_us = 9000;
+  TEST_ASSERT_EQUAL(0, pacer.pace(AREA, 10000));
+  FramePacer::Stats stats = pacer.stats();
+  TEST_ASSERT_EQUAL(1, stats.frames);
+  TEST_ASSERT_EQUAL(0, stats.delayed);
+
+  // The window is 8700 to 11800 us after the edge. Waking 4000 us late misses it, and the next is a refresh away.
+  clock.now_us = 12000 + 2 * PERIOD_US;
+  clock.step_us = 12701 + 4000;
+  TEST_ASSERT_EQUAL(2 * clock.step_us, pacer.pace(AREA, 10000));
+  stats = pacer.stats();
+  TEST_ASSERT_EQUAL(2, stats.frames);
+  TEST_ASSERT_EQUAL(1, stats.delayed);
+  TEST_ASSERT_EQUAL(1, stats.missed);
+  TEST_ASSERT_EQUAL(0, stats.overlong);
+  TEST_ASSERT_EQUAL(2 * clock.step_us, stats.wait_max_us);
+
+  pacer.reset_stats();
+  TEST_ASSERT_EQUAL(0, pacer.stats().frames);
+}
+
+TEST_CASE("FramePacer counts dropped edges and follows jittered ones", "[frame_pacer]") {
+  SimulatedVsync vsync(vsync_config(100, 4));
+  Clock clock;
+  FramePacer pacer;
+  TEST_ASSERT_EQUAL(ESP_OK, pacer.start(config(false), &vsync, Clock::read, &clock));
+
+  // Mid refresh, so every edge up to now has arrived whatever its jitter. Every fourth is dropped, the last edges
+  // arrive and reveal the tenth.
+  for(int64_t refresh = 0; refresh < 42; refresh++) {
+    pacer.schedule(refresh * PERIOD_US + PERIOD_US / 2, AREA, 0);
+  }
+  TEST_ASSERT_EQUAL(42, vsync.edges());
+  const FramePacer::Stats stats = pacer.stats();
+  TEST_ASSERT_EQUAL(32, stats.vsyncs);
+  TEST_ASSERT_EQUAL(10, stats.dropped);
+  TEST_ASSERT_UINT32_WITHIN(200, PERIOD_US, stats.period_us);
+}
@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include <glyph_cache.hpp>
+
+#include "unity.h"
+
+using LVGLDisplay::GlyphCache;
+
+static constexpr lv_coord_t WIDTH = 48;
+static constexpr lv_coord_t HEIGHT = 24;
+
+// A software draw context over a buffer, as LVGL renders into a draw buffer.
+struct Canvas {
+  lv_draw_sw_ctx_t ctx;
+  lv_area_t area = {0, 0, WIDTH - 1, HEIGHT - 1};
+  lv_color_t pixels[WIDTH * HEIGHT];
+
+  Canvas() {
+    lv_init();
+    lv_draw_sw_init_ctx(NULL, &ctx.base_draw);
+    ctx.base_draw.buf = pixels;
+    ctx.base_draw.buf_area = &area;
+    ctx.base_draw.clip_area = &area;
+    memset(pixels, 0, sizeof(pixels));
+  }
+};
+
+TEST_CASE("GlyphCache draws letters as LVGL does", "[glyph_cache]") {
+  GlyphCache cache;
+  GlyphCache::Config config;
+  TEST_ASSERT_EQUAL(ESP_OK, cache.create(config));
+  TEST_ASSERT_EQUAL(ESP_OK, cache.add_font(LV_FONT_DEFAULT));
+
+  lv_draw_label_dsc_t dsc;
+  lv_draw_label_dsc_init(&dsc);
+  dsc.font = LV_FONT_DEFAULT;
+  dsc.color = lv_color_hex(0x40c080);
+  static Canvas lvgl;
+  static Canvas cached;
+  // Letters clipped by each edge of the buffer too.
+  const lv_point_t positions[] = {{4, 2}, {-3, 2}, {40, 16}, {20, -5}};
+  for(const char* letter = "Ag%j "; *letter; letter++) {
+    for(const lv_point_t& pos : positions) {
+      memset(lvgl.pixels, 0, sizeof(lvgl.pixels));
+      memset(cached.pixels, 0, sizeof(cached.pixels));
+      lvgl.ctx.base_draw.draw_letter(&lvgl.ctx.base_draw, &dsc, &pos, *letter);
+      TEST_ASSERT_TRUE(cache.draw(&cached.ctx.base_draw, &dsc, &pos, *letter));
+      TEST_ASSERT_EQUAL_MEMORY(lvgl.pixels, cached.pixels, sizeof(lvgl.pixels));
+    }
+  }
+  // Every letter was rasterized on its first draw and found after.
+  const GlyphCache::Stats stats = cache.stats();
+  TEST_ASSERT_EQUAL(5, stats.misses);
+  TEST_ASSERT_EQUAL(15, stats.hits);
+  TEST_ASSERT_EQUAL(5, stats.glyphs);
+
+  // Fonts not added are left to LVGL.
+  lv_font_t other = *LV_FONT_DEFAULT;
+  dsc.font = &other;
+  const lv_point_t pos = {4, 2};
+  TEST_ASSERT_FALSE(cache.draw(&cached.ctx.base_draw, &dsc, &pos, 'A'));
+}
+
+TEST_CASE("GlyphCache evicts the least recently drawn glyphs", "[glyph_cache]") {
+  GlyphCache cache;
+  GlyphCache::Config config;
+  config.budget = 0;
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, cache.create(config));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, cache.add_font(LV_FONT_DEFAULT));
+  // Room for a few dozen letters of the default font.
+  config.budget = 2048;
+  TEST_ASSERT_EQUAL(ESP_OK, cache.create(config));
+
+  const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+  TEST_ASSERT_EQUAL(ESP_OK, cache.warm(LV_FONT_DEFAULT, "0"));
+  for(int pass = 0; pass < 4; pass++) {
+    cache.warm(LV_FONT_DEFAULT, alphabet);
+    // Drawn again after each letter, so it stays the most recently used.
+    for(const char* letter = alphabet; *letter; letter++) {
+      char text[3] = {*letter, '0', 0};
+      cache.warm(LV_FONT_DEFAULT, text);
+    }
+  }
+  GlyphCache::Stats stats = cache.stats();
+  TEST_ASSERT_GREATER_THAN(0, stats.evictions);
+  TEST_ASSERT_LESS_OR_EQUAL(config.budget, stats.used);
+
+  // The last letters warmed are held, and the most recently used ones survive eviction.
+  lv_draw_label_dsc_t dsc;
+  lv_draw_label_dsc_init(&dsc);
+  dsc.font = LV_FONT_DEFAULT;
+  static Canvas canvas;
+  const lv_point_t pos = {4, 2};
+  cache.reset_stats();
+  TEST_ASSERT_TRUE(cache.draw(&canvas.ctx.base_draw, &dsc, &pos, '0'));
+  TEST_ASSERT_TRUE(cache.draw(&canvas.ctx.base_draw, &dsc, &pos, '9'));
+  stats = cache.stats();
+  TEST_ASSERT_EQUAL(2, stats.hits);
+  TEST_ASSERT_EQUAL(0, stats.misses);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, cache.hit_rate());
+
+  cache.clear();
+  stats = cache.stats();
+  TEST_ASSERT_EQUAL(0, stats.glyphs);
+  TEST_ASSERT_EQUAL(0, stats.used);
+  TEST_ASSERT_TRUE(cache.cached(LV_FONT_DEFAULT));
+}
@@ -0,0 +1,210 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <image_stream.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "unity.h"
+
+using LVGLDisplay::ImageStream;
+
+static constexpr size_t WIDTH = 100;
+static constexpr size_t HEIGHT = 40;
+static constexpr uint8_t LENGTH_MASK = 0x3f;
+static constexpr size_t LONG_LENGTH = LENGTH_MASK + 1;
+static constexpr size_t MAX_LENGTH = LONG_LENGTH + 0xffff;
+
+// Bands of one colour wider than a short token, rows repeating the row above, and noise.
+static std::vector<uint16_t> test_image() {
+  std::vector<uint16_t> pixels(WIDTH * HEIGHT);
+  srand(2);
+  for(size_t y = 0; y < HEIGHT; y++) {
+    for(size_t x = 0; x < WIDTH; x++) {
+      uint16_t& pixel = pixels[y * WIDTH + x];
+      if(y < 8) {
+        pixel = 0xf800;
+      }
+      else if(y % 8 >= 4 && x < 60) {
+        pixel = pixels[(y - 1) * WIDTH + x];
+      }
+      else if(x % 20 < 5) {
+        pixel = 0x07e0 + y;
+      }
+      else {
+        pixel = rand();
+      }
+    }
+  }
+  return pixels;
+}
+
+static void put_pixel(std::vector<uint8_t>& out, uint16_t pixel, bool swapped) {
+  out.push_back(swapped ? pixel >> 8 : pixel & 0xff);
+  out.push_back(swapped ? pixel & 0xff : pixel >> 8);
+}
+
+static void put_token(std::vector<uint8_t>& out, uint8_t op, size_t length) {
+  if(length < LONG_LENGTH) {
+    out.push_back(op << 6 | (length - 1));
+    return;
+  }
+  out.push_back(op << 6 | LENGTH_MASK);
+  out.push_back((length - LONG_LENGTH) & 0xff);
+  out.push_back((length - LONG_LENGTH) >> 8);
+}
+
+// As tools/image_encoder.py: greedy tokens running on from row to row within a block of key rows.
+static std::vector<uint8_t> encode(const std::vector<uint16_t>& pixels, ImageStream::Codec codec, uint16_t key_rows, bool swapped) {
+  std::vector<uint8_t> payload;
+  std::vector<uint32_t> index;
+  if(codec == ImageStream::Codec::RAW) {
+    key_rows = 0;
+    for(auto pixel : pixels) {
+      put_pixel(payload, pixel, swapped);
+    }
+  }
+  else {
+    const size_t block_rows = key_rows ? key_rows : HEIGHT;
+    for(size_t block = 0; block < HEIGHT; block += block_rows) {
+      index.push_back(payload.size());
+      const size_t start = block * WIDTH;
+      const size_t end = std::min(block + block_rows, HEIGHT) * WIDTH;
+      size_t literal = start;
+      auto flush_literal = [&](size_t i) {
+        for(; literal < i; literal += std::min(i - literal, MAX_LENGTH)) {
+          const size_t count = std::min(i - literal, MAX_LENGTH);
+          put_token(payload, ImageStream::LITERAL, count);
+          for(size_t n = 0; n < count; n++) {
+            put_pixel(payload, pixels[literal + n], swapped);
+          }
+        }
+      };
+      for(size_t i = start; i < end;) {
+        size_t up = 0;
+        while(i + up < end && i + up >= start + WIDTH && pixels[i + up] == pixels[i + up - WIDTH] && up < MAX_LENGTH) {
+          up++;
+        }
+        size_t run = 1;
+        while(i + run < end && pixels[i + run] == pixels[i] && run < MAX_LENGTH) {
+          run++;
+        }
+        if(up >= 2 && up >= run) {
+          flush_literal(i);
+          put_token(payload, ImageStream::COPY_UP, up);
+          i += up;
+          literal = i;
+        }
+        else if(run >= 3) {
+          flush_literal(i);
+          put_token(payload, ImageStream::RUN, run);
+          put_pixel(payload, pixels[i], swapped);
+          i += run;
+          literal = i;
+        }
+        else {
+          i++;
+        }
+      }
+      flush_literal(end);
+    }
+  }
+
+  ImageStream::Header header;
+  memcpy(header.magic, ImageStream::MAGIC, sizeof(header.magic));
+  header.width = WIDTH;
+  header.height = HEIGHT;
+  header.codec = (uint8_t)codec;
+  header.flags = swapped ? ImageStream::FLAG_SWAPPED : 0;
+  header.key_rows = key_rows;
+  header.payload_size = payload.size();
+  std::vector<uint8_t> image((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+  if(key_rows) {
+    image.insert(image.end(), (const uint8_t*)index.data(), (const uint8_t*)(index.data() + index.size()));
+  }
+  image.insert(image.end(), payload.begin(), payload.end());
+  return image;
+}
+
+// Rows are read in LVGL's byte order, whichever order the image stores them in.
+static uint16_t expected(uint16_t pixel) { return LV_COLOR_16_SWAP ? (uint16_t)(pixel << 8 | pixel >> 8) : pixel; }
+
+static void check_rows(ImageStream& stream, const std::vector<uint16_t>& pixels, size_t first, size_t last, int step) {
+  uint16_t row[WIDTH];
+  for(size_t y = first;; y += step) {
+    TEST_ASSERT_EQUAL(ESP_OK, stream.read(y, 0, WIDTH - 1, row));
+    for(size_t x = 0; x < WIDTH; x++) {
+      TEST_ASSERT_EQUAL_HEX16(expected(pixels[y * WIDTH + x]), row[x]);
+    }
+    if(y == last) {
+      break;
+    }
+  }
+}
+
+TEST_CASE("ImageStream decodes every codec and byte order", "[image_stream]") {
+  const std::vector<uint16_t> pixels = test_image();
+  for(auto codec : {ImageStream::Codec::RAW, ImageStream::Codec::RLE}) {
+    for(uint16_t key_rows : {0, 16}) {
+      for(bool swapped : {false, true}) {
+        const std::vector<uint8_t> image = encode(pixels, codec, key_rows, swapped);
+        ImageStream stream;
+        TEST_ASSERT_EQUAL(ESP_OK, stream.open(image.data(), image.size()));
+        TEST_ASSERT_EQUAL(WIDTH, stream.width());
+        TEST_ASSERT_EQUAL(HEIGHT, stream.height());
+        check_rows(stream, pixels, 0, HEIGHT - 1, 1);
+        // Backwards, restarting from a key row or the top for every row.
+        check_rows(stream, pixels, HEIGHT - 1, 0, -1);
+      }
+    }
+  }
+}
+
+TEST_CASE("ImageStream reads part of a row and seeks from key rows", "[image_stream]") {
+  const std::vector<uint16_t> pixels = test_image();
+  const std::vector<uint8_t> image = encode(pixels, ImageStream::Codec::RLE, 16, false);
+  ImageStream stream;
+  TEST_ASSERT_EQUAL(ESP_OK, stream.open(image.data(), image.size()));
+
+  uint16_t row[WIDTH];
+  TEST_ASSERT_EQUAL(ESP_OK, stream.read(37, 10, 69, row));
+  for(size_t x = 10; x <= 69; x++) {
+    TEST_ASSERT_EQUAL_HEX16(expected(pixels[37 * WIDTH + x]), row[x - 10]);
+  }
+  // Row 37 decodes from the key row at 32, and row 38 carries on from it.
+  TEST_ASSERT_EQUAL(1, stream.stats().seeks);
+  TEST_ASSERT_EQUAL(5, stream.stats().skipped_rows);
+  TEST_ASSERT_EQUAL(ESP_OK, stream.read(38, 0, WIDTH - 1, row));
+  TEST_ASSERT_EQUAL(1, stream.stats().seeks);
+  TEST_ASSERT_EQUAL(5, stream.stats().skipped_rows);
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stream.read(HEIGHT, 0, WIDTH - 1, row));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stream.read(0, 10, WIDTH, row));
+}
+
+TEST_CASE("ImageStream rejects invalid images", "[image_stream]") {
+  const std::vector<uint16_t> pixels = test_image();
+  std::vector<uint8_t> image = encode(pixels, ImageStream::Codec::RLE, 16, false);
+  ImageStream stream;
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stream.open(image.data(), sizeof(ImageStream::Header) - 1));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stream.open(image.data(), image.size() - 1));
+
+  std::vector<uint8_t> bad = image;
+  bad[0] = 'X';
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stream.open(bad.data(), bad.size()));
+  bad = image;
+  bad[offsetof(ImageStream::Header, codec)] = 7;
+  TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, stream.open(bad.data(), bad.size()));
+
+  // A payload cut short opens, but the rows past its end do not decode.
+  ImageStream::Header header;
+  memcpy(&header, image.data(), sizeof(header));
+  header.payload_size -= 8;
+  bad = image;
+  memcpy(bad.data(), &header, sizeof(header));
+  bad.resize(bad.size() - 8);
+  TEST_ASSERT_EQUAL(ESP_OK, stream.open(bad.data(), bad.size()));
+  uint16_t row[WIDTH];
+  TEST_ASSERT_EQUAL(ESP_OK, stream.read(0, 0, WIDTH - 1, row));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, stream.read(HEIGHT - 1, 0, WIDTH - 1, row));
+}
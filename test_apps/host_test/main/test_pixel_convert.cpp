@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <pixel_convert.hpp>
+
+#include "esp_heap_caps.h"
+#include "unity.h"
+
+namespace Convert = LVGLDisplay::PixelConvert;
+
+// One 320 x 170 frame, the size of the supported panels.
+static constexpr size_t WIDTH = 320;
+static constexpr size_t HEIGHT = 170;
+static constexpr size_t PIXELS = WIDTH * HEIGHT;
+
+// Offsets in bytes applied to the source and destination, to exercise the unaligned head and tail paths.
+static constexpr size_t OFFSETS[] = {0, 2, 4, 6, 14};
+
+// Random source pixels, and the output of a kernel and of the scalar reference, with slack for the offsets.
+struct Buffers {
+  uint8_t* src;
+  uint16_t* dst;
+  uint16_t* ref;
+
+  Buffers() {
+    src = (uint8_t*)heap_caps_aligned_alloc(16, PIXELS * 4 + 64, MALLOC_CAP_DEFAULT);
+    dst = (uint16_t*)heap_caps_aligned_alloc(16, (PIXELS + 16) * sizeof(uint16_t), MALLOC_CAP_DEFAULT);
+    ref = (uint16_t*)heap_caps_aligned_alloc(16, (PIXELS + 16) * sizeof(uint16_t), MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(src);
+    TEST_ASSERT_NOT_NULL(dst);
+    TEST_ASSERT_NOT_NULL(ref);
+    srand(1);
+    for(size_t i = 0; i < PIXELS * 4 + 64; i++) {
+      src[i] = rand();
+    }
+  }
+
+  ~Buffers() {
+    heap_caps_free(src);
+    heap_caps_free(dst);
+    heap_caps_free(ref);
+  }
+
+  void clear() {
+    memset(dst, 0, (PIXELS + 16) * sizeof(uint16_t));
+    memset(ref, 0, (PIXELS + 16) * sizeof(uint16_t));
+  }
+};
+
+// Run a kernel and its reference at every pair of offsets, with and without swapping, and compare the whole buffers
+// so a kernel writing past its end fails too. ARGB8888 sources are words, so only word aligned offsets apply.
+template <typename Run>
+static void compare(Buffers& buffers, size_t source_bytes, Run run) {
+  for(auto src_offset : OFFSETS) {
+    for(auto dst_offset : OFFSETS) {
+      if(source_bytes == 4 && src_offset % 4) {
+        continue;
+      }
+      for(int swap = 0; swap < 2; swap++) {
+        buffers.clear();
+        run(false, (uint16_t*)((uint8_t*)buffers.dst + dst_offset), buffers.src + src_offset, swap);
+        run(true, (uint16_t*)((uint8_t*)buffers.ref + dst_offset), buffers.src + src_offset, swap);
+        TEST_ASSERT_EQUAL_MEMORY(buffers.ref, buffers.dst, (PIXELS + 16) * sizeof(uint16_t));
+      }
+    }
+  }
+}
+
+TEST_CASE("swap_rgb565 matches the reference", "[pixel_convert]") {
+  Buffers buffers;
+  compare(buffers, 2, [](bool scalar, uint16_t* dst, const uint8_t* src, bool) {
+    scalar ? Convert::Scalar::swap_rgb565(dst, (const uint16_t*)src, PIXELS) : Convert::swap_rgb565(dst, (const uint16_t*)src, PIXELS);
+  });
+
+  // The flush path swaps in place.
+  memcpy(buffers.dst, buffers.src, PIXELS * sizeof(uint16_t));
+  memcpy(buffers.ref, buffers.src, PIXELS * sizeof(uint16_t));
+  Convert::swap_rgb565(buffers.dst, buffers.dst, PIXELS);
+  Convert::Scalar::swap_rgb565(buffers.ref, buffers.ref, PIXELS);
+  TEST_ASSERT_EQUAL_MEMORY(buffers.ref, buffers.dst, PIXELS * sizeof(uint16_t));
+}
+
+TEST_CASE("rgb888_to_rgb565 matches the reference", "[pixel_convert]") {
+  Buffers buffers;
+  compare(buffers, 3, [](bool scalar, uint16_t* dst, const uint8_t* src, bool swap) {
+    scalar ? Convert::Scalar::rgb888_to_rgb565(dst, src, PIXELS, swap) : Convert::rgb888_to_rgb565(dst, src, PIXELS, swap);
+  });
+}
+
+TEST_CASE("argb8888_to_rgb565 matches the reference", "[pixel_convert]") {
+  Buffers buffers;
+  compare(buffers, 4, [](bool scalar, uint16_t* dst, const uint8_t* src, bool swap) {
+    scalar ? Convert::Scalar::argb8888_to_rgb565(dst, (const uint32_t*)src, PIXELS, swap)
+           : Convert::argb8888_to_rgb565(dst, (const uint32_t*)src, PIXELS, swap);
+  });
+}
+
+TEST_CASE("rgb888_to_rgb565_dither matches the reference", "[pixel_convert]") {
+  Buffers buffers;
+  compare(buffers, 3, [](bool scalar, uint16_t* dst, const uint8_t* src, bool swap) {
+    scalar ? Convert::Scalar::rgb888_to_rgb565_dither(dst, src, WIDTH, HEIGHT, 3, 1, swap)
+           : Convert::rgb888_to_rgb565_dither(dst, src, WIDTH, HEIGHT, 3, 1, swap);
+  });
+}
+
+TEST_CASE("argb8888_to_rgb565_dither matches the reference", "[pixel_convert]") {
+  Buffers buffers;
+  compare(buffers, 4, [](bool scalar, uint16_t* dst, const uint8_t* src, bool swap) {
+    scalar ? Convert::Scalar::argb8888_to_rgb565_dither(dst, (const uint32_t*)src, WIDTH, HEIGHT, 3, 1, swap)
+           : Convert::argb8888_to_rgb565_dither(dst, (const uint32_t*)src, WIDTH, HEIGHT, 3, 1, swap);
+  });
+}
+
+TEST_CASE("rgb565_to_rgb444 matches the reference", "[pixel_convert]") {
+  Buffers buffers;
+  compare(buffers, 2, [](bool scalar, uint16_t* dst, const uint8_t* src, bool swap) {
+    scalar ? Convert::Scalar::rgb565_to_rgb444((uint8_t*)dst, (const uint16_t*)src, PIXELS, swap)
+           : Convert::rgb565_to_rgb444((uint8_t*)dst, (const uint16_t*)src, PIXELS, swap);
+  });
+
+  // The flush path packs in place, and an odd count ends with half a byte.
+  for(size_t count = PIXELS - 1; count <= PIXELS; count++) {
+    for(int swap = 0; swap < 2; swap++) {
+      memcpy(buffers.dst, buffers.src, count * sizeof(uint16_t));
+      Convert::rgb565_to_rgb444((uint8_t*)buffers.dst, buffers.dst, count, swap);
+      Convert::Scalar::rgb565_to_rgb444((uint8_t*)buffers.ref, (const uint16_t*)buffers.src, count, swap);
+      TEST_ASSERT_EQUAL_MEMORY(buffers.ref, buffers.dst, Convert::rgb444_bytes(count));
+    }
+  }
+}
+
+TEST_CASE("rotate_rgb565 matches the reference for every turn", "[pixel_convert]") {
+  Buffers buffers;
+  // A whole frame, and one narrower than a tile.
+  for(unsigned turns = 0; turns < 4; turns++) {
+    buffers.clear();
+    Convert::rotate_rgb565(buffers.dst, (const uint16_t*)buffers.src, WIDTH, HEIGHT, turns);
+    Convert::Scalar::rotate_rgb565(buffers.ref, (const uint16_t*)buffers.src, WIDTH, HEIGHT, turns);
+    TEST_ASSERT_EQUAL_MEMORY(buffers.ref, buffers.dst, (PIXELS + 16) * sizeof(uint16_t));
+
+    buffers.clear();
+    Convert::rotate_rgb565(buffers.dst, (const uint16_t*)buffers.src, 7, 3, turns);
+    Convert::Scalar::rotate_rgb565(buffers.ref, (const uint16_t*)buffers.src, 7, 3, turns);
+    TEST_ASSERT_EQUAL_MEMORY(buffers.ref, buffers.dst, 7 * 3 * sizeof(uint16_t) + 16);
+  }
+}
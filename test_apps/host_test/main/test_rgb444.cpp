@@ -0,0 +1,71 @@
+#include <string.h>
+
+#include <pixel_convert.hpp>
+
+#include "unity.h"
+
+namespace Convert = LVGLDisplay::PixelConvert;
+
+// The primaries, grey, white, black and mixed colours, and the top four bits of each of their channels.
+static constexpr uint16_t PIXELS[] = {0xf800, 0x07e0, 0x001f, 0x8410, 0x1234, 0xffff, 0x0000, 0x7bef, 0xa5b6};
+static constexpr uint16_t PACKED[] = {0xf00, 0x0f0, 0x00f, 0x888, 0x14a, 0xfff, 0x000, 0x777, 0xabb};
+static constexpr size_t COUNT = sizeof(PIXELS) / sizeof(PIXELS[0]);
+
+// Past the packed bytes, to catch a kernel writing beyond its end.
+static constexpr uint8_t GUARD = 0xa5;
+
+// The packed bytes, written a nibble at a time in scan order, an odd count padded with a zero nibble.
+static size_t expected(uint8_t* bytes, size_t count) {
+  memset(bytes, 0, Convert::rgb444_bytes(count));
+  for(size_t i = 0; i < count * 3; i++) {
+    const uint8_t nibble = (PACKED[i / 3] >> (8 - 4 * (i % 3))) & 0xf;
+    bytes[i / 2] |= i % 2 ? nibble : nibble << 4;
+  }
+  return Convert::rgb444_bytes(count);
+}
+
+static void source(uint16_t* pixels, size_t count, bool swapped) {
+  for(size_t i = 0; i < count; i++) {
+    pixels[i] = swapped ? (uint16_t)(PIXELS[i] << 8 | PIXELS[i] >> 8) : PIXELS[i];
+  }
+}
+
+TEST_CASE("rgb565_to_rgb444 packs two pixels into three bytes", "[pixel_convert]") {
+  TEST_ASSERT_EQUAL(0, Convert::rgb444_bytes(0));
+  TEST_ASSERT_EQUAL(2, Convert::rgb444_bytes(1));
+  TEST_ASSERT_EQUAL(3, Convert::rgb444_bytes(2));
+  TEST_ASSERT_EQUAL(8, Convert::rgb444_bytes(5));
+  TEST_ASSERT_EQUAL(480, Convert::rgb444_bytes(320));
+
+  // R0G0 B0R1 G1B1, the last pixel of an odd count padded with zero bits.
+  uint16_t pixels[COUNT];
+  uint8_t packed[COUNT * 2];
+  source(pixels, 5, false);
+  Convert::rgb565_to_rgb444(packed, pixels, 5, false);
+  static constexpr uint8_t FIVE[] = {0xf0, 0x00, 0xf0, 0x00, 0xf8, 0x88, 0x14, 0xa0};
+  TEST_ASSERT_EQUAL_MEMORY(FIVE, packed, sizeof(FIVE));
+}
+
+TEST_CASE("rgb565_to_rgb444 packs even and odd counts in either byte order", "[pixel_convert]") {
+  // Up to two words of four pixels and a tail, so both the word path and the scalar tail run.
+  for(size_t count = 1; count <= COUNT; count++) {
+    for(int swapped = 0; swapped < 2; swapped++) {
+      uint8_t reference[COUNT * 2];
+      const size_t bytes = expected(reference, count);
+
+      uint16_t pixels[COUNT];
+      uint8_t packed[COUNT * 2 + 1];
+      source(pixels, count, swapped);
+      memset(packed, GUARD, sizeof(packed));
+      Convert::rgb565_to_rgb444(packed, pixels, count, swapped);
+      TEST_ASSERT_EQUAL_MEMORY(reference, packed, bytes);
+      TEST_ASSERT_EQUAL(GUARD, packed[bytes]);
+
+      // As the flush path packs, in place.
+      uint16_t in_place[COUNT + 1];
+      source(in_place, count, swapped);
+      Convert::rgb565_to_rgb444((uint8_t*)in_place, in_place, count, swapped);
+      TEST_ASSERT_EQUAL_MEMORY(reference, in_place, bytes);
+    }
+  }
+}
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Decode a LVGLDisplay::FrameCapture stream into PNG images, or compare it against golden images.
+
+Reads the record stream described in include/frame_capture.hpp from a file, or stdin, skipping anything between
+records such as console output, and writes the frame of every record as frame_NNNNNN.png, numbered by the display's
+frame number. With --compare, each frame is compared pixel for pixel against the image of the same name in a
+directory of golden images, and the exit status is 1 if any differs or is missing.
+
+  capture_decoder.py capture.ldc -o frames
+  capture_decoder.py capture.ldc --compare tests/golden
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+from image_encoder import COPY_UP, LENGTH_MASK, LITERAL, LONG_LENGTH, RUN, load_image
+
+MAGIC = b"LDC1"
+KEY = 0
+DELTA = 1
+FLAG_SWAPPED = 0x01
+
+HEADER = struct.Struct("<4sBBHHHII")
+RECT = struct.Struct("<HHHH")
+
+
+class CorruptRecord(Exception):
+    pass
+
+
+def decode_row(data, position, pixels, offset, count, stride, fmt):
+    """Decode the tokens of one row into pixels[offset:offset + count], copying up from stride pixels before unless it
+    is None, and return the position after them."""
+    end = offset + count
+    while offset < end:
+        if position >= len(data):
+            raise CorruptRecord("stream ends within a row")
+        op, length = data[position] >> 6, (data[position] & LENGTH_MASK) + 1
+        position += 1
+        if length == LONG_LENGTH:
+            length += struct.unpack_from("<H", data, position)[0]
+            position += 2
+        if offset + length > end:
+            raise CorruptRecord("token runs past the end of the row")
+        if op == LITERAL:
+            pixels[offset:offset + length] = struct.unpack_from("%s%dH" % (fmt, length), data, position)
+            position += 2 * length
+        elif op == RUN:
+            pixels[offset:offset + length] = [struct.unpack_from(fmt + "H", data, position)[0]] * length
+            position += 2
+        elif op == COPY_UP and stride is not None:
+            pixels[offset:offset + length] = pixels[offset - stride:offset - stride + length]
+        else:
+            raise CorruptRecord("unknown token, or copy up in the first row of a rectangle")
+        offset += length
+    return position
+
+
+def decode_record(data, position, frame):
+    """Decode the record at position into frame, a dict holding width, height and pixels, returning the header and the
+    position after the record."""
+    start = position
+    magic, kind, flags, width, height, rects, number, time_ms = HEADER.unpack_from(data, position)
+    position += HEADER.size
+    if kind == KEY:
+        frame.update(width=width, height=height, pixels=[0] * (width * height))
+    elif kind != DELTA:
+        raise CorruptRecord("unknown record type %d" % kind)
+    elif frame.get("width") != width or frame.get("height") != height:
+        raise CorruptRecord("delta record without a key record")
+    fmt = ">" if flags & FLAG_SWAPPED else "<"
+    pixels = frame["pixels"]
+    for _ in range(rects):
+        x, y, rect_width, rect_height = RECT.unpack_from(data, position)
+        position += RECT.size
+        if x + rect_width > width or y + rect_height > height:
+            raise CorruptRecord("rectangle outside the frame")
+        for row in range(rect_height):
+            offset = (y + row) * width + x
+            position = decode_row(data, position, pixels, offset, rect_width, width if row else None, fmt)
+    if struct.unpack_from("<I", data, position)[0] != position - start:
+        raise CorruptRecord("record cut short")
+    position += 4
+    return {"type": "key" if kind == KEY else "delta", "frame": number, "time_ms": time_ms, "rects": rects}, position
+
+
+def records(data):
+    """Yield each record decoded, with the frame it leaves, from the first key record on."""
+    frame = {}
+    position = data.find(MAGIC)
+    while position >= 0 and position + HEADER.size <= len(data):
+        try:
+            header, end = decode_record(data, position, frame)
+        except (CorruptRecord, struct.error) as error:
+            # Resynchronise at the next record, the frame is only whole again from a key record.
+            if frame:
+                print("skipping record at byte %d: %s" % (position, error), file=sys.stderr)
+            frame.clear()
+            position = data.find(MAGIC, position + 1)
+            continue
+        header["bytes"] = end - position
+        yield header, frame
+        position = data.find(MAGIC, end)
+
+
+def rgb888(pixel):
+    r, g, b = pixel >> 11, (pixel >> 5) & 0x3F, pixel & 0x1F
+    return (r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2)
+
+
+def save_png(path, frame):
+    try:
+        from PIL import Image
+    except ImportError:
+        sys.exit("Writing images needs Pillow: pip install pillow")
+    image = Image.new("RGB", (frame["width"], frame["height"]))
+    image.putdata([rgb888(pixel) for pixel in frame["pixels"]])
+    image.save(path)
+
+
+def handle(header, frame, args):
+    """Write the frame of a record, compare it against its golden image, and print a line about it. Returns whether the
+    frame matches, or was not compared."""
+    name = "frame_%06d.png" % header["frame"]
+    if args.output:
+        save_png(os.path.join(args.output, name), frame)
+    status = ""
+    if args.compare:
+        golden = os.path.join(args.compare, name)
+        if not os.path.exists(golden):
+            status = ", no golden image"
+        else:
+            width, height, pixels = load_image(golden)
+            if (width, height) != (frame["width"], frame["height"]):
+                status = ", golden image is %dx%d" % (width, height)
+            else:
+                differ = sum(a != b for a, b in zip(pixels, frame["pixels"]))
+                status = ", %d pixels differ" % differ if differ else ", matches"
+    print("%s: %s %dx%d, %d rects, %d bytes%s" % (name, header["type"], frame["width"], frame["height"], header["rects"],
+                                                 header["bytes"], status))
+    return status in ("", ", matches")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("stream", nargs="?", help="capture stream, stdin if omitted")
+    parser.add_argument("-o", "--output", help="directory to write the frames to")
+    parser.add_argument("--compare", metavar="DIR", help="directory of golden images to compare the frames against")
+    parser.add_argument("--last", action="store_true", help="only write or compare the last frame")
+    args = parser.parse_args()
+    if not args.output and not args.compare:
+        parser.error("--output or --compare is required")
+
+    if args.stream:
+        with open(args.stream, "rb") as stream:
+            data = stream.read()
+    else:
+        data = sys.stdin.buffer.read()
+    if args.output:
+        os.makedirs(args.output, exist_ok=True)
+
+    # Frames are handled as they are decoded, with --last only the frame the stream ends with.
+    failures = 0
+    count = 0
+    last = None
+    for header, frame in records(data):
+        count += 1
+        if args.last:
+            last = (header, dict(frame, pixels=list(frame["pixels"])))
+        else:
+            failures += not handle(header, frame, args)
+    if last:
+        failures += not handle(last[0], last[1], args)
+    if not count:
+        sys.exit("no key record found")
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
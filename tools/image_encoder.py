@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""Encode RGB565 images for LVGLDisplay::ImageStream.
+
+Reads an image with Pillow, or synthesises a test background, and writes it in the encoded image format described in
+include/image_stream.hpp, as a binary file to embed or as C source.
+
+  image_encoder.py background.png -o background.ldi
+  image_encoder.py background.png --c-array background -o background.c
+  image_encoder.py --pattern ui --size 320x170 --codec raw -o background_raw.ldi
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"LDI1"
+CODECS = {"raw": 0, "rle": 1}
+FLAG_SWAPPED = 0x01
+
+LITERAL = 0
+RUN = 1
+COPY_UP = 2
+
+LENGTH_MASK = 0x3F
+LONG_LENGTH = LENGTH_MASK + 1
+MAX_LENGTH = LONG_LENGTH + 0xFFFF
+
+
+def rgb565(r, g, b):
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+
+
+def load_image(path):
+    try:
+        from PIL import Image
+    except ImportError:
+        sys.exit("Reading images needs Pillow: pip install pillow")
+    image = Image.open(path).convert("RGB")
+    width, height = image.size
+    return width, height, [rgb565(*pixel) for pixel in image.getdata()]
+
+
+def synthesise(pattern, width, height):
+    """A test background: a vertical gradient, flat panels with borders, and a noisy photo-like inset."""
+    pixels = []
+    seed = 12345
+    for y in range(height):
+        shade = 32 + 96 * y // max(height - 1, 1)
+        for x in range(width):
+            colour = rgb565(shade // 4, shade // 2, shade)
+            if pattern == "ui":
+                panel_x = x % (width // 2)
+                if 8 <= panel_x < width // 2 - 8 and height // 4 <= y < height // 4 + height // 3:
+                    border = panel_x in (8, width // 2 - 9) or y in (height // 4, height // 4 + height // 3 - 1)
+                    colour = rgb565(200, 200, 210) if border else rgb565(40, 44, 52)
+                if width - width // 4 <= x < width - 8 and height - height // 3 <= y < height - 8:
+                    seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF
+                    grey = 96 + (seed >> 16) % 64
+                    colour = rgb565(grey, grey - 16, grey - 32)
+            pixels.append(colour)
+    return pixels
+
+
+def token(op, length):
+    if length < LONG_LENGTH:
+        return bytes([op << 6 | (length - 1)])
+    return bytes([op << 6 | LENGTH_MASK]) + struct.pack("<H", length - LONG_LENGTH)
+
+
+def pack_pixel(pixel, swapped):
+    return struct.pack(">H" if swapped else "<H", pixel)
+
+
+def encode_rle(pixels, width, height, key_rows, swapped):
+    """Greedy encoding: copy from the row above where two or more pixels match it, runs of three or more, literals
+    otherwise. Tokens run on from row to row within a block of key rows."""
+    payload = bytearray()
+    index = []
+    block_rows = key_rows or height
+    for block in range(0, height, block_rows):
+        index.append(len(payload))
+        start = block * width
+        end = min(block + block_rows, height) * width
+
+        def copy_up_length(i):
+            n = 0
+            while i + n < end and i + n - width >= start and pixels[i + n] == pixels[i + n - width] and n < MAX_LENGTH:
+                n += 1
+            return n
+
+        def run_length(i):
+            n = 1
+            while i + n < end and pixels[i + n] == pixels[i] and n < MAX_LENGTH:
+                n += 1
+            return n
+
+        literal = []
+
+        def flush_literal():
+            for offset in range(0, len(literal), MAX_LENGTH):
+                chunk = literal[offset:offset + MAX_LENGTH]
+                payload.extend(token(LITERAL, len(chunk)))
+                for pixel in chunk:
+                    payload.extend(pack_pixel(pixel, swapped))
+            literal.clear()
+
+        i = start
+        while i < end:
+            up = copy_up_length(i)
+            run = run_length(i)
+            if up >= 2 and up >= run:
+                flush_literal()
+                payload.extend(token(COPY_UP, up))
+                i += up
+            elif run >= 3:
+                flush_literal()
+                payload.extend(token(RUN, run))
+                payload.extend(pack_pixel(pixels[i], swapped))
+                i += run
+            else:
+                literal.append(pixels[i])
+                i += 1
+        flush_literal()
+    return bytes(payload), index if key_rows else []
+
+
+def decode_rle(payload, width, height, swapped):
+    """Reference decoder, to check the encoding."""
+    pixels = []
+    position = 0
+    fmt = ">H" if swapped else "<H"
+    while len(pixels) < width * height:
+        op, length = payload[position] >> 6, (payload[position] & LENGTH_MASK) + 1
+        position += 1
+        if length == LONG_LENGTH:
+            length += struct.unpack_from("<H", payload, position)[0]
+            position += 2
+        if op == LITERAL:
+            pixels.extend(struct.unpack_from(fmt, payload, position + 2 * n)[0] for n in range(length))
+            position += 2 * length
+        elif op == RUN:
+            pixels.extend([struct.unpack_from(fmt, payload, position)[0]] * length)
+            position += 2
+        else:
+            for _ in range(length):
+                pixels.append(pixels[len(pixels) - width])
+    return pixels
+
+
+def encode(pixels, width, height, codec, key_rows, swapped):
+    if codec == "raw":
+        payload = b"".join(pack_pixel(pixel, swapped) for pixel in pixels)
+        index = []
+        key_rows = 0
+    else:
+        payload, index = encode_rle(pixels, width, height, key_rows, swapped)
+        assert decode_rle(payload, width, height, swapped) == pixels, "RLE encoding does not round trip"
+    header = MAGIC + struct.pack("<HHBBHI", width, height, CODECS[codec], FLAG_SWAPPED if swapped else 0,
+                                 key_rows if index else 0, len(payload))
+    return header + b"".join(struct.pack("<I", offset) for offset in index) + payload
+
+
+def c_array(name, data):
+    lines = ["#include <stddef.h>", "#include <stdint.h>", "",
+             "// Encoded with tools/image_encoder.py, open with LVGLDisplay::ImageStream::open(%s, %s_size)." % (name, name),
+             "const uint8_t %s[] = {" % name]
+    for offset in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % byte for byte in data[offset:offset + 16]) + ",")
+    lines += ["};", "const size_t %s_size = sizeof(%s);" % (name, name), ""]
+    return "\n".join(lines).encode()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", nargs="?", help="image to encode, any format Pillow reads")
+    parser.add_argument("-o", "--output", required=True, help="output file")
+    parser.add_argument("--codec", choices=CODECS, default="rle", help="payload codec (default rle)")
+    parser.add_argument("--key-rows", type=int, default=16, help="rows between key rows, 0 for no index (default 16)")
+    parser.add_argument("--swap", action="store_true", help="store pixels big endian, for LV_COLOR_16_SWAP builds")
+    parser.add_argument("--c-array", metavar="NAME", help="write C source defining NAME and NAME_size")
+    parser.add_argument("--pattern", choices=["ui", "gradient"], help="synthesise a test background instead")
+    parser.add_argument("--size", default="320x170", help="size of the synthesised background (default 320x170)")
+    args = parser.parse_args()
+
+    if args.pattern:
+        width, height = (int(n) for n in args.size.split("x"))
+        pixels = synthesise(args.pattern, width, height)
+    elif args.image:
+        width, height, pixels = load_image(args.image)
+    else:
+        parser.error("an image or --pattern is required")
+    if not 0 < width <= 0xFFFF or not 0 < height <= 0xFFFF or not 0 <= args.key_rows <= 0xFFFF:
+        parser.error("image size or key rows out of range")
+
+    data = encode(pixels, width, height, args.codec, args.key_rows, args.swap)
+    with open(args.output, "wb") as output:
+        output.write(c_array(args.c_array, data) if args.c_array else data)
+    print("%dx%d %s: %d bytes, %.1f%% of %d raw" % (width, height, args.codec, len(data), 100.0 * len(data) /
+                                                     (width * height * 2), width * height * 2))
+
+
+if __name__ == "__main__":
+    main()
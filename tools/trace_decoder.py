@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Decode a LVGLDisplay::TraceRecorder trace, printing its events or a summary, or compare two traces.
+
+Reads the trace described in include/workload_trace.hpp from a file, or stdin. By default prints a summary of the
+session as one JSON object: frames, flush and render times, bytes and lock holds. With --events, prints every event as
+one JSON object per line, times in microseconds from the start of the trace. With --compare, summarises a second
+trace too, such as a replay of the first recorded in turn, and prints both with the change of each measure.
+
+  trace_decoder.py session.ldt
+  trace_decoder.py session.ldt --events
+  trace_decoder.py session.ldt --compare replay.ldt
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"LDT1"
+END, FRAME, DONE, LOCK = range(4)
+
+HEADER = struct.Struct("<4sHHIBBBB")
+
+
+class CorruptTrace(Exception):
+    pass
+
+
+class Reader:
+    def __init__(self, data, position):
+        self.data = data
+        self.position = position
+
+    def done(self):
+        return self.position >= len(self.data)
+
+    def byte(self):
+        if self.done():
+            raise CorruptTrace("trace ends within an event")
+        self.position += 1
+        return self.data[self.position - 1]
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            if not byte & 0x80:
+                return value
+            shift += 7
+
+    def time(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+
+def events(data):
+    """Yield the header, then each event as a dict, times made absolute."""
+    if data[:4] != MAGIC or len(data) < HEADER.size:
+        raise CorruptTrace("not a trace")
+    _, width, height, buffer_pixels, buffers, fmt, rotation, _ = HEADER.unpack_from(data)
+    yield {"width": width, "height": height, "buffer_pixels": buffer_pixels, "buffers": buffers,
+           "format": "rgb444" if fmt else "rgb565", "rotation": rotation * 90}
+    reader = Reader(data, HEADER.size)
+    time_us = 0
+    while not reader.done():
+        kind = reader.byte()
+        if kind == FRAME:
+            time_us += reader.time()
+            event = {"event": "frame", "time_us": time_us}
+            for field in ("frame", "lock_wait_us", "render_us", "dma_wait_us", "flushed"):
+                event[field] = reader.varint()
+            event["areas"] = [[reader.varint(), reader.varint(), reader.varint() + 1, reader.varint() + 1]
+                              for _ in range(reader.varint())]
+        elif kind == DONE:
+            event = {"event": "done"}
+            for field in ("frame", "flush_us", "bytes", "buffers"):
+                event[field] = reader.varint()
+        elif kind == LOCK:
+            time_us += reader.time()
+            event = {"event": "lock", "time_us": time_us, "wait_us": reader.varint(), "hold_us": reader.varint()}
+        elif kind == END:
+            event = {"event": "end", "dropped": reader.varint()}
+        else:
+            raise CorruptTrace("unknown event %d at byte %d" % (kind, reader.position - 1))
+        yield event
+
+
+def percentile(values, fraction):
+    return sorted(values)[int(len(values) * fraction)] if values else 0
+
+
+def summarise(data):
+    stream = events(data)
+    summary = dict(next(stream))
+    frames, done, locks = [], [], []
+    duration = 0
+    for event in stream:
+        duration = max(duration, event.get("time_us", 0))
+        if event["event"] == "frame":
+            frames.append(event)
+        elif event["event"] == "done":
+            done.append(event)
+        elif event["event"] == "lock":
+            locks.append(event)
+    flush = [event["flush_us"] for event in done]
+    render = [event["render_us"] for event in frames]
+    summary.update({
+        "duration_us": duration,
+        "frames": len(frames),
+        "fps": round(len(frames) * 1e6 / duration, 1) if duration else 0,
+        "areas": sum(len(event["areas"]) for event in frames),
+        "render_avg_us": sum(render) // len(render) if render else 0,
+        "render_p95_us": percentile(render, 0.95),
+        "dma_wait_avg_us": sum(event["dma_wait_us"] for event in frames) // len(frames) if frames else 0,
+        "flush_avg_us": sum(flush) // len(flush) if flush else 0,
+        "flush_p95_us": percentile(flush, 0.95),
+        "flush_max_us": max(flush, default=0),
+        "bytes": sum(event["bytes"] for event in done),
+        "locks": len(locks),
+        "lock_hold_avg_us": sum(event["hold_us"] for event in locks) // len(locks) if locks else 0,
+        "lock_wait_max_us": max((event["wait_us"] for event in locks), default=0),
+    })
+    return summary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace", nargs="?", help="trace, stdin if omitted")
+    parser.add_argument("--events", action="store_true", help="print every event")
+    parser.add_argument("--compare", metavar="TRACE", help="trace to compare the summary with")
+    args = parser.parse_args()
+
+    if args.trace:
+        with open(args.trace, "rb") as trace:
+            data = trace.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    try:
+        if args.events:
+            for event in events(data):
+                print(json.dumps(event))
+        elif args.compare:
+            with open(args.compare, "rb") as trace:
+                other = summarise(trace.read())
+            summary = summarise(data)
+            for key, value in summary.items():
+                change = ""
+                if isinstance(value, (int, float)) and value and isinstance(other.get(key), (int, float)):
+                    change = " (%+.1f%%)" % ((other[key] - value) * 100.0 / value)
+                print("%-18s %12s %12s%s" % (key, value, other.get(key), change))
+        else:
+            print(json.dumps(summarise(data)))
+    except CorruptTrace as error:
+        sys.exit("%s" % error)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,354 @@
+#include <controller.hpp>
+#include <touch_input.hpp>
+
+#include <utility>
+
+#if !CONFIG_IDF_TARGET_LINUX
+  #include "driver/gpio.h"
+  #include "driver/i2c.h"
+  #include "esp_timer.h"
+#endif
+
+namespace LVGLDisplay {
+
+#if !CONFIG_IDF_TARGET_LINUX
+  // The finger count, then the X and Y coordinates, high nibble first.
+  static constexpr uint8_t CST816_REG_FINGERS = 0x02;
+  static constexpr uint32_t CST816_TIMEOUT_MS = 10;
+
+  Cst816Touch::~Cst816Touch() {
+    stop();
+    if(_task) {
+      vTaskDelete(_task);
+    }
+  }
+
+  esp_err_t Cst816Touch::start(TouchInput* input) {
+    if(_input) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err;
+    if(_config.install_driver && !_installed) {
+      i2c_config_t i2c_config = {};
+      i2c_config.mode = I2C_MODE_MASTER;
+      i2c_config.sda_io_num = _config.sda;
+      i2c_config.scl_io_num = _config.scl;
+      i2c_config.sda_pullup_en = GPIO_PULLUP_ENABLE;
+      i2c_config.scl_pullup_en = GPIO_PULLUP_ENABLE;
+      i2c_config.master.clk_speed = _config.clock_hz;
+      err = i2c_param_config((i2c_port_t)_config.port, &i2c_config);
+      if(err != ESP_OK) {
+        return err;
+      }
+      err = i2c_driver_install((i2c_port_t)_config.port, I2C_MODE_MASTER, 0, 0, 0);
+      if(err != ESP_OK) {
+        return err;
+      }
+      _installed = true;
+    }
+
+    if(_config.reset >= 0) {
+      gpio_config_t rst_gpio_config = {.pin_bit_mask = 1ULL << _config.reset,
+                                       .mode = GPIO_MODE_OUTPUT,
+                                       .pull_up_en = GPIO_PULLUP_DISABLE,
+                                       .pull_down_en = GPIO_PULLDOWN_DISABLE,
+                                       .intr_type = GPIO_INTR_DISABLE};
+      err = gpio_config(&rst_gpio_config);
+      if(err != ESP_OK) {
+        return err;
+      }
+      gpio_set_level((gpio_num_t)_config.reset, 0);
+      vTaskDelay(pdMS_TO_TICKS(10));
+      gpio_set_level((gpio_num_t)_config.reset, 1);
+      vTaskDelay(pdMS_TO_TICKS(50));
+    }
+
+    // The interrupt line is open drain, pulled low for each report.
+    gpio_config_t int_gpio_config = {.pin_bit_mask = 1ULL << _config.interrupt,
+                                     .mode = GPIO_MODE_INPUT,
+                                     .pull_up_en = GPIO_PULLUP_ENABLE,
+                                     .pull_down_en = GPIO_PULLDOWN_DISABLE,
+                                     .intr_type = GPIO_INTR_NEGEDGE};
+    err = gpio_config(&int_gpio_config);
+    if(err != ESP_OK) {
+      return err;
+    }
+    const BaseType_t core = _config.core < 0 ? tskNO_AFFINITY : _config.core;
+    if(!_task && xTaskCreatePinnedToCore(task_main, "cst816", 3072, this, _config.priority, &_task, core) != pdPASS) {
+      _task = NULL;
+      return ESP_ERR_NO_MEM;
+    }
+    // The ISR service may already be installed by the application.
+    err = gpio_install_isr_service(0);
+    if(err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+      return err;
+    }
+    _last = TouchPoint();
+    _input = input;
+    err = gpio_isr_handler_add((gpio_num_t)_config.interrupt, isr, this);
+    if(err != ESP_OK) {
+      _input = NULL;
+    }
+    return err;
+  }
+
+  void Cst816Touch::stop() {
+    if(_input) {
+      gpio_isr_handler_remove((gpio_num_t)_config.interrupt);
+      _input = NULL;
+    }
+  }
+
+  void Cst816Touch::isr(void* arg) {
+    Cst816Touch* touch = (Cst816Touch*)arg;
+    touch->_irq_us = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(touch->_task, &woken);
+    if(woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+
+  void Cst816Touch::task_main(void* arg) {
+    Cst816Touch* touch = (Cst816Touch*)arg;
+    while(true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      TouchPoint point;
+      TouchInput* input = touch->_input;
+      if(!input || touch->read(&point) != ESP_OK) {
+        continue;
+      }
+      // The controller keeps interrupting for a while after the touch is lifted, only the first release is reported,
+      // where the touch was lifted.
+      if(!point.pressed) {
+        if(!touch->_last.pressed) {
+          continue;
+        }
+        point.x = touch->_last.x;
+        point.y = touch->_last.y;
+      }
+      input->report(point);
+      touch->_last = point;
+    }
+  }
+
+  esp_err_t Cst816Touch::read(TouchPoint* point) {
+    uint8_t data[5];
+    esp_err_t err = i2c_master_write_read_device((i2c_port_t)_config.port, ADDRESS, &CST816_REG_FINGERS, 1, data, sizeof(data),
+                                                 pdMS_TO_TICKS(CST816_TIMEOUT_MS));
+    if(err != ESP_OK) {
+      return err;
+    }
+    lv_coord_t x = (data[1] & 0x0f) << 8 | data[2];
+    lv_coord_t y = (data[3] & 0x0f) << 8 | data[4];
+    lv_coord_t columns = _config.columns;
+    lv_coord_t rows = _config.rows;
+    if(_config.swap_xy) {
+      std::swap(x, y);
+      std::swap(columns, rows);
+    }
+    point->x = _config.mirror_x ? columns - 1 - x : x;
+    point->y = _config.mirror_y ? rows - 1 - y : y;
+    point->pressed = (data[0] & 0x0f) != 0;
+    point->time_us = _irq_us;
+    return ESP_OK;
+  }
+#endif
+
+  esp_err_t ScriptedTouch::start(TouchInput* input) {
+    _input = input;
+    _point = TouchPoint();
+    return ESP_OK;
+  }
+
+  bool ScriptedTouch::press(lv_coord_t x, lv_coord_t y) {
+    if(!_input) {
+      return false;
+    }
+    _point.x = x;
+    _point.y = y;
+    _point.pressed = true;
+    return _input->report(_point);
+  }
+
+  bool ScriptedTouch::release() {
+    if(!_input) {
+      return false;
+    }
+    _point.pressed = false;
+    return _input->report(_point);
+  }
+
+  TouchInput::~TouchInput() { stop(); }
+
+  esp_err_t TouchInput::start(const Config& config, TouchSource* source) {
+    if(!source || config.queue_length == 0 || config.read_period_ms == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if(active() || !_display.display()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    _queue = xQueueCreate(config.queue_length, sizeof(TouchPoint));
+    if(!_queue) {
+      return ESP_ERR_NO_MEM;
+    }
+    _config = config;
+    _last = TouchPoint();
+
+    {
+      Lock lock;
+      lv_indev_drv_init(&_driver);
+      _driver.type = LV_INDEV_TYPE_POINTER;
+      _driver.read_cb = read_callback;
+      _driver.disp = _display.display();
+      _driver.user_data = this;
+      _indev = lv_indev_drv_register(&_driver);
+      if(!_indev) {
+        vQueueDelete(_queue);
+        _queue = NULL;
+        return ESP_ERR_NO_MEM;
+      }
+      // Reads go through the input, so the frame redrawn for a point is timed. Dispatched, the timer only runs while
+      // the panel is touched.
+      lv_timer_t* timer = _indev->driver->read_timer;
+      lv_timer_set_cb(timer, timer_callback);
+      lv_timer_set_period(timer, config.read_period_ms);
+      if(config.dispatch_task) {
+        lv_timer_pause(timer);
+      }
+    }
+
+    if(config.dispatch_task) {
+      const BaseType_t core = config.core < 0 ? tskNO_AFFINITY : config.core;
+      if(xTaskCreatePinnedToCore(dispatch_main, "lvgl_touch", config.stack, this, config.priority, &_task, core) != pdPASS) {
+        _task = NULL;
+        stop();
+        return ESP_ERR_NO_MEM;
+      }
+    }
+
+    esp_err_t err = source->start(this);
+    if(err != ESP_OK) {
+      stop();
+      return err;
+    }
+    _source = source;
+    return ESP_OK;
+  }
+
+  void TouchInput::stop() {
+    if(!_queue) {
+      return;
+    }
+    if(_source) {
+      _source->stop();
+      _source = NULL;
+    }
+    // With the lock held, the dispatch task is waiting for a point or for the lock, never handling one.
+    Lock lock;
+    if(_task) {
+      vTaskDelete(_task);
+      _task = NULL;
+    }
+    if(_indev) {
+      lv_indev_delete(_indev);
+      _indev = NULL;
+    }
+    if(_queue) {
+      vQueueDelete(_queue);
+      _queue = NULL;
+    }
+  }
+
+  bool TouchInput::report(const TouchPoint& point) {
+    if(!_queue) {
+      return false;
+    }
+    TouchPoint queued = point;
+    if(!queued.time_us) {
+      queued.time_us = _display.time_us();
+    }
+    _points.fetch_add(1, std::memory_order_relaxed);
+    if(xQueueSend(_queue, &queued, 0) != pdTRUE) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if(_task) {
+      xTaskNotifyGive(_task);
+    }
+    return true;
+  }
+
+  void TouchInput::read_callback(lv_indev_drv_t* drv, lv_indev_data_t* data) {
+    TouchInput* input = (TouchInput*)drv->user_data;
+    TouchPoint point;
+    if(xQueueReceive(input->_queue, &point, 0) == pdTRUE) {
+      input->_last = point;
+      input->_read++;
+      if(!input->_first_us) {
+        input->_first_us = point.time_us;
+      }
+      // LVGL handles each queued point in turn, so a tap shorter than the read period is not lost.
+      data->continue_reading = uxQueueMessagesWaiting(input->_queue) > 0;
+    }
+    data->point.x = input->_last.x;
+    data->point.y = input->_last.y;
+    data->state = input->_last.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+  }
+
+  void TouchInput::timer_callback(lv_timer_t* timer) {
+    lv_indev_t* indev = (lv_indev_t*)timer->user_data;
+    ((TouchInput*)indev->driver->user_data)->handle();
+  }
+
+  void TouchInput::dispatch_main(void* arg) {
+    TouchInput* input = (TouchInput*)arg;
+    while(true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      Lock lock;
+      input->_dispatches++;
+      input->handle();
+    }
+  }
+
+  void TouchInput::handle() {
+    lv_timer_t* timer = _indev->driver->read_timer;
+    _first_us = 0;
+    lv_indev_read_timer_cb(timer);
+    if(_first_us && _display.display()->inv_p) {
+      _display.mark_input(_first_us);
+      _redraws++;
+      // Drawn now rather than at the next refresh, which may be an idle period away.
+      if(_config.dispatch_task) {
+        Controller::instance().refresh(_display);
+      }
+    }
+    if(_config.dispatch_task) {
+      if(_last.pressed) {
+        lv_timer_resume(timer);
+      }
+      else {
+        lv_timer_pause(timer);
+      }
+    }
+  }
+
+  TouchInput::Stats TouchInput::stats() const {
+    Stats stats;
+    stats.points = _points.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.read = _read;
+    stats.dispatches = _dispatches;
+    stats.redraws = _redraws;
+    return stats;
+  }
+
+  void TouchInput::reset_stats() {
+    _points = 0;
+    _dropped = 0;
+    _read = 0;
+    _dispatches = 0;
+    _redraws = 0;
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,55 @@
+#include <display.hpp>
+#include <pixel_convert.hpp>
+#include <transfer_packer.hpp>
+
+#include "esp_lcd_panel_commands.h"
+
+namespace LVGLDisplay {
+
+  bool TransferPacker::supports(TransferFormat format) const {
+    return format == TransferFormat::RGB565 || (sizeof(lv_color_t) == sizeof(uint16_t) && !_display.bus_swap());
+  }
+
+  esp_err_t TransferPacker::set(TransferFormat format) {
+    if(!supports(format)) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_err_t err = _display.bring_up().wait_ready(portMAX_DELAY);
+    if(err != ESP_OK) {
+      return err;
+    }
+    // Areas already packed must be sent in the format they were packed in.
+    _display.wait_flushed();
+    const TransferFormat previous = _format;
+    _format = format;
+    err = send_format();
+    if(err != ESP_OK) {
+      _format = previous;
+    }
+    return err;
+  }
+
+  esp_err_t TransferPacker::initialise(TransferFormat format) {
+    _format = format;
+    return format == TransferFormat::RGB565 ? ESP_OK : send_format();
+  }
+
+  size_t TransferPacker::bytes(size_t pixels) const {
+    return _format == TransferFormat::RGB444 ? PixelConvert::rgb444_bytes(pixels) : pixels * sizeof(lv_color_t);
+  }
+
+  size_t TransferPacker::pack(void* pixels, size_t count, bool swapped) const {
+    if(_format != TransferFormat::RGB444) {
+      return count * sizeof(lv_color_t);
+    }
+    PixelConvert::rgb565_to_rgb444((uint8_t*)pixels, (const uint16_t*)pixels, count, swapped);
+    return PixelConvert::rgb444_bytes(count);
+  }
+
+  esp_err_t TransferPacker::send_format() {
+    // 65K colours, with 16 or 12 bits per pixel on the interface.
+    const uint8_t colmod = _format == TransferFormat::RGB444 ? 0x53 : 0x55;
+    return esp_lcd_panel_io_tx_param(_display.io_handle(), LCD_CMD_COLMOD, &colmod, 1);
+  }
+
+}  // namespace LVGLDisplay
@@ -0,0 +1,528 @@
+#include <controller.hpp>
+#include <string.h>
+#include <workload_trace.hpp>
+
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+#include "esp_lvgl_port.h"
+
+namespace LVGLDisplay {
+
+  // Reads a trace's varints, remembering whether it ran past the end.
+  class TraceReader {
+   public:
+    TraceReader(const uint8_t* data, size_t size) : _data(data), _end(data + size) {}
+
+    bool done() const { return _data == _end; }
+    bool failed() const { return _failed; }
+
+    bool read(void* out, size_t size) {
+      if(_failed || (size_t)(_end - _data) < size) {
+        _failed = true;
+        return false;
+      }
+      memcpy(out, _data, size);
+      _data += size;
+      return true;
+    }
+
+    uint64_t varint() {
+      uint64_t value = 0;
+      for(unsigned shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if(!read(&byte, 1)) {
+          return 0;
+        }
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+          return value;
+        }
+      }
+      _failed = true;
+      return 0;
+    }
+
+    int64_t time() {
+      const uint64_t value = varint();
+      return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+   private:
+    const uint8_t* _data;
+    const uint8_t* _end;
+    bool _failed = false;
+  };
+
+  // The fields of a FRAME event, after its type.
+  struct TraceFrame {
+    int64_t dt_us;
+    uint32_t frame;
+    uint32_t lock_wait_us;
+    uint32_t render_us;
+    uint32_t dma_wait_us;
+    uint32_t flushed;
+    uint32_t count;
+  };
+
+  static TraceFrame read_frame(TraceReader& reader) {
+    TraceFrame frame;
+    frame.dt_us = reader.time();
+    frame.frame = reader.varint();
+    frame.lock_wait_us = reader.varint();
+    frame.render_us = reader.varint();
+    frame.dma_wait_us = reader.varint();
+    frame.flushed = reader.varint();
+    frame.count = reader.varint();
+    return frame;
+  }
+
+  static lv_area_t read_area(TraceReader& reader) {
+    lv_area_t area;
+    area.x1 = reader.varint();
+    area.y1 = reader.varint();
+    area.x2 = area.x1 + reader.varint();
+    area.y2 = area.y1 + reader.varint();
+    return area;
+  }
+
+  static esp_err_t read_header(TraceReader& reader, TraceRecorder::Header* header) {
+    if(!reader.read(header, sizeof(*header))) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    return memcmp(header->magic, TraceRecorder::MAGIC, sizeof(TraceRecorder::MAGIC)) ? ESP_ERR_INVALID_VERSION : ESP_OK;
+  }
+
+  TraceRecorder::~TraceRecorder() {
+    if(_display) {
+      _display->remove_hook(this);
+    }
+    heap_caps_free(_out);
+  }
+
+  esp_err_t TraceRecorder::start(const Config& config, Header header, int64_t time_us) {
+    if(active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(!config.sink || config.buffer_size < sizeof(Header)) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _out = (uint8_t*)heap_caps_malloc(config.buffer_size, config.caps);
+    if(!_out) {
+      return ESP_ERR_NO_MEM;
+    }
+    _config = config;
+    _out_size = 0;
+    _sink_err = ESP_OK;
+    _last_us = time_us;
+    _area_count = 0;
+    portENTER_CRITICAL_SAFE(&_pending_lock);
+    _pending_count = 0;
+    portEXIT_CRITICAL_SAFE(&_pending_lock);
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    put(&header, sizeof(header));
+    // The header goes out at once, so a sink which can not take the trace fails its start.
+    const esp_err_t err = drain();
+    if(err != ESP_OK) {
+      heap_caps_free(_out);
+      _out = NULL;
+    }
+    return err;
+  }
+
+  esp_err_t TraceRecorder::start(Display& display, const Config& config) {
+    if(!display.display() || active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    // Frames refreshed before the trace complete outside it.
+    display.wait_flushed();
+    const BufferRing& ring = display.buffer_ring();
+    Header header = {};
+    header.width = display.width();
+    header.height = display.height();
+    header.buffer_pixels = display.buffer_size();
+    header.buffers = ring.active() ? ring.depth() : display.double_buffer() ? 2 : 1;
+    header.format = (uint8_t)display.packer().format();
+    header.rotation = display.rotation().angle();
+    esp_err_t err = start(config, header, display.time_us());
+    if(err != ESP_OK) {
+      return err;
+    }
+    err = display.add_hook(this);
+    if(err != ESP_OK) {
+      heap_caps_free(_out);
+      _out = NULL;
+      return err;
+    }
+    _display = &display;
+    return ESP_OK;
+  }
+
+  esp_err_t TraceRecorder::stop() {
+    if(!active()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if(_display) {
+      // The trace ends with the completions of its frames.
+      _display->remove_hook(this);
+      _display = NULL;
+    }
+    write_pending();
+    const uint8_t type = (uint8_t)Event::END;
+    put(&type, 1);
+    put_varint(_stats.dropped);
+    const esp_err_t err = drain();
+    heap_caps_free(_out);
+    _out = NULL;
+    return err;
+  }
+
+  void TraceRecorder::refresh_started(lv_disp_t* disp) {
+    // Kept before they are coalesced, so a replay coalesces them with its own settings.
+    begin_frame(disp->inv_areas, disp->inv_area_joined, disp->inv_p);
+  }
+
+  void TraceRecorder::begin_frame(const lv_area_t* areas, const uint8_t* joined, size_t count) {
+    _area_count = 0;
+    for(size_t i = 0; i < count && _area_count < LV_INV_BUF_SIZE; i++) {
+      if(!joined[i]) {
+        _areas[_area_count++] = areas[i];
+      }
+    }
+  }
+
+  void TraceRecorder::end_frame(const FrameRecord& frame) {
+    if(!active()) {
+      return;
+    }
+    write_pending();
+    const uint8_t type = (uint8_t)Event::FRAME;
+    put(&type, 1);
+    put_time(frame.start_us);
+    put_varint(frame.frame);
+    put_varint(frame.lock_wait_us);
+    put_varint(frame.render_us);
+    put_varint(frame.dma_wait_us);
+    put_varint(frame.areas);
+    put_varint(_area_count);
+    for(size_t i = 0; i < _area_count; i++) {
+      const lv_area_t& area = _areas[i];
+      put_varint(area.x1);
+      put_varint(area.y1);
+      put_varint(area.x2 - area.x1);
+      put_varint(area.y2 - area.y1);
+    }
+    _area_count = 0;
+    _stats.frames++;
+  }
+
+  void TraceRecorder::frame_done(const FrameRecord& frame) {
+    portENTER_CRITICAL_SAFE(&_pending_lock);
+    if(_pending_count < MAX_PENDING) {
+      _pending[_pending_count++] = {frame.frame, frame.flush_us, frame.bytes, frame.buffers};
+    }
+    else {
+      _stats.dropped++;
+    }
+    portEXIT_CRITICAL_SAFE(&_pending_lock);
+  }
+
+  void TraceRecorder::lock(int64_t time_us, uint32_t wait_us, uint32_t hold_us) {
+    if(!active()) {
+      return;
+    }
+    write_pending();
+    const uint8_t type = (uint8_t)Event::LOCK;
+    put(&type, 1);
+    put_time(time_us);
+    put_varint(wait_us);
+    put_varint(hold_us);
+    _stats.locks++;
+  }
+
+  void TraceRecorder::write_pending() {
+    Done pending[MAX_PENDING];
+    portENTER_CRITICAL_SAFE(&_pending_lock);
+    const size_t count = _pending_count;
+    std::copy(_pending, _pending + count, pending);
+    _pending_count = 0;
+    portEXIT_CRITICAL_SAFE(&_pending_lock);
+    for(size_t i = 0; i < count; i++) {
+      const uint8_t type = (uint8_t)Event::DONE;
+      put(&type, 1);
+      put_varint(pending[i].frame);
+      put_varint(pending[i].flush_us);
+      put_varint(pending[i].bytes);
+      put_varint(pending[i].buffers);
+    }
+    _stats.done += count;
+  }
+
+  void TraceRecorder::put_time(int64_t time_us) {
+    // A frame refreshed while another task holds the lock starts before the hold is recorded.
+    const int64_t dt = time_us - _last_us;
+    _last_us = time_us;
+    put_varint((uint64_t)dt << 1 ^ (uint64_t)(dt >> 63));
+  }
+
+  void TraceRecorder::put_varint(uint64_t value) {
+    uint8_t bytes[10];
+    size_t count = 0;
+    do {
+      bytes[count] = value & 0x7f;
+      value >>= 7;
+      bytes[count++] |= value ? 0x80 : 0;
+    } while(value);
+    put(bytes, count);
+  }
+
+  void TraceRecorder::put(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    while(size && _sink_err == ESP_OK) {
+      const size_t count = std::min(size, _config.buffer_size - _out_size);
+      memcpy(_out + _out_size, bytes, count);
+      _out_size += count;
+      bytes += count;
+      size -= count;
+      if(_out_size == _config.buffer_size) {
+        drain();
+      }
+    }
+  }
+
+  esp_err_t TraceRecorder::drain() {
+    if(_out_size && _sink_err == ESP_OK) {
+      _sink_err = _config.sink(_out, _out_size, _config.context);
+      if(_sink_err == ESP_OK) {
+        _stats.bytes += _out_size;
+      }
+    }
+    _out_size = 0;
+    return _sink_err;
+  }
+
+  esp_err_t TraceReplayer::summarise(const uint8_t* data, size_t size, Summary* summary, TraceRecorder::Header* header) {
+    if(!data || !summary) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    TraceReader reader(data, size);
+    TraceRecorder::Header trace_header;
+    esp_err_t err = read_header(reader, &trace_header);
+    if(err != ESP_OK) {
+      return err;
+    }
+    if(header) {
+      *header = trace_header;
+    }
+    *summary = Summary();
+    int64_t time_us = 0;
+    while(!reader.done() && !reader.failed()) {
+      uint8_t type;
+      reader.read(&type, 1);
+      switch((TraceRecorder::Event)type) {
+        case TraceRecorder::Event::FRAME: {
+          const TraceFrame frame = read_frame(reader);
+          for(uint32_t i = 0; i < frame.count; i++) {
+            read_area(reader);
+          }
+          time_us += frame.dt_us;
+          summary->frames++;
+          summary->render_us += frame.render_us;
+          summary->dma_wait_us += frame.dma_wait_us;
+          break;
+        }
+        case TraceRecorder::Event::DONE: {
+          reader.varint();
+          const uint32_t flush_us = reader.varint();
+          summary->bytes += reader.varint();
+          reader.varint();
+          summary->done++;
+          summary->flush_us += flush_us;
+          summary->flush_max_us = std::max(summary->flush_max_us, flush_us);
+          break;
+        }
+        case TraceRecorder::Event::LOCK: {
+          time_us += reader.time();
+          const uint32_t wait_us = reader.varint();
+          summary->locks++;
+          summary->lock_wait_us += wait_us;
+          summary->lock_wait_max_us = std::max(summary->lock_wait_max_us, wait_us);
+          summary->lock_hold_us += reader.varint();
+          break;
+        }
+        case TraceRecorder::Event::END:
+          summary->dropped = reader.varint();
+          break;
+        default: return ESP_ERR_INVALID_VERSION;
+      }
+      summary->duration_us = std::max<int64_t>(summary->duration_us, time_us);
+    }
+    return reader.failed() ? ESP_ERR_INVALID_SIZE : ESP_OK;
+  }
+
+  esp_err_t TraceReplayer::replay(Display& display, const uint8_t* data, size_t size, const Config& config) {
+    if(!data) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    // The whole trace is read before anything is replayed, so a bad one leaves the display as it was.
+    Summary summary;
+    esp_err_t err = summarise(data, size, &summary);
+    if(err != ESP_OK) {
+      return err;
+    }
+    lv_disp_t* disp = display.display();
+    if(!disp) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    _config = config;
+    _stats = Stats();
+    _display = &display;
+
+    // The replayer's screen draws every area it is asked to, whatever the UI showed there.
+    lvgl_port_lock(0);
+    lv_obj_t* previous = lv_disp_get_scr_act(disp);
+    lv_disp_t* default_disp = lv_disp_get_default();
+    lv_disp_set_default(disp);
+    lv_obj_t* screen = lv_obj_create(NULL);
+    lv_disp_set_default(default_disp);
+    if(!screen) {
+      lvgl_port_unlock();
+      return ESP_ERR_NO_MEM;
+    }
+    lv_obj_remove_style_all(screen);
+    _screen = screen;
+    lv_obj_add_event_cb(screen, event_callback, LV_EVENT_ALL, this);
+    _render_pixels = 0;
+    lv_disp_load_scr(screen);
+    Controller::instance().refresh(display);
+    lvgl_port_unlock();
+    display.wait_flushed();
+
+    TraceReader reader(data, size);
+    TraceRecorder::Header header;
+    read_header(reader, &header);
+    const lv_area_t bounds = {0, 0, (lv_coord_t)(display.width() - 1), (lv_coord_t)(display.height() - 1)};
+    const int64_t start = display.time_us();
+    int64_t time_us = 0;
+    while(!reader.done()) {
+      uint8_t type;
+      reader.read(&type, 1);
+      if((TraceRecorder::Event)type == TraceRecorder::Event::FRAME) {
+        const TraceFrame frame = read_frame(reader);
+        time_us += frame.dt_us;
+        wait_until(start + time_us);
+        // Refreshed as the LVGL task does, without Lock, so a replay recorded in turn only holds the trace's locks.
+        lvgl_port_lock(0);
+        _color = lv_color_make((uint8_t)(frame.frame * 37), (uint8_t)(frame.frame * 91), (uint8_t)(frame.frame * 53));
+        _render_us = frame.render_us;
+        _render_pixels = 0;
+        for(uint32_t i = 0; i < frame.count; i++) {
+          lv_area_t area = read_area(reader);
+          if(_lv_area_intersect(&area, &area, &bounds)) {
+            _lv_inv_area(disp, &area);
+            _render_pixels += lv_area_get_size(&area);
+            _stats.areas++;
+          }
+        }
+        Controller::instance().refresh(display);
+        lvgl_port_unlock();
+        _stats.frames++;
+      }
+      else if((TraceRecorder::Event)type == TraceRecorder::Event::LOCK) {
+        time_us += reader.time();
+        reader.varint();
+        const uint32_t hold_us = reader.varint();
+        if(!config.locks) {
+          continue;
+        }
+        wait_until(start + time_us - hold_us);
+        {
+          Lock lock;
+          spin(hold_us);
+        }
+        _stats.locks++;
+      }
+      else if((TraceRecorder::Event)type == TraceRecorder::Event::DONE) {
+        for(size_t i = 0; i < 4; i++) {
+          reader.varint();
+        }
+      }
+      else {
+        break;
+      }
+    }
+    _stats.duration_us = summary.duration_us;
+
+    // The last frames are part of the replay until they reach the panel.
+    display.wait_flushed();
+    _stats.elapsed_us = display.time_us() - start;
+
+    lvgl_port_lock(0);
+    lv_disp_load_scr(previous);
+    lv_obj_del(screen);
+    _screen = NULL;
+    lvgl_port_unlock();
+    return ESP_OK;
+  }
+
+  void TraceReplayer::event_callback(lv_event_t* e) {
+    TraceReplayer* replayer = (TraceReplayer*)lv_event_get_user_data(e);
+    switch(lv_event_get_code(e)) {
+      case LV_EVENT_COVER_CHECK: {
+        // Without styles the screen reports it covers nothing, but it fills every area, so LVGL draws nothing under it.
+        lv_cover_check_info_t* info = (lv_cover_check_info_t*)lv_event_get_param(e);
+        if(info->res != LV_COVER_RES_MASKED) {
+          info->res = LV_COVER_RES_COVER;
+        }
+        break;
+      }
+      case LV_EVENT_DRAW_MAIN: replayer->draw(e); break;
+      default: break;
+    }
+  }
+
+  void TraceReplayer::draw(lv_event_t* e) {
+    lv_draw_ctx_t* draw_ctx = lv_event_get_draw_ctx(e);
+    lv_area_t coords;
+    lv_area_t clip;
+    lv_obj_get_coords(_screen, &coords);
+    if(!_lv_area_intersect(&clip, &coords, draw_ctx->clip_area)) {
+      return;
+    }
+    const lv_coord_t stride = lv_area_get_width(draw_ctx->buf_area);
+    lv_color_t* row =
+      (lv_color_t*)draw_ctx->buf + (clip.y1 - draw_ctx->buf_area->y1) * stride + (clip.x1 - draw_ctx->buf_area->x1);
+    for(lv_coord_t y = clip.y1; y <= clip.y2; y++, row += stride) {
+      std::fill(row, row + lv_area_get_width(&clip), _color);
+    }
+    // Each part of the frame takes its share of the recorded render time.
+    if(_config.render && _render_pixels) {
+      spin((uint64_t)_render_us * lv_area_get_size(&clip) / _render_pixels);
+    }
+  }
+
+  void TraceReplayer::wait_until(int64_t time_us) {
+    if(_config.mode != Mode::REAL_TIME) {
+      return;
+    }
+    int64_t now = _display->time_us();
+    // Sleep whole ticks, then spin the rest.
+    const int64_t ticks = (time_us - now) / (portTICK_PERIOD_MS * 1000);
+    if(ticks > 1) {
+      vTaskDelay(ticks - 1);
+      now = _display->time_us();
+    }
+    if(now > time_us) {
+      _stats.late_max_us = std::max<uint32_t>(_stats.late_max_us, now - time_us);
+      return;
+    }
+    spin(time_us - now);
+  }
+
+  void TraceReplayer::spin(int64_t duration_us) {
+    const int64_t until = _display->time_us() + duration_us;
+    while(_display->time_us() < until) {
+    }
+  }
+
+}  // namespace LVGLDisplay